@@ -0,0 +1,210 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+// poloc_bench：在进程里反复编译合成程序，按阶段计时，输出 JSON 格式的吞吐量。
+//   poloc_bench [--runs <n>] [--scale <k>] [--shape <name>]... [-j <n>] [-S] [-o <file.json>]
+// 每个形状先编译一次预热，再编译 --runs 次，阶段耗时取中位数：
+//   tokens_per_sec       token 数 / Lex+Parse
+//   nodes_per_sec        AST 节点数 / 整个编译
+//   output_bytes_per_sec 输出的字节数 / (Codegen + Write output)
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "program_gen.h"
+#include "common.h"
+#include "driver.h"
+#include "lexer.h"
+#include "parser.h"
+#include "stats/mem_report.h"
+#include "stats/time_trace.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr const char* PHASES[] = {
+    "Total", "Load modules", "Read file", "Lex+Parse", "Rename", "Type check", "Const eval",
+    "Codegen", "Function codegen", "Emit function", "Write output",
+};
+constexpr size_t PHASE_COUNT = std::size(PHASES);
+
+struct Result {
+    ProgramShape shape;
+    size_t source_bytes{0}, tokens{0}, nodes{0}, output_bytes{0};
+    double phases[PHASE_COUNT]{};   // 各阶段耗时的中位数，秒
+};
+
+double median(std::vector<double> v) {
+    std::sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+double phase(const Result& r, const std::string& name) {
+    for (size_t i = 0; i < PHASE_COUNT; i++)
+        if (name == PHASES[i]) return r.phases[i];
+    return 0;
+}
+
+double rate(const size_t amount, const double seconds) {
+    return seconds > 0 ? static_cast<double>(amount) / seconds : 0;
+}
+
+size_t count_tokens(const std::string& source) {
+    Lexer lexer(source);
+    while (lexer.getNextToken().type != TokenType::EOF_TOKEN) {}
+    return lexer.token_count();
+}
+
+bool run_shape(const ProgramShape& shape, const Options& base, const fs::path& dir, const size_t runs, Result& result) {
+    result.shape = shape;
+    const std::string source = generate_program(shape);
+    const fs::path input = dir / (shape.name + ".polo");
+    std::ofstream(input, std::ios::binary) << source;
+    result.source_bytes = source.size();
+    result.tokens = count_tokens(source);
+    {
+        Lexer lexer(source);
+        Parser parser(lexer);
+        const auto program = parser.parseProgram();
+        if (has_err || !program) return false;
+        result.nodes = count_ast_nodes(*program);
+    }
+
+    Options options = base;
+    options.input = input.string();
+    options.inputs = {options.input};
+    finish_options(options);
+    std::vector<double> samples[PHASE_COUNT];
+    for (size_t run = 0; run <= runs; run++) {
+        TimeTrace trace;
+        time_trace = &trace;
+        int rc;
+        {
+            TimeScope scope("Total");
+            rc = compile(options);
+        }
+        time_trace = nullptr;
+        if (rc != 0) return false;
+        // 第一次是预热，不计入结果
+        if (run == 0) continue;
+        for (size_t i = 0; i < PHASE_COUNT; i++)
+            samples[i].push_back(static_cast<double>(trace.total(PHASES[i])) / 1e6);
+    }
+    for (size_t i = 0; i < PHASE_COUNT; i++) result.phases[i] = median(samples[i]);
+    result.output_bytes = fs::file_size(options.output);
+    return true;
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results, const size_t runs, const Options& options) {
+    out << "{\n  \"runs\": " << runs << ",\n  \"jobs\": " << options.jobs
+        << ",\n  \"output\": \"" << (options.emit_asm ? "asm" : "object") << "\",\n  \"shapes\": [\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const auto& r = results[k];
+        const auto& s = r.shape;
+        out << "    {\n      \"name\": \"" << s.name << "\",\n";
+        out << "      \"functions\": " << s.functions << ", \"statements\": " << s.statements
+            << ", \"expression_depth\": " << s.expression_depth << ", \"locals\": " << s.locals
+            << ", \"strings\": " << s.strings << ", \"string_length\": " << s.string_length
+            << ", \"calls\": " << s.calls << ",\n";
+        out << "      \"source_bytes\": " << r.source_bytes << ", \"tokens\": " << r.tokens
+            << ", \"nodes\": " << r.nodes << ", \"output_bytes\": " << r.output_bytes << ",\n";
+        out << "      \"seconds\": {";
+        for (size_t i = 0; i < PHASE_COUNT; i++)
+            out << (i ? ", " : "") << "\"" << PHASES[i] << "\": " << r.phases[i];
+        out << "},\n";
+        out << "      \"tokens_per_sec\": " << rate(r.tokens, phase(r, "Lex+Parse"))
+            << ", \"nodes_per_sec\": " << rate(r.nodes, phase(r, "Total"))
+            << ", \"output_bytes_per_sec\": " << rate(r.output_bytes, phase(r, "Codegen") + phase(r, "Write output"))
+            << "\n    }" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void print_usage() {
+    std::cerr << "Usage: poloc_bench [--runs <n>] [--scale <k>] [--shape <name>]... [-j <n>] [-S] [-o <file.json>]" << std::endl;
+    std::cerr << "  shapes:";
+    for (const auto& s : preset_shapes()) std::cerr << " " << s.name;
+    std::cerr << " (default: all)" << std::endl;
+}
+
+}
+
+int main(const int argc, char* argv[]) {
+    size_t runs = 5, scale = 1;
+    std::vector<std::string> names;
+    std::string json;
+    Options base;
+    base.jobs = 1;
+    base.emit_asm = P_TARGET != "Linux";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--runs" && has_value) runs = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--scale" && has_value) scale = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--shape" && has_value) names.emplace_back(argv[++i]);
+        else if (arg == "-j" && has_value) base.jobs = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "-S") base.emit_asm = true;
+        else if (arg == "-o" && has_value) json = argv[++i];
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (runs == 0 || scale == 0) {
+        print_usage();
+        return 1;
+    }
+
+    std::vector<ProgramShape> shapes;
+    for (auto& s : preset_shapes()) {
+        if (!names.empty() && std::find(names.begin(), names.end(), s.name) == names.end()) continue;
+        s.functions *= scale;
+        shapes.push_back(s);
+    }
+    if (shapes.empty()) {
+        print_usage();
+        return 1;
+    }
+
+    std::error_code ec;
+    const fs::path dir = fs::temp_directory_path(ec) / ("poloc_bench." + std::to_string(std::random_device{}()));
+    fs::create_directories(dir, ec);
+    std::vector<Result> results;
+    bool ok = true;
+    for (const auto& shape : shapes) {
+        Result r;
+        if (!run_shape(shape, base, dir, runs, r)) {
+            std::cerr << "Error: Could not compile shape " << shape.name << std::endl;
+            ok = false;
+            break;
+        }
+        std::cerr << shape.name << ": " << phase(r, "Total") * 1000 << " ms, "
+                  << static_cast<size_t>(rate(r.tokens, phase(r, "Lex+Parse"))) << " tokens/s, "
+                  << static_cast<size_t>(rate(r.nodes, phase(r, "Total"))) << " nodes/s" << std::endl;
+        results.push_back(r);
+    }
+    fs::remove_all(dir, ec);
+    if (!ok) return 1;
+
+    if (json.empty()) {
+        write_json(std::cout, results, runs, base);
+    } else {
+        std::ofstream file(json);
+        write_json(file, results, runs, base);
+        if (!file.flush()) {
+            std::cerr << "Error: Could not write " << json << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
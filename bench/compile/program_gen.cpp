@@ -0,0 +1,100 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "program_gen.h"
+#include <algorithm>
+
+namespace {
+
+class Generator {
+public:
+    explicit Generator(const ProgramShape& shape) : shape(shape), state(shape.seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    std::string run() {
+        out += "#!(extern = true)\n";
+        out += "fn printf(format: str, num: i32) -> i32;\n";
+        for (size_t i = 0; i < shape.functions; i++) function(i);
+        out += "fn main() -> i32 {\n";
+        if (shape.functions > 0) out += "\treturn f" + std::to_string(shape.functions - 1) + "(1 as i32);\n";
+        else out += "\treturn 0 as i32;\n";
+        out += "}\n";
+        return std::move(out);
+    }
+
+private:
+    const ProgramShape& shape;
+    uint64_t state;
+    std::string out;
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    size_t pick(const size_t n) { return static_cast<size_t>(next() % n); }
+
+    [[nodiscard]] size_t locals() const { return std::max<size_t>(1, shape.locals); }
+
+    std::string local() { return "v" + std::to_string(pick(locals())); }
+
+    std::string literal() { return "(" + std::to_string(pick(100)) + " as i32)"; }
+
+    std::string expr(const size_t depth) {
+        if (depth == 0) return pick(3) == 0 ? literal() : local();
+        static constexpr const char* ops[] = {" + ", " - ", " * "};
+        return "(" + expr(depth - 1) + ops[pick(3)] + expr(depth - 1) + ")";
+    }
+
+    void function(const size_t index) {
+        out += "fn f" + std::to_string(index) + "(x: i32) -> i32 {\n";
+        for (size_t i = 0; i < locals(); i++)
+            out += "\tlet v" + std::to_string(i) + ": i32 = x + " + literal() + ";\n";
+        for (size_t i = 0; i < shape.strings; i++) {
+            out += "\tlet s" + std::to_string(i) + ": str = \"";
+            for (size_t k = 0; k < shape.string_length; k++) out += static_cast<char>('a' + pick(26));
+            out += "\";\n";
+        }
+        // 被调用的函数都在前面，调用图没有环
+        for (size_t i = 0; i < std::min(shape.calls, index); i++)
+            out += "\t" + local() + " = f" + std::to_string(pick(index)) + "(" + local() + ");\n";
+        for (size_t i = 0; i < shape.statements; i++) {
+            if (pick(4) == 0) {
+                out += "\tif " + local() + " > " + literal() + " {\n";
+                out += "\t\t" + local() + " = " + expr(shape.expression_depth) + ";\n";
+                out += "\t} else {\n";
+                out += "\t\t" + local() + " = " + expr(shape.expression_depth) + ";\n";
+                out += "\t}\n";
+            } else {
+                out += "\t" + local() + " = " + expr(shape.expression_depth) + ";\n";
+            }
+        }
+        out += "\treturn " + local() + ";\n";
+        out += "}\n";
+    }
+};
+
+}
+
+std::vector<ProgramShape> preset_shapes() {
+    std::vector<ProgramShape> shapes;
+    // 大量中等大小的函数
+    shapes.push_back({.name = "functions", .functions = 2000, .statements = 10, .expression_depth = 2, .locals = 4});
+    // 深层嵌套的表达式
+    shapes.push_back({.name = "deep", .functions = 40, .statements = 4, .expression_depth = 10, .locals = 4});
+    // 局部变量很多的大函数
+    shapes.push_back({.name = "locals", .functions = 100, .statements = 40, .expression_depth = 2, .locals = 200});
+    // 长字符串字面量
+    shapes.push_back({.name = "strings", .functions = 500, .statements = 2, .expression_depth = 1, .locals = 2,
+                      .strings = 4, .string_length = 2048});
+    // 宽调用图
+    shapes.push_back({.name = "calls", .functions = 1000, .statements = 2, .expression_depth = 1, .locals = 4,
+                      .calls = 32});
+    return shapes;
+}
+
+std::string generate_program(const ProgramShape& shape) {
+    return Generator(shape).run();
+}
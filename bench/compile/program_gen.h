@@ -0,0 +1,32 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_PROGRAM_GEN_H
+#define POLO_COMPILER_PRE_PROGRAM_GEN_H
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 生成能通过类型检查的合成 Polo 程序，用来测编译器的吞吐量。
+// 每个函数 fn f<i>(x: i32) -> i32：先声明 locals 个局部变量，再写 statements 条语句
+// （赋值、if、调用前面的函数），表达式是深度为 expression_depth 的二叉树；
+// main 调用最后一个函数。同样的参数和种子总是生成同样的程序。
+struct ProgramShape {
+    std::string name;
+    size_t functions{100};
+    size_t statements{20};          // 每个函数的语句数
+    size_t expression_depth{3};
+    size_t locals{4};               // 每个函数的局部变量数，至少 1 个
+    size_t strings{0};              // 每个函数里的字符串字面量数
+    size_t string_length{0};
+    size_t calls{1};                // 每个函数调用前面多少个函数，决定调用图的宽度
+    uint64_t seed{1};
+};
+
+// 预设的形状：functions、deep、locals、strings、calls
+std::vector<ProgramShape> preset_shapes();
+std::string generate_program(const ProgramShape& shape);
+
+#endif //POLO_COMPILER_PRE_PROGRAM_GEN_H
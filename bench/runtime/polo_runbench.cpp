@@ -0,0 +1,333 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+// polo_runbench：衡量生成代码的质量。programs/ 里每个 <name>.polo 都有一个做同样计算的 <name>.c，
+// 用 poloc 编译 Polo 版本、用 cc -O2 编译 C 版本，分别链接后交替运行 --runs 次，
+// 先核对两者的输出一致，再报告运行时间的中位数和 Polo/C 的比值。
+// perf_event_open 可用时同时记录 cycles、instructions、branch-misses 和 cache-misses（只计用户态）。
+//   polo_runbench [--runs <n>] [--bench <name>]... [--cc <cc>] [-S] [-o <file.json>] [<programs_dir>]
+// 语言还没有数组下标和结构体的代码生成，数组和结构体的基准等这些功能进来后再加。
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "driver.h"
+
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#ifndef POLO_BENCH_PROGRAMS
+#define POLO_BENCH_PROGRAMS "programs"
+#endif
+
+namespace {
+
+constexpr const char* COUNTERS[] = {"cycles", "instructions", "branch_misses", "cache_misses"};
+constexpr size_t COUNTER_COUNT = std::size(COUNTERS);
+
+// 一次运行的结果；counters 在 perf_event_open 不可用时为空
+struct Sample {
+    double seconds{0};
+    std::vector<uint64_t> counters;
+};
+
+struct Side {
+    std::vector<Sample> samples;
+};
+
+struct Result {
+    std::string name;
+    Side polo, c;
+};
+
+std::string quote(const std::string& s) {
+    std::string out = "'";
+    for (const char ch : s) {
+        if (ch == '\'') out += "'\\''";
+        else out += ch;
+    }
+    return out + "'";
+}
+
+double median(std::vector<double> v) {
+    if (v.empty()) return 0;
+    std::sort(v.begin(), v.end());
+    const size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+double median_seconds(const Side& side) {
+    std::vector<double> v;
+    for (const auto& s : side.samples) v.push_back(s.seconds);
+    return median(v);
+}
+
+// 第 k 个计数器的中位数，没有计数器时返回 -1
+double median_counter(const Side& side, const size_t k) {
+    std::vector<double> v;
+    for (const auto& s : side.samples) {
+        if (s.counters.size() != COUNTER_COUNT) return -1;
+        v.push_back(static_cast<double>(s.counters[k]));
+    }
+    return v.empty() ? -1 : median(v);
+}
+
+#if defined(__linux__)
+
+int open_counter(const pid_t pid, const uint32_t type, const uint64_t config) {
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+// 运行 path，收集标准输出；子进程在父进程为它打开计数器之后才 exec
+bool run(const std::string& path, Sample& sample, std::string& output) {
+    int go[2], out[2];
+    if (pipe(go) != 0) return false;
+    if (pipe(out) != 0) {
+        close(go[0]);
+        close(go[1]);
+        return false;
+    }
+    const pid_t pid = fork();
+    if (pid < 0) return false;
+    if (pid == 0) {
+        close(go[1]);
+        close(out[0]);
+        char c;
+        if (read(go[0], &c, 1) != 1) _exit(127);
+        close(go[0]);
+        dup2(out[1], STDOUT_FILENO);
+        close(out[1]);
+        execl(path.c_str(), path.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    close(go[0]);
+    close(out[1]);
+
+    static constexpr std::pair<uint32_t, uint64_t> events[COUNTER_COUNT] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    };
+    std::vector<int> fds;
+    for (const auto& [type, config] : events) {
+        const int fd = open_counter(pid, type, config);
+        if (fd < 0) break;
+        fds.push_back(fd);
+    }
+    // 只有一部分计数器能打开时一个也不报告
+    if (fds.size() != COUNTER_COUNT) {
+        for (const int fd : fds) close(fd);
+        fds.clear();
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool started = write(go[1], "x", 1) == 1;
+    close(go[1]);
+    output.clear();
+    char buf[4096];
+    for (ssize_t n; (n = read(out[0], buf, sizeof(buf))) != 0;) {
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        output.append(buf, static_cast<size_t>(n));
+    }
+    close(out[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+    sample.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    sample.counters.clear();
+    for (const int fd : fds) {
+        uint64_t value = 0;
+        if (read(fd, &value, sizeof(value)) == sizeof(value)) sample.counters.push_back(value);
+        close(fd);
+    }
+    if (sample.counters.size() != COUNTER_COUNT) sample.counters.clear();
+    return started && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#else
+
+bool run(const std::string&, Sample&, std::string&) {
+    std::cerr << "Error: polo_runbench only runs on Linux" << std::endl;
+    return false;
+}
+
+#endif
+
+bool build(const std::string& name, const fs::path& programs, const fs::path& dir, const std::string& cc,
+           const bool emit_asm, std::string& polo_bin, std::string& c_bin) {
+    Options options;
+    options.input = (programs / (name + ".polo")).string();
+    options.inputs = {options.input};
+    options.output = (dir / (name + (emit_asm ? ".s" : ".o"))).string();
+    options.emit_asm = emit_asm;
+    options.jobs = 1;
+    finish_options(options);
+    if (compile(options) != 0) return false;
+    polo_bin = (dir / (name + ".polo.bin")).string();
+    c_bin = (dir / (name + ".c.bin")).string();
+    const std::string link = cc + " " + quote(options.output) + " -o " + quote(polo_bin);
+    const std::string c = cc + " -O2 " + quote((programs / (name + ".c")).string()) + " -o " + quote(c_bin);
+    if (std::system(link.c_str()) != 0) {
+        std::cerr << "Error: Could not link " << options.output << std::endl;
+        return false;
+    }
+    if (std::system(c.c_str()) != 0) {
+        std::cerr << "Error: Could not compile " << name << ".c" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void write_side(std::ostream& out, const Side& side) {
+    out << "{\"seconds\": " << median_seconds(side);
+    for (size_t k = 0; k < COUNTER_COUNT; k++) {
+        const double v = median_counter(side, k);
+        out << ", \"" << COUNTERS[k] << "\": ";
+        if (v < 0) out << "null";
+        else out << static_cast<uint64_t>(v);
+    }
+    out << "}";
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results, const size_t runs) {
+    out << "{\n  \"runs\": " << runs << ",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        const double c = median_seconds(r.c);
+        out << "    {\"name\": \"" << r.name << "\", \"ratio\": " << (c > 0 ? median_seconds(r.polo) / c : 0)
+            << ",\n     \"polo\": ";
+        write_side(out, r.polo);
+        out << ",\n     \"c\": ";
+        write_side(out, r.c);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+void print_usage() {
+    std::cerr << "Usage: polo_runbench [--runs <n>] [--bench <name>]... [--cc <cc>] [-S] [-o <file.json>] [<programs_dir>]"
+              << std::endl;
+}
+
+}
+
+int main(const int argc, char* argv[]) {
+    size_t runs = 5;
+    std::vector<std::string> names;
+    const char* cc_env = std::getenv("CC");
+    std::string cc = cc_env && *cc_env ? cc_env : "cc";
+    std::string json;
+    fs::path programs = POLO_BENCH_PROGRAMS;
+    bool emit_asm = P_TARGET != "Linux";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--runs" && has_value) runs = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--bench" && has_value) names.emplace_back(argv[++i]);
+        else if (arg == "--cc" && has_value) cc = argv[++i];
+        else if (arg == "-S") emit_asm = true;
+        else if (arg == "-o" && has_value) json = argv[++i];
+        else if (!arg.empty() && arg[0] != '-') programs = arg;
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+    if (runs == 0) {
+        print_usage();
+        return 1;
+    }
+
+    // programs 目录里同时有 .polo 和 .c 的才是基准
+    std::vector<std::string> benches;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(programs, ec)) {
+        const auto& path = entry.path();
+        if (path.extension() != ".polo") continue;
+        auto c = path;
+        if (!fs::is_regular_file(c.replace_extension(".c"), ec)) continue;
+        const std::string name = path.stem().string();
+        if (names.empty() || std::find(names.begin(), names.end(), name) != names.end()) benches.push_back(name);
+    }
+    std::sort(benches.begin(), benches.end());
+    if (benches.empty()) {
+        std::cerr << "Error: No benchmarks found in " << programs.string() << std::endl;
+        return 1;
+    }
+
+    const fs::path dir = fs::temp_directory_path(ec) / ("polo_runbench." + std::to_string(std::random_device{}()));
+    fs::create_directories(dir, ec);
+    std::vector<Result> results;
+    bool ok = true;
+    for (const auto& name : benches) {
+        Result r{name, {}, {}};
+        std::string polo_bin, c_bin;
+        if (!build(name, programs, dir, cc, emit_asm, polo_bin, c_bin)) {
+            ok = false;
+            break;
+        }
+        // 交替运行，机器负载的变化对两边的影响差不多
+        for (size_t k = 0; ok && k < runs; k++) {
+            Sample polo, c;
+            std::string polo_out, c_out;
+            if (!run(polo_bin, polo, polo_out) || !run(c_bin, c, c_out)) {
+                std::cerr << "Error: " << name << " exited with an error" << std::endl;
+                ok = false;
+                break;
+            }
+            if (polo_out != c_out) {
+                std::cerr << "Error: " << name << " printed " << polo_out << " but the C version printed " << c_out;
+                ok = false;
+                break;
+            }
+            r.polo.samples.push_back(polo);
+            r.c.samples.push_back(c);
+        }
+        if (!ok) break;
+        const double polo = median_seconds(r.polo), c = median_seconds(r.c);
+        std::cerr << name << ": polo " << polo * 1000 << " ms, c " << c * 1000 << " ms, ratio "
+                  << (c > 0 ? polo / c : 0) << std::endl;
+        results.push_back(std::move(r));
+    }
+    fs::remove_all(dir, ec);
+    if (!ok) return 1;
+
+    if (json.empty()) {
+        write_json(std::cout, results, runs);
+    } else {
+        std::ofstream file(json);
+        write_json(file, results, runs);
+        if (!file.flush()) {
+            std::cerr << "Error: Could not write " << json << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+// noinline：和 Polo 版本一样保留调用
+__attribute__((noinline)) static long mix(long acc, long x) {
+    return (acc * 31 + x) % 1000003;
+}
+
+__attribute__((noinline)) static long twice(long acc, long x) {
+    return mix(mix(acc, x), x + 1);
+}
+
+int main(void) {
+    long acc = 1;
+    for (long i = 0; i < 20000000; i++) acc = twice(acc, i);
+    printf("%ld\n", acc);
+    return 0;
+}
@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+static long steps(long n) {
+    long count = 0;
+    while (n != 1) {
+        if (n % 2 == 0) n = n / 2;
+        else n = n * 3 + 1;
+        count++;
+    }
+    return count;
+}
+
+int main(void) {
+    long total = 0;
+    for (long i = 1; i < 300000; i++) total += steps(i);
+    printf("%ld\n", total);
+    return 0;
+}
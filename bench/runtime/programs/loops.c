@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+int main(void) {
+    long sum = 0;
+    for (long i = 0; i < 6000; i++)
+        for (long j = 0; j < 6000; j++)
+            sum += (i * j + j) % 7;
+    printf("%ld\n", sum);
+    return 0;
+}
@@ -7,8 +7,6 @@
 #include <string>
 #include <memory>
 #include <unordered_map>
-#include <pstl/algorithm_impl.h>
-#include <pstl/algorithm_impl.h>
 
 enum class TypeKind {
     I8,
@@ -55,7 +53,8 @@ enum class NodeType {
     VARIANT_DECL,
     METHOD_DECL,
     CONSTRUCTOR_DECL,
-    MEMBER_ACCESS, MEMBER_ASSIGN, NAME_SPACE_VISIT
+    MEMBER_ACCESS, MEMBER_ASSIGN, NAME_SPACE_VISIT,
+    IMPORT,
 };
 
 enum class BinaryOpType {
@@ -72,7 +71,8 @@ enum class BinaryOpType {
     GE,
     AND,
     OR,
-    DOT, AS
+    DOT, AS,
+    BIT_AND,    // 整数按位与 a & b；新的运算放在最后，模块接口里按编号保存
 };
 
 class Type {
@@ -81,18 +81,35 @@ public:
 
     bool is_ptr{false};
     bool is_arr{false};
+    bool is_dyn{false};     // dyn Trait：trait 对象，name 是 trait 名
     std::string name;
     TypeKind kind;
+    std::vector<std::shared_ptr<Type>> args;    // 泛型结构体的类型实参：Encap<i32>
     
     explicit Type(const TypeKind k = TypeKind::ANY, const bool is_ptr = false) : is_ptr(is_ptr), name(to_string(k)), kind(k) {} // any is auto infer
 
     [[nodiscard]] virtual bool equals(const std::shared_ptr<Type>& other) const {
-        return kind == other->kind && is_ptr == other->is_ptr && is_arr == other->is_arr;
+        return kind == other->kind && is_ptr == other->is_ptr && is_arr == other->is_arr && is_dyn == other->is_dyn
+            && (!is_dyn || name == other->name);
+    }
+    // 按值传递的 str 是 fat pointer：指针 + 长度，各占 8 字节
+    [[nodiscard]] bool is_fat_str() const {
+        return kind == TypeKind::STR && !is_ptr && !is_arr;
+    }
+    // 占两个字（寄存器）的值：str 是指针 + 长度，dyn Trait 是数据指针 + 虚表
+    [[nodiscard]] bool is_fat() const {
+        return (kind == TypeKind::STR || is_dyn) && !is_ptr && !is_arr;
     }
     [[nodiscard]] virtual std::string to_string() const {
         std::string result;
         if (is_ptr) result += "*";
+        if (is_dyn) result += "dyn ";
         result += name;
+        if (!args.empty()) {
+            result += "<";
+            for (size_t i = 0; i < args.size(); i++) result += (i ? ", " : "") + args[i]->to_string();
+            result += ">";
+        }
         if (is_arr) result += "[]";
         return result;
     }
@@ -136,20 +153,25 @@ public:
     Type(const Type& other) {
         this->is_arr = other.is_arr;
         this->is_ptr = other.is_ptr;
+        this->is_dyn = other.is_dyn;
         this->kind = other.kind;
         this->name = other.name;
+        this->args = other.args;
     }
 
     [[nodiscard]] virtual std::shared_ptr<Type> clone() const {
         auto result = std::make_shared<Type>();
         result->is_arr = is_arr;
         result->is_ptr = is_ptr;
+        result->is_dyn = is_dyn;
         result->kind = kind;
         result->name = name;
+        for (const auto& a : args) result->args.push_back(a->clone());
         return result;
     }
     [[nodiscard]] virtual size_t size() const {
         if (is_ptr) return 8;
+        if (is_dyn) return 16;
         switch (kind) {
         case TypeKind::BOOL:
         case TypeKind::I8:
@@ -165,8 +187,9 @@ public:
         case TypeKind::I64:
         case TypeKind::U64:
         case TypeKind::F64:
-        case TypeKind::STR:
             return 8;
+        case TypeKind::STR:
+            return 16;
         case TypeKind::VOID:
         default:
             return 0;
@@ -283,6 +306,8 @@ public:
     std::vector<Parameter> parameters;
     std::shared_ptr<Type> returnType;
     std::vector<ASTNodePtr> body;
+    // fn f<T, U>(...)：非空时是泛型函数，不直接生成代码，单态化时按类型实参生成实例
+    std::vector<std::string> type_params;
 
     explicit FunctionNode(
         const size_t line,
@@ -300,6 +325,8 @@ public:
     std::string name;
     std::shared_ptr<Type> type;
     ASTNodePtr initializer;
+    bool is_const{false};       // const：初始化必须是编译期常量，使用处会被折叠
+    bool is_static{false};      // static：全局变量
 
     explicit VariableDeclNode(const size_t line, const size_t col, std::string name, std::shared_ptr<Type> type,
                               ASTNodePtr initializer) : StmtNode(NodeType::VARIABLE_DECL, line, col),
@@ -313,6 +340,13 @@ public:
     explicit NameSpaceVisitNode(const size_t line, const size_t col, ASTNodePtr last, ASTNodePtr name) : StmtNode(NodeType::NAME_SPACE_VISIT, line, col),
         last(std::move(last)), expr(std::move(name)){}
 };
+// import a::b; 由 ModuleLoader 解析，不会进入类型检查和代码生成
+class ImportNode final : public StmtNode {
+public:
+    std::vector<std::string> path;
+    explicit ImportNode(const size_t line, const size_t col, std::vector<std::string> path) : StmtNode(NodeType::IMPORT, line, col),
+        path(std::move(path)) {}
+};
 class AssignmentNode final: public StmtNode {
 public:
     std::string name;
@@ -343,6 +377,7 @@ public:
 
 enum class UnaryOpType{
     Addr, Minus,
+    Dyn,    // p as dyn Trait：ret_type 是 dyn Trait，类型检查把 expr 的 ret_type 设为源指针类型
 };
 class UnaryOpNode final: public ExprNode{
 public:
@@ -356,6 +391,12 @@ class FunctionCallNode final: public ExprNode {
 public:
     std::string name;
     std::vector<ASTNodePtr> arguments;
+    // 调用泛型函数时由类型检查按实参推导出的类型实参，单态化后改为调用实例并清空
+    std::vector<std::shared_ptr<Type>> type_args;
+    // recv.m(args)：arguments[0] 是接收者，name 是方法名；类型检查按接收者的类型改成
+    // "类型.m" 的普通调用，或者对 dyn Trait 接收者改成 "Trait.m" 并设置 vslot
+    bool is_method{false};
+    int vslot{-1};      // >= 0 时通过虚表的第 vslot 项调用，见 traits.h
 
     explicit
     FunctionCallNode(const size_t line, const size_t col, std::string name,
@@ -469,6 +510,7 @@ class MacroCallNode final : public ExprNode {
 public:
     std::string name;
     std::vector<ASTNodePtr> arguments;
+    std::shared_ptr<Type> type_arg;     // size_of!(T) / align_of!(T) 的参数是类型
     
     explicit MacroCallNode(const size_t line, const size_t col, 
                            std::string name,
@@ -492,6 +534,7 @@ public:
     bool is_public{false};
     std::string name;
     std::vector<ASTNodePtr> fields;
+    std::vector<std::string> type_params;   // struct S<T>
 
     explicit StructDeclNode(const size_t line, const size_t col,
                            std::string name,
@@ -515,11 +558,28 @@ public:
           type(std::move(type)) {}
 };
 
+// trait 声明：只有方法签名，第一个参数是 self: *Self
+class TraitDeclNode final : public StmtNode {
+public:
+    std::string name;
+    std::vector<std::shared_ptr<FunctionNode>> methods;     // 声明顺序也是虚表里的顺序
+
+    explicit TraitDeclNode(const size_t line, const size_t col,
+                           std::string name,
+                           std::vector<std::shared_ptr<FunctionNode>> methods)
+        : StmtNode(NodeType::TRAIT_DECL, line, col),
+          name(std::move(name)),
+          methods(std::move(methods)) {}
+};
+
 // Impl声明节点
+// 方法由解析器提到顶层，改名为 "类型.方法"，这里只留下它们的名字（IdentifierNode）
 class ImplDeclNode final : public StmtNode {
 public:
     std::string target_type;
+    std::string trait_name;     // impl Type : Trait，inherent impl 为空
     std::vector<ASTNodePtr> methods;
+    bool vtable{false};         // 需要生成虚表，由 Devirtualizer 设置，methods 已按 trait 的顺序排好
 
     explicit ImplDeclNode(const size_t line, const size_t col,
                          std::string target_type,
@@ -0,0 +1,273 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "bounds.h"
+#include "generics.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+
+namespace {
+
+bool is_macro(const ASTNodePtr& node, const char* name) {
+    return node && node->type == NodeType::MACRO_CALL && std::static_pointer_cast<MacroCallNode>(node)->name == name;
+}
+
+// bounds!(i, m)
+bool is_check(const ASTNodePtr& node, const std::string& i) {
+    if (!is_macro(node, "bounds")) return false;
+    const auto& args = std::static_pointer_cast<MacroCallNode>(node)->arguments;
+    return args.size() == 2 && args[0]->type == NodeType::IDENTIFIER &&
+           std::static_pointer_cast<IdentifierNode>(args[0])->name == i;
+}
+
+// 两个表达式的结构相同（不看 `as` 的类型）
+bool same(const ASTNodePtr& a, const ASTNodePtr& b) {
+    if (!a || !b || a->type != b->type) return a == b;
+    switch (a->type) {
+    case NodeType::NUMBER:
+        return std::static_pointer_cast<NumberNode>(a)->value == std::static_pointer_cast<NumberNode>(b)->value;
+    case NodeType::IDENTIFIER:
+        return std::static_pointer_cast<IdentifierNode>(a)->name == std::static_pointer_cast<IdentifierNode>(b)->name;
+    case NodeType::BINARY_OP: {
+        const auto x = std::static_pointer_cast<BinaryOpNode>(a), y = std::static_pointer_cast<BinaryOpNode>(b);
+        return x->op == y->op && same(x->left, y->left) && same(x->right, y->right);
+    }
+    case NodeType::MACRO_CALL: {
+        const auto x = std::static_pointer_cast<MacroCallNode>(a), y = std::static_pointer_cast<MacroCallNode>(b);
+        if (x->name != y->name || x->arguments.size() != y->arguments.size()) return false;
+        for (size_t k = 0; k < x->arguments.size(); k++)
+            if (!same(x->arguments[k], y->arguments[k])) return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// 只由变量、字面量、算术和 load! 组成，求值没有副作用
+bool is_plain(const ASTNodePtr& node) {
+    switch (node->type) {
+    case NodeType::NUMBER:
+    case NodeType::IDENTIFIER:
+        return true;
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        return is_plain(n->left) && is_plain(n->right);
+    }
+    case NodeType::MACRO_CALL: {
+        const auto n = std::static_pointer_cast<MacroCallNode>(node);
+        return n->name == "load" && n->arguments.size() == 1 && is_plain(n->arguments[0]);
+    }
+    default:
+        return false;
+    }
+}
+
+bool any_node(const ASTNodePtr& node, const std::function<bool(const ASTNodePtr&)>& pred) {
+    bool found = false;
+    each_node(node, [&](const ASTNodePtr& n) { found = found || pred(n); });
+    return found;
+}
+
+bool any_node(const std::vector<ASTNodePtr>& nodes, const std::function<bool(const ASTNodePtr&)>& pred) {
+    for (const auto& n : nodes)
+        if (any_node(n, pred)) return true;
+    return false;
+}
+
+bool is_call(const ASTNodePtr& node) {
+    return node->type == NodeType::FUNCTION_CALL || node->type == NodeType::MEMBER_ASSIGN || is_macro(node, "syscall");
+}
+
+bool is_write(const ASTNodePtr& node) {
+    return is_call(node) || is_macro(node, "store");
+}
+
+// 给变量赋值或者声明同名变量
+bool assigns(const ASTNodePtr& node, const std::unordered_set<std::string>& names) {
+    return any_node(node, [&](const ASTNodePtr& n) {
+        if (n->type == NodeType::ASSIGNMENT) return names.contains(std::static_pointer_cast<AssignmentNode>(n)->name);
+        if (n->type == NodeType::VARIABLE_DECL) return names.contains(std::static_pointer_cast<VariableDeclNode>(n)->name);
+        return false;
+    });
+}
+
+std::unordered_set<std::string> identifiers(const ASTNodePtr& node) {
+    std::unordered_set<std::string> names;
+    each_node(node, [&](const ASTNodePtr& n) {
+        if (n->type == NodeType::IDENTIFIER) names.insert(std::static_pointer_cast<IdentifierNode>(n)->name);
+    });
+    return names;
+}
+
+// stmts[k] 之前最近一次给 i 赋的值是非负的字面量
+bool starts_nonnegative(const std::vector<ASTNodePtr>& stmts, size_t k, const std::string& i) {
+    auto nonnegative = [](const ASTNodePtr& value) {
+        return value && value->type == NodeType::NUMBER && std::static_pointer_cast<NumberNode>(value)->value >= 0;
+    };
+    while (k-- > 0) {
+        const auto& s = stmts[k];
+        if (s->type == NodeType::VARIABLE_DECL && std::static_pointer_cast<VariableDeclNode>(s)->name == i)
+            return nonnegative(std::static_pointer_cast<VariableDeclNode>(s)->initializer);
+        if (s->type == NodeType::ASSIGNMENT && std::static_pointer_cast<AssignmentNode>(s)->name == i)
+            return nonnegative(std::static_pointer_cast<AssignmentNode>(s)->value);
+        if (assigns(s, {i})) return false;
+    }
+    return false;
+}
+
+// 把 node 里满足 pred 的 bounds!(i, m) 换成 i
+void strip(ASTNodePtr& node, const std::function<bool(const ASTNodePtr&)>& pred) {
+    if (!node) return;
+    each_slot(node, [&](ASTNodePtr& n) { strip(n, pred); });
+    if (pred(node)) node = std::static_pointer_cast<MacroCallNode>(node)->arguments[0];
+}
+
+}
+
+void BoundsCheckEliminator::run() {
+    for (const auto& s : program->stmts) {
+        const auto fn = function_of(s);
+        if (!fn || !fn->has_body || !fn->type_params.empty()) continue;
+        addressed = addressed_vars(fn);
+        body(fn->body);
+    }
+}
+
+void BoundsCheckEliminator::body(std::vector<ASTNodePtr>& stmts) {
+    for (size_t k = 0; k < stmts.size(); k++) {
+        const auto s = stmts[k];
+        if (s->type == NodeType::IF_STMT) {
+            const auto n = std::static_pointer_cast<IfStmtNode>(s);
+            body(n->thenBody);
+            body(n->elseBody);
+        } else if (s->type == NodeType::FOR_STMT) {
+            // 先处理内层循环
+            body(std::static_pointer_cast<ForStmtNode>(s)->body);
+            if (loop(stmts, k)) k++;
+        }
+    }
+}
+
+bool BoundsCheckEliminator::loop(std::vector<ASTNodePtr>& stmts, const size_t k) {
+    const auto f = std::static_pointer_cast<ForStmtNode>(stmts[k]);
+    if (!f->condition || f->condition->type != NodeType::BINARY_OP) return false;
+    const auto cond = std::static_pointer_cast<BinaryOpNode>(f->condition);
+    if (cond->op != BinaryOpType::LT || cond->left->type != NodeType::IDENTIFIER || !is_plain(cond->right)) return false;
+    const auto i = std::static_pointer_cast<IdentifierNode>(cond->left)->name;
+    const auto& n = cond->right;
+    if (addressed.contains(i)) return false;
+
+    // 范围 for 的增量在每轮最后执行，和写在循环体末尾一样
+    auto all = f->body;
+    if (f->increment) all.push_back(f->increment);
+
+    // 循环里 i 只做 i = i + c，c > 0；记下 c = 1 且在顶层的那一条
+    bool ok = true;
+    size_t steps = 0, inc = SIZE_MAX;
+    for (size_t k2 = 0; k2 < all.size(); k2++) {
+        each_node(all[k2], [&](const ASTNodePtr& node) {
+            if (node->type == NodeType::VARIABLE_DECL && std::static_pointer_cast<VariableDeclNode>(node)->name == i) ok = false;
+            if (node->type != NodeType::ASSIGNMENT || std::static_pointer_cast<AssignmentNode>(node)->name != i) return;
+            const auto& value = std::static_pointer_cast<AssignmentNode>(node)->value;
+            const auto add = value->type == NodeType::BINARY_OP ? std::static_pointer_cast<BinaryOpNode>(value) : nullptr;
+            if (!add || add->op != BinaryOpType::ADD || add->left->type != NodeType::IDENTIFIER ||
+                std::static_pointer_cast<IdentifierNode>(add->left)->name != i || add->right->type != NodeType::NUMBER ||
+                std::static_pointer_cast<NumberNode>(add->right)->value <= 0) {
+                ok = false;
+                return;
+            }
+            steps++;
+            if (node == all[k2] && std::static_pointer_cast<NumberNode>(add->right)->value == 1) inc = k2;
+        });
+    }
+    if (!ok || !starts_nonnegative(stmts, k, i)) return false;
+
+    // 范围 for 先把上界存进变量：let end = e; for i < end { ... bounds!(i, e) ... }。
+    // e 在整个循环里不变时，检查里的 e 和 end 相等
+    ASTNodePtr alias;
+    if (n->type == NodeType::IDENTIFIER && k > 0 && stmts[k - 1]->type == NodeType::VARIABLE_DECL) {
+        const auto decl = std::static_pointer_cast<VariableDeclNode>(stmts[k - 1]);
+        const auto& e = decl->initializer;
+        if (decl->name == std::static_pointer_cast<IdentifierNode>(n)->name && e && is_plain(e)) {
+            const auto vars = identifiers(e);
+            const bool loads = any_node(e, [](const ASTNodePtr& x) { return is_macro(x, "load"); });
+            if (std::none_of(vars.begin(), vars.end(), [&](const std::string& v) { return addressed.contains(v); }) &&
+                !any_node(all, [&](const ASTNodePtr& x) { return assigns(x, vars) || (loads && is_write(x)); }))
+                alias = e;
+        }
+    }
+
+    // 消除：条件检查之后、i 和 n 改变之前的语句里，bounds!(i, n) 一定成立
+    auto n_vars = identifiers(n);
+    const bool n_loads = any_node(n, [](const ASTNodePtr& x) { return is_macro(x, "load"); });
+    auto proven = [&](const ASTNodePtr& node) {
+        if (!is_check(node, i)) return false;
+        const auto& m = std::static_pointer_cast<MacroCallNode>(node)->arguments[1];
+        return same(m, n) || (alias && same(m, alias));
+    };
+    n_vars.insert(i);
+    for (auto& s : f->body) {
+        // 语句里先于检查发生的写入：调用，或者嵌套的 store!
+        const bool writes_first = any_node(s, [&](const ASTNodePtr& x) { return is_call(x) || (x != s && is_macro(x, "store")); });
+        if (s->type != NodeType::IF_STMT && s->type != NodeType::FOR_STMT && !writes_first) strip(s, proven);
+        if (assigns(s, n_vars) || (n_loads && any_node(s, is_write))) break;
+    }
+
+    // 外提：i 每轮正好加 1，循环体没有调用和提前退出，n 和 m 在循环里不变
+    if (steps != 1 || inc == SIZE_MAX) return false;
+    if (any_node(all, [](const ASTNodePtr& x) {
+        return is_call(x) || x->type == NodeType::BREAK_STMT || x->type == NodeType::CONTINUE_STMT ||
+               x->type == NodeType::RETURN_STMT;
+    })) return false;
+    const bool stores = any_node(all, [](const ASTNodePtr& x) { return is_macro(x, "store"); });
+    auto invariant = [&](const ASTNodePtr& e) {
+        if (!is_plain(e)) return false;
+        const auto vars = identifiers(e);
+        for (const auto& v : vars)
+            if (addressed.contains(v)) return false;
+        if (stores && any_node(e, [](const ASTNodePtr& x) { return is_macro(x, "load"); })) return false;
+        return !any_node(all, [&](const ASTNodePtr& x) { return assigns(x, vars); });
+    };
+    if (!invariant(n)) return false;
+
+    std::vector<ASTNodePtr> bounds;
+    auto hoisted = [&](const ASTNodePtr& node) {
+        if (!is_check(node, i)) return false;
+        const auto& m = std::static_pointer_cast<MacroCallNode>(node)->arguments[1];
+        if (!invariant(m)) return false;
+        if (std::none_of(bounds.begin(), bounds.end(), [&](const ASTNodePtr& b) { return same(b, m); }))
+            bounds.push_back(m);
+        return true;
+    };
+    // 增量之前的顶层语句每轮都执行；&& / || 的右边不一定求值，不去动
+    std::function<void(ASTNodePtr&)> visit = [&](ASTNodePtr& node) {
+        if (!node) return;
+        if (node->type == NodeType::BINARY_OP) {
+            const auto b = std::static_pointer_cast<BinaryOpNode>(node);
+            if (b->op == BinaryOpType::AND || b->op == BinaryOpType::OR) {
+                visit(b->left);
+                return;
+            }
+        }
+        each_slot(node, visit);
+        if (hoisted(node)) node = std::static_pointer_cast<MacroCallNode>(node)->arguments[0];
+    };
+    for (size_t k2 = 0; k2 < inc; k2++) visit(f->body[k2]);
+    if (bounds.empty()) return false;
+
+    // if i < n { bounds!(n - 1, m); ... }
+    std::vector<ASTNodePtr> checks;
+    for (const auto& m : bounds) {
+        auto last = std::make_shared<BinaryOpNode>(f->line, f->col, copy_node(n), BinaryOpType::SUB,
+                                                   std::make_shared<NumberNode>(f->line, f->col, 1));
+        checks.push_back(std::make_shared<MacroCallNode>(f->line, f->col, "bounds",
+                                                         std::vector<ASTNodePtr>{last, copy_node(m)}));
+    }
+    stmts.insert(stmts.begin() + static_cast<std::ptrdiff_t>(k),
+                 std::make_shared<IfStmtNode>(f->line, f->col, copy_node(f->condition), std::move(checks),
+                                              std::vector<ASTNodePtr>{}));
+    return true;
+}
@@ -0,0 +1,39 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_BOUNDS_H
+#define POLO_COMPILER_PRE_BOUNDS_H
+#include "ast.h"
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// 下标检查消除。bounds!(i, n) 在 i 不在 [0, n) 内时终止程序（Vec.get / Vec.set 用它），
+// 内联之后循环里的 v.get(i) 变成 load!(load!(v) + bounds!(i, load!(v + 8)) * 8)。
+// 对 `for i < n { ... }` 形式的循环，i 是没有被取地址的局部变量，循环里只有 i = i + c（c > 0），
+// 进入循环前 i 被赋成非负的字面量：
+//   消除：循环体开头的语句里 bounds!(i, n) 一定成立——条件刚检查过 i < n，在那之前
+//         i 和 n 都没有变（n 读内存时中间也不能写内存），检查换成 i
+//   外提：循环体里没有调用、系统调用、break / continue / return，i 每轮在顶层加 1，
+//         循环里 n 和 m 都不变时，增量之前的 bounds!(i, m) 合成循环前的一次
+//         if i < n { bounds!(n - 1, m); }，循环里只剩 i。越界时在进入循环前就终止，
+//         循环体不调用函数，提前终止看不出区别
+// 在内联之后运行。
+
+class BoundsCheckEliminator {
+public:
+    explicit BoundsCheckEliminator(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    void run();
+
+private:
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_set<std::string> addressed;      // 当前函数里被取了地址的变量
+
+    void body(std::vector<ASTNodePtr>& stmts);
+    // stmts[k] 是循环；外提的检查插在它前面时返回 true
+    bool loop(std::vector<ASTNodePtr>& stmts, size_t k);
+};
+
+#endif //POLO_COMPILER_PRE_BOUNDS_H
@@ -0,0 +1,412 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "codegen_cache.h"
+#include "serialize.h"
+#include "../traits.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <set>
+
+namespace {
+
+// 缓存条目用变长整数紧凑编码，只写出操作数类型实际用到的字段
+class Writer : public ByteWriter {
+public:
+    void operand(const Operand& o) {
+        byte(static_cast<uint8_t>(o.kind));
+        switch (o.kind) {
+        case Operand::Kind::Reg:
+            byte(static_cast<uint8_t>(o.reg));
+            byte(o.size);
+            break;
+        case Operand::Kind::Imm:
+            svar(o.imm);
+            break;
+        case Operand::Kind::Mem:
+            byte(static_cast<uint8_t>(o.reg));
+            svar(o.imm);
+            if (o.reg == Reg::RIP) {
+                svar(o.label);
+                str(o.sym);
+            } else {
+                byte(static_cast<uint8_t>(o.index));
+                byte(o.scale);
+            }
+            break;
+        case Operand::Kind::Label:
+            svar(o.label);
+            break;
+        case Operand::Kind::Symbol:
+            str(o.sym);
+            break;
+        case Operand::Kind::None:
+            break;
+        }
+    }
+};
+
+class Reader : public ByteReader {
+public:
+    using ByteReader::ByteReader;
+    Operand operand() {
+        Operand o;
+        o.kind = static_cast<Operand::Kind>(byte());
+        switch (o.kind) {
+        case Operand::Kind::Reg:
+            o.reg = static_cast<Reg>(byte());
+            o.size = byte();
+            break;
+        case Operand::Kind::Imm:
+            o.imm = svar();
+            break;
+        case Operand::Kind::Mem:
+            o.reg = static_cast<Reg>(byte());
+            o.imm = svar();
+            if (o.reg == Reg::RIP) {
+                o.label = static_cast<int>(svar());
+                o.sym = str();
+            } else {
+                o.index = static_cast<Reg>(byte());
+                o.scale = byte();
+            }
+            break;
+        case Operand::Kind::Label:
+            o.label = static_cast<int>(svar());
+            break;
+        case Operand::Kind::Symbol:
+            o.sym = str();
+            break;
+        case Operand::Kind::None:
+            break;
+        default:
+            ok = false;
+            break;
+        }
+        return o;
+    }
+};
+
+std::string serialize(const CachedFunction& f) {
+    Writer w;
+    w.str(f.fn.name);
+    w.var(f.fn.frame_fixup == SIZE_MAX ? 0 : f.fn.frame_fixup + 1);
+    w.var(f.fn.labels.size());
+    for (const auto& l : f.fn.labels) w.str(l);
+    w.var(f.fn.insts.size());
+    for (const auto& inst : f.fn.insts) {
+        w.byte(static_cast<uint8_t>(inst.op));
+        if (inst.op == Op::SETCC || inst.op == Op::JCC) w.byte(static_cast<uint8_t>(inst.cc));
+        w.operand(inst.a);
+        w.operand(inst.b);
+        if (inst.op == Op::COMMENT) w.str(inst.text);
+    }
+    w.var(f.strings.size());
+    for (size_t i = 0; i < f.strings.size(); i++) {
+        w.str(f.strings[i]);
+        w.byte(i < f.tables.size() && f.tables[i]);
+    }
+    w.var(f.prof_names.size());
+    for (const auto& s : f.prof_names) w.str(s);
+    return w.out;
+}
+
+std::optional<CachedFunction> deserialize(const std::string& in) {
+    Reader r(in);
+    CachedFunction f;
+    f.fn.name = r.str();
+    const uint64_t fixup = r.var();
+    f.fn.frame_fixup = fixup == 0 ? SIZE_MAX : fixup - 1;
+    for (uint64_t n = r.var(); r.ok && n > 0; n--) f.fn.labels.push_back(r.str());
+    const uint64_t count = r.var();
+    if (r.ok && count <= in.size()) f.fn.insts.reserve(count);
+    for (uint64_t n = count; r.ok && n > 0; n--) {
+        Inst inst{};
+        inst.op = static_cast<Op>(r.byte());
+        if (inst.op == Op::SETCC || inst.op == Op::JCC) inst.cc = static_cast<Cond>(r.byte());
+        inst.a = r.operand();
+        inst.b = r.operand();
+        if (inst.op == Op::COMMENT) inst.text = r.str();
+        f.fn.insts.push_back(std::move(inst));
+    }
+    for (uint64_t n = r.var(); r.ok && n > 0; n--) {
+        f.strings.push_back(r.str());
+        f.tables.push_back(r.byte() != 0);
+    }
+    for (uint64_t n = r.var(); r.ok && n > 0; n--) f.prof_names.push_back(r.str());
+    if (!r.ok) return std::nullopt;
+    return f;
+}
+
+// 把函数 AST 和它的外部依赖喂给哈希
+class KeyBuilder {
+public:
+    explicit KeyBuilder(const CacheContext& ctx) : ctx(ctx) {
+        h.add(ctx.global.a);
+        h.add(ctx.global.b);
+    }
+
+    KeyHasher h;
+    bool ok{true};
+    std::set<std::string> callees;
+
+    void type(const std::shared_ptr<Type>& t) {
+        h.add(t ? t->to_string() : std::string("-"));
+    }
+
+    void ret_type(const ASTNodePtr& node) {
+        type(std::static_pointer_cast<ExprNode>(node)->ret_type);
+    }
+
+    void name_ref(const std::string& name) {
+        h.add(name);
+        h.add(ctx.statics && ctx.statics->contains(name) ? 1 : 0);
+    }
+
+    void body(const std::vector<ASTNodePtr>& stmts) {
+        h.add(stmts.size());
+        for (const auto& s : stmts) node(s);
+    }
+
+    void node(const ASTNodePtr& node) {
+        if (!node) {
+            h.add(UINT64_MAX);
+            return;
+        }
+        h.add(static_cast<uint64_t>(node->type));
+        switch (node->type) {
+        case NodeType::VARIABLE_DECL: {
+            const auto n = std::static_pointer_cast<VariableDeclNode>(node);
+            h.add(n->name);
+            type(n->type);
+            h.add(n->is_const << 1 | n->is_static);
+            this->node(n->initializer);
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            const auto n = std::static_pointer_cast<AssignmentNode>(node);
+            name_ref(n->name);
+            this->node(n->value);
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+            this->node(n->member);
+            this->node(n->value);
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+            h.add(static_cast<uint64_t>(n->op));
+            ret_type(node);
+            this->node(n->left);
+            this->node(n->right);
+            break;
+        }
+        case NodeType::UNARY: {
+            const auto n = std::static_pointer_cast<UnaryOpNode>(node);
+            h.add(static_cast<uint64_t>(n->op));
+            // 转换成 dyn Trait 时虚表可能不存在（没有动态调用）
+            if (n->op == UnaryOpType::Dyn) h.add(ctx.vtables && ctx.vtables->contains(vtable_symbol(*n)) ? 1 : 0);
+            ret_type(node);
+            this->node(n->expr);
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            const auto n = std::static_pointer_cast<FunctionCallNode>(node);
+            h.add(n->name);
+            h.add(static_cast<uint64_t>(n->vslot));
+            callees.insert(n->name);
+            ret_type(node);
+            body(n->arguments);
+            break;
+        }
+        case NodeType::MACRO_CALL: {
+            const auto n = std::static_pointer_cast<MacroCallNode>(node);
+            h.add(n->name);
+            ret_type(node);
+            type(n->type_arg);
+            body(n->arguments);
+            break;
+        }
+        case NodeType::NUMBER:
+            h.add(static_cast<uint64_t>(std::static_pointer_cast<NumberNode>(node)->value));
+            ret_type(node);
+            break;
+        case NodeType::FLOAT: {
+            const double v = std::static_pointer_cast<FloatNode>(node)->value;
+            h.add(&v, sizeof(v));
+            ret_type(node);
+            break;
+        }
+        case NodeType::BOOLEAN:
+            h.add(std::static_pointer_cast<BooleanNode>(node)->value);
+            ret_type(node);
+            break;
+        case NodeType::STRING:
+            h.add(std::static_pointer_cast<StringNode>(node)->value);
+            ret_type(node);
+            break;
+        case NodeType::IDENTIFIER:
+            name_ref(std::static_pointer_cast<IdentifierNode>(node)->name);
+            ret_type(node);
+            break;
+        case NodeType::RETURN_STMT:
+            this->node(std::static_pointer_cast<ReturnStmtNode>(node)->expression);
+            break;
+        case NodeType::IF_STMT: {
+            const auto n = std::static_pointer_cast<IfStmtNode>(node);
+            this->node(n->condition);
+            body(n->thenBody);
+            body(n->elseBody);
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            const auto n = std::static_pointer_cast<ForStmtNode>(node);
+            this->node(n->init);
+            this->node(n->condition);
+            this->node(n->increment);
+            body(n->body);
+            break;
+        }
+        case NodeType::BREAK_STMT:
+        case NodeType::CONTINUE_STMT:
+            break;
+        case NodeType::MEMBER_ACCESS: {
+            const auto n = std::static_pointer_cast<MemberAccessNode>(node);
+            this->node(n->object);
+            this->node(n->expr);
+            break;
+        }
+        default:
+            // 不认识的节点：不缓存，宁可重新生成
+            ok = false;
+            break;
+        }
+    }
+
+private:
+    const CacheContext& ctx;
+};
+
+}
+
+void KeyHasher::add(const void* data, const size_t size) {
+    const auto* p = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        a = (a ^ p[i]) * 0x100000001b3ull;
+        b = (b ^ p[i]) * 0x9e3779b97f4a7c15ull;
+        b ^= b >> 29;
+    }
+}
+
+void KeyHasher::add(const std::string& s) {
+    add(s.size());
+    add(s.data(), s.size());
+}
+
+std::optional<CacheKey> function_key(const std::shared_ptr<FunctionNode>& fn, const CacheContext& ctx) {
+    KeyBuilder k(ctx);
+    k.h.add(fn->name);
+    k.h.add(fn->parameters.size());
+    for (const auto& p : fn->parameters) {
+        k.h.add(p.name);
+        k.type(p.type);
+    }
+    k.type(fn->returnType);
+    k.body(fn->body);
+    if (!k.ok) return std::nullopt;
+    // extern 函数与 Polo 函数传递 str 的方式不同
+    const auto c_abi = [&](const std::string& name) { return ctx.c_functions && ctx.c_functions->contains(name); };
+    k.h.add(c_abi(fn->name));
+
+    // 被调函数的签名：签名变了，调用方的缓存也要失效
+    for (const auto& name : k.callees) {
+        k.h.add(name);
+        std::shared_ptr<FunctionNode> callee;
+        if (ctx.signatures)
+            if (const auto it = ctx.signatures->find(name); it != ctx.signatures->end()) callee = it->second;
+        if (!callee) {
+            k.h.add(UINT64_MAX);
+            continue;
+        }
+        k.h.add(callee->parameters.size());
+        for (const auto& p : callee->parameters) k.type(p.type);
+        k.type(callee->returnType);
+        k.h.add(callee->has_body);
+        k.h.add(c_abi(name));
+    }
+    if (ctx.profile) {
+        if (const auto it = ctx.profile->find(fn->name); it != ctx.profile->end()) {
+            k.h.add(it->second.a);
+            k.h.add(it->second.b);
+        }
+    }
+    return k.h.key();
+}
+
+void CodegenCache::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return;
+    const std::string in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (in.size() < 16 || std::memcmp(in.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return;
+    Reader r(in);
+    r.u64();
+    const uint64_t n = r.u64();
+    std::unordered_map<CacheKey, std::string, CacheKeyHash> entries;
+    for (uint64_t i = 0; i < n && r.ok; i++) {
+        CacheKey key;
+        key.a = r.u64();
+        key.b = r.u64();
+        auto payload = r.str();
+        if (r.ok) entries.emplace(key, std::move(payload));
+    }
+    // 截断的文件整个丢掉
+    if (r.ok) stored = std::move(entries);
+}
+
+bool CodegenCache::save(const std::string& path) const {
+    Writer w;
+    w.out.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    w.u64(live.size());
+    for (const auto& [key, payload] : live) {
+        w.u64(key.a);
+        w.u64(key.b);
+        w.str(payload);
+    }
+    // 先写临时文件再改名，编译中断也不会留下写了一半的缓存
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.is_open()) return false;
+        file.write(w.out.data(), static_cast<std::streamsize>(w.out.size()));
+        if (!file) return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::optional<CachedFunction> CodegenCache::find(const CacheKey& key) {
+    const std::string* payload;
+    {
+        std::lock_guard lock(m);
+        auto node = stored.extract(key);
+        if (node.empty()) {
+            miss_count++;
+            return std::nullopt;
+        }
+        // 移进 live 之后不会再被修改或删除，可以在锁外解码
+        payload = &live.insert(std::move(node)).position->second;
+        hit_count++;
+    }
+    return deserialize(*payload);
+}
+
+void CodegenCache::store(const CacheKey& key, const CachedFunction& fn) {
+    auto payload = serialize(fn);
+    std::lock_guard lock(m);
+    live.try_emplace(key, std::move(payload));
+}
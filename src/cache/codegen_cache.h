@@ -0,0 +1,90 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_CODEGEN_CACHE_H
+#define POLO_COMPILER_PRE_CODEGEN_CACHE_H
+#include "../ast.h"
+#include "../x64/asm.h"
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 增量编译缓存：按函数保存生成好的机器指令，下次编译内容没变的函数直接复用
+// 键是函数 AST（编译期求值之后）的哈希，再加上它依赖的外部信息：
+//   调用的函数的签名、引用的 static 变量、目标平台、插桩开关和该函数的 profile 计数
+// 编译期求值已经把调用其他函数得到的常量折叠进了 AST，所以被调函数的函数体改变导致的
+// 折叠结果变化也会反映在键上
+// 文件格式：[magic 8][条目数 8] 之后每个条目 [键 16][长度 8][内容]
+
+constexpr char CACHE_MAGIC[8] = {'P', 'O', 'L', 'O', 'C', 'A', 'C', '1'};
+// 代码生成的输出变化时加一，旧缓存整体失效
+constexpr uint32_t CODEGEN_VERSION = 8;
+
+struct CacheKey {
+    uint64_t a{0}, b{0};
+    bool operator==(const CacheKey&) const = default;
+};
+
+struct CacheKeyHash {
+    size_t operator()(const CacheKey& k) const { return static_cast<size_t>(k.a ^ (k.b * 31)); }
+};
+
+// 两路独立的 64 位哈希拼成 128 位
+class KeyHasher {
+public:
+    void add(const void* data, size_t size);
+    void add(const std::string& s);
+    void add(uint64_t v) { add(&v, sizeof(v)); }
+    [[nodiscard]] CacheKey key() const { return {a, b}; }
+private:
+    uint64_t a{0xcbf29ce484222325ull}, b{0x84222325cbf29ce4ull};
+};
+
+// 缓存的单个函数：标签、字符串和计数器都是函数内的局部编号，和 FunctionGen 的结果一致
+struct CachedFunction {
+    MachineFunction fn;
+    std::vector<std::string> strings;       // 局部字符串编号 -> 内容
+    std::vector<bool> tables;               // 对应 strings，是否是 rodata! 的常量表
+    std::vector<std::string> prof_names;
+};
+
+// 函数依赖的外部信息，由 WatGen 提供
+struct CacheContext {
+    CacheKey global;    // 对所有函数都一样的部分
+    const std::unordered_map<std::string, std::shared_ptr<FunctionNode>>* signatures{nullptr};
+    const std::unordered_map<std::string, CacheKey>* profile{nullptr};    // 函数名 -> 该函数 profile 计数的哈希
+    const std::unordered_set<std::string>* statics{nullptr};
+    const std::unordered_set<std::string>* c_functions{nullptr};    // 按 C 约定调用的 extern 函数
+    const std::unordered_set<std::string>* vtables{nullptr};        // 生成了的虚表
+};
+
+// 函数无法缓存（含有不认识的节点）时返回空
+std::optional<CacheKey> function_key(const std::shared_ptr<FunctionNode>& fn, const CacheContext& ctx);
+
+class CodegenCache {
+public:
+    // 文件不存在或格式不对时当作空缓存
+    void load(const std::string& path);
+    // 只写出本次编译用到或新生成的条目，过期的条目随之清除
+    bool save(const std::string& path) const;
+
+    // 可以在多个线程里同时调用
+    std::optional<CachedFunction> find(const CacheKey& key);
+    void store(const CacheKey& key, const CachedFunction& fn);
+
+    [[nodiscard]] size_t hits() const { return hit_count; }
+    [[nodiscard]] size_t misses() const { return miss_count; }
+
+private:
+    std::mutex m;
+    std::unordered_map<CacheKey, std::string, CacheKeyHash> stored;     // 上次保存的条目
+    std::unordered_map<CacheKey, std::string, CacheKeyHash> live;       // 本次用到的条目
+    size_t hit_count{0}, miss_count{0};
+};
+
+#endif //POLO_COMPILER_PRE_CODEGEN_CACHE_H
@@ -0,0 +1,743 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "module_interface.h"
+#include "serialize.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// 类型：[标记][...]，标记 0 空、1 Type、2 ExtType、3 StructType
+enum class TypeTag : uint8_t { None, Plain, Ext, Struct };
+
+class AstWriter : public ByteWriter {
+public:
+    bool ok{true};
+
+    void key(const CacheKey& k) {
+        u64(k.a);
+        u64(k.b);
+    }
+
+    void type(const std::shared_ptr<Type>& t) {
+        if (!t) {
+            byte(static_cast<uint8_t>(TypeTag::None));
+            return;
+        }
+        if (const auto ext = std::dynamic_pointer_cast<ExtType>(t)) {
+            byte(static_cast<uint8_t>(TypeTag::Ext));
+            byte(ext->is_ptr);
+            type(ext->basic);
+        } else if (const auto st = std::dynamic_pointer_cast<StructType>(t)) {
+            byte(static_cast<uint8_t>(TypeTag::Struct));
+            // 字段按名字排序，同样的结构体写出同样的字节
+            std::vector<std::pair<std::string, std::shared_ptr<Type>>> fields(st->fields.begin(), st->fields.end());
+            std::sort(fields.begin(), fields.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+            var(fields.size());
+            for (const auto& [name, field] : fields) {
+                str(name);
+                type(field);
+            }
+        } else {
+            byte(static_cast<uint8_t>(TypeTag::Plain));
+        }
+        byte(static_cast<uint8_t>(t->is_ptr | t->is_arr << 1 | t->is_dyn << 2));
+        byte(static_cast<uint8_t>(t->kind));
+        str(t->name);
+        var(t->args.size());
+        for (const auto& a : t->args) type(a);
+    }
+
+    void names(const std::vector<std::string>& ns) {
+        var(ns.size());
+        for (const auto& n : ns) str(n);
+    }
+
+    void params(const std::vector<Parameter>& ps) {
+        var(ps.size());
+        for (const auto& p : ps) {
+            str(p.name);
+            type(p.type);
+        }
+    }
+
+    void nodes(const std::vector<ASTNodePtr>& ns) {
+        var(ns.size());
+        for (const auto& n : ns) node(n);
+    }
+
+    // 只写函数签名，函数体写成空的
+    void signature(const std::shared_ptr<FunctionNode>& fn) {
+        function_head(fn);
+        var(0);
+    }
+
+    void node(const ASTNodePtr& node) {
+        if (!node) {
+            byte(0);
+            return;
+        }
+        if (node->type == NodeType::FUNCTION) {
+            const auto n = std::static_pointer_cast<FunctionNode>(node);
+            function_head(n);
+            nodes(n->body);
+            return;
+        }
+        header(node);
+        switch (node->type) {
+        case NodeType::VARIABLE_DECL: {
+            const auto n = std::static_pointer_cast<VariableDeclNode>(node);
+            str(n->name);
+            type(n->type);
+            byte(static_cast<uint8_t>(n->is_const | n->is_static << 1));
+            this->node(n->initializer);
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            const auto n = std::static_pointer_cast<AssignmentNode>(node);
+            str(n->name);
+            this->node(n->value);
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+            this->node(n->member);
+            this->node(n->value);
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+            byte(static_cast<uint8_t>(n->op));
+            this->node(n->left);
+            this->node(n->right);
+            break;
+        }
+        case NodeType::UNARY: {
+            const auto n = std::static_pointer_cast<UnaryOpNode>(node);
+            byte(static_cast<uint8_t>(n->op));
+            this->node(n->expr);
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            const auto n = std::static_pointer_cast<FunctionCallNode>(node);
+            str(n->name);
+            byte(n->is_method);
+            svar(n->vslot);
+            nodes(n->arguments);
+            var(n->type_args.size());
+            for (const auto& t : n->type_args) type(t);
+            break;
+        }
+        case NodeType::MACRO_CALL: {
+            const auto n = std::static_pointer_cast<MacroCallNode>(node);
+            str(n->name);
+            nodes(n->arguments);
+            type(n->type_arg);
+            break;
+        }
+        case NodeType::NUMBER:
+            svar(std::static_pointer_cast<NumberNode>(node)->value);
+            break;
+        case NodeType::FLOAT: {
+            const double v = std::static_pointer_cast<FloatNode>(node)->value;
+            uint64_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            u64(bits);
+            break;
+        }
+        case NodeType::BOOLEAN:
+            byte(std::static_pointer_cast<BooleanNode>(node)->value);
+            break;
+        case NodeType::STRING:
+            str(std::static_pointer_cast<StringNode>(node)->value);
+            break;
+        case NodeType::IDENTIFIER:
+            str(std::static_pointer_cast<IdentifierNode>(node)->name);
+            break;
+        case NodeType::RETURN_STMT:
+            this->node(std::static_pointer_cast<ReturnStmtNode>(node)->expression);
+            break;
+        case NodeType::IF_STMT: {
+            const auto n = std::static_pointer_cast<IfStmtNode>(node);
+            this->node(n->condition);
+            nodes(n->thenBody);
+            nodes(n->elseBody);
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            const auto n = std::static_pointer_cast<ForStmtNode>(node);
+            this->node(n->init);
+            this->node(n->condition);
+            this->node(n->increment);
+            nodes(n->body);
+            break;
+        }
+        case NodeType::BREAK_STMT:
+        case NodeType::CONTINUE_STMT:
+            break;
+        case NodeType::MACRO_DECL: {
+            const auto n = std::static_pointer_cast<MacroDeclNode>(node);
+            std::vector<std::pair<std::string, ASTNodePtr>> eqs(n->equations.begin(), n->equations.end());
+            std::sort(eqs.begin(), eqs.end(), [](const auto& x, const auto& y) { return x.first < y.first; });
+            var(eqs.size());
+            for (const auto& [name, value] : eqs) {
+                str(name);
+                this->node(value);
+            }
+            this->node(n->declaration);
+            break;
+        }
+        case NodeType::STRUCT_DECL: {
+            const auto n = std::static_pointer_cast<StructDeclNode>(node);
+            byte(n->is_public);
+            str(n->name);
+            names(n->type_params);
+            nodes(n->fields);
+            break;
+        }
+        case NodeType::FIELD_DECL: {
+            const auto n = std::static_pointer_cast<FieldDeclNode>(node);
+            str(n->name);
+            type(n->type);
+            break;
+        }
+        case NodeType::IMPL_DECL: {
+            const auto n = std::static_pointer_cast<ImplDeclNode>(node);
+            str(n->target_type);
+            str(n->trait_name);
+            nodes(n->methods);
+            break;
+        }
+        case NodeType::TRAIT_DECL: {
+            const auto n = std::static_pointer_cast<TraitDeclNode>(node);
+            str(n->name);
+            var(n->methods.size());
+            for (const auto& m : n->methods) signature(m);
+            break;
+        }
+        case NodeType::CONSTRUCTOR_DECL: {
+            const auto n = std::static_pointer_cast<ConstructorDeclNode>(node);
+            params(n->parameters);
+            nodes(n->body);
+            break;
+        }
+        case NodeType::MEMBER_ACCESS: {
+            const auto n = std::static_pointer_cast<MemberAccessNode>(node);
+            this->node(n->object);
+            this->node(n->expr);
+            break;
+        }
+        case NodeType::NAME_SPACE_VISIT: {
+            const auto n = std::static_pointer_cast<NameSpaceVisitNode>(node);
+            this->node(n->last);
+            this->node(n->expr);
+            break;
+        }
+        default:
+            ok = false;
+            break;
+        }
+        if (const auto e = std::dynamic_pointer_cast<ExprNode>(node)) type(e->ret_type);
+    }
+
+private:
+    void function_head(const std::shared_ptr<FunctionNode>& fn) {
+        header(fn);
+        str(fn->name);
+        params(fn->parameters);
+        type(fn->returnType);
+        byte(fn->has_body);
+        names(fn->type_params);
+    }
+
+    // [节点类型 + 1][行][列][pub]，0 表示空节点
+    void header(const ASTNodePtr& node) {
+        byte(static_cast<uint8_t>(static_cast<uint8_t>(node->type) + 1));
+        var(node->line);
+        var(node->col);
+        const auto stmt = std::dynamic_pointer_cast<StmtNode>(node);
+        byte(stmt && stmt->is_pub);
+    }
+};
+
+class AstReader : public ByteReader {
+public:
+    using ByteReader::ByteReader;
+
+    CacheKey key() {
+        CacheKey k;
+        k.a = u64();
+        k.b = u64();
+        return k;
+    }
+
+    std::shared_ptr<Type> type() {
+        std::shared_ptr<Type> t;
+        switch (static_cast<TypeTag>(byte())) {
+        case TypeTag::None:
+            return nullptr;
+        case TypeTag::Plain:
+            t = std::make_shared<Type>();
+            break;
+        case TypeTag::Ext: {
+            auto ext = std::make_shared<ExtType>();
+            ext->is_ptr = byte();
+            ext->basic = type();
+            if (!ext->basic) ok = false;
+            t = ext;
+            break;
+        }
+        case TypeTag::Struct: {
+            auto st = std::make_shared<StructType>();
+            for (uint64_t n = var(); ok && n > 0; n--) {
+                auto name = str();
+                st->fields[name] = type();
+            }
+            t = st;
+            break;
+        }
+        default:
+            ok = false;
+            return nullptr;
+        }
+        const uint8_t flags = byte();
+        t->is_ptr = flags & 1;
+        t->is_arr = flags & 2;
+        t->is_dyn = flags & 4;
+        t->kind = static_cast<TypeKind>(byte());
+        t->name = str();
+        for (uint64_t n = var(); ok && n > 0; n--) t->args.push_back(type());
+        return t;
+    }
+
+    std::vector<std::string> names() {
+        std::vector<std::string> ns;
+        for (uint64_t n = var(); ok && n > 0; n--) ns.push_back(str());
+        return ns;
+    }
+
+    std::vector<Parameter> params() {
+        std::vector<Parameter> ps;
+        for (uint64_t n = var(); ok && n > 0; n--) {
+            auto name = str();
+            ps.push_back({std::move(name), type()});
+        }
+        return ps;
+    }
+
+    std::vector<ASTNodePtr> nodes() {
+        std::vector<ASTNodePtr> ns;
+        for (uint64_t n = var(); ok && n > 0; n--) ns.push_back(node());
+        return ns;
+    }
+
+    ASTNodePtr node() {
+        const uint8_t tag = byte();
+        if (!ok || tag == 0) return nullptr;
+        const auto kind = static_cast<NodeType>(tag - 1);
+        const size_t line = var(), col = var();
+        const bool is_pub = byte();
+
+        ASTNodePtr result;
+        switch (kind) {
+        case NodeType::FUNCTION: {
+            auto name = str();
+            auto ps = params();
+            auto ret = type();
+            const bool has_body = byte();
+            auto type_params = names();
+            auto fn = std::make_shared<FunctionNode>(line, col, std::move(name), std::move(ps), std::move(ret), nodes());
+            fn->has_body = has_body;
+            fn->type_params = std::move(type_params);
+            result = fn;
+            break;
+        }
+        case NodeType::VARIABLE_DECL: {
+            auto name = str();
+            auto t = type();
+            const uint8_t flags = byte();
+            auto decl = std::make_shared<VariableDeclNode>(line, col, std::move(name), std::move(t), node());
+            decl->is_const = flags & 1;
+            decl->is_static = flags & 2;
+            result = decl;
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            auto name = str();
+            result = std::make_shared<AssignmentNode>(line, col, std::move(name), node());
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            auto member = node();
+            result = std::make_shared<MemberAssignNode>(line, col, std::move(member), node());
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto op = static_cast<BinaryOpType>(byte());
+            auto left = node();
+            result = std::make_shared<BinaryOpNode>(line, col, std::move(left), op, node());
+            break;
+        }
+        case NodeType::UNARY: {
+            const auto op = static_cast<UnaryOpType>(byte());
+            result = std::make_shared<UnaryOpNode>(line, col, op, node());
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            auto name = str();
+            const bool is_method = byte();
+            const auto vslot = static_cast<int>(svar());
+            auto call = std::make_shared<FunctionCallNode>(line, col, std::move(name), nodes());
+            call->is_method = is_method;
+            call->vslot = vslot;
+            for (uint64_t n = var(); ok && n > 0; n--) call->type_args.push_back(type());
+            result = call;
+            break;
+        }
+        case NodeType::MACRO_CALL: {
+            auto name = str();
+            auto macro = std::make_shared<MacroCallNode>(line, col, std::move(name), nodes());
+            macro->type_arg = type();
+            result = macro;
+            break;
+        }
+        case NodeType::NUMBER:
+            result = std::make_shared<NumberNode>(line, col, svar());
+            break;
+        case NodeType::FLOAT: {
+            const uint64_t bits = u64();
+            double v;
+            std::memcpy(&v, &bits, sizeof(v));
+            result = std::make_shared<FloatNode>(line, col, v);
+            break;
+        }
+        case NodeType::BOOLEAN:
+            result = std::make_shared<BooleanNode>(line, col, byte() != 0);
+            break;
+        case NodeType::STRING:
+            result = std::make_shared<StringNode>(line, col, str());
+            break;
+        case NodeType::IDENTIFIER:
+            result = std::make_shared<IdentifierNode>(line, col, str());
+            break;
+        case NodeType::RETURN_STMT:
+            result = std::make_shared<ReturnStmtNode>(line, col, node());
+            break;
+        case NodeType::IF_STMT: {
+            auto cond = node();
+            auto then_body = nodes();
+            result = std::make_shared<IfStmtNode>(line, col, std::move(cond), std::move(then_body), nodes());
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            auto init = node();
+            auto cond = node();
+            auto inc = node();
+            result = std::make_shared<ForStmtNode>(line, col, std::move(init), std::move(cond), std::move(inc), nodes());
+            break;
+        }
+        case NodeType::BREAK_STMT:
+            result = std::make_shared<BreakStmtNode>(line, col);
+            break;
+        case NodeType::CONTINUE_STMT:
+            result = std::make_shared<ContinueStmtNode>(line, col);
+            break;
+        case NodeType::MACRO_DECL: {
+            std::unordered_map<std::string, ASTNodePtr> eqs;
+            for (uint64_t n = var(); ok && n > 0; n--) {
+                auto name = str();
+                eqs[name] = node();
+            }
+            result = std::make_shared<MacroDeclNode>(line, col, std::move(eqs), node());
+            break;
+        }
+        case NodeType::STRUCT_DECL: {
+            const bool is_public = byte();
+            auto name = str();
+            auto type_params = names();
+            auto decl = std::make_shared<StructDeclNode>(line, col, std::move(name), nodes());
+            decl->is_public = is_public;
+            decl->type_params = std::move(type_params);
+            result = decl;
+            break;
+        }
+        case NodeType::FIELD_DECL: {
+            auto name = str();
+            result = std::make_shared<FieldDeclNode>(line, col, std::move(name), type());
+            break;
+        }
+        case NodeType::IMPL_DECL: {
+            auto target = str();
+            auto trait = str();
+            auto impl = std::make_shared<ImplDeclNode>(line, col, std::move(target), nodes());
+            impl->trait_name = std::move(trait);
+            result = impl;
+            break;
+        }
+        case NodeType::TRAIT_DECL: {
+            auto name = str();
+            std::vector<std::shared_ptr<FunctionNode>> methods;
+            for (uint64_t n = var(); ok && n > 0; n--) {
+                const auto m = node();
+                if (!m || m->type != NodeType::FUNCTION) {
+                    ok = false;
+                    break;
+                }
+                methods.push_back(std::static_pointer_cast<FunctionNode>(m));
+            }
+            result = std::make_shared<TraitDeclNode>(line, col, std::move(name), std::move(methods));
+            break;
+        }
+        case NodeType::CONSTRUCTOR_DECL: {
+            auto ps = params();
+            result = std::make_shared<ConstructorDeclNode>(line, col, std::move(ps), nodes());
+            break;
+        }
+        case NodeType::MEMBER_ACCESS: {
+            auto object = node();
+            result = std::make_shared<MemberAccessNode>(line, col, std::move(object), node());
+            break;
+        }
+        case NodeType::NAME_SPACE_VISIT: {
+            auto last = node();
+            result = std::make_shared<NameSpaceVisitNode>(line, col, std::move(last), node());
+            break;
+        }
+        default:
+            ok = false;
+            return nullptr;
+        }
+        if (const auto stmt = std::dynamic_pointer_cast<StmtNode>(result)) stmt->is_pub = is_pub;
+        if (const auto e = std::dynamic_pointer_cast<ExprNode>(result)) {
+            // 字面量的构造函数会按值推断类型，这里用写入时的类型覆盖
+            if (auto t = type()) e->ret_type = std::move(t);
+            else e->ret_type = nullptr;
+        }
+        return ok ? result : nullptr;
+    }
+};
+
+// 符号表按原名排序写出，同一个模块总是得到同样的字节和哈希
+std::string symbol_table(const Module& module) {
+    std::vector<const std::pair<const std::string, Module::Symbol>*> symbols;
+    for (const auto& s : module.symbols) symbols.push_back(&s);
+    std::sort(symbols.begin(), symbols.end(), [](const auto* x, const auto* y) { return x->first < y->first; });
+    AstWriter w;
+    w.var(symbols.size());
+    for (const auto* s : symbols) {
+        w.str(s->first);
+        w.byte(s->second.is_pub);
+        if (s->second.function) {
+            w.signature(s->second.function);
+        } else if (s->second.decl) {
+            w.node(s->second.decl);
+        } else {
+            // static 变量只需要名字和类型，初始化留在声明段里
+            const auto& g = s->second.global;
+            auto decl = std::make_shared<VariableDeclNode>(g->line, g->col, g->name, g->type, nullptr);
+            decl->is_const = g->is_const;
+            decl->is_static = g->is_static;
+            w.node(decl);
+        }
+    }
+    return w.out;
+}
+
+}
+
+MappedFile::~MappedFile() {
+#if !defined(_WIN32)
+    if (mapped) munmap(const_cast<char*>(ptr), len);
+#endif
+}
+
+bool MappedFile::open(const std::string& path) {
+#if !defined(_WIN32)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+    ptr = static_cast<const char*>(p);
+    len = static_cast<size_t>(st.st_size);
+    mapped = true;
+    return true;
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    ptr = buffer.data();
+    len = buffer.size();
+    return !buffer.empty();
+#endif
+}
+
+void MappedFile::assign(std::string data) {
+    buffer = std::move(data);
+    ptr = buffer.data();
+    len = buffer.size();
+}
+
+std::shared_ptr<ModuleInterface> ModuleInterface::open(const std::string& path) {
+    auto result = std::make_shared<ModuleInterface>();
+    if (!result->file.open(path) || !result->read_header()) return nullptr;
+    return result;
+}
+
+std::shared_ptr<ModuleInterface> ModuleInterface::load(std::string data) {
+    auto result = std::make_shared<ModuleInterface>();
+    result->file.assign(std::move(data));
+    if (!result->read_header()) return nullptr;
+    return result;
+}
+
+bool ModuleInterface::read_header() {
+    const auto data = file.data();
+    if (data.size() < sizeof(PMI_MAGIC) || std::memcmp(data.data(), PMI_MAGIC, sizeof(PMI_MAGIC)) != 0)
+        return false;
+
+    AstReader r(data.substr(sizeof(PMI_MAGIC)));
+    source = r.str();
+    source_hash = r.key();
+    hash = r.key();
+    name = r.str();
+    for (uint64_t n = r.var(); r.ok && n > 0; n--) {
+        Import import;
+        for (uint64_t k = r.var(); r.ok && k > 0; k--) import.path.push_back(r.str());
+        import.line = r.var();
+        import.col = r.var();
+        import.hash = r.key();
+        imports.push_back(std::move(import));
+    }
+
+    AstReader table(r.view());
+    for (uint64_t n = table.var(); table.ok && n > 0; n--) {
+        auto name = table.str();
+        const bool is_pub = table.byte();
+        const auto node = table.node();
+        if (!node) return false;
+        Module::Symbol symbol{"", is_pub, nullptr, nullptr, nullptr};
+        if (node->type == NodeType::FUNCTION) {
+            symbol.function = std::static_pointer_cast<FunctionNode>(node);
+            symbol.name = symbol.function->name;
+        } else if (node->type == NodeType::VARIABLE_DECL) {
+            symbol.global = std::static_pointer_cast<VariableDeclNode>(node);
+            symbol.name = symbol.global->name;
+        } else if (node->type == NodeType::TRAIT_DECL || node->type == NodeType::IMPL_DECL) {
+            symbol.decl = std::static_pointer_cast<StmtNode>(node);
+            symbol.name = name;
+        } else {
+            return false;
+        }
+        symbols.emplace(std::move(name), std::move(symbol));
+    }
+    if (!r.ok || !table.ok) return false;
+    decls = sizeof(PMI_MAGIC) + r.offset();
+    return true;
+}
+
+std::shared_ptr<ProgramNode> ModuleInterface::program() const {
+    AstReader r(file.data().substr(decls));
+    auto stmts = r.nodes();
+    if (!r.ok || r.offset() != r.size()) return nullptr;
+    return std::make_shared<ProgramNode>(0, 0, std::move(stmts));
+}
+
+CacheKey source_hash(const std::string_view source) {
+    KeyHasher h;
+    h.add(source.data(), source.size());
+    return h.key();
+}
+
+CacheKey interface_hash(const Module& module) {
+    const auto table = symbol_table(module);
+    KeyHasher h;
+    h.add(table);
+    return h.key();
+}
+
+std::optional<std::string> serialize_interface(const Module& module, const std::vector<Module>& modules) {
+    AstWriter w;
+    w.out.append(PMI_MAGIC, sizeof(PMI_MAGIC));
+    w.str(fs::absolute(module.path).lexically_normal().string());
+    w.key(module.source_hash);
+    w.key(module.hash);
+    w.str(module.name);
+
+    std::vector<std::shared_ptr<ImportNode>> imports;
+    std::vector<ASTNodePtr> decls;
+    for (const auto& s : module.program->stmts) {
+        if (s->type == NodeType::IMPORT) imports.push_back(std::static_pointer_cast<ImportNode>(s));
+        else decls.push_back(s);
+    }
+    w.var(imports.size());
+    for (const auto& import : imports) {
+        w.var(import->path.size());
+        std::string name;
+        for (const auto& p : import->path) {
+            w.str(p);
+            name += (name.empty() ? "" : "::") + p;
+        }
+        w.var(import->line);
+        w.var(import->col);
+        w.key(modules[module.aliases.at(name)].hash);
+    }
+    w.str(symbol_table(module));
+    w.nodes(decls);
+    if (!w.ok) return std::nullopt;
+    return std::move(w.out);
+}
+
+bool write_interface(const std::string& path, const std::string& data) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    // 先写临时文件再改名，并行的编译不会读到写了一半的接口
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file.is_open()) return false;
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) return false;
+    }
+    std::remove(path.c_str());
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+std::shared_ptr<ModuleInterface> InterfaceCache::find(const std::string& source) {
+    std::lock_guard lock(m);
+    const auto it = entries.find(source);
+    if (it == entries.end()) return nullptr;
+    it->second.used = ++clock;
+    return it->second.interface;
+}
+
+void InterfaceCache::store(const std::string& source, std::shared_ptr<ModuleInterface> interface) {
+    std::lock_guard lock(m);
+    entries[source] = {std::move(interface), ++clock};
+    // 满了才扫一遍找最旧的，条目数有上限，不必维护链表
+    while (entries.size() > capacity) {
+        auto oldest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (it->second.used < oldest->second.used) oldest = it;
+        entries.erase(oldest);
+    }
+}
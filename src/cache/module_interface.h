@@ -0,0 +1,108 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_MODULE_INTERFACE_H
+#define POLO_COMPILER_PRE_MODULE_INTERFACE_H
+#include "../module.h"
+#include "codegen_cache.h"
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 预编译模块接口 (.pmi)：保存一个已经通过类型检查、改过名的模块，
+// 再次 import 时不用重新做词法、语法分析和类型检查。
+// 打开时只读出头部和符号表（导出的签名），模块的声明和函数体留在映射的文件里，
+// 合并程序时才解码。
+// 文件格式：
+//   [magic 8][源文件路径][源文件哈希 16][接口哈希 16][模块名]
+//   [import 数] 每个 [路径段数][段...][行][列][被导入模块的接口哈希 16]
+//   [符号表长度][符号表]  每个符号 [原名][pub][签名节点]，按原名排序；trait 和 impl Type : Trait 写出整个声明
+//   [声明数][顶层声明...]
+// 类型在名字后面跟着泛型的类型实参，函数签名和结构体带类型参数，调用泛型函数带推导出的类型实参，
+// 通过虚表的调用带虚表槽位。
+// 接口哈希是符号表的哈希。源文件没变、导入的模块接口也没变时 .pmi 才有效。
+
+constexpr char PMI_MAGIC[8] = {'P', 'O', 'L', 'O', 'P', 'M', 'I', '5'};
+
+// 只读映射一个文件；不支持 mmap 的平台整个读进内存
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    // 直接持有内存里的内容
+    void assign(std::string data);
+    [[nodiscard]] std::string_view data() const { return {ptr, len}; }
+
+private:
+    const char* ptr{nullptr};
+    size_t len{0};
+    bool mapped{false};
+    std::string buffer;
+};
+
+class ModuleInterface {
+public:
+    struct Import {
+        std::vector<std::string> path;
+        size_t line, col;
+        CacheKey hash;
+    };
+
+    std::string source;         // 源文件的绝对路径
+    CacheKey source_hash;
+    CacheKey hash;
+    std::string name;
+    std::vector<Import> imports;
+    std::unordered_map<std::string, Module::Symbol> symbols;
+
+    // 读出头部和符号表；文件不存在或格式不对时返回 nullptr
+    static std::shared_ptr<ModuleInterface> open(const std::string& path);
+    // 同上，内容已经在内存里
+    static std::shared_ptr<ModuleInterface> load(std::string data);
+    // 解码模块的全部顶层声明，格式不对时返回 nullptr
+    [[nodiscard]] std::shared_ptr<ProgramNode> program() const;
+
+private:
+    MappedFile file;
+    size_t decls{0};    // 声明段在文件中的偏移
+
+    bool read_header();
+};
+
+// poloc --server 在请求之间保留的模块接口，键是源文件路径；可以在多个线程里同时使用
+// 最多保留 capacity 个，超出时丢掉最久没用到的
+class InterfaceCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+    explicit InterfaceCache(const size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    std::shared_ptr<ModuleInterface> find(const std::string& source);
+    void store(const std::string& source, std::shared_ptr<ModuleInterface> interface);
+
+private:
+    struct Entry {
+        std::shared_ptr<ModuleInterface> interface;
+        uint64_t used{0};       // 最后一次 find / store 的序号
+    };
+    std::mutex m;
+    size_t capacity;
+    uint64_t clock{0};
+    std::unordered_map<std::string, Entry> entries;
+};
+
+CacheKey source_hash(std::string_view source);
+// 模块符号表的哈希，需要在 ModuleLoader 改名之后调用
+CacheKey interface_hash(const Module& module);
+// 模块里有接口格式不支持的节点时返回空
+std::optional<std::string> serialize_interface(const Module& module, const std::vector<Module>& modules);
+bool write_interface(const std::string& path, const std::string& data);
+
+#endif //POLO_COMPILER_PRE_MODULE_INTERFACE_H
@@ -0,0 +1,87 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_SERIALIZE_H
+#define POLO_COMPILER_PRE_SERIALIZE_H
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// 缓存文件共用的紧凑二进制编码：变长整数、带长度的字符串和定长 64 位整数
+class ByteWriter {
+public:
+    std::string out;
+    void byte(const uint8_t v) { out += static_cast<char>(v); }
+    void u64(const uint64_t v) { out.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+    void var(uint64_t v) {
+        while (v >= 0x80) {
+            byte(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        byte(static_cast<uint8_t>(v));
+    }
+    void svar(const int64_t v) { var(static_cast<uint64_t>(v) << 1 ^ static_cast<uint64_t>(v >> 63)); }
+    void str(const std::string_view s) {
+        var(s.size());
+        out += s;
+    }
+};
+
+// 读越界或格式不对时 ok 置为 false，之后的读取都返回零值
+class ByteReader {
+public:
+    explicit ByteReader(const std::string_view in) : in(in) {}
+    bool ok{true};
+    uint8_t byte() {
+        if (pos >= in.size()) {
+            ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(in[pos++]);
+    }
+    uint64_t u64() {
+        uint64_t v = 0;
+        if (pos + sizeof(v) > in.size()) {
+            ok = false;
+            return 0;
+        }
+        std::memcpy(&v, in.data() + pos, sizeof(v));
+        pos += sizeof(v);
+        return v;
+    }
+    uint64_t var() {
+        uint64_t v = 0;
+        for (int shift = 0; ok && shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t svar() {
+        const uint64_t v = var();
+        return static_cast<int64_t>(v >> 1 ^ (~(v & 1) + 1));
+    }
+    std::string_view view() {
+        const uint64_t n = var();
+        if (!ok || n > in.size() - pos) {
+            ok = false;
+            return {};
+        }
+        const auto s = in.substr(pos, n);
+        pos += n;
+        return s;
+    }
+    std::string str() { return std::string(view()); }
+    [[nodiscard]] size_t offset() const { return pos; }
+    [[nodiscard]] size_t size() const { return in.size(); }
+    [[nodiscard]] std::string_view data() const { return in; }
+private:
+    std::string_view in;
+    size_t pos{0};
+};
+
+#endif //POLO_COMPILER_PRE_SERIALIZE_H
@@ -4,7 +4,6 @@
 
 #include "common.h"
 
-volatile bool has_err = false;
 std::string P_TARGET =
 #if defined(WIN32) || defined(WIN64)
     "Windows"
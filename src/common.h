@@ -4,16 +4,42 @@
 
 #ifndef POLO_COMPILER_PRE_COMMON_H
 #define POLO_COMPILER_PRE_COMMON_H
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
-extern volatile bool has_err;
+
+// 一次编译的错误状态和错误输出。poloc --server 同时处理多个请求，每个请求有自己的一份，
+// 错误信息写进请求的回复里；普通编译只用进程里的这一份
+struct Diagnostics {
+    std::atomic<bool> failed{false};
+    std::ostream* out{&std::cerr};
+    // 非空时错误位置里这个目录下的文件显示成相对路径（--server 里是客户端的工作目录）
+    std::string base;
+    std::mutex m;       // 代码生成会在多个线程里报告错误，保证每条消息完整
+};
+inline Diagnostics process_diagnostics;
+// 当前线程在为哪次编译报告错误；ThreadPool 的任务沿用提交者的设置
+inline thread_local Diagnostics* diagnostics = &process_diagnostics;
+#define has_err (diagnostics->failed)
+
+// 把一条完整的消息写到当前编译的错误输出
+inline void report(const std::string& text) {
+    std::lock_guard lock(diagnostics->m);
+    *diagnostics->out << text << std::flush;
+}
+
 extern std::string P_TARGET;
+// 当前线程正在处理的源文件，非空时错误位置带上文件名
+inline thread_local std::string error_file;
 
 // 带位置信息的错误报告工具函数
 inline void make_error(const std::string& message, size_t line, size_t col) {
     has_err = true;
-    std::cerr <<
-    ("Error: " + message + " (" + std::to_string(line) + ":" + std::to_string(col) + ")") << std::endl;
+    std::string file = error_file.empty() ? "" : error_file + ":";
+    if (const auto& base = diagnostics->base; !base.empty() && file.starts_with(base + "/"))
+        file.erase(0, base.size() + 1);
+    report("Error: " + message + " (" + file + std::to_string(line) + ":" + std::to_string(col) + ")\n");
 }
 
 #define THROW_ERROR(msg, line, col) make_error(msg, line, col)
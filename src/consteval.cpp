@@ -0,0 +1,482 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "consteval.h"
+#include <algorithm>
+#include "common.h"
+#include "generics.h"
+
+ASTNodePtr make_literal(const ConstValue& value, const ASTNodePtr& origin) {
+    std::shared_ptr<ExprNode> node;
+    switch (value.kind) {
+    case ConstValue::Kind::Int:
+        node = std::make_shared<NumberNode>(origin->line, origin->col, value.i);
+        break;
+    case ConstValue::Kind::Bool:
+        node = std::make_shared<BooleanNode>(origin->line, origin->col, value.i != 0);
+        break;
+    case ConstValue::Kind::Str:
+        node = std::make_shared<StringNode>(origin->line, origin->col, value.s);
+        break;
+    }
+    if (const auto e = std::dynamic_pointer_cast<ExprNode>(origin); e && e->ret_type && value.kind == ConstValue::Kind::Int)
+        node->set_ret_type(e->ret_type);
+    return node;
+}
+
+std::optional<ConstValue> literal_value(const ASTNodePtr& node) {
+    if (!node) return std::nullopt;
+    switch (node->type) {
+    case NodeType::NUMBER:
+        return ConstValue{ConstValue::Kind::Int, std::static_pointer_cast<NumberNode>(node)->value, {}};
+    case NodeType::BOOLEAN:
+        return ConstValue{ConstValue::Kind::Bool, std::static_pointer_cast<BooleanNode>(node)->value ? 1 : 0, {}};
+    case NodeType::STRING:
+        return ConstValue{ConstValue::Kind::Str, 0, std::static_pointer_cast<StringNode>(node)->value};
+    default:
+        return std::nullopt;
+    }
+}
+
+ConstEvaluator::ConstEvaluator(const std::shared_ptr<ProgramNode>& program) : program(program) {
+    auto add = [this](const ASTNodePtr& node) {
+        if (node->type == NodeType::STRUCT_DECL) {
+            const auto decl = std::static_pointer_cast<StructDeclNode>(node);
+            structs[decl->name] = decl;
+        }
+        if (node->type != NodeType::FUNCTION) return;
+        const auto fn = std::static_pointer_cast<FunctionNode>(node);
+        if (fn->has_body) functions[fn->name] = fn;
+    };
+    for (const auto& stmt : program->stmts) {
+        if (stmt->type != NodeType::MACRO_DECL) {
+            add(stmt);
+            continue;
+        }
+        // 与代码生成一致：target 不匹配的声明不存在，extern 声明没有函数体
+        const auto macro = std::static_pointer_cast<MacroDeclNode>(stmt);
+        bool gen = true;
+        for (const auto& [name, v] : macro->equations)
+            if (name == "target" && std::static_pointer_cast<StringNode>(v)->value != P_TARGET) gen = false;
+        if (gen) add(macro->declaration);
+    }
+}
+
+void ConstEvaluator::fold_program() {
+    // 先处理全局变量，函数体里才能直接替换
+    for (const auto& stmt : program->stmts)
+        if (stmt->type == NodeType::VARIABLE_DECL)
+            fold_global(std::static_pointer_cast<VariableDeclNode>(stmt));
+    for (const auto& stmt : program->stmts) {
+        if (stmt->type == NodeType::FUNCTION) {
+            fold_function(std::static_pointer_cast<FunctionNode>(stmt));
+        } else if (stmt->type == NodeType::MACRO_DECL) {
+            const auto& decl = std::static_pointer_cast<MacroDeclNode>(stmt)->declaration;
+            if (decl->type == NodeType::FUNCTION)
+                fold_function(std::static_pointer_cast<FunctionNode>(decl));
+        }
+    }
+}
+
+void ConstEvaluator::fold_global(const std::shared_ptr<VariableDeclNode>& decl) {
+    // static let 的初值同样要在编译期算好写进 .data
+    fold_expr(decl->initializer);
+    auto v = literal_value(decl->initializer);
+    if (!v) v = evaluate(decl->initializer, const_limits);
+    if (!v) {
+        THROW_ERROR("Initializer of static `" + decl->name + "` is not a compile-time constant: " + failure,
+                    decl->line, decl->col);
+        return;
+    }
+    decl->initializer = make_literal(*v, decl->initializer);
+    if (decl->is_const) globals[decl->name] = *v;
+}
+
+void ConstEvaluator::fold_function(const std::shared_ptr<FunctionNode>& fn) {
+    if (!fn->has_body) return;
+    function_consts.clear();
+    fold_body(fn->body);
+}
+
+void ConstEvaluator::fold_body(std::vector<ASTNodePtr>& body) {
+    for (auto& stmt : body) fold_stmt(stmt);
+}
+
+void ConstEvaluator::fold_stmt(ASTNodePtr& stmt) {
+    if (!stmt) return;
+    switch (stmt->type) {
+    case NodeType::VARIABLE_DECL: {
+        const auto decl = std::static_pointer_cast<VariableDeclNode>(stmt);
+        fold_expr(decl->initializer);
+        if (decl->is_const) fold_const_decl(decl);
+        break;
+    }
+    case NodeType::ASSIGNMENT:
+        fold_expr(std::static_pointer_cast<AssignmentNode>(stmt)->value);
+        break;
+    case NodeType::RETURN_STMT:
+        fold_expr(std::static_pointer_cast<ReturnStmtNode>(stmt)->expression);
+        break;
+    case NodeType::IF_STMT: {
+        const auto n = std::static_pointer_cast<IfStmtNode>(stmt);
+        fold_expr(n->condition);
+        fold_body(n->thenBody);
+        fold_body(n->elseBody);
+        break;
+    }
+    case NodeType::FOR_STMT: {
+        const auto n = std::static_pointer_cast<ForStmtNode>(stmt);
+        fold_stmt(n->init);
+        fold_expr(n->condition);
+        fold_stmt(n->increment);
+        fold_body(n->body);
+        break;
+    }
+    default:
+        fold_expr(stmt);
+        break;
+    }
+}
+
+void ConstEvaluator::fold_const_decl(const std::shared_ptr<VariableDeclNode>& decl) {
+    auto v = literal_value(decl->initializer);
+    if (!v) v = evaluate(decl->initializer, const_limits);
+    if (!v) {
+        THROW_ERROR("const `" + decl->name + "` is not a compile-time constant: " + failure, decl->line, decl->col);
+        return;
+    }
+    decl->initializer = make_literal(*v, decl->initializer);
+    function_consts[decl->name] = *v;
+}
+
+void ConstEvaluator::fold_expr(ASTNodePtr& expr) {
+    if (!expr) return;
+    switch (expr->type) {
+    case NodeType::IDENTIFIER:
+        if (const auto* c = find_const(std::static_pointer_cast<IdentifierNode>(expr)->name))
+            expr = make_literal(*c, expr);
+        return;
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(expr);
+        fold_expr(n->left);
+        fold_expr(n->right);
+        if (!literal_value(n->left) || !literal_value(n->right)) return;
+        break;
+    }
+    case NodeType::UNARY: {
+        const auto n = std::static_pointer_cast<UnaryOpNode>(expr);
+        // 取地址的对象必须留在内存里
+        if (n->op == UnaryOpType::Addr) return;
+        fold_expr(n->expr);
+        // 转换成 dyn Trait 要带上虚表，不是字面量
+        if (n->op == UnaryOpType::Dyn || !literal_value(n->expr)) return;
+        break;
+    }
+    case NodeType::FUNCTION_CALL: {
+        const auto n = std::static_pointer_cast<FunctionCallNode>(expr);
+        bool constant = functions.contains(n->name);
+        for (auto& a : n->arguments) {
+            fold_expr(a);
+            constant &= literal_value(a).has_value();
+        }
+        if (!constant) return;
+        break;
+    }
+    case NodeType::MACRO_CALL: {
+        const auto n = std::static_pointer_cast<MacroCallNode>(expr);
+        for (auto& a : n->arguments) fold_expr(a);
+        if (!n->type_arg) return;
+        // 代码生成不处理 size_of! / align_of!，这里必须算出来
+        failure.clear();
+        if (const auto v = type_query(n)) expr = make_literal(*v, expr);
+        else THROW_ERROR(n->name + "!(" + n->type_arg->to_string() + "): " + failure, n->line, n->col);
+        return;
+    }
+    case NodeType::ASSIGNMENT:
+        fold_expr(std::static_pointer_cast<AssignmentNode>(expr)->value);
+        return;
+    default:
+        return;
+    }
+    // 操作数都是常量，失败时保持原样留到运行时
+    if (const auto v = evaluate(expr, fold_limits)) expr = make_literal(*v, expr);
+}
+
+const ConstValue* ConstEvaluator::find_const(const std::string& name) const {
+    if (const auto it = function_consts.find(name); it != function_consts.end()) return &it->second;
+    if (const auto it = globals.find(name); it != globals.end()) return &it->second;
+    return nullptr;
+}
+
+std::optional<ConstValue> ConstEvaluator::evaluate(const ASTNodePtr& expr, const ConstEvalLimits& lim) {
+    limits = lim;
+    steps = depth = memory = 0;
+    failure.clear();
+    Frame frame;
+    return eval(expr, frame);
+}
+
+bool ConstEvaluator::fail(std::string why) {
+    // 只保留最内层的原因
+    if (failure.empty()) failure = std::move(why);
+    return false;
+}
+
+bool ConstEvaluator::step() {
+    if (++steps > limits.max_steps)
+        return fail("evaluation exceeded " + std::to_string(limits.max_steps) + " steps");
+    return true;
+}
+
+bool ConstEvaluator::bind(Frame& frame, const std::string& name, ConstValue value) {
+    auto size_of = [](const ConstValue& v) {
+        return v.kind == ConstValue::Kind::Str ? 16 + v.s.size() : size_t{8};
+    };
+    if (const auto it = frame.vars.find(name); it != frame.vars.end()) {
+        memory -= size_of(it->second);
+        frame.memory -= size_of(it->second);
+    }
+    memory += size_of(value);
+    frame.memory += size_of(value);
+    frame.vars[name] = std::move(value);
+    if (memory > limits.max_memory)
+        return fail("evaluation exceeded " + std::to_string(limits.max_memory) + " bytes of memory");
+    return true;
+}
+
+std::optional<ConstValue> ConstEvaluator::type_query(const std::shared_ptr<MacroCallNode>& node) {
+    int64_t size = 0, align = 1;
+    if (!layout(*node->type_arg, size, align, 0)) return std::nullopt;
+    return ConstValue{ConstValue::Kind::Int, node->name == "size_of" ? size : align, {}};
+}
+
+bool ConstEvaluator::layout(const Type& type, int64_t& size, int64_t& align, const size_t depth) {
+    // 指针和数组都按一个地址存放
+    const auto* ext = dynamic_cast<const ExtType*>(&type);
+    if (type.is_ptr || type.is_arr || (ext && ext->is_ptr)) {
+        size = align = 8;
+        return true;
+    }
+    if (Type::to_string(type.kind) == type.name) {
+        size = static_cast<int64_t>(type.size());
+        align = std::clamp<int64_t>(size, 1, 8);
+        return true;
+    }
+    const auto it = structs.find(type.name);
+    if (it == structs.end()) return fail("unknown type `" + type.name + "`");
+    if (depth > 64) return fail("struct `" + type.name + "` contains itself");
+    // 泛型结构体：字段类型里的类型参数换成类型实参再计算
+    const auto& params = it->second->type_params;
+    if (type.args.size() != params.size())
+        return fail("`" + type.name + "` expects " + std::to_string(params.size()) + " type arguments, got "
+                    + std::to_string(type.args.size()));
+    TypeBindings bindings;
+    for (size_t i = 0; i < params.size(); i++) bindings[params[i]] = type.args[i];
+    // 字段按声明顺序排布，各自按自然对齐，总大小补齐到最大的对齐
+    size = 0;
+    align = 1;
+    for (const auto& f : it->second->fields) {
+        int64_t fs = 0, fa = 1;
+        if (!layout(*substitute(std::static_pointer_cast<FieldDeclNode>(f)->type, bindings), fs, fa, depth + 1))
+            return false;
+        size = (size + fa - 1) / fa * fa + fs;
+        align = std::max(align, fa);
+    }
+    size = (size + align - 1) / align * align;
+    return true;
+}
+
+std::optional<ConstValue> ConstEvaluator::eval(const ASTNodePtr& expr, Frame& frame) {
+    if (!expr || !step()) return std::nullopt;
+    switch (expr->type) {
+    case NodeType::NUMBER:
+    case NodeType::BOOLEAN:
+    case NodeType::STRING:
+        return literal_value(expr);
+    case NodeType::IDENTIFIER: {
+        const auto& name = std::static_pointer_cast<IdentifierNode>(expr)->name;
+        if (const auto it = frame.vars.find(name); it != frame.vars.end()) return it->second;
+        // 被调函数只能看到全局常量
+        const ConstValue* c = depth == 0 ? find_const(name) : nullptr;
+        if (const auto it = globals.find(name); !c && it != globals.end()) c = &it->second;
+        if (c) return *c;
+        fail("`" + name + "` is not a compile-time constant");
+        return std::nullopt;
+    }
+    case NodeType::BINARY_OP:
+        return eval_binary(std::static_pointer_cast<BinaryOpNode>(expr), frame);
+    case NodeType::UNARY: {
+        const auto n = std::static_pointer_cast<UnaryOpNode>(expr);
+        if (n->op != UnaryOpType::Minus) {
+            fail("cannot take an address at compile time");
+            return std::nullopt;
+        }
+        auto v = eval(n->expr, frame);
+        if (!v) return std::nullopt;
+        if (v->kind != ConstValue::Kind::Int) {
+            fail("unary minus needs an integer");
+            return std::nullopt;
+        }
+        v->i = static_cast<int64_t>(0 - static_cast<uint64_t>(v->i));
+        return v;
+    }
+    case NodeType::FUNCTION_CALL:
+        return call(std::static_pointer_cast<FunctionCallNode>(expr), frame);
+    case NodeType::MACRO_CALL: {
+        const auto n = std::static_pointer_cast<MacroCallNode>(expr);
+        if (n->name == "strlen" && n->arguments.size() == 1 && n->arguments[0]->type == NodeType::STRING)
+            return ConstValue{ConstValue::Kind::Int,
+                              static_cast<int64_t>(std::static_pointer_cast<StringNode>(n->arguments[0])->value.length()), {}};
+        if (n->type_arg) return type_query(n);
+        fail("macro " + n->name + "! cannot be evaluated at compile time");
+        return std::nullopt;
+    }
+    case NodeType::FLOAT:
+        fail("floating point is not supported at compile time");
+        return std::nullopt;
+    default:
+        fail("expression cannot be evaluated at compile time");
+        return std::nullopt;
+    }
+}
+
+std::optional<ConstValue> ConstEvaluator::eval_binary(const std::shared_ptr<BinaryOpNode>& op, Frame& frame) {
+    // 与生成的代码一样，两边都求值（and / or 不短路）
+    const auto l = eval(op->left, frame);
+    if (!l) return std::nullopt;
+    const auto r = eval(op->right, frame);
+    if (!r) return std::nullopt;
+    if (l->kind == ConstValue::Kind::Str || r->kind == ConstValue::Kind::Str) {
+        fail("string operations cannot be evaluated at compile time");
+        return std::nullopt;
+    }
+    const auto a = static_cast<uint64_t>(l->i), b = static_cast<uint64_t>(r->i);
+    auto integer = [](const uint64_t v) { return ConstValue{ConstValue::Kind::Int, static_cast<int64_t>(v), {}}; };
+    auto boolean = [](const bool v) { return ConstValue{ConstValue::Kind::Bool, v ? 1 : 0, {}}; };
+    switch (op->op) {
+    case BinaryOpType::ADD: return integer(a + b);
+    case BinaryOpType::SUB: return integer(a - b);
+    case BinaryOpType::MUL: return integer(a * b);
+    case BinaryOpType::DIV:
+    case BinaryOpType::MOD:
+        if (r->i == 0 || (l->i == INT64_MIN && r->i == -1)) {
+            fail("division overflow at compile time");
+            return std::nullopt;
+        }
+        return integer(static_cast<uint64_t>(op->op == BinaryOpType::DIV ? l->i / r->i : l->i % r->i));
+    case BinaryOpType::EQ: return boolean(l->i == r->i);
+    case BinaryOpType::NE: return boolean(l->i != r->i);
+    case BinaryOpType::LT: return boolean(l->i < r->i);
+    case BinaryOpType::GT: return boolean(l->i > r->i);
+    case BinaryOpType::LE: return boolean(l->i <= r->i);
+    case BinaryOpType::GE: return boolean(l->i >= r->i);
+    case BinaryOpType::AND:
+    case BinaryOpType::OR: {
+        ConstValue v = integer(op->op == BinaryOpType::AND ? a & b : a | b);
+        if (l->kind == ConstValue::Kind::Bool && r->kind == ConstValue::Kind::Bool) v.kind = ConstValue::Kind::Bool;
+        return v;
+    }
+    case BinaryOpType::BIT_AND: return integer(a & b);
+    default:
+        fail("operator cannot be evaluated at compile time");
+        return std::nullopt;
+    }
+}
+
+std::optional<ConstValue> ConstEvaluator::call(const std::shared_ptr<FunctionCallNode>& node, Frame& frame) {
+    std::optional<ConstValue> ret;
+    if (!invoke(node, frame, ret)) return std::nullopt;
+    if (!ret) fail("`" + node->name + "` does not return a value");
+    return ret;
+}
+
+bool ConstEvaluator::invoke(const std::shared_ptr<FunctionCallNode>& node, Frame& frame, std::optional<ConstValue>& ret) {
+    const auto it = functions.find(node->name);
+    if (it == functions.end())
+        return fail("`" + node->name + "` has no body to evaluate at compile time");
+    const auto& fn = it->second;
+
+    Frame callee;
+    for (size_t i = 0; i < node->arguments.size() && i < fn->parameters.size(); i++) {
+        auto v = eval(node->arguments[i], frame);
+        if (!v || !bind(callee, fn->parameters[i].name, std::move(*v))) return false;
+    }
+    if (++depth > limits.max_depth) {
+        depth--;
+        memory -= callee.memory;
+        return fail("evaluation exceeded call depth " + std::to_string(limits.max_depth));
+    }
+    const Flow flow = exec(fn->body, callee, ret);
+    depth--;
+    memory -= callee.memory;
+    return flow != Flow::Fail;
+}
+
+ConstEvaluator::Flow ConstEvaluator::exec(const std::vector<ASTNodePtr>& body, Frame& frame, std::optional<ConstValue>& ret) {
+    for (const auto& stmt : body)
+        if (const Flow f = exec(stmt, frame, ret); f != Flow::Normal) return f;
+    return Flow::Normal;
+}
+
+ConstEvaluator::Flow ConstEvaluator::exec(const ASTNodePtr& stmt, Frame& frame, std::optional<ConstValue>& ret) {
+    if (!stmt) return Flow::Normal;
+    if (!step()) return Flow::Fail;
+    switch (stmt->type) {
+    case NodeType::VARIABLE_DECL: {
+        const auto decl = std::static_pointer_cast<VariableDeclNode>(stmt);
+        auto v = eval(decl->initializer, frame);
+        if (!v || !bind(frame, decl->name, std::move(*v))) return Flow::Fail;
+        return Flow::Normal;
+    }
+    case NodeType::ASSIGNMENT: {
+        const auto assign = std::static_pointer_cast<AssignmentNode>(stmt);
+        if (!frame.vars.contains(assign->name)) {
+            fail("cannot write `" + assign->name + "` at compile time");
+            return Flow::Fail;
+        }
+        auto v = eval(assign->value, frame);
+        if (!v || !bind(frame, assign->name, std::move(*v))) return Flow::Fail;
+        return Flow::Normal;
+    }
+    case NodeType::RETURN_STMT: {
+        const auto n = std::static_pointer_cast<ReturnStmtNode>(stmt);
+        if (n->expression) {
+            ret = eval(n->expression, frame);
+            if (!ret) return Flow::Fail;
+        }
+        return Flow::Return;
+    }
+    case NodeType::IF_STMT: {
+        const auto n = std::static_pointer_cast<IfStmtNode>(stmt);
+        const auto c = eval(n->condition, frame);
+        if (!c) return Flow::Fail;
+        return exec(c->i ? n->thenBody : n->elseBody, frame, ret);
+    }
+    case NodeType::FOR_STMT: {
+        const auto n = std::static_pointer_cast<ForStmtNode>(stmt);
+        if (exec(n->init, frame, ret) != Flow::Normal) return Flow::Fail;
+        for (;;) {
+            if (n->condition) {
+                const auto c = eval(n->condition, frame);
+                if (!c) return Flow::Fail;
+                if (!c->i) return Flow::Normal;
+            }
+            if (const Flow f = exec(n->body, frame, ret); f != Flow::Normal) return f;
+            if (exec(n->increment, frame, ret) != Flow::Normal) return Flow::Fail;
+            if (!step()) return Flow::Fail;
+        }
+    }
+    case NodeType::FUNCTION_CALL: {
+        // 语句位置允许调用无返回值的函数
+        std::optional<ConstValue> ignored;
+        return invoke(std::static_pointer_cast<FunctionCallNode>(stmt), frame, ignored) ? Flow::Normal : Flow::Fail;
+    }
+    case NodeType::BREAK_STMT:
+    case NodeType::CONTINUE_STMT:
+        fail("break / continue cannot be evaluated at compile time");
+        return Flow::Fail;
+    default:
+        return eval(stmt, frame) ? Flow::Normal : Flow::Fail;
+    }
+}
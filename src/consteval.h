@@ -0,0 +1,87 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_CONSTEVAL_H
+#define POLO_COMPILER_PRE_CONSTEVAL_H
+#include "ast.h"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 编译期求值：在类型检查之后、代码生成之前运行，直接解释 AST
+//  - const 局部变量和 static 全局变量的初始化必须能在编译期求值，使用处替换为字面量
+//  - 参数全是常量的函数调用会尝试求值，成功就替换为字面量，失败（碰到外部调用、
+//    系统调用、超出限制等）则保持原样留到运行时
+//  - size_of!(T) / align_of!(T) 总是替换为字面量，结构体按字段顺序和自然对齐排布
+// 整数运算与生成的代码一致：64 位补码回绕，`as` 不截断
+
+struct ConstValue {
+    enum class Kind : uint8_t { Int, Bool, Str } kind{Kind::Int};
+    int64_t i{0};
+    std::string s;
+};
+
+struct ConstEvalLimits {
+    size_t max_steps;       // 解释执行的节点数
+    size_t max_depth;       // 调用深度
+    size_t max_memory;      // 所有活动栈帧中变量占用的字节数
+};
+
+class ConstEvaluator {
+public:
+    // const / static 上下文中的限制，可由 -fconstexpr-steps 调整
+    ConstEvalLimits const_limits{10'000'000, 512, 16u << 20};
+    // 普通表达式里顺带尝试的调用只给很小的预算，避免拖慢编译
+    ConstEvalLimits fold_limits{100'000, 128, 1u << 20};
+
+    explicit ConstEvaluator(const std::shared_ptr<ProgramNode>& program);
+    void fold_program();
+
+private:
+    struct Frame {
+        std::unordered_map<std::string, ConstValue> vars;
+        size_t memory{0};
+    };
+    enum class Flow : uint8_t { Normal, Return, Fail };
+
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_map<std::string, std::shared_ptr<FunctionNode>> functions;
+    std::unordered_map<std::string, std::shared_ptr<StructDeclNode>> structs;
+    std::unordered_map<std::string, ConstValue> globals;           // static const
+    std::unordered_map<std::string, ConstValue> function_consts;   // 正在折叠的函数里的 const
+
+    // 当前一次求值的预算
+    ConstEvalLimits limits{};
+    size_t steps{0}, depth{0}, memory{0};
+    std::string failure;            // 最近一次失败的原因
+
+    std::optional<ConstValue> evaluate(const ASTNodePtr& expr, const ConstEvalLimits& lim);
+    bool fail(std::string why);
+    bool step();
+    std::optional<ConstValue> eval(const ASTNodePtr& expr, Frame& frame);
+    std::optional<ConstValue> eval_binary(const std::shared_ptr<BinaryOpNode>& op, Frame& frame);
+    std::optional<ConstValue> call(const std::shared_ptr<FunctionCallNode>& node, Frame& frame);
+    bool invoke(const std::shared_ptr<FunctionCallNode>& node, Frame& frame, std::optional<ConstValue>& ret);
+    Flow exec(const std::vector<ASTNodePtr>& body, Frame& frame, std::optional<ConstValue>& ret);
+    Flow exec(const ASTNodePtr& stmt, Frame& frame, std::optional<ConstValue>& ret);
+    bool bind(Frame& frame, const std::string& name, ConstValue value);
+    std::optional<ConstValue> type_query(const std::shared_ptr<MacroCallNode>& node);
+    bool layout(const Type& type, int64_t& size, int64_t& align, size_t depth);
+
+    void fold_global(const std::shared_ptr<VariableDeclNode>& decl);
+    void fold_function(const std::shared_ptr<FunctionNode>& fn);
+    void fold_body(std::vector<ASTNodePtr>& body);
+    void fold_stmt(ASTNodePtr& stmt);
+    void fold_expr(ASTNodePtr& expr);
+    void fold_const_decl(const std::shared_ptr<VariableDeclNode>& decl);
+    [[nodiscard]] const ConstValue* find_const(const std::string& name) const;
+};
+
+// 常量对应的字面量节点，沿用原表达式的类型
+ASTNodePtr make_literal(const ConstValue& value, const ASTNodePtr& origin);
+std::optional<ConstValue> literal_value(const ASTNodePtr& node);
+
+#endif //POLO_COMPILER_PRE_CONSTEVAL_H
@@ -0,0 +1,374 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "driver.h"
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "module.h"
+#include "consteval.h"
+#include "bounds.h"
+#include "escape.h"
+#include "inliner.h"
+#include "unroll.h"
+#include "x64/x64gen.hpp"
+#include "elf/elf_writer.h"
+#include "jit/jit.h"
+#include "pgo/profile.h"
+#include "cache/codegen_cache.h"
+#include "cache/module_interface.h"
+#include "output.h"
+#include "stats/mem_report.h"
+#include "stats/time_trace.h"
+#include "thread_pool.h"
+
+namespace fs = std::filesystem;
+
+void usage() {
+    std::ostream& out = *diagnostics->out;
+    out << "Usage: poloc [-S] [-j <n>] [-I <dir>] [-o <output_file>] <input_file>..." << std::endl;
+    out << "       poloc --run <input_file> [args...]" << std::endl;
+    out << "       poloc --server <socket> [-j <n>]" << std::endl;
+    out << "  -S       emit assembly (.s) instead of an object file (.o)" << std::endl;
+    out << "  -o -     write the output to stdout" << std::endl;
+    out << "  --run    compile into memory and run main in-process" << std::endl;
+    out << "  -j <n>   load modules and generate functions on <n> threads (default: all cores);" << std::endl;
+    out << "           with several input files, compile them <n> at a time, each to its own output" << std::endl;
+    out << "  -I <dir> add <dir> to the package path searched by import" << std::endl;
+    out << "           (after the input file's directory, before $POLO_PACKAGE_PATH)" << std::endl;
+    out << "  -fprofile-generate[=<file>]  instrument the program; it writes counts to <file> on exit" << std::endl;
+    out << "  -fprofile-use[=<file>]       optimize code layout with counts from <file>" << std::endl;
+    out << "                               (default <file>: <input_file> with extension .poloprof)" << std::endl;
+    out << "  -fconstexpr-steps=<n>        step limit for evaluating const initializers" << std::endl;
+    out << "  -fincremental[=<file>]       reuse code generated for unchanged functions, cached in <file>" << std::endl;
+    out << "                               (default <file>: <input_file> with extension .polocache)" << std::endl;
+    out << "  -femit-interfaces[=<dir>]    write a precompiled interface (.pmi) for every imported module" << std::endl;
+    out << "                               (default: next to the module's source)" << std::endl;
+    out << "  -fsyntax-only                check the program without generating code" << std::endl;
+    out << "  -ftime-report                print how long each compiler phase and the slowest functions took" << std::endl;
+    out << "  -fmem-report                 print memory use after each phase and by kind of compiler data" << std::endl;
+    out << "  -ftime-trace[=<file>]        write the same timings as Chrome trace-event JSON to <file>" << std::endl;
+    out << "                               (default <file>: <input_file> with extension .trace.json)" << std::endl;
+    out << "  --server <socket>  stay resident and compile requests from poloc clients, <n> at a time;" << std::endl;
+    out << "                     poloc sends its compilations there when $POLO_SERVER is set to <socket>" << std::endl;
+}
+
+bool parse_options(const int argc, char* argv[], Options& options) {
+    // 直接输出 ELF 目标文件只支持 Linux，其余平台仍然输出汇编
+    options.emit_asm = P_TARGET != "Linux";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "-S") options.emit_asm = true;
+        else if (arg == "--run") options.run = true;
+        else if (arg == "-fprofile-generate") options.prof_gen = true;
+        else if (arg.starts_with("-fprofile-generate=")) {
+            options.prof_gen = true;
+            options.prof_gen_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg.starts_with("-fconstexpr-steps=")) {
+            options.constexpr_steps = std::strtoull(arg.c_str() + arg.find('=') + 1, nullptr, 10);
+            if (options.constexpr_steps == 0) {
+                usage();
+                return false;
+            }
+        }
+        else if (arg == "-fincremental") options.incremental = true;
+        else if (arg.starts_with("-fincremental=")) {
+            options.incremental = true;
+            options.cache_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg == "-femit-interfaces") options.emit_interfaces = true;
+        else if (arg.starts_with("-femit-interfaces=")) {
+            options.emit_interfaces = true;
+            options.interface_dir = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg == "-fsyntax-only") options.syntax_only = true;
+        else if (arg == "-ftime-report") options.time_report = true;
+        else if (arg == "-fmem-report") options.mem_report = true;
+        else if (arg == "-ftime-trace") options.time_trace = true;
+        else if (arg.starts_with("-ftime-trace=")) {
+            options.time_trace = true;
+            options.time_trace_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg == "-fprofile-use") options.prof_use = true;
+        else if (arg.starts_with("-fprofile-use=")) {
+            options.prof_use = true;
+            options.prof_use_path = arg.substr(arg.find('=') + 1);
+        }
+        else if (arg == "-o" && i + 1 < argc) options.output = argv[++i];
+        else if (arg == "-I" && i + 1 < argc) options.package_path.emplace_back(argv[++i]);
+        else if (arg.starts_with("-I") && arg.size() > 2) options.package_path.push_back(arg.substr(2));
+        else if (arg.starts_with("-j")) {
+            const char* n = arg.size() > 2 ? arg.c_str() + 2 : (i + 1 < argc ? argv[++i] : "");
+            options.jobs = std::strtoull(n, nullptr, 10);
+            if (options.jobs == 0) {
+                usage();
+                return false;
+            }
+        }
+        else if (!arg.empty() && arg[0] != '-') {
+            options.inputs.push_back(arg);
+            // --run 时输入文件之后的参数都交给程序的 main
+            if (options.run) {
+                options.run_argc = argc - i;
+                options.run_argv = argv + i;
+                break;
+            }
+        }
+        else {
+            usage();
+            return false;
+        }
+    }
+    if (options.inputs.empty()) {
+        usage();
+        return false;
+    }
+    if (options.inputs.size() > 1 && (options.run || !options.output.empty())) {
+        report("Error: --run and -o cannot be used with multiple input files\n");
+        return false;
+    }
+    options.input = options.inputs.front();
+    return true;
+}
+
+void resolve_paths(Options& options, const std::string& dir) {
+    auto resolve = [&](std::string& path) {
+        if (!path.empty() && path != "-" && fs::path(path).is_relative()) path = (fs::path(dir) / path).string();
+    };
+    for (auto& p : options.inputs) resolve(p);
+    resolve(options.input);
+    resolve(options.output);
+    resolve(options.prof_gen_path);
+    resolve(options.prof_use_path);
+    resolve(options.cache_path);
+    resolve(options.interface_dir);
+    resolve(options.time_trace_path);
+    for (auto& p : options.package_path) resolve(p);
+}
+
+void add_package_env(Options& options, const char* package_env) {
+    if (!package_env) return;
+    // 与 PATH 相同的分隔符
+    const char sep = P_TARGET == "Windows" ? ';' : ':';
+    const std::string paths = package_env;
+    for (size_t start = 0, end; start <= paths.size(); start = end + 1) {
+        end = paths.find(sep, start);
+        if (end == std::string::npos) end = paths.size();
+        if (end > start) options.package_path.push_back(paths.substr(start, end - start));
+    }
+}
+
+void finish_options(Options& options) {
+    const std::string stem = options.input.substr(0, options.input.find_last_of('.'));
+    if (options.output.empty()) options.output = stem + (options.emit_asm ? ".s" : ".o");
+    if (options.prof_gen_path.empty()) options.prof_gen_path = stem + ".poloprof";
+    if (options.prof_use_path.empty()) options.prof_use_path = stem + ".poloprof";
+    if (options.cache_path.empty()) options.cache_path = stem + ".polocache";
+    if (options.time_trace_path.empty()) options.time_trace_path = stem + ".trace.json";
+}
+
+namespace {
+
+// 模块的 token 和符号表，要在 ModuleLoader 释放之前统计
+void count_modules(MemReport& mem, const ModuleLoader& loader) {
+    using Entry = std::pair<const std::string, Module::Symbol>;
+    auto heap = [](const std::string& s) { return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0; };
+    for (const auto& m : loader.get_modules()) {
+        mem.add("Tokens (all lexed)", m.tokens, m.token_bytes);
+        size_t bytes = m.symbols.bucket_count() * sizeof(void*) + m.symbols.size() * (sizeof(Entry) + sizeof(void*));
+        for (const auto& [name, s] : m.symbols) bytes += heap(name) + heap(s.name);
+        mem.add("Symbol tables", m.symbols.size(), bytes);
+    }
+}
+
+int compile_program(const Options& options, InterfaceCache* interfaces, MemReport* mem) {
+    // 插桩代码用 Linux 系统调用写 profile
+    if (options.prof_gen && P_TARGET != "Linux") {
+        report("Error: -fprofile-generate is only supported on Linux\n");
+        return 1;
+    }
+    ProfileData profile;
+    if (options.prof_use && !profile.load(options.prof_use_path)) return 1;
+
+    ModuleLoader loader;
+    loader.jobs = options.jobs;
+    loader.package_path = options.package_path;
+    loader.emit_interfaces = options.emit_interfaces;
+    loader.interface_dir = options.interface_dir;
+    loader.interfaces = interfaces;
+    std::shared_ptr<ProgramNode> program;
+    {
+        TimeScope scope("Load modules");
+        program = loader.load(options.input);
+    }
+    if (mem) {
+        count_modules(*mem, loader);
+        mem->phase("Load modules");
+    }
+    if (has_err || !program) return 1;
+    ConstEvaluator evaluator(program);
+    if (options.constexpr_steps) evaluator.const_limits.max_steps = options.constexpr_steps;
+    {
+        TimeScope scope("Const eval");
+        evaluator.fold_program();
+    }
+    if (!has_err) {
+        TimeScope scope("Unroll");
+        LoopUnroller(program).run();
+    }
+    if (!has_err) {
+        TimeScope scope("Inline");
+        Inliner(program).run();
+    }
+    if (!has_err) {
+        TimeScope scope("Bounds checks");
+        BoundsCheckEliminator(program).run();
+    }
+    if (!has_err) {
+        TimeScope scope("Escape analysis");
+        EscapeAnalysis(program).run();
+    }
+    if (mem) {
+        mem->add_ast(*program);
+        mem->phase("Const eval");
+    }
+    if (has_err) return 1;
+    if (options.syntax_only) return 0;
+    WatGen gen;
+    gen.jobs = options.jobs;
+    gen.profile_generate = options.prof_gen;
+    gen.profile_path = options.prof_gen_path;
+    if (options.prof_use) gen.profile = &profile;
+    CodegenCache cache;
+    if (options.incremental) {
+        cache.load(options.cache_path);
+        gen.cache = &cache;
+    }
+
+    if (options.run) {
+        {
+            TimeScope scope("Codegen");
+            gen.gen(program);
+        }
+        if (has_err) return 1;
+        if (options.incremental && !cache.save(options.cache_path))
+            report("Warning: Could not write cache " + options.cache_path + "\n");
+        TimeScope scope("Run");
+        const int rc = run_jit(gen.get_module(), options.run_argc, options.run_argv);
+        return has_err ? 1 : rc;
+    }
+
+    // 汇编边生成边写出；目标文件只保留编码后的字节，最后一次写出
+    OutputSink out;
+    if (!out.open(options.output)) return 1;
+    AsmPrinter printer(out.stream());
+    ObjectBuilder builder;
+    if (options.emit_asm) gen.sink = &printer;
+    else gen.sink = &builder;
+    {
+        TimeScope scope("Codegen");
+        gen.gen(program);
+    }
+    if (mem) {
+        // 汇编边生成边写出，只占一个块；目标文件的各段留在内存里直到写出
+        const auto& image = builder.image;
+        if (options.emit_asm) mem->add("Output buffers", 1, OutputSink::CHUNK_SIZE);
+        else mem->add("Output buffers", 1, image.text.capacity() + image.rodata.capacity() + image.data.capacity()
+                      + image.relocs.capacity() * sizeof(Reloc) + OutputSink::CHUNK_SIZE);
+        mem->phase("Codegen");
+    }
+    TimeScope scope("Write output");
+    if (!has_err && !options.emit_asm) {
+        const auto object = write_elf_object(builder.image, gen.get_module().gnu_stack_note);
+        out.write(object.data(), object.size());
+    }
+    if (has_err) {
+        out.discard();
+        return 1;
+    }
+    if (!out.close()) return 1;
+    if (mem) mem->phase("Write output");
+    // 缓存写不进去不影响这次编译的结果
+    if (options.incremental && !cache.save(options.cache_path))
+        report("Warning: Could not write cache " + options.cache_path + "\n");
+
+    //std::cout << "Compilation successful!" << std::endl;
+    //std::cout << "Output file: " << outputFile << std::endl;
+
+    return 0;
+}
+
+}
+
+int compile(const Options& options, InterfaceCache* interfaces) {
+    const bool timing = options.time_report || options.time_trace;
+    if (!timing && !options.mem_report) return compile_program(options, interfaces, nullptr);
+    TimeTrace trace;
+    MemReport mem;
+    TimeTrace* parent = time_trace;
+    if (timing) time_trace = &trace;
+    int rc;
+    {
+        TimeScope scope("Total");
+        rc = compile_program(options, interfaces, options.mem_report ? &mem : nullptr);
+    }
+    time_trace = parent;
+    if (options.mem_report) {
+        std::ostringstream table;
+        mem.print(table, options.input);
+        report(table.str());
+    }
+    if (options.time_report) {
+        std::ostringstream table;
+        trace.print(table, options.input);
+        report(table.str());
+    }
+    if (options.time_trace && !trace.write(options.time_trace_path))
+        report("Warning: Could not write time trace " + options.time_trace_path + "\n");
+    return rc;
+}
+
+int compile_batch(const Options& options, InterfaceCache* interfaces) {
+    InterfaceCache local;
+    if (!interfaces) interfaces = &local;
+    const size_t n = options.inputs.size();
+    const size_t threads = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::ostringstream> errors(n);
+    std::vector<int> rcs(n, 1);
+    auto compile_unit = [&](const size_t i, const size_t jobs) {
+        Options unit = options;
+        unit.input = options.inputs[i];
+        unit.jobs = jobs;
+        finish_options(unit);
+        // 每个文件的 has_err 单独计算，一个文件出错不影响其他文件
+        Diagnostics* parent = diagnostics;
+        Diagnostics diag;
+        diag.out = &errors[i];
+        diag.base = parent->base;
+        diagnostics = &diag;
+        rcs[i] = compile(unit, interfaces);
+        diagnostics = parent;
+    };
+    // 同时开始的文件都找不到缓存的接口，会各自解析一遍共同导入的模块；
+    // 先用全部线程编译第一个文件，后面的文件就能直接用它留下的接口
+    compile_unit(0, threads);
+    ThreadPool pool(std::min(threads, n - 1));
+    pool.parallel_for(n - 1, [&](const size_t i) {
+        // 文件比线程少时，多出来的线程留给每个文件内部的模块加载和代码生成
+        compile_unit(i + 1, std::max<size_t>(1, threads / (n - 1)));
+    });
+
+    int rc = 0;
+    for (size_t i = 0; i < n; i++) {
+        report(errors[i].str());
+        if (rcs[i] != 0) rc = 1;
+    }
+    return rc;
+}
@@ -0,0 +1,53 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_DRIVER_H
+#define POLO_COMPILER_PRE_DRIVER_H
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class InterfaceCache;
+
+// 一次编译的命令行选项
+struct Options {
+    // inputs 是命令行上的全部输入文件，input 是这次编译的那一个
+    std::vector<std::string> inputs;
+    std::string input, output;
+    bool emit_asm{false};
+    bool run{false};
+    bool prof_gen{false}, prof_use{false};
+    std::string prof_gen_path, prof_use_path;
+    bool incremental{false};
+    std::string cache_path;
+    bool emit_interfaces{false};
+    std::string interface_dir;
+    bool syntax_only{false};
+    bool time_report{false}, time_trace{false}, mem_report{false};
+    std::string time_trace_path;
+    size_t constexpr_steps{0};
+    size_t jobs{0};
+    std::vector<std::string> package_path;
+    // --run 时输入文件之后的参数，交给程序的 main
+    int run_argc{0};
+    char** run_argv{nullptr};
+};
+
+void usage();
+// 参数不对时打印用法并返回 false
+bool parse_options(int argc, char* argv[], Options& options);
+// 相对路径改成相对 dir 的路径，--server 按客户端的工作目录解释参数
+void resolve_paths(Options& options, const std::string& dir);
+// 把 POLO_PACKAGE_PATH 的值 package_env 加到包路径后面
+void add_package_env(Options& options, const char* package_env);
+// 按 input 补上默认的输出、profile 和缓存路径
+void finish_options(Options& options);
+// 编译并写出结果，返回进程退出码；interfaces 非空时在多次编译之间保留模块接口
+int compile(const Options& options, InterfaceCache* interfaces = nullptr);
+// 在同一个进程里编译 options.inputs 的每个文件，各自输出 .s/.o。
+// 文件分给 -j 个线程，导入的模块处理一次后以接口的形式给后面的文件共用。
+// 每个文件的错误输出按命令行顺序打印，有一个失败就返回 1
+int compile_batch(const Options& options, InterfaceCache* interfaces = nullptr);
+
+#endif //POLO_COMPILER_PRE_DRIVER_H
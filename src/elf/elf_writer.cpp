@@ -0,0 +1,346 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "elf_writer.h"
+#include <cstring>
+#include "../common.h"
+#include <unordered_map>
+
+namespace {
+
+// ELF64 常量，只保留用到的部分
+constexpr uint16_t ET_REL = 1;
+constexpr uint16_t EM_X86_64 = 62;
+constexpr uint32_t SHT_PROGBITS = 1, SHT_SYMTAB = 2, SHT_STRTAB = 3, SHT_RELA = 4, SHT_FINI_ARRAY = 15;
+constexpr uint32_t SHT_X86_64_UNWIND = 0x70000001;
+constexpr uint64_t SHF_WRITE = 0x1, SHF_ALLOC = 0x2, SHF_EXECINSTR = 0x4, SHF_INFO_LINK = 0x40;
+constexpr uint8_t STB_LOCAL = 0, STB_GLOBAL = 1;
+constexpr uint8_t STT_NOTYPE = 0, STT_OBJECT = 1, STT_FUNC = 2, STT_SECTION = 3;
+constexpr uint32_t R_X86_64_64 = 1, R_X86_64_PC32 = 2, R_X86_64_PLT32 = 4;
+
+struct Section {
+    std::string name;
+    uint32_t type{0};
+    uint64_t flags{0};
+    std::vector<uint8_t> data;
+    uint32_t link{0}, info{0};
+    uint64_t align{1}, entsize{0};
+};
+
+struct Sym {
+    uint32_t name;
+    uint8_t info;
+    uint16_t shndx;
+    uint64_t value, size;
+};
+
+template<class T> void put(std::vector<uint8_t>& out, const T v) {
+    const size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(out.data() + at, &v, sizeof(T));
+}
+
+template<class T> void patch(std::vector<uint8_t>& out, const size_t at, const T v) {
+    std::memcpy(out.data() + at, &v, sizeof(T));
+}
+
+uint32_t add_string(std::vector<uint8_t>& table, const std::string& s) {
+    const auto at = static_cast<uint32_t>(table.size());
+    table.insert(table.end(), s.begin(), s.end());
+    table.push_back(0);
+    return at;
+}
+
+void pad_to(std::vector<uint8_t>& out, const size_t align, const uint8_t fill = 0) {
+    while (out.size() % align) out.push_back(fill);
+}
+
+// 与 GAS 生成的 CIE 一致：zR 增强，FDE 指针用 pcrel|sdata4
+std::vector<uint8_t> build_cie() {
+    std::vector<uint8_t> cie;
+    put<uint32_t>(cie, 0);          // length，稍后回填
+    put<uint32_t>(cie, 0);          // CIE id
+    cie.push_back(1);               // version
+    cie.push_back('z');
+    cie.push_back('R');
+    cie.push_back(0);
+    cie.push_back(1);               // code alignment
+    cie.push_back(0x78);            // data alignment -8
+    cie.push_back(16);              // 返回地址寄存器
+    cie.push_back(1);               // 增强数据长度
+    cie.push_back(0x1b);            // DW_EH_PE_pcrel | DW_EH_PE_sdata4
+    cie.push_back(0x0c);            // DW_CFA_def_cfa rsp, 8
+    cie.push_back(7);
+    cie.push_back(8);
+    cie.push_back(0x90);            // DW_CFA_offset r16, cfa-8
+    cie.push_back(1);
+    pad_to(cie, 8);
+    patch<uint32_t>(cie, 0, static_cast<uint32_t>(cie.size() - 4));
+    return cie;
+}
+
+}
+
+void ObjectBuilder::begin(const AsmModule& module) {
+    globals = module.globals;
+}
+
+void ObjectBuilder::function(const MachineFunction& mf) {
+    auto fn = encoder.encode(mf);
+    pad_to(image.text, fn.align, 0x90);
+    const size_t base = image.text.size();
+    // 跳转表随函数逐个放进 .rodata，字符串常量在 end 时接在后面
+    pad_to(image.rodata, fn.rodata_align);
+    const size_t rodata_base = image.rodata.size();
+    bool global = false;
+    for (const auto& g : globals) global |= g == fn.name;
+    image.functions.push_back({fn.name, base, fn.code.size(), global});
+    defined[fn.name] = base;
+    for (auto r : fn.relocs) {
+        r.offset += base;
+        if (r.kind == Reloc::Kind::Rodata) r.addend += static_cast<int64_t>(rodata_base);
+        (r.kind == Reloc::Kind::Call ? calls : image.relocs).push_back(std::move(r));
+    }
+    for (auto r : fn.rodata_relocs) {
+        r.offset += rodata_base;
+        r.addend += static_cast<int64_t>(base);
+        image.rodata_relocs.push_back(std::move(r));
+    }
+    image.rodata.insert(image.rodata.end(), fn.rodata.begin(), fn.rodata.end());
+    if (fn.has_cfi)
+        image.fdes.push_back({base, fn.code.size(), std::move(fn.cfi)});
+    image.text.insert(image.text.end(), fn.code.begin(), fn.code.end());
+}
+
+void ObjectBuilder::end(const AsmModule& module) {
+    // 字符串和数据对象要等全部函数生成完才确定
+    for (size_t i = 0; i < module.strings.size(); i++) {
+        const auto& s = module.strings[i];
+        if (module.tables.contains(static_cast<int>(i))) pad_to(image.rodata, 8);
+        image.string_offsets.push_back(image.rodata.size());
+        image.rodata.insert(image.rodata.end(), s.begin(), s.end());
+        image.rodata.push_back(0);
+    }
+    std::unordered_map<std::string, size_t> objects;
+    for (const auto& d : module.data) {
+        pad_to(image.data, d.align);
+        objects[d.name] = image.data.size();
+        image.objects.push_back({d.name, image.data.size(), d.bytes.size(), false});
+        image.data.insert(image.data.end(), d.bytes.begin(), d.bytes.end());
+    }
+    for (auto& r : image.relocs) {
+        if (r.kind != Reloc::Kind::Data) continue;
+        if (const auto it = objects.find(r.sym); it != objects.end())
+            r.addend += static_cast<int64_t>(it->second);
+        else
+            THROW_ERROR("undefined data symbol " + r.sym, 0, 0);
+    }
+
+    // 模块内定义的函数直接回填 rel32，其余留给链接器
+    for (auto& r : calls) {
+        if (const auto it = defined.find(r.sym); it != defined.end()) {
+            const auto disp = static_cast<int32_t>(static_cast<int64_t>(it->second) + r.addend
+                                                   - static_cast<int64_t>(r.offset));
+            patch<int32_t>(image.text, r.offset, disp);
+            continue;
+        }
+        bool seen = false;
+        for (const auto& u : image.undefined) seen |= u == r.sym;
+        if (!seen) image.undefined.push_back(r.sym);
+        image.relocs.push_back(std::move(r));
+    }
+    calls.clear();
+    for (const auto& f : module.fini_array) {
+        if (const auto it = defined.find(f); it != defined.end())
+            image.fini.push_back(it->second);
+        else
+            THROW_ERROR("undefined fini function " + f, 0, 0);
+    }
+    for (const auto& g : module.globals) {
+        bool seen = defined.contains(g);
+        for (const auto& u : image.undefined) seen |= u == g;
+        if (!seen) image.undefined.push_back(g);
+    }
+}
+
+ObjectImage build_object_image(const AsmModule& module) {
+    ObjectBuilder builder;
+    builder.begin(module);
+    for (const auto& e : module.entries)
+        if (e.kind == AsmEntry::Kind::Function) builder.function(module.functions[e.index]);
+    builder.end(module);
+    return std::move(builder.image);
+}
+
+std::vector<uint8_t> write_elf_object(const ObjectImage& image, const bool gnu_stack_note) {
+    std::vector<Section> sections(1);
+    auto add_section = [&](Section s) {
+        sections.push_back(std::move(s));
+        return static_cast<uint16_t>(sections.size() - 1);
+    };
+    const auto text_idx = add_section({".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, image.text, 0, 0, 16, 0});
+    const auto rela_text_idx = add_section({".rela.text", SHT_RELA, SHF_INFO_LINK, {}, 0, text_idx, 8, 24});
+    const auto rodata_idx = add_section({".rodata", SHT_PROGBITS, SHF_ALLOC, image.rodata, 0, 0, 8, 0});
+    uint16_t rela_rodata_idx = 0;
+    if (!image.rodata_relocs.empty())
+        rela_rodata_idx = add_section({".rela.rodata", SHT_RELA, SHF_INFO_LINK, {}, 0, rodata_idx, 8, 24});
+    uint16_t data_idx = 0, fini_idx = 0, rela_fini_idx = 0;
+    if (!image.data.empty())
+        data_idx = add_section({".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, image.data, 0, 0, 8, 0});
+    if (!image.fini.empty()) {
+        fini_idx = add_section({".fini_array", SHT_FINI_ARRAY, SHF_ALLOC | SHF_WRITE,
+                                std::vector<uint8_t>(image.fini.size() * 8, 0), 0, 0, 8, 8});
+        rela_fini_idx = add_section({".rela.fini_array", SHT_RELA, SHF_INFO_LINK, {}, 0, fini_idx, 8, 24});
+    }
+    const auto eh_idx = add_section({".eh_frame", SHT_X86_64_UNWIND, SHF_ALLOC, {}, 0, 0, 8, 0});
+    const auto rela_eh_idx = add_section({".rela.eh_frame", SHT_RELA, SHF_INFO_LINK, {}, 0, eh_idx, 8, 24});
+    if (gnu_stack_note)
+        add_section({".note.GNU-stack", SHT_PROGBITS, 0, {}, 0, 0, 1, 0});
+    const auto symtab_idx = add_section({".symtab", SHT_SYMTAB, 0, {}, 0, 0, 8, 24});
+    const auto strtab_idx = add_section({".strtab", SHT_STRTAB, 0, {0}, 0, 0, 1, 0});
+    const auto shstrtab_idx = add_section({".shstrtab", SHT_STRTAB, 0, {0}, 0, 0, 1, 0});
+
+    // 符号表：局部符号必须排在全局符号之前
+    auto& strtab = sections[strtab_idx].data;
+    std::vector<Sym> syms;
+    syms.push_back({0, 0, 0, 0, 0});
+    auto section_sym = [&](const uint16_t idx) {
+        syms.push_back({0, static_cast<uint8_t>(STB_LOCAL << 4 | STT_SECTION), idx, 0, 0});
+        return static_cast<uint32_t>(syms.size() - 1);
+    };
+    const auto text_sym = section_sym(text_idx);
+    const auto rodata_sym = section_sym(rodata_idx);
+    const auto data_sym = data_idx ? section_sym(data_idx) : 0;
+    section_sym(eh_idx);
+    for (const auto& o : image.objects)
+        syms.push_back({add_string(strtab, o.name), STB_LOCAL << 4 | STT_OBJECT, data_idx, o.offset, o.size});
+    for (const auto& f : image.functions)
+        if (!f.global)
+            syms.push_back({add_string(strtab, f.name), STB_LOCAL << 4 | STT_FUNC, text_idx, f.offset, f.size});
+    const auto first_global = static_cast<uint32_t>(syms.size());
+    for (const auto& f : image.functions)
+        if (f.global)
+            syms.push_back({add_string(strtab, f.name), STB_GLOBAL << 4 | STT_FUNC, text_idx, f.offset, f.size});
+    std::unordered_map<std::string, uint32_t> undefined_sym;
+    for (const auto& u : image.undefined) {
+        syms.push_back({add_string(strtab, u), STB_GLOBAL << 4 | STT_NOTYPE, 0, 0, 0});
+        undefined_sym[u] = static_cast<uint32_t>(syms.size() - 1);
+    }
+
+    // .rela.text
+    auto& rela_text = sections[rela_text_idx].data;
+    for (const auto& r : image.relocs) {
+        put<uint64_t>(rela_text, r.offset);
+        if (r.kind == Reloc::Kind::Call) {
+            put<uint64_t>(rela_text, static_cast<uint64_t>(undefined_sym[r.sym]) << 32 | R_X86_64_PLT32);
+            put<int64_t>(rela_text, r.addend);
+        } else if (r.kind == Reloc::Kind::Data) {
+            put<uint64_t>(rela_text, static_cast<uint64_t>(data_sym) << 32 | R_X86_64_PC32);
+            put<int64_t>(rela_text, r.addend);
+        } else if (r.kind == Reloc::Kind::Rodata) {
+            put<uint64_t>(rela_text, static_cast<uint64_t>(rodata_sym) << 32 | R_X86_64_PC32);
+            put<int64_t>(rela_text, r.addend);
+        } else {
+            put<uint64_t>(rela_text, static_cast<uint64_t>(rodata_sym) << 32 | R_X86_64_PC32);
+            put<int64_t>(rela_text, static_cast<int64_t>(image.string_offsets[r.str]) + r.addend);
+        }
+    }
+
+    // .rodata 里的跳转表项：到 .text 的 PC 相对偏移
+    if (rela_rodata_idx) {
+        auto& rela_rodata = sections[rela_rodata_idx].data;
+        for (const auto& r : image.rodata_relocs) {
+            put<uint64_t>(rela_rodata, r.offset);
+            put<uint64_t>(rela_rodata, static_cast<uint64_t>(text_sym) << 32 | R_X86_64_PC32);
+            put<int64_t>(rela_rodata, r.addend);
+        }
+    }
+
+    // .fini_array：每项是一个绝对地址
+    if (fini_idx) {
+        auto& rela_fini = sections[rela_fini_idx].data;
+        for (size_t i = 0; i < image.fini.size(); i++) {
+            put<uint64_t>(rela_fini, i * 8);
+            put<uint64_t>(rela_fini, static_cast<uint64_t>(text_sym) << 32 | R_X86_64_64);
+            put<int64_t>(rela_fini, static_cast<int64_t>(image.fini[i]));
+        }
+    }
+
+    // .eh_frame：一个 CIE + 每个函数一个 FDE
+    auto& eh = sections[eh_idx].data;
+    auto& rela_eh = sections[rela_eh_idx].data;
+    if (!image.fdes.empty()) {
+        eh = build_cie();
+        for (const auto& fde : image.fdes) {
+            const size_t start = eh.size();
+            put<uint32_t>(eh, 0);
+            put<uint32_t>(eh, static_cast<uint32_t>(eh.size()));     // 到 CIE 的距离
+            put<uint64_t>(rela_eh, eh.size());
+            put<uint64_t>(rela_eh, static_cast<uint64_t>(text_sym) << 32 | R_X86_64_PC32);
+            put<int64_t>(rela_eh, static_cast<int64_t>(fde.offset));
+            put<int32_t>(eh, 0);                                      // pc_begin
+            put<uint32_t>(eh, static_cast<uint32_t>(fde.size));       // pc_range
+            eh.push_back(0);                                          // 增强数据长度
+            eh.insert(eh.end(), fde.program.begin(), fde.program.end());
+            pad_to(eh, 8);
+            patch<uint32_t>(eh, start, static_cast<uint32_t>(eh.size() - start - 4));
+        }
+    }
+
+    auto& symtab = sections[symtab_idx];
+    symtab.link = strtab_idx;
+    symtab.info = first_global;
+    for (const auto& s : syms) {
+        put<uint32_t>(symtab.data, s.name);
+        symtab.data.push_back(s.info);
+        symtab.data.push_back(0);
+        put<uint16_t>(symtab.data, s.shndx);
+        put<uint64_t>(symtab.data, s.value);
+        put<uint64_t>(symtab.data, s.size);
+    }
+    sections[rela_text_idx].link = symtab_idx;
+    sections[rela_eh_idx].link = symtab_idx;
+    if (rela_rodata_idx) sections[rela_rodata_idx].link = symtab_idx;
+    if (rela_fini_idx) sections[rela_fini_idx].link = symtab_idx;
+
+    std::vector<uint32_t> name_offsets(sections.size(), 0);
+    for (size_t i = 1; i < sections.size(); i++)
+        name_offsets[i] = add_string(sections[shstrtab_idx].data, sections[i].name);
+
+    // 文件布局：ELF 头 + 各节数据 + 节头表
+    std::vector<uint8_t> out(64, 0);
+    std::vector<uint64_t> offsets(sections.size(), 0);
+    for (size_t i = 1; i < sections.size(); i++) {
+        pad_to(out, sections[i].align);
+        offsets[i] = out.size();
+        out.insert(out.end(), sections[i].data.begin(), sections[i].data.end());
+    }
+    pad_to(out, 8);
+    const uint64_t shoff = out.size();
+    for (size_t i = 0; i < sections.size(); i++) {
+        const auto& s = sections[i];
+        put<uint32_t>(out, name_offsets[i]);
+        put<uint32_t>(out, s.type);
+        put<uint64_t>(out, s.flags);
+        put<uint64_t>(out, 0);                  // sh_addr
+        put<uint64_t>(out, offsets[i]);
+        put<uint64_t>(out, s.data.size());
+        put<uint32_t>(out, s.link);
+        put<uint32_t>(out, s.info);
+        put<uint64_t>(out, i == 0 ? 0 : s.align);
+        put<uint64_t>(out, s.entsize);
+    }
+
+    const uint8_t ident[16] = {0x7f, 'E', 'L', 'F', 2, 1, 1, 0};
+    std::memcpy(out.data(), ident, sizeof(ident));
+    patch<uint16_t>(out, 16, ET_REL);
+    patch<uint16_t>(out, 18, EM_X86_64);
+    patch<uint32_t>(out, 20, 1);                // e_version
+    patch<uint64_t>(out, 40, shoff);
+    patch<uint16_t>(out, 52, 64);               // e_ehsize
+    patch<uint16_t>(out, 58, 64);               // e_shentsize
+    patch<uint16_t>(out, 60, static_cast<uint16_t>(sections.size()));
+    patch<uint16_t>(out, 62, shstrtab_idx);
+    return out;
+}
@@ -0,0 +1,62 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_ELF_WRITER_H
+#define POLO_COMPILER_PRE_ELF_WRITER_H
+#include "../x64/asm.h"
+#include "../x64/encoder.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 编码整个模块得到的 .text / .rodata / .data，供 ELF 输出和 JIT 共用
+struct ObjectImage {
+    struct Symbol {
+        std::string name;
+        size_t offset;
+        size_t size;
+        bool global;
+    };
+    std::vector<uint8_t> text;
+    std::vector<uint8_t> rodata;
+    std::vector<size_t> string_offsets;     // .L_str_<id> 在 .rodata 中的偏移
+    std::vector<uint8_t> data;
+    std::vector<Symbol> objects;            // .data 中的对象
+    std::vector<Symbol> functions;
+    std::vector<size_t> fini;               // .fini_array：退出函数在 .text 中的偏移
+    std::vector<Reloc> relocs;              // 未能在模块内解析的调用，以及全部字符串/数据/跳转表引用
+    std::vector<Reloc> rodata_relocs;       // .rodata 里跳转表项对 .text 的引用
+    struct Fde {
+        size_t offset;
+        size_t size;
+        std::vector<uint8_t> program;
+    };
+    std::vector<Fde> fdes;
+    std::vector<std::string> undefined;     // 外部符号
+};
+
+// 逐个编码收到的函数，只保留编码结果，不需要整个模块的机器指令
+// end 之后 image 才完整
+class ObjectBuilder : public ModuleSink {
+public:
+    ObjectImage image;
+
+    void begin(const AsmModule& module) override;
+    void function(const MachineFunction& fn) override;
+    void end(const AsmModule& module) override;
+
+private:
+    X64Encoder encoder;
+    std::vector<std::string> globals;
+    std::unordered_map<std::string, size_t> defined;
+    std::vector<Reloc> calls;
+};
+
+ObjectImage build_object_image(const AsmModule& module);
+
+// 生成 x86-64 可重定位 ELF64 目标文件
+std::vector<uint8_t> write_elf_object(const ObjectImage& image, bool gnu_stack_note);
+
+#endif //POLO_COMPILER_PRE_ELF_WRITER_H
@@ -0,0 +1,144 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "escape.h"
+#include "generics.h"
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+bool is_call(const ASTNodePtr& node, const std::string& name) {
+    return node && node->type == NodeType::FUNCTION_CALL &&
+           std::static_pointer_cast<FunctionCallNode>(node)->name == name &&
+           std::static_pointer_cast<FunctionCallNode>(node)->arguments.size() == 1;
+}
+
+// 是变量则返回变量名，否则返回空串
+std::string var_of(const ASTNodePtr& node) {
+    return node && node->type == NodeType::IDENTIFIER ? std::static_pointer_cast<IdentifierNode>(node)->name : "";
+}
+
+// load! / store! 的地址：p 或 p ± n
+std::string address_of(const ASTNodePtr& node) {
+    if (node && node->type == NodeType::BINARY_OP) {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        return n->op == BinaryOpType::ADD || n->op == BinaryOpType::SUB ? var_of(n->left) : "";
+    }
+    return var_of(node);
+}
+
+bool is_compare(const BinaryOpType op) {
+    using enum BinaryOpType;
+    return op == EQ || op == NE || op == LT || op == GT || op == LE || op == GE;
+}
+
+// 函数体和其中 if / for 的语句列表
+void each_body(std::vector<ASTNodePtr>& body, const std::function<void(std::vector<ASTNodePtr>&)>& f) {
+    f(body);
+    for (const auto& s : body) {
+        if (s->type == NodeType::IF_STMT) {
+            const auto n = std::static_pointer_cast<IfStmtNode>(s);
+            each_body(n->thenBody, f);
+            each_body(n->elseBody, f);
+        } else if (s->type == NodeType::FOR_STMT) {
+            each_body(std::static_pointer_cast<ForStmtNode>(s)->body, f);
+        }
+    }
+}
+
+}
+
+void EscapeAnalysis::run() {
+    // 程序自己定义了 malloc / free 时不知道它们的语义
+    for (const auto& s : program->stmts) {
+        const auto fn = function_of(s);
+        if (fn && fn->has_body && (fn->name == "malloc" || fn->name == "free")) return;
+    }
+    for (const auto& s : program->stmts)
+        if (const auto fn = function_of(s); fn && fn->has_body) function(fn);
+}
+
+void EscapeAnalysis::function(const std::shared_ptr<FunctionNode>& fn) {
+    // 同名变量声明了不止一次时按名字区分不了，都不处理
+    std::unordered_map<std::string, size_t> decls;
+    std::vector<std::shared_ptr<VariableDeclNode>> candidates;
+    for (const auto& p : fn->parameters) decls[p.name]++;
+    each_node(fn, [&](const ASTNodePtr& node) {
+        if (node->type != NodeType::VARIABLE_DECL) return;
+        const auto decl = std::static_pointer_cast<VariableDeclNode>(node);
+        decls[decl->name]++;
+        if (decl->is_const || decl->is_static || !decl->type || decl->type->is_fat()) return;
+        if (!is_call(decl->initializer, "malloc")) return;
+        const auto& size = std::static_pointer_cast<FunctionCallNode>(decl->initializer)->arguments[0];
+        if (size->type != NodeType::NUMBER) return;
+        const auto n = std::static_pointer_cast<NumberNode>(size)->value;
+        if (n > 0 && n <= MAX_OBJECT) candidates.push_back(decl);
+    });
+    if (candidates.empty()) return;
+
+    // 变量出现的次数，以及其中不会让指针逃逸的次数；两者相等才能放到栈上
+    std::unordered_map<std::string, size_t> uses, allowed;
+    std::unordered_set<std::string> assigned;
+    each_node(fn, [&](const ASTNodePtr& node) {
+        switch (node->type) {
+        case NodeType::IDENTIFIER:
+            uses[std::static_pointer_cast<IdentifierNode>(node)->name]++;
+            break;
+        case NodeType::ASSIGNMENT:
+            assigned.insert(std::static_pointer_cast<AssignmentNode>(node)->name);
+            break;
+        case NodeType::MACRO_CALL: {
+            const auto n = std::static_pointer_cast<MacroCallNode>(node);
+            if ((n->name == "load" || n->name == "store") && !n->arguments.empty())
+                if (const auto name = address_of(n->arguments[0]); !name.empty()) allowed[name]++;
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+            if (!is_compare(n->op)) break;
+            if (const auto name = var_of(n->left); !name.empty()) allowed[name]++;
+            if (const auto name = var_of(n->right); !name.empty()) allowed[name]++;
+            break;
+        }
+        default:
+            break;
+        }
+    });
+    // 只有作为语句的 free(p) 可以删掉
+    each_body(fn->body, [&](std::vector<ASTNodePtr>& body) {
+        for (const auto& s : body)
+            if (is_call(s, "free"))
+                if (const auto name = var_of(std::static_pointer_cast<FunctionCallNode>(s)->arguments[0]); !name.empty())
+                    allowed[name]++;
+    });
+
+    std::unordered_set<std::string> promoted;
+    int64_t total = 0;
+    for (const auto& decl : candidates) {
+        const auto& name = decl->name;
+        if (decls[name] != 1 || assigned.contains(name) || uses[name] != allowed[name]) continue;
+        const auto call = std::static_pointer_cast<FunctionCallNode>(decl->initializer);
+        const auto size = (std::static_pointer_cast<NumberNode>(call->arguments[0])->value + 7) & ~int64_t{7};
+        if (total + size > MAX_FRAME) continue;
+        total += size;
+
+        auto alloc = std::make_shared<MacroCallNode>(call->line, call->col, "stack_alloc",
+            std::vector<ASTNodePtr>{std::make_shared<NumberNode>(call->line, call->col, size)});
+        alloc->ret_type = call->ret_type;
+        decl->initializer = alloc;
+        promoted.insert(name);
+    }
+    if (promoted.empty()) return;
+    each_body(fn->body, [&](std::vector<ASTNodePtr>& body) {
+        std::erase_if(body, [&](const ASTNodePtr& s) {
+            return is_call(s, "free") &&
+                   promoted.contains(var_of(std::static_pointer_cast<FunctionCallNode>(s)->arguments[0]));
+        });
+    });
+}
@@ -0,0 +1,34 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_ESCAPE_H
+#define POLO_COMPILER_PRE_ESCAPE_H
+#include "ast.h"
+#include <cstdint>
+#include <memory>
+
+// 逃逸分析：把不逃出函数的堆分配改成栈上分配
+//   let p: *Point = malloc(16) as *Point;   ->  let p: *Point = stack_alloc!(16);
+//   store!(p + 8, 1); free(p);              ->  store!(p + 8, 1);
+// 在编译期求值之后运行，size_of! 已经折叠成字面量。只处理大小是常量的 malloc，
+// p 只能用作 load! / store! 的地址（可以加减偏移）、参与比较、作为语句 free(p)；
+// 传给其他函数、返回、赋值给别的变量、取地址、被重新赋值都算逃逸，保持原样。
+// 这样的 p 没有别名，循环里每次分配复用同一块栈空间也没有问题。
+// stack_alloc!(n) 由代码生成在栈帧里预留 n 字节（8 字节对齐），lower_frame 计入 slot_size。
+
+class EscapeAnalysis {
+public:
+    static constexpr int64_t MAX_OBJECT = 1024;     // 单个对象
+    static constexpr int64_t MAX_FRAME = 4096;      // 每个函数栈上分配的总量
+
+    explicit EscapeAnalysis(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    void run();
+
+private:
+    std::shared_ptr<ProgramNode> program;
+
+    void function(const std::shared_ptr<FunctionNode>& fn);
+};
+
+#endif //POLO_COMPILER_PRE_ESCAPE_H
@@ -0,0 +1,492 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "generics.h"
+#include <algorithm>
+#include <functional>
+#include "common.h"
+
+namespace {
+
+// 实例里再调用泛型函数的层数上限，超过说明类型实参在递归中不断变长
+constexpr size_t MAX_INSTANCE_DEPTH = 64;
+
+std::shared_ptr<Type> copy(const std::shared_ptr<Type>& type) {
+    if (const auto ext = std::dynamic_pointer_cast<ExtType>(type)) {
+        auto result = std::make_shared<ExtType>();
+        result->basic = copy(ext->basic);
+        result->is_ptr = ext->is_ptr;
+        result->is_arr = ext->is_arr;
+        return result;
+    }
+    return type->clone();
+}
+
+bool is_pointer(const Type& type) {
+    // &x 得到的 ExtType 不带 is_ptr，指针标记在 basic 上
+    if (const auto* ext = dynamic_cast<const ExtType*>(&type)) return ext->is_ptr || is_pointer(*ext->basic);
+    return type.is_ptr || type.is_arr;
+}
+
+// type 的值里是否直接含有类型参数 p（隔着指针的不算，指针的布局与指向的类型无关）
+bool mentions(const Type& type, const std::string& p) {
+    if (is_pointer(type)) return false;
+    if (const auto* ext = dynamic_cast<const ExtType*>(&type)) return mentions(*ext->basic, p);
+    if (type.args.empty()) return type.name == p;
+    return std::any_of(type.args.begin(), type.args.end(), [&](const auto& a) { return mentions(*a, p); });
+}
+
+}
+
+void each_node(const ASTNodePtr& node, const std::function<void(const ASTNodePtr&)>& f) {
+    if (!node) return;
+    f(node);
+    auto all = [&](const std::vector<ASTNodePtr>& nodes) {
+        for (const auto& n : nodes) each_node(n, f);
+    };
+    switch (node->type) {
+    case NodeType::FUNCTION:
+        all(std::static_pointer_cast<FunctionNode>(node)->body);
+        break;
+    case NodeType::MACRO_DECL:
+        each_node(std::static_pointer_cast<MacroDeclNode>(node)->declaration, f);
+        break;
+    case NodeType::VARIABLE_DECL:
+        each_node(std::static_pointer_cast<VariableDeclNode>(node)->initializer, f);
+        break;
+    case NodeType::ASSIGNMENT:
+        each_node(std::static_pointer_cast<AssignmentNode>(node)->value, f);
+        break;
+    case NodeType::MEMBER_ASSIGN: {
+        const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+        each_node(n->member, f);
+        each_node(n->value, f);
+        break;
+    }
+    case NodeType::RETURN_STMT:
+        each_node(std::static_pointer_cast<ReturnStmtNode>(node)->expression, f);
+        break;
+    case NodeType::IF_STMT: {
+        const auto n = std::static_pointer_cast<IfStmtNode>(node);
+        each_node(n->condition, f);
+        all(n->thenBody);
+        all(n->elseBody);
+        break;
+    }
+    case NodeType::FOR_STMT: {
+        const auto n = std::static_pointer_cast<ForStmtNode>(node);
+        each_node(n->init, f);
+        each_node(n->condition, f);
+        each_node(n->increment, f);
+        all(n->body);
+        break;
+    }
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        each_node(n->left, f);
+        each_node(n->right, f);
+        break;
+    }
+    case NodeType::UNARY:
+        each_node(std::static_pointer_cast<UnaryOpNode>(node)->expr, f);
+        break;
+    case NodeType::FUNCTION_CALL:
+        all(std::static_pointer_cast<FunctionCallNode>(node)->arguments);
+        break;
+    case NodeType::MACRO_CALL:
+        all(std::static_pointer_cast<MacroCallNode>(node)->arguments);
+        break;
+    case NodeType::MEMBER_ACCESS:
+        each_node(std::static_pointer_cast<MemberAccessNode>(node)->object, f);
+        break;
+    default:
+        break;
+    }
+}
+
+void each_slot(const ASTNodePtr& node, const std::function<void(ASTNodePtr&)>& f) {
+    switch (node->type) {
+    case NodeType::VARIABLE_DECL:
+        f(std::static_pointer_cast<VariableDeclNode>(node)->initializer);
+        break;
+    case NodeType::ASSIGNMENT:
+        f(std::static_pointer_cast<AssignmentNode>(node)->value);
+        break;
+    case NodeType::MEMBER_ASSIGN: {
+        const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+        f(n->member);
+        f(n->value);
+        break;
+    }
+    case NodeType::RETURN_STMT:
+        f(std::static_pointer_cast<ReturnStmtNode>(node)->expression);
+        break;
+    case NodeType::IF_STMT:
+        f(std::static_pointer_cast<IfStmtNode>(node)->condition);
+        break;
+    case NodeType::FOR_STMT: {
+        const auto n = std::static_pointer_cast<ForStmtNode>(node);
+        f(n->init);
+        f(n->condition);
+        f(n->increment);
+        break;
+    }
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        f(n->left);
+        f(n->right);
+        break;
+    }
+    case NodeType::UNARY:
+        f(std::static_pointer_cast<UnaryOpNode>(node)->expr);
+        break;
+    case NodeType::FUNCTION_CALL:
+        for (auto& a : std::static_pointer_cast<FunctionCallNode>(node)->arguments) f(a);
+        break;
+    case NodeType::MACRO_CALL:
+        for (auto& a : std::static_pointer_cast<MacroCallNode>(node)->arguments) f(a);
+        break;
+    case NodeType::MEMBER_ACCESS:
+        f(std::static_pointer_cast<MemberAccessNode>(node)->object);
+        break;
+    default:
+        break;
+    }
+}
+
+std::shared_ptr<FunctionNode> function_of(const ASTNodePtr& stmt) {
+    ASTNodePtr node = stmt;
+    if (node->type == NodeType::MACRO_DECL) node = std::static_pointer_cast<MacroDeclNode>(node)->declaration;
+    return node && node->type == NodeType::FUNCTION ? std::static_pointer_cast<FunctionNode>(node) : nullptr;
+}
+
+std::unordered_set<std::string> addressed_vars(const ASTNodePtr& node) {
+    std::unordered_set<std::string> result;
+    each_node(node, [&](const ASTNodePtr& n) {
+        if (n->type != NodeType::UNARY) return;
+        const auto op = std::static_pointer_cast<UnaryOpNode>(n);
+        if (op->op == UnaryOpType::Addr && op->expr->type == NodeType::IDENTIFIER)
+            result.insert(std::static_pointer_cast<IdentifierNode>(op->expr)->name);
+    });
+    return result;
+}
+
+namespace {
+
+// 复制泛型函数体，同时把其中的类型参数换成类型实参
+class Instantiator {
+public:
+    explicit Instantiator(const TypeBindings& bindings) : bindings(bindings) {}
+
+    std::shared_ptr<FunctionNode> function(const FunctionNode& fn, const std::string& name) {
+        std::vector<Parameter> params;
+        for (const auto& p : fn.parameters) params.push_back({p.name, type(p.type)});
+        auto result = std::make_shared<FunctionNode>(fn.line, fn.col, name, std::move(params), type(fn.returnType),
+                                                     nodes(fn.body));
+        result->is_pub = fn.is_pub;
+        return result;
+    }
+
+    ASTNodePtr copy(const ASTNodePtr& n) {
+        return node(n);
+    }
+
+private:
+    const TypeBindings& bindings;
+
+    std::shared_ptr<Type> type(const std::shared_ptr<Type>& t) const {
+        return t ? substitute(t, bindings) : nullptr;
+    }
+
+    std::vector<ASTNodePtr> nodes(const std::vector<ASTNodePtr>& ns) {
+        std::vector<ASTNodePtr> result;
+        for (const auto& n : ns) result.push_back(node(n));
+        return result;
+    }
+
+    ASTNodePtr node(const ASTNodePtr& node) {
+        if (!node) return nullptr;
+        const size_t line = node->line, col = node->col;
+        ASTNodePtr result;
+        switch (node->type) {
+        case NodeType::VARIABLE_DECL: {
+            const auto n = std::static_pointer_cast<VariableDeclNode>(node);
+            auto decl = std::make_shared<VariableDeclNode>(line, col, n->name, type(n->type), this->node(n->initializer));
+            decl->is_const = n->is_const;
+            decl->is_static = n->is_static;
+            result = decl;
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            const auto n = std::static_pointer_cast<AssignmentNode>(node);
+            result = std::make_shared<AssignmentNode>(line, col, n->name, this->node(n->value));
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+            result = std::make_shared<MemberAssignNode>(line, col, this->node(n->member), this->node(n->value));
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+            result = std::make_shared<BinaryOpNode>(line, col, this->node(n->left), n->op, this->node(n->right));
+            break;
+        }
+        case NodeType::UNARY: {
+            const auto n = std::static_pointer_cast<UnaryOpNode>(node);
+            result = std::make_shared<UnaryOpNode>(line, col, n->op, this->node(n->expr));
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            const auto n = std::static_pointer_cast<FunctionCallNode>(node);
+            auto call = std::make_shared<FunctionCallNode>(line, col, n->name, nodes(n->arguments));
+            call->is_method = n->is_method;
+            call->vslot = n->vslot;
+            for (const auto& t : n->type_args) call->type_args.push_back(type(t));
+            result = call;
+            break;
+        }
+        case NodeType::MACRO_CALL: {
+            const auto n = std::static_pointer_cast<MacroCallNode>(node);
+            auto macro = std::make_shared<MacroCallNode>(line, col, n->name, nodes(n->arguments));
+            macro->type_arg = type(n->type_arg);
+            result = macro;
+            break;
+        }
+        case NodeType::NUMBER:
+            result = std::make_shared<NumberNode>(line, col, std::static_pointer_cast<NumberNode>(node)->value);
+            break;
+        case NodeType::FLOAT:
+            result = std::make_shared<FloatNode>(line, col, std::static_pointer_cast<FloatNode>(node)->value);
+            break;
+        case NodeType::BOOLEAN:
+            result = std::make_shared<BooleanNode>(line, col, std::static_pointer_cast<BooleanNode>(node)->value);
+            break;
+        case NodeType::STRING:
+            result = std::make_shared<StringNode>(line, col, std::static_pointer_cast<StringNode>(node)->value);
+            break;
+        case NodeType::IDENTIFIER:
+            result = std::make_shared<IdentifierNode>(line, col, std::static_pointer_cast<IdentifierNode>(node)->name);
+            break;
+        case NodeType::RETURN_STMT:
+            result = std::make_shared<ReturnStmtNode>(line, col,
+                                                      this->node(std::static_pointer_cast<ReturnStmtNode>(node)->expression));
+            break;
+        case NodeType::IF_STMT: {
+            const auto n = std::static_pointer_cast<IfStmtNode>(node);
+            result = std::make_shared<IfStmtNode>(line, col, this->node(n->condition), nodes(n->thenBody), nodes(n->elseBody));
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            const auto n = std::static_pointer_cast<ForStmtNode>(node);
+            result = std::make_shared<ForStmtNode>(line, col, this->node(n->init), this->node(n->condition),
+                                                   this->node(n->increment), nodes(n->body));
+            break;
+        }
+        case NodeType::BREAK_STMT:
+            result = std::make_shared<BreakStmtNode>(line, col);
+            break;
+        case NodeType::CONTINUE_STMT:
+            result = std::make_shared<ContinueStmtNode>(line, col);
+            break;
+        case NodeType::MEMBER_ACCESS: {
+            const auto n = std::static_pointer_cast<MemberAccessNode>(node);
+            result = std::make_shared<MemberAccessNode>(line, col, this->node(n->object), this->node(n->expr));
+            break;
+        }
+        default:
+            THROW_ERROR("Generic function body contains a statement that cannot be instantiated", line, col);
+            return nullptr;
+        }
+        if (const auto stmt = std::dynamic_pointer_cast<StmtNode>(node))
+            std::static_pointer_cast<StmtNode>(result)->is_pub = stmt->is_pub;
+        // `as T` 的类型同样要代入；字面量沿用原来的类型
+        if (const auto e = std::dynamic_pointer_cast<ExprNode>(node))
+            std::static_pointer_cast<ExprNode>(result)->ret_type = type(e->ret_type);
+        return result;
+    }
+};
+
+// 实例名里的类型：a::b 已经改名成 a.b，剩下的 <>, 和空格换成汇编符号里能用的字符
+std::string mangle(const std::string& type) {
+    std::string result;
+    for (const char ch : type) {
+        if (ch == '*') result += 'P';
+        else if (ch == '<' || ch == '>' || ch == ',') result += '$';
+        else if (ch != ' ') result += ch;
+    }
+    return result;
+}
+
+}
+
+ASTNodePtr copy_node(const ASTNodePtr& node, const TypeBindings& bindings) {
+    return Instantiator(bindings).copy(node);
+}
+
+std::shared_ptr<Type> substitute(const std::shared_ptr<Type>& type, const TypeBindings& bindings) {
+    if (!type || bindings.empty()) return type;
+    if (const auto ext = std::dynamic_pointer_cast<ExtType>(type)) {
+        auto result = std::make_shared<ExtType>();
+        result->basic = substitute(ext->basic, bindings);
+        result->is_ptr = ext->is_ptr;
+        result->is_arr = ext->is_arr;
+        return result;
+    }
+    if (type->args.empty()) {
+        const auto it = bindings.find(type->name);
+        if (it == bindings.end()) return type;
+        auto result = copy(it->second);
+        // *T 代入指针类型时得到指向指针的指针
+        if (type->is_ptr) {
+            if (is_pointer(*result)) {
+                auto ptr = std::make_shared<ExtType>();
+                ptr->basic = result;
+                ptr->is_ptr = true;
+                result = ptr;
+            } else {
+                result->is_ptr = true;
+            }
+        }
+        if (type->is_arr) result->is_arr = true;
+        return result;
+    }
+    auto result = type->clone();
+    for (auto& a : result->args) a = substitute(a, bindings);
+    return result;
+}
+
+bool deduce(const std::shared_ptr<Type>& param, const std::shared_ptr<Type>& arg,
+            const std::vector<std::string>& params, TypeBindings& bindings, std::string& error) {
+    if (!param || !arg) return true;
+    if (const auto a = std::dynamic_pointer_cast<ExtType>(arg); a && !a->is_ptr)
+        return deduce(param, a->basic, params, bindings, error);
+    if (const auto ext = std::dynamic_pointer_cast<ExtType>(param)) {
+        const auto a = std::dynamic_pointer_cast<ExtType>(arg);
+        return !a || a->is_ptr != ext->is_ptr || deduce(ext->basic, a->basic, params, bindings, error);
+    }
+    if (param->args.empty() && std::find(params.begin(), params.end(), param->name) != params.end()) {
+        std::shared_ptr<Type> value = arg;
+        if (param->is_ptr) {
+            // *T 匹配 *X 得到 T = X
+            if (const auto a = std::dynamic_pointer_cast<ExtType>(arg); a && a->is_ptr) {
+                value = a->basic;
+            } else if (arg->is_ptr) {
+                value = copy(arg);
+                value->is_ptr = false;
+            } else {
+                error = "`" + param->to_string() + "` needs a pointer, got `" + arg->to_string() + "`";
+                return false;
+            }
+        }
+        const auto [it, inserted] = bindings.try_emplace(param->name, value);
+        if (!inserted && it->second->to_string() != value->to_string()) {
+            error = "`" + param->name + "` is both `" + it->second->to_string() + "` and `" + value->to_string() + "`";
+            return false;
+        }
+        return true;
+    }
+    if (param->name != arg->name || param->args.size() != arg->args.size()) return true;
+    for (size_t i = 0; i < param->args.size(); i++)
+        if (!deduce(param->args[i], arg->args[i], params, bindings, error)) return false;
+    return true;
+}
+
+void Monomorphizer::run() {
+    for (const auto& s : program->stmts)
+        if (const auto fn = function_of(s); fn && !fn->type_params.empty()) generics[fn->name] = {fn, {}};
+    // 没有泛型函数的程序不用再遍历一遍
+    if (generics.empty()) return;
+    observe();
+
+    std::vector<ASTNodePtr> stmts;
+    for (const auto& s : program->stmts) {
+        if (const auto fn = function_of(s); fn && !fn->type_params.empty()) continue;
+        rewrite(s, 0);
+        stmts.push_back(s);
+    }
+    // 实例里的调用在生成实例时已经代入了具体类型，同样改写，可能再生成新的实例
+    while (!pending.empty()) {
+        const auto p = pending.back();
+        pending.pop_back();
+        rewrite(p.fn, p.depth);
+    }
+    stmts.insert(stmts.end(), created.begin(), created.end());
+    program->stmts = std::move(stmts);
+}
+
+void Monomorphizer::observe() {
+    for (auto& [name, g] : generics) g.observed.assign(g.fn->type_params.size(), false);
+    // 直接对类型参数用 size_of!/align_of! 的先标出来，再沿着泛型调用传播到不动点
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto& [name, g] : generics) {
+            for (size_t i = 0; i < g.observed.size(); i++) {
+                if (g.observed[i]) continue;
+                const auto& p = g.fn->type_params[i];
+                bool seen = false;
+                each_node(g.fn, [&](const ASTNodePtr& node) {
+                    if (node->type == NodeType::MACRO_CALL) {
+                        const auto& t = std::static_pointer_cast<MacroCallNode>(node)->type_arg;
+                        seen |= t && mentions(*t, p);
+                    } else if (node->type == NodeType::FUNCTION_CALL) {
+                        const auto call = std::static_pointer_cast<FunctionCallNode>(node);
+                        const auto it = generics.find(call->name);
+                        if (it == generics.end()) return;
+                        for (size_t k = 0; k < call->type_args.size() && k < it->second.observed.size(); k++)
+                            seen |= it->second.observed[k] && mentions(*call->type_args[k], p);
+                    }
+                });
+                if (seen) g.observed[i] = changed = true;
+            }
+        }
+    }
+}
+
+void Monomorphizer::rewrite(const ASTNodePtr& node, const size_t depth) {
+    each_node(node, [&](const ASTNodePtr& n) {
+        if (n->type != NodeType::FUNCTION_CALL) return;
+        if (const auto call = std::static_pointer_cast<FunctionCallNode>(n); !call->type_args.empty())
+            instantiate(call, depth);
+    });
+}
+
+void Monomorphizer::instantiate(const std::shared_ptr<FunctionCallNode>& call, const size_t depth) {
+    const auto it = generics.find(call->name);
+    if (it == generics.end() || call->type_args.size() != it->second.fn->type_params.size()) {
+        THROW_ERROR("Wrong type arguments for function " + call->name, call->line, call->col);
+        return;
+    }
+    const auto& g = it->second;
+    // 键只包含影响生成代码的信息：没被观察的类型参数只区分是不是占两个字（str、dyn Trait），指针都一样
+    std::string key = call->name, suffix;
+    for (size_t i = 0; i < call->type_args.size(); i++) {
+        const auto& t = *call->type_args[i];
+        std::string part;
+        if (!g.observed[i]) part = t.is_fat() ? "str" : "w";
+        else part = is_pointer(t) ? "*" : t.to_string();
+        key += "|" + part;
+        suffix += "$" + mangle(part);
+    }
+    const auto [slot, inserted] = instances.try_emplace(key);
+    if (inserted) {
+        if (depth >= MAX_INSTANCE_DEPTH) {
+            THROW_ERROR("Generic function " + call->name + " is instantiated more than "
+                        + std::to_string(MAX_INSTANCE_DEPTH) + " levels deep", call->line, call->col);
+            return;
+        }
+        // 换掉的字符可能让两个键得到同样的名字，这时加序号
+        std::string name = call->name + suffix;
+        for (size_t n = 2; names.contains(name); n++) name = call->name + suffix + "$" + std::to_string(n);
+        names.insert(name);
+        slot->second = name;
+        TypeBindings bindings;
+        for (size_t i = 0; i < call->type_args.size(); i++) bindings[g.fn->type_params[i]] = call->type_args[i];
+        auto fn = Instantiator(bindings).function(*g.fn, name);
+        created.push_back(fn);
+        pending.push_back({fn, depth + 1});
+    }
+    call->name = slot->second;
+    call->type_args.clear();
+}
@@ -0,0 +1,73 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_GENERICS_H
+#define POLO_COMPILER_PRE_GENERICS_H
+#include "ast.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 泛型：fn f<T>(x: T) -> T 和 struct S<T> { v: T; }
+// 类型检查把 T 当作一个不透明的类型检查一次泛型函数体；调用处按实参类型推导 T，
+// 推导结果记在 FunctionCallNode::type_args 上（也写进 .pmi）。
+// 模块合并之后由 Monomorphizer 为每组类型实参生成一个普通函数（实例），调用改为调用实例，
+// 泛型函数本身不生成代码。泛型结构体只影响布局，size_of!(S<i32>) 在编译期求值时代入。
+
+using TypeBindings = std::unordered_map<std::string, std::shared_ptr<Type>>;
+
+// 把 type 中的类型参数换成 bindings 里的类型，返回新的类型；不含类型参数时原样返回
+std::shared_ptr<Type> substitute(const std::shared_ptr<Type>& type, const TypeBindings& bindings);
+// 用实参类型 arg 匹配形参类型 param，推导 params 中的类型参数，结果加进 bindings；
+// 同一个类型参数推导出两种类型时返回 false，原因写进 error
+bool deduce(const std::shared_ptr<Type>& param, const std::shared_ptr<Type>& arg,
+            const std::vector<std::string>& params, TypeBindings& bindings, std::string& error);
+// 先序访问函数体、初始化表达式里的每个节点
+void each_node(const ASTNodePtr& node, const std::function<void(const ASTNodePtr&)>& f);
+// 依次访问 node 下面子表达式所在的位置（可以替换），不进入 if / for 的语句列表
+void each_slot(const ASTNodePtr& node, const std::function<void(ASTNodePtr&)>& f);
+// stmt 是函数定义（可以带 #!(...) 属性）时返回这个函数，否则返回空
+std::shared_ptr<FunctionNode> function_of(const ASTNodePtr& stmt);
+// node 里被取了地址（&x）的变量名
+std::unordered_set<std::string> addressed_vars(const ASTNodePtr& node);
+// 复制一个节点，其中的类型参数换成 bindings 里的类型
+ASTNodePtr copy_node(const ASTNodePtr& node, const TypeBindings& bindings = {});
+
+// 单态化。实例按生成的代码区分而不是按类型实参区分：生成的代码只关心一个值是不是 str 或 dyn Trait
+// （fat pointer 占两个寄存器），其余类型都按 8 字节处理，所以 f<i32>、f<i64>、f<*Node>
+// 共用一个实例 f$w。只有类型参数的具体类型会影响代码时（函数体对它用了 size_of!/align_of!，
+// 或者把它传给了这样的泛型函数）才按具体类型分开，指针类型仍然共用一个。
+// 同一个实例在整个程序里只生成一次，不管有多少个模块调用它。
+class Monomorphizer {
+public:
+    explicit Monomorphizer(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    // 出错时设置 has_err
+    void run();
+
+private:
+    struct Generic {
+        std::shared_ptr<FunctionNode> fn;
+        std::vector<bool> observed;     // 第 i 个类型参数的具体类型是否影响生成的代码
+    };
+    struct Pending {
+        std::shared_ptr<FunctionNode> fn;
+        size_t depth;                   // 从非泛型代码出发经过了几层实例
+    };
+
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_map<std::string, Generic> generics;
+    std::unordered_map<std::string, std::string> instances;    // 实例的键 -> 实例名
+    std::unordered_set<std::string> names;                      // 已经用掉的实例名
+    std::vector<std::shared_ptr<FunctionNode>> created;         // 按生成顺序
+    std::vector<Pending> pending;
+
+    void observe();
+    void rewrite(const ASTNodePtr& node, size_t depth);
+    void instantiate(const std::shared_ptr<FunctionCallNode>& call, size_t depth);
+};
+
+#endif //POLO_COMPILER_PRE_GENERICS_H
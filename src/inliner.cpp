@@ -0,0 +1,226 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "inliner.h"
+#include "generics.h"
+#include <functional>
+
+namespace {
+
+// 复制出来的函数体里，形参换成实参
+void replace(ASTNodePtr& node, const std::unordered_map<std::string, ASTNodePtr>& args) {
+    if (!node) return;
+    if (node->type == NodeType::IDENTIFIER) {
+        const auto id = std::static_pointer_cast<IdentifierNode>(node);
+        const auto it = args.find(id->name);
+        if (it == args.end()) return;
+        node = copy_node(it->second);
+        // 函数体里的 `as` 写在形参上
+        if (id->ret_type) std::static_pointer_cast<ExprNode>(node)->ret_type = id->ret_type;
+        return;
+    }
+    each_slot(node, [&](ASTNodePtr& n) { replace(n, args); });
+    if (node->type == NodeType::IF_STMT) {
+        const auto n = std::static_pointer_cast<IfStmtNode>(node);
+        for (auto& s : n->thenBody) replace(s, args);
+        for (auto& s : n->elseBody) replace(s, args);
+    } else if (node->type == NodeType::FOR_STMT) {
+        for (auto& s : std::static_pointer_cast<ForStmtNode>(node)->body) replace(s, args);
+    }
+}
+
+// 不写内存、不调用函数的表达式；bounds! 只可能终止程序
+bool is_pure(const ASTNodePtr& node) {
+    if (!node) return true;
+    switch (node->type) {
+    case NodeType::NUMBER:
+    case NodeType::BOOLEAN:
+    case NodeType::IDENTIFIER:
+        return true;
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        return is_pure(n->left) && is_pure(n->right);
+    }
+    case NodeType::UNARY: {
+        const auto n = std::static_pointer_cast<UnaryOpNode>(node);
+        return n->op == UnaryOpType::Minus && is_pure(n->expr);
+    }
+    case NodeType::MACRO_CALL: {
+        const auto n = std::static_pointer_cast<MacroCallNode>(node);
+        if (n->name != "load" && n->name != "bounds") return false;
+        for (const auto& a : n->arguments)
+            if (!is_pure(a)) return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+bool is_void(const std::shared_ptr<Type>& type) {
+    return !type || (type->kind == TypeKind::VOID && !type->is_ptr);
+}
+
+}
+
+void Inliner::run() {
+    // 带属性的函数（extern、target）保持原样
+    for (const auto& s : program->stmts) {
+        if (s->type != NodeType::FUNCTION) continue;
+        const auto fn = std::static_pointer_cast<FunctionNode>(s);
+        if (fn->has_body && fn->type_params.empty() && fn->name != "main") functions[fn->name] = fn;
+    }
+    if (functions.empty()) return;
+    for (const auto& s : program->stmts)
+        if (const auto fn = function_of(s); fn && fn->has_body && fn->type_params.empty()) function(fn);
+}
+
+void Inliner::function(const std::shared_ptr<FunctionNode>& fn) {
+    current = fn->name;
+    locals.clear();
+    addressed = addressed_vars(fn);
+    for (const auto& p : fn->parameters) locals[p.name] = p.type;
+    each_node(fn, [&](const ASTNodePtr& node) {
+        if (node->type != NodeType::VARIABLE_DECL) return;
+        const auto decl = std::static_pointer_cast<VariableDeclNode>(node);
+        locals[decl->name] = decl->type;
+    });
+    body(fn->body, 0);
+}
+
+void Inliner::body(std::vector<ASTNodePtr>& stmts, const size_t depth) {
+    std::vector<ASTNodePtr> result;
+    for (auto& s : stmts) {
+        if (s->type == NodeType::FUNCTION_CALL && depth < MAX_DEPTH) {
+            const auto call = std::static_pointer_cast<FunctionCallNode>(s);
+            for (auto& a : call->arguments) expr(a, depth);
+            auto expanded = expand(call, true);
+            if (expanded.empty()) {
+                result.push_back(s);
+                continue;
+            }
+            body(expanded, depth + 1);
+            result.insert(result.end(), expanded.begin(), expanded.end());
+            continue;
+        }
+        expr(s, depth);
+        result.push_back(s);
+    }
+    stmts = std::move(result);
+}
+
+void Inliner::expr(ASTNodePtr& node, const size_t depth) {
+    if (!node) return;
+    each_slot(node, [&](ASTNodePtr& n) { expr(n, depth); });
+    if (node->type == NodeType::IF_STMT) {
+        const auto n = std::static_pointer_cast<IfStmtNode>(node);
+        body(n->thenBody, depth);
+        body(n->elseBody, depth);
+    } else if (node->type == NodeType::FOR_STMT) {
+        body(std::static_pointer_cast<ForStmtNode>(node)->body, depth);
+    } else if (node->type == NodeType::FUNCTION_CALL && depth < MAX_DEPTH) {
+        const auto call = std::static_pointer_cast<FunctionCallNode>(node);
+        auto expanded = expand(call, false);
+        if (expanded.empty()) return;
+        node = expanded[0];
+        if (call->ret_type) std::static_pointer_cast<ExprNode>(node)->ret_type = call->ret_type;
+        expr(node, depth + 1);
+    }
+}
+
+std::vector<ASTNodePtr> Inliner::expand(const std::shared_ptr<FunctionCallNode>& call, const bool as_stmt) {
+    const auto it = functions.find(call->name);
+    if (it == functions.end() || call->vslot >= 0 || call->name == current) return {};
+    const auto& fn = it->second;
+    if (fn->parameters.size() != call->arguments.size() || fn->body.empty()) return {};
+    if (fn->returnType && fn->returnType->is_fat()) return {};
+    for (const auto& p : fn->parameters)
+        if (!p.type || p.type->is_fat()) return {};
+    const bool is_expr = fn->body.size() == 1 && fn->body[0]->type == NodeType::RETURN_STMT &&
+                         std::static_pointer_cast<ReturnStmtNode>(fn->body[0])->expression;
+    if (!is_expr && !(as_stmt && is_void(fn->returnType))) return {};
+
+    // 检查函数体，顺便数出每个形参用了几次
+    std::unordered_map<std::string, size_t> uses;
+    for (const auto& p : fn->parameters) uses[p.name] = 0;
+    // 在 if 的分支里用到的形参不一定被求值
+    std::unordered_set<std::string> conditional;
+    size_t count = 0;
+    bool ok = true, pure = true;
+    for (const auto& stmt : fn->body) {
+        each_node(stmt, [&](const ASTNodePtr& node) {
+            count++;
+            switch (node->type) {
+            case NodeType::IDENTIFIER: {
+                const auto& name = std::static_pointer_cast<IdentifierNode>(node)->name;
+                if (const auto u = uses.find(name); u != uses.end()) u->second++;
+                // 全局变量展开后会被同名的局部变量遮住
+                else if (locals.contains(name)) ok = false;
+                break;
+            }
+            case NodeType::RETURN_STMT:
+                ok &= is_expr;
+                break;
+            case NodeType::IF_STMT: {
+                const auto n = std::static_pointer_cast<IfStmtNode>(node);
+                for (const auto* branch : {&n->thenBody, &n->elseBody})
+                    for (const auto& b : *branch)
+                        each_node(b, [&](const ASTNodePtr& m) {
+                            if (m->type == NodeType::IDENTIFIER)
+                                conditional.insert(std::static_pointer_cast<IdentifierNode>(m)->name);
+                        });
+                break;
+            }
+            case NodeType::UNARY:
+                ok &= std::static_pointer_cast<UnaryOpNode>(node)->op == UnaryOpType::Minus;
+                break;
+            case NodeType::FUNCTION_CALL:
+                pure = false;
+                ok &= std::static_pointer_cast<FunctionCallNode>(node)->name != fn->name;
+                break;
+            case NodeType::MACRO_CALL:
+                pure &= std::static_pointer_cast<MacroCallNode>(node)->name == "load" ||
+                        std::static_pointer_cast<MacroCallNode>(node)->name == "bounds";
+                break;
+            case NodeType::VARIABLE_DECL:
+            case NodeType::ASSIGNMENT:
+            case NodeType::MEMBER_ASSIGN:
+            case NodeType::MEMBER_ACCESS:
+            case NodeType::NAME_SPACE_VISIT:
+            case NodeType::FOR_STMT:
+            case NodeType::BREAK_STMT:
+            case NodeType::CONTINUE_STMT:
+                ok = false;
+                break;
+            default:
+                break;
+            }
+        });
+    }
+    if (!ok || count > MAX_NODES) return {};
+
+    std::unordered_map<std::string, ASTNodePtr> args;
+    for (size_t i = 0; i < fn->parameters.size(); i++) {
+        const auto& a = call->arguments[i];
+        const auto& name = fn->parameters[i].name;
+        bool simple = a->type == NodeType::NUMBER || a->type == NodeType::BOOLEAN;
+        if (a->type == NodeType::IDENTIFIER) {
+            const auto& var = std::static_pointer_cast<IdentifierNode>(a)->name;
+            const auto local = locals.find(var);
+            simple = local != locals.end() && local->second && !local->second->is_fat() && !addressed.contains(var);
+        }
+        // 代入后实参恰好求值一次；没用到的实参里的 bounds! 不能跟着消失
+        if (!simple && !(pure && uses[name] == 1 && !conditional.contains(name) && is_pure(a))) return {};
+        args[name] = a;
+    }
+
+    std::vector<ASTNodePtr> result;
+    if (is_expr) {
+        result.push_back(copy_node(std::static_pointer_cast<ReturnStmtNode>(fn->body[0])->expression));
+    } else {
+        for (const auto& stmt : fn->body) result.push_back(copy_node(stmt));
+    }
+    for (auto& n : result) replace(n, args);
+    return result;
+}
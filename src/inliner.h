@@ -0,0 +1,49 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_INLINER_H
+#define POLO_COMPILER_PRE_INLINER_H
+#include "ast.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 内联：把很短的函数在调用处展开，省掉调用、传参和建立栈帧
+//   pub fn len(self: *Self) -> i64 { return load!(self + 8 as i64); }
+//   v.len()  ->  load!(v + 8 as i64)
+// 两种函数可以展开：
+//   函数体只有一条 return expr：调用换成 expr
+//   返回 void、函数体里没有 return：作为语句的调用换成函数体的语句
+// 形参直接换成实参，所以函数体不能有局部变量、赋值、循环，也不能取地址。
+// 实参是字面量或没有被取地址的局部变量时总能代入；函数体不调用函数、不写内存时，
+// 恰好用到一次、且不在 if 分支里的形参还可以代入任意不写内存的表达式，求值顺序的变化观察不到；
+// 没用到的形参对应的实参不是字面量或变量时不展开，免得丢掉实参里的 bounds! 检查。
+// 在编译期求值之后、逃逸分析之前运行；展开出来的调用继续展开，最多 MAX_DEPTH 层。
+
+class Inliner {
+public:
+    static constexpr size_t MAX_NODES = 40;     // 函数体的节点数
+    static constexpr size_t MAX_DEPTH = 4;
+
+    explicit Inliner(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    void run();
+
+private:
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_map<std::string, std::shared_ptr<FunctionNode>> functions;
+    // 正在处理的函数、它的局部变量（包括参数）和被取了地址的局部变量
+    std::string current;
+    std::unordered_map<std::string, std::shared_ptr<Type>> locals;
+    std::unordered_set<std::string> addressed;
+
+    void function(const std::shared_ptr<FunctionNode>& fn);
+    void body(std::vector<ASTNodePtr>& stmts, size_t depth);
+    void expr(ASTNodePtr& node, size_t depth);
+    // 展开 call，不能展开时返回空；as_stmt 表示调用是一条语句
+    std::vector<ASTNodePtr> expand(const std::shared_ptr<FunctionCallNode>& call, bool as_stmt);
+};
+
+#endif //POLO_COMPILER_PRE_INLINER_H
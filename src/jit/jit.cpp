@@ -0,0 +1,135 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "jit.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "../common.h"
+#include "../elf/elf_writer.h"
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+// jmp [rip + 0]; .quad addr —— 外部符号可能离 JIT 内存超过 2GB
+constexpr size_t STUB_SIZE = 16;
+
+size_t align_up(const size_t n, const size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+// perf 会读取 /tmp/perf-<pid>.map 来给 JIT 代码的采样标注符号
+void write_perf_map(const ObjectImage& image, const uint8_t* text, const uint8_t* stubs) {
+    std::ofstream map("/tmp/perf-" + std::to_string(getpid()) + ".map", std::ios::app);
+    if (!map.is_open()) return;
+    map << std::hex;
+    for (const auto& f : image.functions)
+        map << reinterpret_cast<uintptr_t>(text + f.offset) << " " << f.size << " " << f.name << "\n";
+    for (size_t i = 0; i < image.undefined.size(); i++)
+        map << reinterpret_cast<uintptr_t>(stubs + i * STUB_SIZE) << " " << STUB_SIZE << " "
+            << image.undefined[i] << "@plt\n";
+}
+
+}
+
+int run_jit(const AsmModule& module, const int argc, char** argv) {
+    const auto image = build_object_image(module);
+    if (has_err) return 1;
+
+    size_t entry = SIZE_MAX;
+    for (const auto& f : image.functions)
+        if (f.name == "main") entry = f.offset;
+    if (entry == SIZE_MAX) {
+        THROW_ERROR("JIT: no main function", 0, 0);
+        return 1;
+    }
+
+    // 布局：[.text][外部符号跳板] | [.rodata] | [.data]，三段分别设置权限
+    const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t stub_offset = align_up(image.text.size(), 16);
+    const size_t code_size = align_up(stub_offset + image.undefined.size() * STUB_SIZE, page);
+    const size_t rodata_size = align_up(std::max<size_t>(image.rodata.size(), 1), page);
+    const size_t data_size = rodata_size + align_up(image.data.size(), page);
+    void* mem = mmap(nullptr, code_size + data_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        THROW_ERROR("JIT: mmap failed", 0, 0);
+        return 1;
+    }
+    auto* base = static_cast<uint8_t*>(mem);
+    auto* stubs = base + stub_offset;
+    auto* rodata = base + code_size;
+    auto* data = rodata + rodata_size;
+    std::memcpy(base, image.text.data(), image.text.size());
+    std::memcpy(rodata, image.rodata.data(), image.rodata.size());
+    std::memcpy(data, image.data.data(), image.data.size());
+
+    std::unordered_map<std::string, uint8_t*> stub_of;
+    for (size_t i = 0; i < image.undefined.size(); i++) {
+        const auto& name = image.undefined[i];
+        void* addr = dlsym(RTLD_DEFAULT, name.c_str());
+        if (!addr) {
+            THROW_ERROR("JIT: unresolved symbol " + name, 0, 0);
+            continue;
+        }
+        uint8_t* stub = stubs + i * STUB_SIZE;
+        stub[0] = 0xFF;
+        stub[1] = 0x25;
+        std::memset(stub + 2, 0, 4);
+        std::memcpy(stub + 6, &addr, sizeof(addr));
+        stub_of[name] = stub;
+    }
+
+    for (const auto& r : image.relocs) {
+        uint8_t* at = base + r.offset;
+        const uint8_t* target = r.kind == Reloc::Kind::Call ? stub_of[r.sym]
+            : r.kind == Reloc::Kind::Data ? data
+            : r.kind == Reloc::Kind::Rodata ? rodata
+            : rodata + image.string_offsets[r.str];
+        if (!target) continue;
+        const auto disp = static_cast<int32_t>(target + r.addend - at);
+        std::memcpy(at, &disp, sizeof(disp));
+    }
+    for (const auto& r : image.rodata_relocs) {
+        uint8_t* at = rodata + r.offset;
+        const auto disp = static_cast<int32_t>(base + r.addend - at);
+        std::memcpy(at, &disp, sizeof(disp));
+    }
+    if (has_err || mprotect(base, code_size, PROT_READ | PROT_EXEC) != 0
+        || mprotect(rodata, rodata_size, PROT_READ) != 0) {
+        if (!has_err) THROW_ERROR("JIT: mprotect failed", 0, 0);
+        munmap(mem, code_size + data_size);
+        return 1;
+    }
+    write_perf_map(image, base, stubs);
+
+    using MainFn = int (*)(int, char**);
+    const auto main_fn = reinterpret_cast<MainFn>(base + entry);
+    const int rc = main_fn(argc, argv);
+    // 没有经过 libc 的退出流程，.fini_array 由这里调用
+    for (auto it = image.fini.rbegin(); it != image.fini.rend(); ++it)
+        reinterpret_cast<void (*)()>(base + *it)();
+    std::fflush(stdout);
+
+    munmap(mem, code_size + data_size);
+    return rc;
+}
+
+#else
+
+int run_jit(const AsmModule& module, const int argc, char** argv) {
+    (void)module;
+    (void)argc;
+    (void)argv;
+    THROW_ERROR("--run is only supported on Linux", 0, 0);
+    return 1;
+}
+
+#endif
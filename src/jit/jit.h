@@ -0,0 +1,13 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_JIT_H
+#define POLO_COMPILER_PRE_JIT_H
+#include "../x64/asm.h"
+
+// 把模块编码进可执行内存，用 dlsym 解析外部符号，在当前进程内调用 main
+// 返回 main 的返回值；失败时设置 has_err
+int run_jit(const AsmModule& module, int argc, char** argv);
+
+#endif //POLO_COMPILER_PRE_JIT_H
@@ -3,7 +3,7 @@
 #include <unordered_map>
 #include <utility>
 
-std::unordered_map<std::string, TokenType> keywords = {
+const std::unordered_map<std::string, TokenType> keywords = {
     {"let", TokenType::LET},
     {"const", TokenType::CONST},
     {"fn", TokenType::FN},
@@ -15,6 +15,7 @@ std::unordered_map<std::string, TokenType> keywords = {
     {"if", TokenType::IF},
     {"else", TokenType::ELSE},
     {"for", TokenType::FOR},
+    {"match", TokenType::MATCH},
     {"break", TokenType::BREAK},
     {"continue", TokenType::CONTINUE},
     {"as", TokenType::AS},
@@ -24,13 +25,22 @@ std::unordered_map<std::string, TokenType> keywords = {
     {"impl", TokenType::IMPL},
     {"pub", TokenType::PUB},
     {"static", TokenType::STATIC},
-    {"constructor", TokenType::CONSTRUCTOR}
+    {"constructor", TokenType::CONSTRUCTOR},
+    {"import", TokenType::IMPORT}
 };
 
 Lexer::Lexer(std::string  source) : source(std::move(source)) {
 }
 
 Token Lexer::getNextToken() {
+    Token token = next();
+    tokens++;
+    bytes += sizeof(Token);
+    if (token.value.capacity() > std::string().capacity()) bytes += token.value.capacity() + 1;
+    return token;
+}
+
+Token Lexer::next() {
     skipWhitespace();
     
     if (position >= source.length()) {
@@ -77,6 +87,10 @@ Token Lexer::getNextToken() {
                 advance();
                 return {TokenType::EQ, "==", line, column - 2};
             }
+            if (position < source.length() && currentChar() == '>') {
+                advance();
+                return {TokenType::FAT_ARROW, "=>", line, column - 2};
+            }
             return {TokenType::ASSIGN, "=", line, column - 1};
         case '!':
             advance();
@@ -92,6 +106,10 @@ Token Lexer::getNextToken() {
                 advance();
                 return {TokenType::LE, "<=", line, column - 2};
             }
+            if (position < source.length() && currentChar() == ':') {
+                advance();
+                return {TokenType::LT_COLON, "<:", line, column - 2};
+            }
             return {TokenType::LT, "<", line, column - 1};
         case '>':
             advance();
@@ -126,6 +144,10 @@ Token Lexer::getNextToken() {
             return {TokenType::SEMICOLON, ";", line, column - 1};
         case '.':
             advance();
+            if (position < source.length() && currentChar() == '.') {
+                advance();
+                return {TokenType::DOT_DOT, "..", line, column - 2};
+            }
             return {TokenType::DOT, ".", line, column - 1};
         case ':':
             advance();
@@ -142,6 +164,9 @@ Token Lexer::getNextToken() {
             advance();
             return {TokenType::REF, "&", line, column - 1};
         }
+        case '|':
+            advance();
+            return {TokenType::PIPE, "|", line, column - 1};
         default:
             advance();
             return {TokenType::EOF_TOKEN, std::string(1, c), line, column - 1};
@@ -150,17 +175,17 @@ Token Lexer::getNextToken() {
     return {TokenType::EOF_TOKEN, "", line, column};
 }
 
-Token Lexer::peek() const {
+Token Lexer::peek() {
+    // 读一个 token 后恢复位置；不能复制整个 Lexer，否则每次 peek 都要拷贝源码
     const size_t currentPos = position;
     const size_t currentLine = line;
     const size_t currentColumn = column;
     
-    Lexer tempLexer(source);
-    tempLexer.position = currentPos;
-    tempLexer.line = currentLine;
-    tempLexer.column = currentColumn;
-    
-    return tempLexer.getNextToken();
+    Token token = getNextToken();
+    position = currentPos;
+    line = currentLine;
+    column = currentColumn;
+    return token;
 }
 
 void Lexer::skipWhitespace() {
@@ -219,7 +244,8 @@ Token Lexer::processNumber() {
         advance();
     }
     
-    if (position < source.length() && currentChar() == '.') {
+    // `0..n` 里的点是范围，不是小数点
+    if (position + 1 < source.length() && currentChar() == '.' && isdigit(source[position + 1])) {
         isFloat = true;
         advance();
         while (position < source.length() && isdigit(currentChar())) {
@@ -50,6 +50,12 @@ enum class TokenType {
     STATIC,
     CONSTRUCTOR,
     DOT,
+    IMPORT,
+    LT_COLON,   // for x <: ...
+    DOT_DOT,
+    MATCH,
+    FAT_ARROW,  // match 的分支 =>
+    PIPE,       // 1 | 2 => ...
 };
 
 struct Token {
@@ -65,12 +71,18 @@ public:
 
     Token getNextToken();
     
-    [[nodiscard]] Token peek() const;
+    [[nodiscard]] Token peek();
+
+    // 读出过的 token 个数和它们占用的字节数（-fmem-report）
+    [[nodiscard]] size_t token_count() const { return tokens; }
+    [[nodiscard]] size_t token_bytes() const { return bytes; }
     
 private:
     std::string source;
     size_t position{0}, line{1}, column{1};
+    size_t tokens{0}, bytes{0};
     
+    Token next();
     void skipWhitespace();
     Token processIdentifier();
     Token processNumber();
@@ -1,69 +1,42 @@
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
 #include <string>
 
 #include "common.h"
-#include "lexer.h"
-#include "parser.h"
-#include "typechecker.h"
-#include "x64/x64gen.hpp"
-
-std::string readFile(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open file " << filename << std::endl;
-        exit(1);
-    }
-
-    std::string content;
-    std::string line;
-    while (std::getline(file, line)) {
-        content += line + '\n';
-    }
-
-    file.close();
-    return content;
-}
-
-void writeFile(const std::string& filename, const std::string& content) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not write to file " << filename << std::endl;
-        exit(1);
-    }
-
-    file << content;
-    file.close();
-}
+#include "driver.h"
+#include "server/server.h"
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: poloc <input_file>" << std::endl;
-        return 1;
+    // poloc --server <socket> [-j <n>]
+    if (argc >= 2 && std::string(argv[1]) == "--server") {
+        std::string socket;
+        size_t jobs = 0;
+        bool ok = true;
+        for (int i = 2; ok && i < argc; i++) {
+            const std::string arg = argv[i];
+            if (arg.starts_with("-j")) {
+                const char* n = arg.size() > 2 ? arg.c_str() + 2 : (i + 1 < argc ? argv[++i] : "");
+                jobs = std::strtoull(n, nullptr, 10);
+                ok = jobs != 0;
+            }
+            else if (socket.empty() && !arg.empty() && arg[0] != '-') socket = arg;
+            else ok = false;
+        }
+        if (!ok || socket.empty()) {
+            usage();
+            return 1;
+        }
+        return run_server(socket, jobs);
     }
 
-    std::string inputFile = argv[1];
-    std::string outputFile = inputFile.substr(0, inputFile.find_last_of('.')) + ".s";
-
-    std::string source = readFile(inputFile);
-
-    Lexer lexer(source);
-
-    Parser parser(lexer);
-    std::shared_ptr<ProgramNode> program = parser.parseProgram();
-    if (has_err) return 1;
-    TypeChecker typeChecker;
-    typeChecker.checkProgram(program);
-    if (has_err) return 1;
-    WatGen gen;
-    gen.gen(program);
-    if (has_err) return 1;
-    std::string asmCode = gen.get_output();
-
-    writeFile(outputFile, asmCode);
-
-    //std::cout << "Compilation successful!" << std::endl;
-    //std::cout << "Output file: " << outputFile << std::endl;
+    // 设置了 POLO_SERVER 时交给常驻的编译服务器，连不上就自己编译
+    if (const char* server = std::getenv("POLO_SERVER"); server && *server)
+        if (const auto rc = run_client(server, argc, argv)) return *rc;
 
-    return 0;
+    Options options;
+    if (!parse_options(argc, argv, options)) return 1;
+    add_package_env(options, std::getenv("POLO_PACKAGE_PATH"));
+    if (options.inputs.size() > 1) return compile_batch(options);
+    finish_options(options);
+    return compile(options);
 }
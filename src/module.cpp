@@ -0,0 +1,545 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "module.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "common.h"
+#include "lexer.h"
+#include "parser.h"
+#include "generics.h"
+#include "traits.h"
+#include "typechecker.h"
+#include "thread_pool.h"
+#include "cache/module_interface.h"
+#include "stats/time_trace.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string join(const std::vector<std::string>& path) {
+    std::string result;
+    for (const auto& p : path) result += (result.empty() ? "" : "::") + p;
+    return result;
+}
+
+// 模块 a::b 中的 f 改名为 a.b.f
+std::string mangle(const std::string& module, const std::string& name) {
+    std::string result;
+    for (size_t i = 0; i < module.size(); i++) {
+        if (module.compare(i, 2, "::") == 0) {
+            result += '.';
+            i++;
+        } else {
+            result += module[i];
+        }
+    }
+    return result + "." + name;
+}
+
+// 把模块里对本模块符号和 a::b::f 形式的引用改写成改名后的名字
+class Renamer {
+public:
+    Renamer(Module& module, const std::vector<Module>& modules) : module(module), modules(modules) {}
+
+    void run() {
+        for (auto& s : module.program->stmts) {
+            ASTNodePtr node = s;
+            if (node->type == NodeType::MACRO_DECL)
+                node = std::static_pointer_cast<MacroDeclNode>(node)->declaration;
+            if (node->type == NodeType::FUNCTION) {
+                const auto fn = std::static_pointer_cast<FunctionNode>(node);
+                for (const auto& p : fn->parameters) declare_local(p.name, fn);
+                body(fn->body);
+            } else if (node->type == NodeType::VARIABLE_DECL) {
+                expr(std::static_pointer_cast<VariableDeclNode>(node)->initializer);
+            }
+        }
+    }
+
+private:
+    Module& module;
+    const std::vector<Module>& modules;
+
+    [[nodiscard]] const Module::Symbol* own(const std::string& name) const {
+        const auto it = module.symbols.find(name);
+        return it == module.symbols.end() ? nullptr : &it->second;
+    }
+
+    // 局部变量不能和全局变量重名；全局变量改名后类型检查发现不了，在这里报
+    void declare_local(const std::string& name, const ASTNodePtr& at) const {
+        if (const auto* s = own(name); s && s->global && s->name != name)
+            THROW_ERROR("Variable already defined: " + name, at->line, at->col);
+    }
+
+    void body(std::vector<ASTNodePtr>& stmts) {
+        for (auto& s : stmts) stmt(s);
+    }
+
+    void stmt(ASTNodePtr& node) {
+        if (!node) return;
+        switch (node->type) {
+        case NodeType::VARIABLE_DECL: {
+            const auto decl = std::static_pointer_cast<VariableDeclNode>(node);
+            expr(decl->initializer);
+            declare_local(decl->name, decl);
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            const auto n = std::static_pointer_cast<AssignmentNode>(node);
+            if (const auto* s = own(n->name); s && s->global) n->name = s->name;
+            expr(n->value);
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            const auto n = std::static_pointer_cast<MemberAssignNode>(node);
+            expr(n->member);
+            expr(n->value);
+            break;
+        }
+        case NodeType::RETURN_STMT:
+            expr(std::static_pointer_cast<ReturnStmtNode>(node)->expression);
+            break;
+        case NodeType::IF_STMT: {
+            const auto n = std::static_pointer_cast<IfStmtNode>(node);
+            expr(n->condition);
+            body(n->thenBody);
+            body(n->elseBody);
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            const auto n = std::static_pointer_cast<ForStmtNode>(node);
+            stmt(n->init);
+            expr(n->condition);
+            stmt(n->increment);
+            body(n->body);
+            break;
+        }
+        default:
+            expr(node);
+            break;
+        }
+    }
+
+    void expr(ASTNodePtr& node) {
+        if (!node) return;
+        switch (node->type) {
+        case NodeType::IDENTIFIER: {
+            const auto n = std::static_pointer_cast<IdentifierNode>(node);
+            if (const auto* s = own(n->name); s && s->global) n->name = s->name;
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            const auto n = std::static_pointer_cast<FunctionCallNode>(node);
+            // recv.m() 的名字是方法名，由类型检查解析
+            if (const auto* s = own(n->name); s && s->function && !n->is_method) n->name = s->name;
+            for (auto& a : n->arguments) expr(a);
+            break;
+        }
+        case NodeType::MACRO_CALL:
+            for (auto& a : std::static_pointer_cast<MacroCallNode>(node)->arguments) expr(a);
+            break;
+        case NodeType::BINARY_OP: {
+            const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+            expr(n->left);
+            expr(n->right);
+            break;
+        }
+        case NodeType::UNARY:
+            expr(std::static_pointer_cast<UnaryOpNode>(node)->expr);
+            break;
+        case NodeType::MEMBER_ACCESS:
+            expr(std::static_pointer_cast<MemberAccessNode>(node)->object);
+            break;
+        case NodeType::NAME_SPACE_VISIT:
+            qualified(node);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // a::b::f(...) / a::b::x -> 改名后的调用或变量
+    void qualified(ASTNodePtr& node) {
+        std::vector<std::string> path;
+        ASTNodePtr cur = node;
+        while (cur->type == NodeType::NAME_SPACE_VISIT) {
+            const auto n = std::static_pointer_cast<NameSpaceVisitNode>(cur);
+            if (n->last->type != NodeType::IDENTIFIER) {
+                THROW_ERROR("Expected module name", n->line, n->col);
+                return;
+            }
+            path.push_back(std::static_pointer_cast<IdentifierNode>(n->last)->name);
+            cur = n->expr;
+        }
+        const std::string name = join(path);
+        const auto it = module.aliases.find(name);
+        if (it == module.aliases.end()) {
+            THROW_ERROR("Module `" + name + "` is not imported", node->line, node->col);
+            return;
+        }
+        const auto& target = modules[it->second];
+
+        std::string member;
+        if (cur->type == NodeType::FUNCTION_CALL) member = std::static_pointer_cast<FunctionCallNode>(cur)->name;
+        else if (cur->type == NodeType::IDENTIFIER) member = std::static_pointer_cast<IdentifierNode>(cur)->name;
+        else {
+            THROW_ERROR("Expected function call or variable after `" + name + "::`", cur->line, cur->col);
+            return;
+        }
+        const auto sym = target.symbols.find(member);
+        if (sym == target.symbols.end()) {
+            THROW_ERROR("`" + name + "::" + member + "` is not defined", cur->line, cur->col);
+            return;
+        }
+        if (!sym->second.is_pub) {
+            THROW_ERROR("`" + name + "::" + member + "` is not public", cur->line, cur->col);
+            return;
+        }
+
+        if (cur->type == NodeType::FUNCTION_CALL) {
+            const auto call = std::static_pointer_cast<FunctionCallNode>(cur);
+            if (!sym->second.function) {
+                THROW_ERROR("`" + name + "::" + member + "` is not a function", cur->line, cur->col);
+                return;
+            }
+            for (auto& a : call->arguments) expr(a);
+            node = std::make_shared<FunctionCallNode>(node->line, node->col, sym->second.name, call->arguments);
+        } else {
+            if (!sym->second.global) {
+                THROW_ERROR("`" + name + "::" + member + "` is not a variable", cur->line, cur->col);
+                return;
+            }
+            node = std::make_shared<IdentifierNode>(node->line, node->col, sym->second.name);
+        }
+    }
+};
+
+}
+
+std::shared_ptr<ProgramNode> ModuleLoader::load(const std::string& root) {
+    modules.clear();
+    loaded.clear();
+    modules.emplace_back().path = root;     // 入口模块没有名字
+    loaded[fs::weakly_canonical(root).string()] = 0;
+
+    const size_t threads = jobs ? jobs : std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(threads);
+
+    // 按层加载：同一层的模块互不依赖，并行解析；解析完才知道下一层要加载哪些
+    std::vector<size_t> wave{0};
+    while (!wave.empty()) {
+        pool.parallel_for(wave.size(), [&](const size_t i) {
+            open(modules[wave[i]]);
+        });
+        if (has_err) return nullptr;
+        const size_t first = modules.size();
+        for (const size_t index : wave) resolve_imports(index);
+        if (has_err) return nullptr;
+        wave.clear();
+        for (size_t i = first; i < modules.size(); i++) wave.push_back(i);
+    }
+
+    for (auto& m : modules) {
+        if (m.interface) m.symbols = m.interface->symbols;
+        else collect_symbols(m);
+    }
+    for (auto& m : modules) m.hash = m.interface ? m.interface->hash : interface_hash(m);
+    for (auto& m : modules)
+        if (m.interface) revalidate(m);
+    if (has_err) return nullptr;
+
+    pool.parallel_for(modules.size(), [&](const size_t i) {
+        if (modules[i].interface) return;
+        TimeScope scope("Rename", modules[i].path);
+        error_file = modules[i].path;
+        Renamer(modules[i], modules).run();
+        error_file.clear();
+    });
+    if (has_err) return nullptr;
+    pool.parallel_for(modules.size(), [&](const size_t i) {
+        if (!modules[i].interface) check(modules[i]);
+    });
+    if (has_err) return nullptr;
+
+    pool.parallel_for(modules.size(), [&](const size_t i) {
+        auto& m = modules[i];
+        if (m.interface) {
+            TimeScope scope("Decode interface", m.pmi);
+            m.program = m.interface->program();
+            if (!m.program) {
+                report("Error: Corrupt module interface " + m.pmi + "\n");
+                has_err = true;
+            } else if (interfaces && m.path != m.pmi) {
+                interfaces->store(m.path, m.interface);
+            }
+        } else if (i != 0 && (emit_interfaces || interfaces)) {
+            TimeScope scope("Save interface", m.path);
+            save_interface(m);
+        }
+    });
+    if (has_err) return nullptr;
+    std::shared_ptr<ProgramNode> program;
+    {
+        TimeScope scope("Merge");
+        program = merge();
+    }
+    // 合并之后再单态化，各模块对同一个泛型函数的调用共用实例
+    {
+        TimeScope scope("Monomorphize");
+        Monomorphizer(program).run();
+        if (has_err) return nullptr;
+    }
+    // 整个程序都在这里，能看到所有转换成 dyn Trait 的地方
+    TimeScope scope("Devirtualize");
+    Devirtualizer(program).run();
+    if (has_err) return nullptr;
+    return program;
+}
+
+void ModuleLoader::open(Module& module) {
+    // 先找 --server 留在内存里的接口，再找 .pmi 文件
+    std::shared_ptr<ModuleInterface> interface;
+    if (interfaces && !module.path.empty()) interface = interfaces->find(module.path);
+    if (!interface && !module.pmi.empty()) interface = ModuleInterface::open(module.pmi);
+    // 接口是用别的模块名生成的，改名结果对不上
+    if (interface && interface->name != module.name) interface.reset();
+    if (!interface) {
+        if (module.path.empty()) {
+            report("Error: Invalid module interface " + module.pmi + "\n");
+            has_err = true;
+            return;
+        }
+        parse(module);
+        return;
+    }
+    // 只有 .pmi 时用它记录的源文件检查是否过期；源文件也不在了就直接信任 .pmi
+    if (module.path.empty()) module.path = interface->source;
+    std::string text;
+    {
+        TimeScope scope("Read file", module.path);
+        std::ifstream file(module.path, std::ios::binary);
+        if (!file.is_open()) {
+            module.path = module.pmi;
+            module.interface = interface;
+            return;
+        }
+        std::ostringstream source;
+        source << file.rdbuf();
+        text = source.str();
+    }
+    if (source_hash(text) == interface->source_hash) {
+        module.source_hash = interface->source_hash;
+        module.interface = interface;
+        return;
+    }
+    parse(module, &text);
+}
+
+void ModuleLoader::parse(Module& module, const std::string* source) {
+    error_file = module.path;
+    std::string text;
+    if (!source) {
+        TimeScope scope("Read file", module.path);
+        std::ifstream file(module.path, std::ios::binary);
+        if (!file.is_open()) {
+            report("Error: Could not open file " + module.path + "\n");
+            has_err = true;
+            error_file.clear();
+            return;
+        }
+        std::ostringstream buffer;
+        buffer << file.rdbuf();
+        text = buffer.str();
+        source = &text;
+    }
+    module.source_hash = source_hash(*source);
+
+    // 词法分析由语法分析按需驱动，两者一起计时
+    TimeScope scope("Lex+Parse", module.path);
+    Lexer lexer(*source);
+    Parser parser(lexer);
+    module.program = parser.parseProgram();
+    module.tokens = lexer.token_count();
+    module.token_bytes = lexer.token_bytes();
+    error_file.clear();
+}
+
+std::pair<std::string, std::string> ModuleLoader::find(const std::vector<std::string>& path) const {
+    fs::path relative;
+    for (const auto& p : path) relative /= p;
+    std::vector<fs::path> dirs{fs::path(modules[0].path).parent_path()};
+    for (const auto& d : package_path) dirs.emplace_back(d);
+    // 源文件旁边的 .pmi 和源文件一起找到；目录里只有 a/b.pmi 时是预编译好的接口
+    auto with_interface = [](fs::path file) -> std::pair<std::string, std::string> {
+        std::error_code ec;
+        auto pmi = file;
+        if (!fs::is_regular_file(pmi.replace_extension(".pmi"), ec)) pmi.clear();
+        return {file.string(), pmi.string()};
+    };
+    for (const auto& dir : dirs) {
+        std::error_code ec;
+        if (auto file = dir / relative; fs::is_regular_file(file.replace_extension(".polo"), ec))
+            return with_interface(file);
+        if (auto file = dir / relative / "package.polo"; fs::is_regular_file(file, ec))
+            return with_interface(file);
+        if (auto file = dir / relative; fs::is_regular_file(file.replace_extension(".pmi"), ec))
+            return {"", file.string()};
+    }
+    return {};
+}
+
+void ModuleLoader::resolve_imports(const size_t index) {
+    error_file = modules[index].path;
+    if (const auto interface = modules[index].interface) {
+        for (const auto& import : interface->imports)
+            add_import(index, import.path, import.line, import.col);
+    } else {
+        for (const auto& s : modules[index].program->stmts) {
+            if (s->type != NodeType::IMPORT) continue;
+            const auto import = std::static_pointer_cast<ImportNode>(s);
+            add_import(index, import->path, import->line, import->col);
+        }
+    }
+    error_file.clear();
+}
+
+void ModuleLoader::add_import(const size_t index, const std::vector<std::string>& path, const size_t line, const size_t col) {
+    const std::string name = join(path);
+    auto [file, pmi] = find(path);
+    if (file.empty() && pmi.empty()) {
+        THROW_ERROR("Module `" + name + "` not found", line, col);
+        return;
+    }
+    const auto [it, inserted] = loaded.try_emplace(fs::weakly_canonical(file.empty() ? pmi : file).string(), modules.size());
+    if (inserted) {
+        auto& module = modules.emplace_back();
+        module.name = name;
+        module.path = file;
+        // 生成接口时总是从源码重新处理
+        if (!emit_interfaces || file.empty()) module.pmi = std::move(pmi);
+    }
+    auto& m = modules[index];
+    if (std::find(m.imports.begin(), m.imports.end(), it->second) == m.imports.end())
+        m.imports.push_back(it->second);
+    m.aliases[name] = it->second;
+    m.aliases[path.back()] = it->second;
+}
+
+// .pmi 里的改名和类型检查结果依赖导入模块的接口；有一个变了就回到源码重新处理
+void ModuleLoader::revalidate(Module& module) {
+    bool fresh = true;
+    for (const auto& import : module.interface->imports)
+        fresh &= modules[module.aliases.at(join(import.path))].hash == import.hash;
+    if (fresh) return;
+    // 打开 .pmi 时源文件已经不在了，path 指向 .pmi 本身
+    if (module.path == module.pmi) {
+        report("Error: Module interface " + module.pmi + " is out of date and its source "
+                     + module.interface->source + " is missing\n");
+        has_err = true;
+        return;
+    }
+    module.interface.reset();
+    parse(module);
+    // 源文件没变，import 列表和符号表都和 .pmi 里的一样，不用重新解析依赖
+    collect_symbols(module);
+}
+
+void ModuleLoader::save_interface(const Module& module) const {
+    auto data = serialize_interface(module, modules);
+    if (!data) return;
+    if (emit_interfaces) {
+        fs::path path;
+        if (interface_dir.empty()) {
+            path = fs::path(module.path).replace_extension(".pmi");
+        } else {
+            path = interface_dir;
+            for (size_t i = 0, next; i < module.name.size(); i = next + 2) {
+                next = std::min(module.name.find("::", i), module.name.size());
+                path /= module.name.substr(i, next - i);
+            }
+            path += ".pmi";
+        }
+        if (!write_interface(path.string(), *data))
+            report("Warning: Could not write module interface " + path.string() + "\n");
+    }
+    if (interfaces)
+        if (auto interface = ModuleInterface::load(std::move(*data))) interfaces->store(module.path, std::move(interface));
+}
+
+void ModuleLoader::collect_symbols(Module& module) {
+    // 入口模块不改名，main 和已有的单文件程序不受影响
+    const bool rename = !module.name.empty();
+    for (const auto& s : module.program->stmts) {
+        bool is_pub = std::static_pointer_cast<StmtNode>(s)->is_pub, is_extern = false;
+        ASTNodePtr node = s;
+        if (node->type == NodeType::MACRO_DECL) {
+            const auto macro = std::static_pointer_cast<MacroDeclNode>(node);
+            is_extern = macro->equations.contains("extern");
+            node = macro->declaration;
+            is_pub |= std::static_pointer_cast<StmtNode>(node)->is_pub;
+        }
+        if (node->type == NodeType::FUNCTION) {
+            const auto fn = std::static_pointer_cast<FunctionNode>(node);
+            const std::string name = fn->name;
+            if (rename && fn->has_body && !is_extern && name.find('.') == std::string::npos) fn->name = mangle(module.name, name);
+            module.symbols[name] = {fn->name, is_pub, fn, nullptr, nullptr};
+        } else if (node->type == NodeType::VARIABLE_DECL) {
+            const auto decl = std::static_pointer_cast<VariableDeclNode>(node);
+            const std::string name = decl->name;
+            if (rename) decl->name = mangle(module.name, name);
+            module.symbols[name] = {decl->name, is_pub, nullptr, decl, nullptr};
+        } else if (node->type == NodeType::TRAIT_DECL) {
+            const auto trait = std::static_pointer_cast<TraitDeclNode>(node);
+            module.symbols[trait->name] = {trait->name, is_pub, nullptr, nullptr, trait};
+        } else if (node->type == NodeType::IMPL_DECL) {
+            // 实现了哪些 trait 对导入的模块总是可见的
+            const auto impl = std::static_pointer_cast<ImplDeclNode>(node);
+            if (impl->trait_name.empty()) continue;
+            const std::string name = impl->target_type + ":" + impl->trait_name;
+            module.symbols[name] = {name, true, nullptr, nullptr, impl};
+        }
+    }
+}
+
+void ModuleLoader::check(const Module& module) {
+    TimeScope scope("Type check", module.path);
+    error_file = module.path;
+    TypeChecker checker;
+    for (const size_t i : module.imports) {
+        if (&modules[i] == &module) continue;
+        for (const auto& [name, s] : modules[i].symbols) {
+            if (!s.is_pub) continue;
+            if (s.function) checker.declareFunction(s.function);
+            else if (s.global) checker.declareGlobal(s.global);
+            else if (s.decl->type == NodeType::TRAIT_DECL) checker.declareTrait(std::static_pointer_cast<TraitDeclNode>(s.decl));
+            else checker.declareImpl(std::static_pointer_cast<ImplDeclNode>(s.decl));
+        }
+    }
+    checker.checkProgram(module.program);
+    error_file.clear();
+}
+
+std::shared_ptr<ProgramNode> ModuleLoader::merge() const {
+    // 依赖排在前面：static 初始化和编译期求值会用到被依赖模块里的定义
+    std::vector<size_t> order;
+    std::vector<bool> visited(modules.size());
+    auto visit = [&](auto&& self, const size_t i) -> void {
+        if (visited[i]) return;
+        visited[i] = true;
+        for (const size_t d : modules[i].imports) self(self, d);
+        order.push_back(i);
+    };
+    visit(visit, 0);
+
+    std::vector<ASTNodePtr> stmts;
+    for (const size_t i : order)
+        for (const auto& s : modules[i].program->stmts)
+            if (s->type != NodeType::IMPORT) stmts.push_back(s);
+    const auto& root = modules[0].program;
+    return std::make_shared<ProgramNode>(root->line, root->col, stmts);
+}
@@ -0,0 +1,84 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_MODULE_H
+#define POLO_COMPILER_PRE_MODULE_H
+#include "ast.h"
+#include "cache/codegen_cache.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 模块系统：从入口文件出发按 import 找到所有模块，每个模块只加载一次
+//   import a::b;  依次在包路径里查找 a/b.polo 和 a/b/package.polo
+//   a::b::f() 或 b::f()  调用模块 a::b 中的 pub fn f
+// 同一层互不依赖的模块并行做词法、语法分析和类型检查，最后按依赖顺序合并成一个 ProgramNode。
+// 入口模块里的名字保持不变；其他模块定义的函数和 static 变量改名为 "a.b.f"，
+// 避免不同模块的同名符号冲突。extern 函数、没有函数体的声明和方法 "类型.m" 保持原名。
+// trait 和 impl Type : Trait 也是符号，导入的模块可以直接使用。
+// 模块旁边（或包路径里）有有效的预编译接口 a/b.pmi 时直接使用，见 cache/module_interface.h。
+// 合并后为泛型函数生成实例，见 generics.h；再把能确定实际类型的 dyn 调用改成直接调用，见 traits.h。
+
+class ModuleInterface;
+class InterfaceCache;
+
+struct Module {
+    std::string name;           // "a::b"，入口模块为空
+    std::string path;           // 源文件
+    std::shared_ptr<ProgramNode> program;
+    std::vector<size_t> imports;                        // 依赖的模块
+    std::unordered_map<std::string, size_t> aliases;    // "a::b" 和 "b" -> 模块下标
+
+    struct Symbol {
+        std::string name;       // 改名后的名字
+        bool is_pub;
+        std::shared_ptr<FunctionNode> function;
+        std::shared_ptr<VariableDeclNode> global;
+        std::shared_ptr<StmtNode> decl;     // trait 或 impl Type : Trait（键为 "Type:Trait"）
+    };
+    std::unordered_map<std::string, Symbol> symbols;    // 原名 -> 符号
+
+    CacheKey source_hash;       // 源文件内容的哈希
+    CacheKey hash;              // 符号表的哈希
+    std::string pmi;            // 查找时找到的 .pmi，可能已经过期
+    // 从 .pmi 加载时非空，这时 program 到合并前才解码
+    std::shared_ptr<ModuleInterface> interface;
+    size_t tokens{0}, token_bytes{0};   // 解析时读出的 token（-fmem-report）
+};
+
+class ModuleLoader {
+public:
+    // 包路径，按顺序查找；入口文件所在目录总是最先查找
+    std::vector<std::string> package_path;
+    // 并行加载的线程数，0 表示使用全部硬件线程
+    size_t jobs{0};
+    // 为从源码加载的非入口模块写出 .pmi；interface_dir 为空时写在源文件旁边
+    bool emit_interfaces{false};
+    std::string interface_dir;
+    // 非空时在多次加载之间保留模块接口（poloc --server）
+    InterfaceCache* interfaces{nullptr};
+
+    // 加载入口文件和它依赖的全部模块，出错时设置 has_err 并返回 nullptr
+    std::shared_ptr<ProgramNode> load(const std::string& root);
+    [[nodiscard]] const std::vector<Module>& get_modules() const { return modules; }
+
+private:
+    std::vector<Module> modules;
+    std::unordered_map<std::string, size_t> loaded;     // 规范化的文件路径 -> 模块下标
+
+    void open(Module& module);
+    void parse(Module& module, const std::string* source = nullptr);
+    void resolve_imports(size_t index);
+    void add_import(size_t index, const std::vector<std::string>& path, size_t line, size_t col);
+    // 返回源文件和 .pmi 的路径，找不到的为空
+    [[nodiscard]] std::pair<std::string, std::string> find(const std::vector<std::string>& path) const;
+    void revalidate(Module& module);
+    void save_interface(const Module& module) const;
+    void collect_symbols(Module& module);
+    void check(const Module& module);
+    [[nodiscard]] std::shared_ptr<ProgramNode> merge() const;
+};
+
+#endif //POLO_COMPILER_PRE_MODULE_H
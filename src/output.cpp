@@ -0,0 +1,107 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "output.h"
+#include <cstring>
+#include "common.h"
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+OutputSink::OutputSink() : chunk(CHUNK_SIZE), os(this) {
+    setp(chunk.data(), chunk.data() + chunk.size());
+}
+
+OutputSink::~OutputSink() {
+    if (file) close();
+}
+
+bool OutputSink::open(const std::string& path_) {
+    path = path_;
+    failed = false;
+    if (path == "-") {
+        file = stdout;
+#if defined(_WIN32)
+        // 目标文件是二进制，不能让 CRT 转换换行
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    } else {
+        file = std::fopen(path.c_str(), "wb");
+    }
+    if (!file) {
+        report("Error: Could not write to file " + path + "\n");
+        has_err = true;
+        return false;
+    }
+    // 已经按块缓冲，关掉 stdio 自己的缓冲
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    return true;
+}
+
+void OutputSink::flush_chunk() {
+    const auto size = static_cast<size_t>(pptr() - pbase());
+    if (size && file && !failed && std::fwrite(pbase(), 1, size, file) != size) failed = true;
+    setp(chunk.data(), chunk.data() + chunk.size());
+}
+
+void OutputSink::write(const void* data, const size_t size) {
+    xsputn(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+}
+
+OutputSink::int_type OutputSink::overflow(const int_type ch) {
+    flush_chunk();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return failed ? traits_type::eof() : traits_type::not_eof(ch);
+}
+
+std::streamsize OutputSink::xsputn(const char* s, const std::streamsize n) {
+    auto size = static_cast<size_t>(n);
+    if (size <= static_cast<size_t>(epptr() - pptr())) {
+        std::memcpy(pptr(), s, size);
+        pbump(static_cast<int>(size));
+        return n;
+    }
+    // 放不下：先写出当前块；超过一块的大段内容直接写出
+    flush_chunk();
+    if (size >= chunk.size()) {
+        if (file && !failed && std::fwrite(s, 1, size, file) != size) failed = true;
+    } else {
+        std::memcpy(pptr(), s, size);
+        pbump(static_cast<int>(size));
+    }
+    return failed ? 0 : n;
+}
+
+int OutputSink::sync() {
+    flush_chunk();
+    if (file && std::fflush(file) != 0) failed = true;
+    return failed ? -1 : 0;
+}
+
+bool OutputSink::close() {
+    if (!file) return !failed;
+    sync();
+    if (file != stdout && std::fclose(file) != 0) failed = true;
+    file = nullptr;
+    if (failed) {
+        report("Error: Could not write to file " + path + "\n");
+        has_err = true;
+    }
+    return !failed;
+}
+
+void OutputSink::discard() {
+    if (!file) return;
+    setp(chunk.data(), chunk.data() + chunk.size());
+    if (file != stdout) {
+        std::fclose(file);
+        std::remove(path.c_str());
+    }
+    file = nullptr;
+}
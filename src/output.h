@@ -0,0 +1,49 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_OUTPUT_H
+#define POLO_COMPILER_PRE_OUTPUT_H
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// 编译结果的输出端：写入文件，路径为 "-" 时写到标准输出（可以接管道）
+// 内容先攒进固定大小的块，满了就直接写出，不在内存里拼出整个文件
+class OutputSink : public std::streambuf {
+public:
+    static constexpr size_t CHUNK_SIZE = 64 << 10;
+
+    OutputSink();
+    ~OutputSink() override;
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    // 打不开时报错并返回 false
+    bool open(const std::string& path);
+    void write(const void* data, size_t size);
+    std::ostream& stream() { return os; }
+    // 写出剩余内容并关闭，写入失败时报错并返回 false
+    bool close();
+    // 编译出错时丢弃：关闭并删除写了一半的文件
+    void discard();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    std::FILE* file{nullptr};
+    std::string path;
+    std::vector<char> chunk;
+    bool failed{false};
+    std::ostream os;
+
+    void flush_chunk();
+};
+
+#endif //POLO_COMPILER_PRE_OUTPUT_H
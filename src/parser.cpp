@@ -17,8 +17,16 @@ std::shared_ptr<ProgramNode> Parser::parseProgram() {
     
     while (currentToken.type != TokenType::EOF_TOKEN) {
         ASTNodePtr statement = parseStatement();
-        if (statement) {
-            program.push_back(statement);
+        program.insert(program.end(), lowered.begin(), lowered.end());
+        lowered.clear();
+        if (!statement) continue;
+        program.push_back(statement);
+        // impl 里的方法提到顶层，作为名为 "类型.方法" 的普通函数参与类型检查和代码生成
+        if (statement->type != NodeType::IMPL_DECL) continue;
+        for (auto& m : std::static_pointer_cast<ImplDeclNode>(statement)->methods) {
+            if (m->type != NodeType::FUNCTION) continue;
+            program.push_back(m);
+            m = std::make_shared<IdentifierNode>(m->line, m->col, std::static_pointer_cast<FunctionNode>(m)->name);
         }
     }
     
@@ -46,9 +54,26 @@ std::shared_ptr<Type> Parser::parseType() {
     if (currentToken.type != TokenType::IDENTIFIER) {
         THROW_ERROR("Expected type identifier", currentToken.line, currentToken.column);
     }
+    // dyn Trait：trait 对象
+    bool is_dyn = false;
+    if (currentToken.value == "dyn" && lexer.peek().type == TokenType::IDENTIFIER) {
+        advance();
+        is_dyn = true;
+    }
 
     std::string typeName = currentToken.value;
+    if (typeName == "Self" && !self_type.empty()) typeName = self_type;
     advance();
+    TypeKind kind = Type::fromString(typeName);
+    // 非内置类型后面的 <...> 是泛型结构体的类型实参
+    std::vector<std::shared_ptr<Type>> args;
+    if (currentToken.type == TokenType::LT && Type::to_string(kind) != typeName) {
+        advance();
+        do {
+            args.push_back(parseType());
+        } while (currentToken.type == TokenType::COMMA && (advance(), true));
+        expect(TokenType::GT);
+    }
     if (currentToken.type == TokenType::LBRACKET) {
         advance();
         if (currentToken.type == TokenType::NUM) {
@@ -58,16 +83,26 @@ std::shared_ptr<Type> Parser::parseType() {
         expect(TokenType::RBRACKET);
         is_arr = true;
     }
-    TypeKind kind = Type::fromString(typeName);
     auto result = std::make_shared<Type>(kind, is_ptr);;
     result->is_arr = is_arr;
+    result->is_dyn = is_dyn;
+    result->args = std::move(args);
+    // 结构体等非内置类型保留名字，size_of! 要按名字找到声明
+    if (Type::to_string(kind) != typeName) result->name = typeName;
     return result;
 }
 
 ASTNodePtr Parser::parseStatement() {
     switch (currentToken.type) {
         case TokenType::LET:
+        case TokenType::CONST:
             return parseVariableDecl();
+        case TokenType::STATIC: {
+            advance();
+            auto decl = parseVariableDecl();
+            decl->is_static = true;
+            return decl;
+        }
         case TokenType::FN:
             return parseFunction();
         case TokenType::RETURN:
@@ -76,6 +111,8 @@ ASTNodePtr Parser::parseStatement() {
             return parseIfStmt();
         case TokenType::FOR:
             return parseForStmt();
+        case TokenType::MATCH:
+            return parseMatchStmt();
         case TokenType::BREAK:
             return parseBreakStmt();
         case TokenType::CONTINUE:
@@ -92,8 +129,12 @@ ASTNodePtr Parser::parseStatement() {
             return parseStructDecl();
         case TokenType::IMPL:
             return parseImplDecl();
+        case TokenType::TRAIT:
+            return parseTraitDecl();
         case TokenType::CONSTRUCTOR:
             return parseConstructorDecl();
+        case TokenType::IMPORT:
+            return parseImport();
         default:
             ASTNodePtr expr = parseAssignment();
             expect(TokenType::SEMICOLON);
@@ -101,15 +142,27 @@ ASTNodePtr Parser::parseStatement() {
     }
 }
 
+// 语句块里的一条语句；范围 for 展开出的准备语句放在它前面
+void Parser::parseBlockStatement(std::vector<ASTNodePtr>& stmts) {
+    ASTNodePtr stmt = parseStatement();
+    stmts.insert(stmts.end(), lowered.begin(), lowered.end());
+    lowered.clear();
+    if (stmt) stmts.push_back(stmt);
+}
+
 std::shared_ptr<VariableDeclNode> Parser::parseVariableDecl() {
     auto line = currentToken.line, col = currentToken.column;
-    expect(TokenType::LET);
+    const bool is_const = currentToken.type == TokenType::CONST;
+    if (is_const) advance();
+    else expect(TokenType::LET);
 
     if (currentToken.type != TokenType::IDENTIFIER) {
-        THROW_ERROR("Expected identifier after let", currentToken.line, currentToken.column);
+        THROW_ERROR(std::string("Expected identifier after ") + (is_const ? "const" : "let"), currentToken.line, currentToken.column);
     }
 
     std::string name = currentToken.value;
+    if (range_vars.contains(name))
+        THROW_ERROR("`" + name + "` is already the variable of an enclosing range for", currentToken.line, currentToken.column);
     advance();
     
     expect(TokenType::COLON);
@@ -121,7 +174,9 @@ std::shared_ptr<VariableDeclNode> Parser::parseVariableDecl() {
     ASTNodePtr initializer = parseExpression();
     expect(TokenType::SEMICOLON);
     
-    return std::make_shared<VariableDeclNode>(line, col, name, type, initializer);
+    auto decl = std::make_shared<VariableDeclNode>(line, col, name, type, initializer);
+    decl->is_const = is_const;
+    return decl;
 }
 std::vector<Parameter> Parser::parseFunctionArgs() {
     expect(TokenType::LPAREN);
@@ -147,6 +202,22 @@ std::vector<Parameter> Parser::parseFunctionArgs() {
     expect(TokenType::RPAREN);
     return parameters;
 }
+// <T, U>，没有时返回空
+std::vector<std::string> Parser::parseTypeParams() {
+    std::vector<std::string> params;
+    if (currentToken.type != TokenType::LT) return params;
+    advance();
+    do {
+        if (currentToken.type != TokenType::IDENTIFIER) {
+            THROW_ERROR("Expected type parameter name", currentToken.line, currentToken.column);
+            break;
+        }
+        params.push_back(currentToken.value);
+        advance();
+    } while (currentToken.type == TokenType::COMMA && (advance(), true));
+    expect(TokenType::GT);
+    return params;
+}
 std::shared_ptr<FunctionNode> Parser::parseFunction() {
     auto line = currentToken.line, col = currentToken.column;
     expect(TokenType::FN);
@@ -158,6 +229,7 @@ std::shared_ptr<FunctionNode> Parser::parseFunction() {
     std::string name = currentToken.value;
     advance();
 
+    auto type_params = parseTypeParams();
     auto parameters = parseFunctionArgs();
     
     auto returnType = std::make_shared<Type>(TypeKind::I32);
@@ -168,6 +240,8 @@ std::shared_ptr<FunctionNode> Parser::parseFunction() {
 
     std::vector<ASTNodePtr> body;
     if (currentToken.type == TokenType::SEMICOLON) {
+        if (!type_params.empty())
+            THROW_ERROR("Generic function `" + name + "` must have a body", line, col);
         advance();
         auto f = std::make_shared<FunctionNode>(line, col, name, parameters, returnType, body);
         f->has_body = false;
@@ -176,16 +250,14 @@ std::shared_ptr<FunctionNode> Parser::parseFunction() {
     expect(TokenType::LBRACE);
     
 
-    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
-        ASTNodePtr statement = parseStatement();
-        if (statement) {
-            body.push_back(statement);
-        }
-    }
+    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+        parseBlockStatement(body);
     
     expect(TokenType::RBRACE);
     
-    return std::make_shared<FunctionNode>(line, col, name, parameters, returnType, body);
+    auto f = std::make_shared<FunctionNode>(line, col, name, parameters, returnType, body);
+    f->type_params = std::move(type_params);
+    return f;
 }
 
 std::shared_ptr<ReturnStmtNode> Parser::parseReturnStmt() {
@@ -244,6 +316,9 @@ BinaryOpType Parser::tokenType2opType(TokenType type) const {
     case TokenType::OR:
         op = BinaryOpType::OR;
         break;
+    case TokenType::REF:
+        op = BinaryOpType::BIT_AND;
+        break;
     default:
         THROW_ERROR("Unknown binary operator", currentToken.line, currentToken.column);
 
@@ -263,7 +338,10 @@ BinaryOpType Parser::tokenType2opType(TokenType type) const {
     if (currentToken.type == TokenType::AS) {\
         advance();\
         auto n = std::static_pointer_cast<ExprNode>(node);\
-        n->set_ret_type(parseType());\
+        auto type = parseType();\
+        /* 转换成 trait 对象不只是改类型，要带上虚表 */\
+        if (type->is_dyn) n = std::make_shared<UnaryOpNode>(line, col, UnaryOpType::Dyn, node);\
+        n->set_ret_type(type);\
         node = n;\
     }\
     return node;
@@ -274,7 +352,7 @@ ASTNodePtr Parser::parseBoolAndOr() {
     PARSE_BASE_BINOP(parseBoolOper, while, currentToken.type == TokenType::AND || currentToken.type == TokenType::OR)
 }
 ASTNodePtr Parser::parseBoolOper() {
-    PARSE_BASE_BINOP(parseAddSub, while,
+    PARSE_BASE_BINOP(parseBitAnd, while,
         currentToken.type == TokenType::EQ ||
         currentToken.type == TokenType::NE ||
         currentToken.type == TokenType::LT ||
@@ -301,6 +379,10 @@ ASTNodePtr Parser::parseAssignment() {
 }
 
 
+// 前面已经有操作数，& 只能是按位与，不会和取地址混淆；优先级低于加减、高于比较
+ASTNodePtr Parser::parseBitAnd() {
+    PARSE_BASE_BINOP(parseAddSub, while, currentToken.type == TokenType::REF)
+}
 ASTNodePtr Parser::parseAddSub() {
     PARSE_BASE_BINOP(parseMulDivMod, while, currentToken.type == TokenType::PLUS || currentToken.type == TokenType::MINUS)
 }
@@ -334,7 +416,7 @@ ASTNodePtr Parser::parsePrimary() {
             if (lexer.peek().type == TokenType::COL_COLON)
                 return parseNameSpaceVisit();
 
-            return parseIdentifier();
+            return parseVariable();
 
         }
         case TokenType::MINUS: {
@@ -418,6 +500,13 @@ std::shared_ptr<IdentifierNode> Parser::parseIdentifier() {
     return std::make_shared<IdentifierNode>(line, col, name);
 }
 
+// 用作值的标识符；范围 for 的循环变量换成改名后的名字
+std::shared_ptr<IdentifierNode> Parser::parseVariable() {
+    auto id = parseIdentifier();
+    if (const auto it = range_vars.find(id->name); it != range_vars.end()) id->name = it->second;
+    return id;
+}
+
 std::shared_ptr<NumberNode> Parser::parseNumber() {
     auto line = currentToken.line, col = currentToken.column;
     if (currentToken.type != TokenType::NUM) {
@@ -471,12 +560,8 @@ std::shared_ptr<IfStmtNode> Parser::parseIfStmt() {
     
     expect(TokenType::LBRACE);
     std::vector<ASTNodePtr> thenBody;
-    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
-        ASTNodePtr stmt = parseStatement();
-        if (stmt) {
-            thenBody.push_back(stmt);
-        }
-    }
+    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+        parseBlockStatement(thenBody);
     expect(TokenType::RBRACE);
     
     std::vector<ASTNodePtr> elseBody;
@@ -487,12 +572,8 @@ std::shared_ptr<IfStmtNode> Parser::parseIfStmt() {
             return std::make_shared<IfStmtNode>(line, col, condition, thenBody, elseBody);
         }
         expect(TokenType::LBRACE);
-        while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
-            ASTNodePtr stmt = parseStatement();
-            if (stmt) {
-                elseBody.push_back(stmt);
-            }
-        }
+        while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+            parseBlockStatement(elseBody);
         expect(TokenType::RBRACE);
     }
     
@@ -502,6 +583,8 @@ std::shared_ptr<IfStmtNode> Parser::parseIfStmt() {
 std::shared_ptr<ForStmtNode> Parser::parseForStmt() {
     auto line = currentToken.line, col = currentToken.column;
     expect(TokenType::FOR);
+    if (currentToken.type == TokenType::IDENTIFIER && lexer.peek().type == TokenType::LT_COLON)
+        return parseRangeFor(line, col);
     
     ASTNodePtr init = nullptr;
     ASTNodePtr condition = nullptr;
@@ -514,16 +597,243 @@ std::shared_ptr<ForStmtNode> Parser::parseForStmt() {
         condition = parseExpression();
     }
     
+    expect(TokenType::LBRACE);
+    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+        parseBlockStatement(body);
+    expect(TokenType::RBRACE);
+    
+    return std::make_shared<ForStmtNode>(line, col, init, condition, increment, body);
+}
+
+// for x <: lo..hi [: T] { ... }
+// for x <: [a, b, ...] [: T[]] { ... }
+// for x <: slice!(ptr, len) [: T[]] { ... }
+// 展开成计数循环：x 改名成 x.N，循环前的准备语句放进 lowered。
+// 范围的类型取标注，其次取带 `as` 的非字面量端点，默认 i64；每轮 x = x + 1。
+// 数组和切片按每个元素 8 字节遍历指针 p.N，循环体开头 let x: T = load!(p.N)；
+// 元素全是整数字面量的数组用 rodata! 放在 .rodata 里，否则用 stack_alloc! 在栈上逐个写入
+std::shared_ptr<ForStmtNode> Parser::parseRangeFor(const size_t line, const size_t col) {
+    const std::string name = currentToken.value;
+    advance();
+    expect(TokenType::LT_COLON);
+    const auto suffix = "." + std::to_string(range_count++);
+    const std::string var = name + suffix, end = "end" + suffix, ptr = "p" + suffix;
+
+    const auto i64 = std::make_shared<Type>(TypeKind::I64);
+    const auto number = [&](const int64_t value, const std::shared_ptr<Type>& type) {
+        auto n = std::make_shared<NumberNode>(line, col, value);
+        n->set_ret_type(type);
+        return n;
+    };
+    const auto ident = [&](const std::string& n) { return std::make_shared<IdentifierNode>(line, col, n); };
+    const auto add = [&](ASTNodePtr a, ASTNodePtr b) {
+        return std::make_shared<BinaryOpNode>(line, col, std::move(a), BinaryOpType::ADD, std::move(b));
+    };
+    const auto let = [&](const std::string& n, const std::shared_ptr<Type>& type, ASTNodePtr init) {
+        return std::make_shared<VariableDeclNode>(line, col, n, type, std::move(init));
+    };
+    const auto element_type = [&] {
+        if (currentToken.type != TokenType::COLON) return i64;
+        advance();
+        auto type = parseType();
+        type->is_arr = false;
+        return type;
+    };
+
+    std::vector<ASTNodePtr> prelude;
+    ASTNodePtr condition, increment;
+    std::shared_ptr<Type> type;     // 数组和切片的元素类型；为空时是整数范围
+    if (currentToken.type == TokenType::LBRACKET) {
+        advance();
+        std::vector<ASTNodePtr> items;
+        if (currentToken.type != TokenType::RBRACKET) {
+            do {
+                items.push_back(parseExpression());
+            } while (currentToken.type == TokenType::COMMA && (advance(), true));
+        }
+        expect(TokenType::RBRACKET);
+        type = element_type();
+        // 整数字面量（包括取负）直接放进表里
+        std::vector<ASTNodePtr> table;
+        for (const auto& item : items) {
+            if (item->type == NodeType::NUMBER) {
+                table.push_back(number(std::static_pointer_cast<NumberNode>(item)->value, i64));
+            } else if (item->type == NodeType::UNARY && std::static_pointer_cast<UnaryOpNode>(item)->op == UnaryOpType::Minus &&
+                       std::static_pointer_cast<UnaryOpNode>(item)->expr->type == NodeType::NUMBER) {
+                table.push_back(number(-std::static_pointer_cast<NumberNode>(std::static_pointer_cast<UnaryOpNode>(item)->expr)->value, i64));
+            } else {
+                break;
+            }
+        }
+        const auto size = static_cast<int64_t>(items.size()) * 8;
+        if (table.size() == items.size()) {
+            prelude.push_back(let(ptr, i64, std::make_shared<MacroCallNode>(line, col, "rodata", table)));
+        } else {
+            prelude.push_back(let(ptr, i64, std::make_shared<MacroCallNode>(line, col, "stack_alloc",
+                                                                            std::vector<ASTNodePtr>{number(size, i64)})));
+            for (size_t j = 0; j < items.size(); j++) {
+                if (items[j]->type == NodeType::NUMBER) std::static_pointer_cast<ExprNode>(items[j])->set_ret_type(type);
+                ASTNodePtr address = ident(ptr);
+                if (j) address = add(address, number(static_cast<int64_t>(j) * 8, i64));
+                prelude.push_back(std::make_shared<MacroCallNode>(line, col, "store", std::vector{address, items[j]}));
+            }
+        }
+        prelude.push_back(let(end, i64, add(ident(ptr), number(size, i64))));
+    } else {
+        auto first = parseExpression();
+        if (currentToken.type == TokenType::DOT_DOT) {
+            advance();
+            auto last = parseExpression();
+            std::shared_ptr<Type> range_type;
+            if (currentToken.type == TokenType::COLON) {
+                advance();
+                range_type = parseType();
+            } else {
+                for (const auto& n : {first, last})
+                    if (n->type != NodeType::NUMBER && std::static_pointer_cast<ExprNode>(n)->ret_type && !range_type)
+                        range_type = std::static_pointer_cast<ExprNode>(n)->ret_type->clone();
+                if (!range_type) range_type = i64;
+            }
+            for (const auto& n : {first, last})
+                if (n->type == NodeType::NUMBER) std::static_pointer_cast<ExprNode>(n)->set_ret_type(range_type);
+            prelude.push_back(let(var, range_type, first));
+            if (last->type != NodeType::NUMBER) {
+                prelude.push_back(let(end, range_type, last));
+                last = ident(end);
+            }
+            condition = std::make_shared<BinaryOpNode>(line, col, ident(var), BinaryOpType::LT, last);
+            increment = std::make_shared<AssignmentNode>(line, col, var, add(ident(var), number(1, range_type)));
+        } else if (first->type == NodeType::MACRO_CALL && std::static_pointer_cast<MacroCallNode>(first)->name == "slice" &&
+                   std::static_pointer_cast<MacroCallNode>(first)->arguments.size() == 2) {
+            const auto& args = std::static_pointer_cast<MacroCallNode>(first)->arguments;
+            std::static_pointer_cast<ExprNode>(args[0])->set_ret_type(i64);
+            type = element_type();
+            prelude.push_back(let(ptr, i64, args[0]));
+            prelude.push_back(let(end, i64, add(ident(ptr), std::make_shared<BinaryOpNode>(
+                line, col, args[1], BinaryOpType::MUL, number(8, i64)))));
+        } else {
+            THROW_ERROR("Expected a range, an array literal or slice!(ptr, len) after `<:`", line, col);
+        }
+    }
+    if (type) {
+        condition = std::make_shared<BinaryOpNode>(line, col, ident(ptr), BinaryOpType::LT, ident(end));
+        increment = std::make_shared<AssignmentNode>(line, col, ptr, add(ident(ptr), number(8, i64)));
+    }
+
+    // 循环体里 x 指改名后的变量；同名的外层范围 for 在循环之后恢复
+    const auto outer = range_vars.find(name) != range_vars.end() ? range_vars[name] : std::string{};
+    range_vars[name] = var;
+    std::vector<ASTNodePtr> body;
+    if (type) {
+        auto load = std::make_shared<MacroCallNode>(line, col, "load", std::vector<ASTNodePtr>{ident(ptr)});
+        load->set_ret_type(type);
+        body.push_back(let(var, type, load));
+    }
+    expect(TokenType::LBRACE);
+    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+        parseBlockStatement(body);
+    expect(TokenType::RBRACE);
+    if (outer.empty()) range_vars.erase(name);
+    else range_vars[name] = outer;
+
+    lowered.insert(lowered.end(), prelude.begin(), prelude.end());
+    return std::make_shared<ForStmtNode>(line, col, nullptr, condition, increment, body);
+}
+
+// match e { 1 => { ... } 2 | 3 => { ... } _ => { ... } }
+// 展开成 if e == 1 { ... } else if e == 2 or e == 3 { ... } else { ... }，按顺序第一个匹配的分支执行，
+// 代码生成把这种链按取值分派。e 不是变量时先存进 match.N（按 i64，或 e 上 `as` 的类型）。
+// 分支是语句块或一条语句，后面可以跟逗号；_ 必须是最后一个分支
+std::shared_ptr<IfStmtNode> Parser::parseMatchStmt() {
+    auto line = currentToken.line, col = currentToken.column;
+    expect(TokenType::MATCH);
+    ASTNodePtr value = parseExpression();
+    std::string var;
+    ASTNodePtr prelude;
+    if (value->type == NodeType::IDENTIFIER && !std::static_pointer_cast<IdentifierNode>(value)->ret_type) {
+        var = std::static_pointer_cast<IdentifierNode>(value)->name;
+    } else {
+        var = "match." + std::to_string(match_count++);
+        std::shared_ptr<Type> type;
+        if (value->type != NodeType::NAME_SPACE_VISIT) {
+            const auto expr = std::static_pointer_cast<ExprNode>(value);
+            if (!expr->ret_type) expr->set_ret_type(std::make_shared<Type>(TypeKind::I64));
+            type = expr->ret_type->clone();
+        } else {
+            type = std::make_shared<Type>(TypeKind::I64);
+        }
+        prelude = std::make_shared<VariableDeclNode>(line, col, var, type, value);
+    }
+
+    struct Arm {
+        ASTNodePtr condition;       // 为空时是 _
+        std::vector<ASTNodePtr> body;
+    };
+    std::vector<Arm> arms;
     expect(TokenType::LBRACE);
     while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
-        ASTNodePtr stmt = parseStatement();
-        if (stmt) {
-            body.push_back(stmt);
+        const auto arm_line = currentToken.line, arm_col = currentToken.column;
+        if (!arms.empty() && !arms.back().condition)
+            THROW_ERROR("`_` must be the last arm of match", arm_line, arm_col);
+        Arm arm;
+        if (currentToken.type == TokenType::IDENTIFIER && currentToken.value == "_") {
+            advance();
+        } else {
+            do {
+                ASTNodePtr test = std::make_shared<BinaryOpNode>(currentToken.line, currentToken.column,
+                    std::make_shared<IdentifierNode>(line, col, var), BinaryOpType::EQ, parseExpression());
+                arm.condition = arm.condition
+                    ? std::make_shared<BinaryOpNode>(arm_line, arm_col, arm.condition, BinaryOpType::OR, test)
+                    : test;
+            } while (currentToken.type == TokenType::PIPE && (advance(), true));
+        }
+        expect(TokenType::FAT_ARROW);
+        if (currentToken.type == TokenType::LBRACE) {
+            advance();
+            while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
+                parseBlockStatement(arm.body);
+            expect(TokenType::RBRACE);
+        } else {
+            parseBlockStatement(arm.body);
         }
+        if (currentToken.type == TokenType::COMMA) advance();
+        arms.push_back(std::move(arm));
     }
     expect(TokenType::RBRACE);
-    
-    return std::make_shared<ForStmtNode>(line, col, init, condition, increment, body);
+    // 分支里的语句块会先取走 lowered，准备语句等分支解析完再放进去
+    if (prelude) lowered.push_back(prelude);
+
+    // 从最后一个分支往前套成 else if 链；只有 _ 时是 if true { ... }
+    std::vector<ASTNodePtr> otherwise;
+    if (!arms.empty() && !arms.back().condition) {
+        otherwise = std::move(arms.back().body);
+        arms.pop_back();
+    }
+    if (arms.empty())
+        return std::make_shared<IfStmtNode>(line, col, std::make_shared<BooleanNode>(line, col, true), otherwise,
+                                            std::vector<ASTNodePtr>{});
+    std::shared_ptr<IfStmtNode> chain;
+    for (auto it = arms.rbegin(); it != arms.rend(); ++it) {
+        chain = std::make_shared<IfStmtNode>(line, col, it->condition, it->body, otherwise);
+        otherwise = {chain};
+    }
+    return chain;
+}
+
+std::shared_ptr<ImportNode> Parser::parseImport() {
+    auto line = currentToken.line, col = currentToken.column;
+    expect(TokenType::IMPORT);
+    std::vector<std::string> path;
+    do {
+        if (currentToken.type != TokenType::IDENTIFIER) {
+            THROW_ERROR("Expected module name", currentToken.line, currentToken.column);
+            break;
+        }
+        path.push_back(currentToken.value);
+        advance();
+    } while (currentToken.type == TokenType::COL_COLON && (advance(), true));
+    expect(TokenType::SEMICOLON);
+    return std::make_shared<ImportNode>(line, col, path);
 }
 
 std::shared_ptr<ASTNode> Parser::parseBreakStmt() {
@@ -547,6 +857,14 @@ std::shared_ptr<MacroCallNode> Parser::parseMacroCall() {
     expect(TokenType::NOT);
     expect(TokenType::LPAREN);
     
+    // size_of!(T) / align_of!(T) 的参数是类型
+    if (name == "size_of" || name == "align_of") {
+        auto macro = std::make_shared<MacroCallNode>(line, col, name, std::vector<ASTNodePtr>{});
+        macro->type_arg = parseType();
+        expect(TokenType::RPAREN);
+        return macro;
+    }
+
     std::vector<ASTNodePtr> arguments;
     if (currentToken.type != TokenType::RPAREN) {
         do {
@@ -597,7 +915,9 @@ std::shared_ptr<StructDeclNode> Parser::parseStructDecl() {
     }
 
     std::string name = currentToken.value;
+    last_struct = name;
     advance();
+    auto type_params = parseTypeParams();
 
     expect(TokenType::LBRACE);
 
@@ -611,6 +931,7 @@ std::shared_ptr<StructDeclNode> Parser::parseStructDecl() {
 
     auto struct_decl = std::make_shared<StructDeclNode>(line, col, name, fields);
     struct_decl->is_public = is_public;
+    struct_decl->type_params = std::move(type_params);
     return struct_decl;
 }
 
@@ -637,28 +958,84 @@ std::shared_ptr<ImplDeclNode> Parser::parseImplDecl() {
     auto line = currentToken.line, col = currentToken.column;
     expect(TokenType::IMPL);
 
-    std::string target_type;
+    // impl Type { ... }、impl Type : Trait { ... }；紧跟在结构体后面时类型名可以省略：
+    // struct S { ... } impl { ... }、struct S { ... } impl as Trait { ... }
+    std::string target_type = last_struct, trait_name;
+    if (currentToken.type == TokenType::IDENTIFIER) {
+        target_type = currentToken.value;
+        advance();
+    }
+    if (target_type.empty()) {
+        THROW_ERROR("Expected type name", currentToken.line, currentToken.column);
+    }
+    if (currentToken.type == TokenType::COLON || currentToken.type == TokenType::AS) {
+        advance();
+        if (currentToken.type != TokenType::IDENTIFIER) {
+            THROW_ERROR("Expected trait name", currentToken.line, currentToken.column);
+        }
+        trait_name = currentToken.value;
+        advance();
+    }
+
+    expect(TokenType::LBRACE);
+
+    const auto saved = self_type;
+    self_type = target_type;
+    std::vector<ASTNodePtr> methods;
+    while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
+        auto decl = parseStatement();
+        if (decl && decl->type == NodeType::FUNCTION) {
+            // 方法改名为 "类型.方法"；trait 的方法和 trait 一样是公开的
+            const auto fn = std::static_pointer_cast<FunctionNode>(decl);
+            fn->name = target_type + "." + fn->name;
+            if (!trait_name.empty()) fn->is_pub = true;
+            methods.push_back(decl);
+        } else if (decl && decl->type == NodeType::CONSTRUCTOR_DECL) {
+            methods.push_back(decl);
+        } else {
+            THROW_ERROR("Expected method or constructor declaration", currentToken.line, currentToken.column);
+        }
+    }
+    self_type = saved;
+
+    expect(TokenType::RBRACE);
+
+    auto impl = std::make_shared<ImplDeclNode>(line, col, target_type, methods);
+    impl->trait_name = std::move(trait_name);
+    return impl;
+}
+
+std::shared_ptr<TraitDeclNode> Parser::parseTraitDecl() {
+    auto line = currentToken.line, col = currentToken.column;
+    expect(TokenType::TRAIT);
 
-    // 解析目标类型
     if (currentToken.type != TokenType::IDENTIFIER) {
-        THROW_ERROR("Expected type name", currentToken.line, currentToken.column);
+        THROW_ERROR("Expected trait name", currentToken.line, currentToken.column);
     }
-    target_type = currentToken.value;
+    std::string name = currentToken.value;
     advance();
+    if (currentToken.type == TokenType::LT) {
+        THROW_ERROR("Generic trait `" + name + "` is not supported", currentToken.line, currentToken.column);
+        parseTypeParams();
+    }
 
     expect(TokenType::LBRACE);
 
-    std::vector<ASTNodePtr> methods;
+    std::vector<std::shared_ptr<FunctionNode>> methods;
     while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN) {
-        if (auto decl = parseStatement();
-            decl && (decl->type == NodeType::FUNCTION || decl->type == NodeType::CONSTRUCTOR_DECL))
-                methods.push_back(decl);
-        else THROW_ERROR("Expected method or constructor declaration", currentToken.line, currentToken.column);
+        if (currentToken.type != TokenType::FN) {
+            THROW_ERROR("Expected method declaration", currentToken.line, currentToken.column);
+            break;
+        }
+        auto fn = parseFunction();
+        if (fn->has_body)
+            THROW_ERROR("Trait method `" + name + "." + fn->name + "` cannot have a body", fn->line, fn->col);
+        methods.push_back(fn);
     }
 
     expect(TokenType::RBRACE);
 
-    return std::make_shared<ImplDeclNode>(line, col, target_type, methods);
+    return std::make_shared<TraitDeclNode>(line, col, name, methods);
 }
 
 
@@ -674,31 +1051,31 @@ std::shared_ptr<ConstructorDeclNode> Parser::parseConstructorDecl() {
 
     std::vector<ASTNodePtr> body;
     while (currentToken.type != TokenType::RBRACE && currentToken.type != TokenType::EOF_TOKEN)
-        if (ASTNodePtr statement = parseStatement()) body.push_back(statement);
+        parseBlockStatement(body);
 
     expect(TokenType::RBRACE);
 
     return std::make_shared<ConstructorDeclNode>(line, col, parameters, body);
 }
 
-std::shared_ptr<MemberAccessNode> Parser::parseMemberAccess() {
-    auto var = parseIdentifier();
-    auto line = currentToken.line, col = currentToken.column;
-    if (currentToken.type != TokenType::DOT)
-        THROW_ERROR("Expected member access", currentToken.line, currentToken.column);
-
-    advance();
-    if (currentToken.type != TokenType::IDENTIFIER)
-        THROW_ERROR("Expected member name", currentToken.line, currentToken.column);
-    auto node = std::make_shared<MemberAccessNode>(line, col, var, parsePrimary());
-
-    if (currentToken.type == TokenType::DOT) {
+ASTNodePtr Parser::parseMemberAccess() {
+    ASTNodePtr node = parseVariable();
+    while (currentToken.type == TokenType::DOT) {
         advance();
-        line = currentToken.line, col = currentToken.column;
-        if (currentToken.type != TokenType::IDENTIFIER)
+        auto line = currentToken.line, col = currentToken.column;
+        if (currentToken.type != TokenType::IDENTIFIER) {
             THROW_ERROR("Expected member name", currentToken.line, currentToken.column);
-
-        node = std::make_shared<MemberAccessNode>(line, col, node, parsePrimary());
+            break;
+        }
+        if (lexer.peek().type == TokenType::LPAREN) {
+            // recv.m(args)：方法调用，接收者作为第一个参数
+            auto call = parseFunctionCall();
+            call->arguments.insert(call->arguments.begin(), node);
+            call->is_method = true;
+            node = call;
+        } else {
+            node = std::make_shared<MemberAccessNode>(line, col, node, parseIdentifier());
+        }
     }
     return node;
 }
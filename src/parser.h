@@ -4,6 +4,7 @@
 #include "lexer.h"
 #include "ast.h"
 #include <memory>
+#include <unordered_map>
 
 class Parser {
 public:
@@ -14,17 +15,25 @@ public:
 private:
     Lexer& lexer;
     Token currentToken;
+    std::string last_struct;    // struct S { ... } impl { ... } 的 impl 省略类型名
+    std::string self_type;      // 解析 impl 时 Self 代表的类型
+    std::unordered_map<std::string, std::string> range_vars;   // 范围 for 的循环变量 -> 改名后的名字
+    std::vector<ASTNodePtr> lowered;    // 范围 for、match 展开出的准备语句，由所在的语句块插在语句前面
+    size_t range_count{0}, match_count{0};
     
     void advance();
     void expect(TokenType type);
     std::shared_ptr<Type> parseType();
     
     ASTNodePtr parseStatement();
+    void parseBlockStatement(std::vector<ASTNodePtr>& stmts);
     std::shared_ptr<VariableDeclNode> parseVariableDecl();
 
     std::vector<Parameter> parseFunctionArgs();
+    std::vector<std::string> parseTypeParams();
 
     std::shared_ptr<FunctionNode> parseFunction();
+    std::shared_ptr<ImportNode> parseImport();
     std::shared_ptr<ReturnStmtNode> parseReturnStmt();
     [[nodiscard]] BinaryOpType tokenType2opType(TokenType type) const;
 
@@ -36,6 +45,8 @@ private:
 
     ASTNodePtr parseAssignment();
 
+    ASTNodePtr parseBitAnd();
+
     ASTNodePtr parseAddSub();
 
     ASTNodePtr parseMulDivMod();
@@ -48,6 +59,7 @@ private:
 
     std::shared_ptr<FunctionCallNode> parseFunctionCall();
     std::shared_ptr<IdentifierNode> parseIdentifier();
+    std::shared_ptr<IdentifierNode> parseVariable();
     std::shared_ptr<NumberNode> parseNumber();
     std::shared_ptr<FloatNode> parseFloat();
     std::shared_ptr<BooleanNode> parseBoolean();
@@ -55,6 +67,8 @@ private:
     
     std::shared_ptr<IfStmtNode> parseIfStmt();
     std::shared_ptr<ForStmtNode> parseForStmt();
+    std::shared_ptr<ForStmtNode> parseRangeFor(size_t line, size_t col);
+    std::shared_ptr<IfStmtNode> parseMatchStmt();
     std::shared_ptr<ASTNode> parseBreakStmt();
     std::shared_ptr<ASTNode> parseContinueStmt();
     std::shared_ptr<MacroCallNode> parseMacroCall();
@@ -63,8 +77,9 @@ private:
     std::shared_ptr<StructDeclNode> parseStructDecl();
     std::shared_ptr<FieldDeclNode> parseFieldDecl();
     std::shared_ptr<ImplDeclNode> parseImplDecl();
+    std::shared_ptr<TraitDeclNode> parseTraitDecl();
     std::shared_ptr<ConstructorDeclNode> parseConstructorDecl();
-    std::shared_ptr<MemberAccessNode> parseMemberAccess();
+    ASTNodePtr parseMemberAccess();
 
 };
 
@@ -0,0 +1,77 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "profile.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include "../common.h"
+
+namespace {
+
+void put64(std::vector<uint8_t>& out, const size_t at, const uint64_t v) {
+    std::memcpy(out.data() + at, &v, sizeof(v));
+}
+
+uint64_t get64(const std::string& in, const size_t at) {
+    uint64_t v;
+    std::memcpy(&v, in.data() + at, sizeof(v));
+    return v;
+}
+
+}
+
+DataObject build_profile_data(const std::vector<std::string>& names) {
+    std::string table;
+    for (const auto& n : names) table += n + '\n';
+
+    DataObject d;
+    d.name = PROFILE_DATA_SYMBOL;
+    d.bytes.resize(PROFILE_HEADER_SIZE + names.size() * 8);
+    std::memcpy(d.bytes.data(), PROFILE_MAGIC, sizeof(PROFILE_MAGIC));
+    put64(d.bytes, 8, names.size());
+    put64(d.bytes, 16, table.size());
+    d.bytes.insert(d.bytes.end(), table.begin(), table.end());
+    return d;
+}
+
+bool ProfileData::load(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        THROW_ERROR("Could not open profile " + path, 0, 0);
+        return false;
+    }
+    const std::string in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (in.size() < PROFILE_HEADER_SIZE || std::memcmp(in.data(), PROFILE_MAGIC, sizeof(PROFILE_MAGIC)) != 0) {
+        THROW_ERROR("Invalid profile " + path, 0, 0);
+        return false;
+    }
+    const uint64_t n = get64(in, 8), table_size = get64(in, 16);
+    if (n > (in.size() - PROFILE_HEADER_SIZE) / 8 || PROFILE_HEADER_SIZE + n * 8 + table_size != in.size()) {
+        THROW_ERROR("Truncated profile " + path, 0, 0);
+        return false;
+    }
+
+    size_t pos = PROFILE_HEADER_SIZE + n * 8;
+    for (uint64_t k = 0; k < n; k++) {
+        const size_t end = in.find('\n', pos);
+        if (end == std::string::npos) {
+            THROW_ERROR("Truncated profile " + path, 0, 0);
+            return false;
+        }
+        // 同名计数器（例如多次合并）累加
+        counts[in.substr(pos, end - pos)] += get64(in, PROFILE_HEADER_SIZE + k * 8);
+        pos = end + 1;
+    }
+    return true;
+}
+
+uint64_t ProfileData::count(const std::string& name) const {
+    const auto it = counts.find(name);
+    return it == counts.end() ? 0 : it->second;
+}
+
+bool ProfileData::has(const std::string& name) const {
+    return counts.contains(name);
+}
@@ -0,0 +1,39 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_PROFILE_H
+#define POLO_COMPILER_PRE_PROFILE_H
+#include "../x64/asm.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 插桩程序退出时把 __polo_prof_data 原样写入 profile 文件：
+//   [magic 8][计数器个数 8][名字表长度 8][计数器 u64 * n][名字表，'\n' 分隔]
+// 计数器按名字匹配（"函数名"、"函数名:if<k>:then" 等），源码改动后旧的计数只会失配而不会错位
+constexpr char PROFILE_MAGIC[8] = {'P', 'O', 'L', 'O', 'P', 'R', 'F', '1'};
+constexpr size_t PROFILE_HEADER_SIZE = 24;
+constexpr const char* PROFILE_DATA_SYMBOL = "__polo_prof_data";
+constexpr const char* PROFILE_DUMP_SYMBOL = "__polo_prof_dump";
+
+// 计数器 k 在数据对象中的偏移
+inline int64_t profile_counter_offset(const size_t k) {
+    return static_cast<int64_t>(PROFILE_HEADER_SIZE + k * 8);
+}
+
+DataObject build_profile_data(const std::vector<std::string>& names);
+
+class ProfileData {
+public:
+    // 读取 profile 文件，格式不对时报错并返回 false
+    bool load(const std::string& path);
+    [[nodiscard]] uint64_t count(const std::string& name) const;
+    [[nodiscard]] bool has(const std::string& name) const;
+    [[nodiscard]] const std::unordered_map<std::string, uint64_t>& entries() const { return counts; }
+private:
+    std::unordered_map<std::string, uint64_t> counts;
+};
+
+#endif //POLO_COMPILER_PRE_PROFILE_H
@@ -0,0 +1,218 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "server.h"
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "../cache/module_interface.h"
+#include "../cache/serialize.h"
+#include "../common.h"
+#include "../driver.h"
+#include "../thread_pool.h"
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+bool write_all(const int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool read_all(const int fd, char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool send_message(const int fd, const std::string& message) {
+    const uint64_t size = message.size();
+    return write_all(fd, reinterpret_cast<const char*>(&size), sizeof(size))
+        && write_all(fd, message.data(), message.size());
+}
+
+bool receive_message(const int fd, std::string& message) {
+    uint64_t size;
+    if (!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size))) return false;
+    // 请求只有命令行，回复只有错误输出，超过这个大小的一定是别的程序连错了
+    if (size > (1u << 30)) return false;
+    message.resize(size);
+    return read_all(fd, message.data(), size);
+}
+
+bool make_address(const std::string& path, sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    path.copy(addr.sun_path, path.size());
+    return true;
+}
+
+int connect_to(const std::string& path) {
+    sockaddr_un addr;
+    if (!make_address(path, addr)) return -1;
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 在当前线程上编译一个请求，错误输出收集到回复里
+std::string handle(const std::string& request, InterfaceCache& interfaces) {
+    ByteReader r(request);
+    std::string magic(sizeof(SERVER_MAGIC), '\0');
+    for (auto& c : magic) c = static_cast<char>(r.byte());
+    const std::string cwd = r.str();
+    const bool has_env = r.byte();
+    const std::string env = r.str();
+    std::vector<std::string> args;
+    for (uint64_t n = r.var(); r.ok && n > 0; n--) args.push_back(r.str());
+
+    std::ostringstream errors;
+    Diagnostics diag;
+    diag.out = &errors;
+    diag.base = cwd;
+    diagnostics = &diag;
+    int rc = 1;
+    if (!r.ok || magic != std::string(SERVER_MAGIC, sizeof(SERVER_MAGIC)) || args.empty()) {
+        report("Error: Invalid request\n");
+    } else {
+        std::vector<char*> argv;
+        for (auto& a : args) argv.push_back(a.data());
+        argv.push_back(nullptr);
+        Options options;
+        if (parse_options(static_cast<int>(args.size()), argv.data(), options)) {
+            add_package_env(options, has_env ? env.c_str() : nullptr);
+            resolve_paths(options, cwd);
+            // 并行来自同时处理的多个请求，单个请求默认不再开线程
+            if (options.jobs == 0) options.jobs = 1;
+            if (options.run || options.output == "-")
+                report("Error: --run and -o - are not supported by poloc --server\n");
+            else if (options.inputs.size() > 1)
+                rc = compile_batch(options, &interfaces);
+            else {
+                finish_options(options);
+                rc = compile(options, &interfaces);
+            }
+        }
+    }
+    diagnostics = &process_diagnostics;
+
+    ByteWriter w;
+    w.svar(rc);
+    w.str(errors.str());
+    return w.out;
+}
+
+}
+
+int run_server(const std::string& path, const size_t jobs) {
+    sockaddr_un addr;
+    if (!make_address(path, addr)) {
+        std::cerr << "Error: Socket path is too long: " << path << std::endl;
+        return 1;
+    }
+    // 上一个服务器没有正常退出时会留下套接字文件；还能连上说明服务器仍在运行
+    if (const int fd = connect_to(path); fd >= 0) {
+        close(fd);
+        std::cerr << "Error: A server is already listening on " << path << std::endl;
+        return 1;
+    }
+    unlink(path.c_str());
+
+    // 服务器以自己的身份替客户端读写文件，只让同一个用户连接；在 listen 之前改好权限，不留空档
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || chmod(path.c_str(), 0600) != 0 || listen(fd, 128) != 0) {
+        std::cerr << "Error: Could not listen on " << path << std::endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    // 客户端中途退出时写回复会收到 SIGPIPE，不能让它结束服务器
+    std::signal(SIGPIPE, SIG_IGN);
+
+    InterfaceCache interfaces;
+    ThreadPool pool(jobs);
+    for (;;) {
+        const int client = accept(fd, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Error: Could not accept connections on " << path << std::endl;
+            break;
+        }
+        pool.submit([client, &interfaces] {
+            if (std::string request; receive_message(client, request))
+                send_message(client, handle(request, interfaces));
+            close(client);
+        });
+    }
+    close(fd);
+    return 1;
+}
+
+std::optional<int> run_client(const std::string& path, const int argc, char* argv[]) {
+    // --run 要在客户端进程里运行程序，-o - 写到客户端的标准输出
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--run" || (arg == "-o" && i + 1 < argc && std::string(argv[i + 1]) == "-")) return std::nullopt;
+    }
+    const int fd = connect_to(path);
+    if (fd < 0) return std::nullopt;
+
+    ByteWriter w;
+    w.out.append(SERVER_MAGIC, sizeof(SERVER_MAGIC));
+    std::error_code ec;
+    w.str(std::filesystem::current_path(ec).string());
+    const char* env = std::getenv("POLO_PACKAGE_PATH");
+    w.byte(env != nullptr);
+    w.str(env ? env : "");
+    w.var(static_cast<uint64_t>(argc));
+    for (int i = 0; i < argc; i++) w.str(argv[i]);
+
+    std::string reply;
+    const bool ok = send_message(fd, w.out) && receive_message(fd, reply);
+    close(fd);
+    if (!ok) return std::nullopt;
+    ByteReader r(reply);
+    const auto rc = static_cast<int>(r.svar());
+    const std::string errors = r.str();
+    if (!r.ok) return std::nullopt;
+    std::cerr << errors << std::flush;
+    return rc;
+}
+
+#else
+
+int run_server(const std::string&, size_t) {
+    std::cerr << "Error: poloc --server is not supported on this platform" << std::endl;
+    return 1;
+}
+
+std::optional<int> run_client(const std::string&, int, char*[]) {
+    return std::nullopt;
+}
+
+#endif
@@ -0,0 +1,28 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_SERVER_H
+#define POLO_COMPILER_PRE_SERVER_H
+#include <cstddef>
+#include <optional>
+#include <string>
+
+// poloc --server：常驻的编译进程，在 Unix 域套接字上接收 poloc 客户端的编译请求。
+// 多个请求在工作线程上同时编译；导入的模块处理完后以接口的形式留在内存里
+// （见 cache/module_interface.h），后面的请求只要源文件没变就不再解析和检查它们。
+// 客户端在设置了 POLO_SERVER=<socket> 时把命令行原样发给服务器，
+// 服务器按客户端的工作目录解释其中的路径，直接写出输出文件，把错误输出和退出码发回客户端。
+// 消息：[长度 8][内容]
+//   请求 [magic 8][工作目录][有无 POLO_PACKAGE_PATH 1][POLO_PACKAGE_PATH][参数个数][参数...]
+//   回复 [退出码][错误输出]
+
+constexpr char SERVER_MAGIC[8] = {'P', 'O', 'L', 'O', 'S', 'R', 'V', '1'};
+
+// 在 path 上监听，最多同时编译 jobs 个请求（0 表示硬件线程数）；只在出错时返回
+int run_server(const std::string& path, size_t jobs);
+// 把这次编译交给 path 上的服务器，返回编译的退出码。
+// 连不上服务器，或者这次编译必须在客户端进程里做（--run、-o -）时返回空
+std::optional<int> run_client(const std::string& path, int argc, char* argv[]);
+
+#endif //POLO_COMPILER_PRE_SERVER_H
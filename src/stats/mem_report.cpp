@@ -0,0 +1,354 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "mem_report.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <unordered_set>
+#include "../ast.h"
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr size_t NODE_TYPES = static_cast<size_t>(NodeType::IMPORT) + 1;
+constexpr std::array<const char*, NODE_TYPES> NODE_NAMES = {
+    "Program", "Function", "VariableDecl", "Assignment", "BinaryOp", "FunctionCall", "Number", "Float",
+    "Boolean", "String", "Identifier", "TypeIdentifier", "Return", "If", "For", "Break", "Continue",
+    "MacroCall", "MacroDecl", "Unary", "StructDecl", "EnumDecl", "TraitDecl", "ImplDecl", "FieldDecl",
+    "VariantDecl", "MethodDecl", "ConstructorDecl", "MemberAccess", "MemberAssign", "NameSpaceVisit", "Import",
+};
+// make_shared 把对象和控制块放在一次分配里，控制块是两个计数和虚表指针
+constexpr size_t CONTROL_BLOCK = 16;
+
+size_t heap_bytes(const std::string& s) {
+    return s.capacity() > std::string().capacity() ? s.capacity() + 1 : 0;
+}
+
+template <typename T>
+size_t heap_bytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+class AstCounter {
+public:
+    std::array<size_t, NODE_TYPES> counts{}, bytes{};
+    size_t types{0}, type_bytes{0};
+
+    void nodes(const std::vector<ASTNodePtr>& ns) {
+        for (const auto& n : ns) node(n);
+    }
+
+    void node(const ASTNodePtr& n) {
+        if (!n) return;
+        size_t size = CONTROL_BLOCK;
+        auto index = static_cast<size_t>(n->type);
+        if (const auto e = std::dynamic_pointer_cast<ExprNode>(n)) type(e->ret_type);
+        switch (n->type) {
+        case NodeType::PROGRAM: {
+            const auto p = std::static_pointer_cast<ProgramNode>(n);
+            size += sizeof(ProgramNode) + heap_bytes(p->stmts);
+            nodes(p->stmts);
+            break;
+        }
+        case NodeType::FUNCTION: {
+            const auto f = std::static_pointer_cast<FunctionNode>(n);
+            size += sizeof(FunctionNode) + heap_bytes(f->name) + heap_bytes(f->parameters) + heap_bytes(f->body);
+            size += parameters(f->parameters);
+            type(f->returnType);
+            nodes(f->body);
+            break;
+        }
+        case NodeType::VARIABLE_DECL: {
+            const auto v = std::static_pointer_cast<VariableDeclNode>(n);
+            size += sizeof(VariableDeclNode) + heap_bytes(v->name);
+            type(v->type);
+            node(v->initializer);
+            break;
+        }
+        case NodeType::ASSIGNMENT: {
+            const auto a = std::static_pointer_cast<AssignmentNode>(n);
+            size += sizeof(AssignmentNode) + heap_bytes(a->name);
+            node(a->value);
+            break;
+        }
+        case NodeType::MEMBER_ASSIGN: {
+            const auto a = std::static_pointer_cast<MemberAssignNode>(n);
+            size += sizeof(MemberAssignNode);
+            node(a->member);
+            node(a->value);
+            break;
+        }
+        case NodeType::BINARY_OP: {
+            const auto b = std::static_pointer_cast<BinaryOpNode>(n);
+            size += sizeof(BinaryOpNode);
+            node(b->left);
+            node(b->right);
+            break;
+        }
+        case NodeType::UNARY: {
+            const auto u = std::static_pointer_cast<UnaryOpNode>(n);
+            size += sizeof(UnaryOpNode);
+            node(u->expr);
+            break;
+        }
+        case NodeType::FUNCTION_CALL: {
+            const auto c = std::static_pointer_cast<FunctionCallNode>(n);
+            size += sizeof(FunctionCallNode) + heap_bytes(c->name) + heap_bytes(c->arguments);
+            nodes(c->arguments);
+            break;
+        }
+        case NodeType::MACRO_CALL: {
+            const auto c = std::static_pointer_cast<MacroCallNode>(n);
+            size += sizeof(MacroCallNode) + heap_bytes(c->name) + heap_bytes(c->arguments);
+            nodes(c->arguments);
+            break;
+        }
+        case NodeType::MACRO_DECL: {
+            const auto d = std::static_pointer_cast<MacroDeclNode>(n);
+            size += sizeof(MacroDeclNode) + d->equations.size() * (sizeof(std::pair<std::string, ASTNodePtr>) + 16);
+            for (const auto& [name, e] : d->equations) node(e);
+            node(d->declaration);
+            break;
+        }
+        case NodeType::NUMBER: size += sizeof(NumberNode); break;
+        case NodeType::FLOAT: size += sizeof(FloatNode); break;
+        case NodeType::BOOLEAN: size += sizeof(BooleanNode); break;
+        case NodeType::STRING:
+            // TypeIdentifierNode 也用 NodeType::STRING
+            if (const auto s = std::dynamic_pointer_cast<StringNode>(n)) {
+                size += sizeof(StringNode) + heap_bytes(s->value);
+            } else {
+                const auto t = std::static_pointer_cast<TypeIdentifierNode>(n);
+                size += sizeof(TypeIdentifierNode) + heap_bytes(t->name);
+                index = static_cast<size_t>(NodeType::TYPE_IDENTIFIER);
+            }
+            break;
+        case NodeType::IDENTIFIER: {
+            const auto i = std::static_pointer_cast<IdentifierNode>(n);
+            size += sizeof(IdentifierNode) + heap_bytes(i->name);
+            break;
+        }
+        case NodeType::RETURN_STMT: {
+            const auto r = std::static_pointer_cast<ReturnStmtNode>(n);
+            size += sizeof(ReturnStmtNode);
+            node(r->expression);
+            break;
+        }
+        case NodeType::IF_STMT: {
+            const auto i = std::static_pointer_cast<IfStmtNode>(n);
+            size += sizeof(IfStmtNode) + heap_bytes(i->thenBody) + heap_bytes(i->elseBody);
+            node(i->condition);
+            nodes(i->thenBody);
+            nodes(i->elseBody);
+            break;
+        }
+        case NodeType::FOR_STMT: {
+            const auto f = std::static_pointer_cast<ForStmtNode>(n);
+            size += sizeof(ForStmtNode) + heap_bytes(f->body);
+            node(f->init);
+            node(f->condition);
+            node(f->increment);
+            nodes(f->body);
+            break;
+        }
+        case NodeType::BREAK_STMT: size += sizeof(BreakStmtNode); break;
+        case NodeType::CONTINUE_STMT: size += sizeof(ContinueStmtNode); break;
+        case NodeType::STRUCT_DECL: {
+            const auto s = std::static_pointer_cast<StructDeclNode>(n);
+            size += sizeof(StructDeclNode) + heap_bytes(s->name) + heap_bytes(s->fields);
+            nodes(s->fields);
+            break;
+        }
+        case NodeType::FIELD_DECL: {
+            const auto f = std::static_pointer_cast<FieldDeclNode>(n);
+            size += sizeof(FieldDeclNode) + heap_bytes(f->name);
+            type(f->type);
+            break;
+        }
+        case NodeType::IMPL_DECL: {
+            const auto i = std::static_pointer_cast<ImplDeclNode>(n);
+            size += sizeof(ImplDeclNode) + heap_bytes(i->target_type) + heap_bytes(i->trait_name) + heap_bytes(i->methods);
+            nodes(i->methods);
+            break;
+        }
+        case NodeType::TRAIT_DECL: {
+            const auto t = std::static_pointer_cast<TraitDeclNode>(n);
+            size += sizeof(TraitDeclNode) + heap_bytes(t->name) + heap_bytes(t->methods);
+            for (const auto& m : t->methods) node(m);
+            break;
+        }
+        case NodeType::CONSTRUCTOR_DECL: {
+            const auto c = std::static_pointer_cast<ConstructorDeclNode>(n);
+            size += sizeof(ConstructorDeclNode) + heap_bytes(c->parameters) + heap_bytes(c->body);
+            size += parameters(c->parameters);
+            nodes(c->body);
+            break;
+        }
+        case NodeType::MEMBER_ACCESS: {
+            const auto m = std::static_pointer_cast<MemberAccessNode>(n);
+            size += sizeof(MemberAccessNode);
+            node(m->object);
+            node(m->expr);
+            break;
+        }
+        case NodeType::NAME_SPACE_VISIT: {
+            const auto v = std::static_pointer_cast<NameSpaceVisitNode>(n);
+            size += sizeof(NameSpaceVisitNode);
+            node(v->last);
+            node(v->expr);
+            break;
+        }
+        case NodeType::IMPORT: {
+            const auto i = std::static_pointer_cast<ImportNode>(n);
+            size += sizeof(ImportNode) + heap_bytes(i->path);
+            for (const auto& p : i->path) size += heap_bytes(p);
+            break;
+        }
+        default:
+            // 解析器还不会生成的节点，只算基类
+            size += sizeof(StmtNode);
+            break;
+        }
+        counts[index]++;
+        bytes[index] += size;
+    }
+
+private:
+    std::unordered_set<const Type*> seen;
+
+    size_t parameters(const std::vector<Parameter>& ps) {
+        size_t size = 0;
+        for (const auto& p : ps) {
+            size += heap_bytes(p.name);
+            type(p.type);
+        }
+        return size;
+    }
+
+    void type(const std::shared_ptr<Type>& t) {
+        if (!t || !seen.insert(t.get()).second) return;
+        types++;
+        size_t size = CONTROL_BLOCK + heap_bytes(t->name);
+        if (const auto ext = std::dynamic_pointer_cast<ExtType>(t)) {
+            size += sizeof(ExtType);
+            type(ext->basic);
+        } else if (const auto st = std::dynamic_pointer_cast<StructType>(t)) {
+            size += sizeof(StructType) + st->fields.bucket_count() * sizeof(void*);
+            for (const auto& [name, field] : st->fields) {
+                size += sizeof(std::pair<std::string, std::shared_ptr<Type>>) + 16 + heap_bytes(name);
+                type(field);
+            }
+        } else {
+            size += sizeof(Type);
+        }
+        type_bytes += size;
+    }
+};
+
+std::string size_text(const size_t bytes) {
+    char buf[32];
+    if (bytes >= (10u << 20)) std::snprintf(buf, sizeof(buf), "%.1f MiB", static_cast<double>(bytes) / (1 << 20));
+    else std::snprintf(buf, sizeof(buf), "%.1f KiB", static_cast<double>(bytes) / (1 << 10));
+    return buf;
+}
+
+std::string row(const std::string& name, const std::string& a, const std::string& b, const std::string& c) {
+    char buf[160];
+    std::snprintf(buf, sizeof(buf), "  %-24s %14s %14s %14s\n", name.c_str(), a.c_str(), b.c_str(), c.c_str());
+    return buf;
+}
+
+}
+
+MemoryUsage memory_usage() {
+    MemoryUsage usage;
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    const auto info = mallinfo2();
+    usage.heap = info.uordblks + info.hblkhd;
+#endif
+#if defined(__linux__)
+    if (std::FILE* f = std::fopen("/proc/self/statm", "r")) {
+        unsigned long size = 0, resident = 0;
+        if (std::fscanf(f, "%lu %lu", &size, &resident) == 2)
+            usage.rss = resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::fclose(f);
+    }
+#endif
+#if !defined(_WIN32)
+    rusage ru{};
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#if defined(__APPLE__)
+        usage.peak_rss = static_cast<size_t>(ru.ru_maxrss);
+#else
+        usage.peak_rss = static_cast<size_t>(ru.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return usage;
+}
+
+size_t count_ast_nodes(const ProgramNode& program) {
+    AstCounter counter;
+    for (const auto& s : program.stmts) counter.node(s);
+    size_t total = 0;
+    for (const size_t c : counter.counts) total += c;
+    return total;
+}
+
+void MemReport::phase(const char* name) {
+    phases.push_back({name, memory_usage()});
+}
+
+void MemReport::add(const std::string& category, const size_t count, const size_t bytes) {
+    const auto it = std::find_if(categories.begin(), categories.end(), [&](const Category& c) { return c.name == category; });
+    if (it == categories.end()) {
+        categories.push_back({category, count, bytes});
+    } else {
+        it->count += count;
+        it->bytes += bytes;
+    }
+}
+
+void MemReport::add_ast(const ProgramNode& program) {
+    AstCounter counter;
+    for (const auto& s : program.stmts) counter.node(s);
+    for (size_t i = 0; i < NODE_TYPES; i++)
+        if (counter.counts[i]) add(std::string("AST ") + NODE_NAMES[i], counter.counts[i], counter.bytes[i]);
+    add("Type objects", counter.types, counter.type_bytes);
+}
+
+void MemReport::print(std::ostream& out, const std::string& title) const {
+    out << "===- Memory report: " << title << " -===\n";
+    out << "  (heap and resident sizes are for the whole process)\n";
+    out << row("phase", "heap", "heap delta", "resident");
+    size_t heap = start.heap;
+    out << row("(start)", size_text(start.heap), "", size_text(start.rss));
+    for (const auto& p : phases) {
+        const auto delta = static_cast<long long>(p.usage.heap) - static_cast<long long>(heap);
+        heap = p.usage.heap;
+        out << row(p.name, size_text(p.usage.heap),
+                   (delta < 0 ? "-" : "+") + size_text(static_cast<size_t>(delta < 0 ? -delta : delta)),
+                   size_text(p.usage.rss));
+    }
+    const auto end = memory_usage();
+    out << "  peak resident: " << size_text(end.peak_rss) << "\n";
+
+    out << "  (tokens are counted over the whole parse, the rest is what is alive after its phase)\n";
+    out << row("category", "count", "bytes", "");
+    size_t total = 0;
+    for (const auto& c : categories) {
+        out << row(c.name, std::to_string(c.count), size_text(c.bytes), "");
+        total += c.bytes;
+    }
+    out << row("total counted", "", size_text(total), "");
+    out << std::flush;
+}
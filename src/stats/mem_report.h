@@ -0,0 +1,51 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_MEM_REPORT_H
+#define POLO_COMPILER_PRE_MEM_REPORT_H
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ProgramNode;
+
+// 进程当前的内存占用；拿不到的项为 0
+struct MemoryUsage {
+    size_t heap{0};         // malloc 分配出去还没释放的字节数
+    size_t rss{0};          // 常驻内存
+    size_t peak_rss{0};     // 常驻内存的峰值
+};
+MemoryUsage memory_usage();
+// 程序里的 AST 节点个数
+size_t count_ast_nodes(const ProgramNode& program);
+
+// -fmem-report：各阶段结束时的内存占用，以及各类数据的个数和字节数。
+// 不改动分配器，阶段之间读一次 malloc 的统计，各类数据在用完之前数一遍，开着也不影响编译速度。
+// 字节数按对象本身、shared_ptr 的控制块和它们在堆上的字符串、数组估算
+class MemReport {
+public:
+    // 一个阶段结束，记下这时的内存占用
+    void phase(const char* name);
+    // 一类数据的个数和字节数，同名的累加
+    void add(const std::string& category, size_t count, size_t bytes);
+    // 按 NodeType 统计 AST 节点，并统计它们引用的 Type 对象（同一个对象只算一次）
+    void add_ast(const ProgramNode& program);
+    void print(std::ostream& out, const std::string& title) const;
+
+private:
+    struct Phase {
+        const char* name;
+        MemoryUsage usage;
+    };
+    struct Category {
+        std::string name;
+        size_t count, bytes;
+    };
+    MemoryUsage start{memory_usage()};
+    std::vector<Phase> phases;
+    std::vector<Category> categories;
+};
+
+#endif //POLO_COMPILER_PRE_MEM_REPORT_H
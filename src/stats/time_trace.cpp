@@ -0,0 +1,110 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "time_trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string_view>
+
+namespace {
+
+int64_t micros(const TimeTrace::Clock::duration d) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+std::string escape(const std::string& s) {
+    std::string out;
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// 一行表格：毫秒、占总时间的百分比、次数（0 时留空）、名字
+std::string row(const int64_t time, const double scale, const size_t count, const std::string& name) {
+    char buf[64];
+    const auto t = static_cast<double>(time);
+    if (count) std::snprintf(buf, sizeof(buf), "%10.3f  %6.1f  %7zu  ", t / 1000, t * scale, count);
+    else std::snprintf(buf, sizeof(buf), "%10.3f  %6.1f           ", t / 1000, t * scale);
+    return buf + name + "\n";
+}
+
+}
+
+void TimeTrace::add(const char* name, std::string detail, const Clock::time_point start, const Clock::time_point end) {
+    std::lock_guard lock(m);
+    const auto [it, _] = threads.try_emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads.size()));
+    events.push_back({name, std::move(detail), micros(start - origin), micros(end - start), it->second});
+}
+
+void TimeTrace::print(std::ostream& out, const std::string& title) const {
+    std::lock_guard lock(m);
+    struct Phase {
+        const char* name;
+        int64_t time{0};
+        size_t count{0};
+        int64_t first;
+    };
+    // 同名的事件合成一个阶段，按第一次开始的时间排列；外层阶段的时间包含内层阶段
+    std::vector<Phase> phases;
+    std::vector<const Event*> functions;
+    int64_t total = 0;
+    for (const auto& e : events) {
+        auto it = std::find_if(phases.begin(), phases.end(), [&](const Phase& p) { return std::string_view(p.name) == e.name; });
+        if (it == phases.end()) it = phases.insert(phases.end(), {e.name, 0, 0, e.start});
+        it->time += e.duration;
+        it->count++;
+        it->first = std::min(it->first, e.start);
+        if (std::string_view(e.name) == "Total") total = e.duration;
+        if (std::string_view(e.name) == "Function codegen") functions.push_back(&e);
+    }
+    std::stable_sort(phases.begin(), phases.end(), [](const Phase& a, const Phase& b) { return a.first < b.first; });
+    std::sort(functions.begin(), functions.end(), [](const Event* a, const Event* b) { return a->duration > b->duration; });
+
+    const double scale = total > 0 ? 100.0 / static_cast<double>(total) : 0;
+    out << "===- Time report: " << title << " -===\n";
+    out << "  (phases running on several threads add up the time of every thread)\n";
+    out << "        ms       %    count  phase\n";
+    for (const auto& p : phases) out << row(p.time, scale, p.count, p.name);
+    if (!functions.empty()) {
+        out << "  slowest functions (codegen):\n";
+        for (size_t i = 0; i < std::min<size_t>(10, functions.size()); i++)
+            out << row(functions[i]->duration, scale, 0, functions[i]->detail);
+    }
+    out << std::flush;
+}
+
+int64_t TimeTrace::total(const std::string_view name) const {
+    std::lock_guard lock(m);
+    int64_t sum = 0;
+    for (const auto& e : events)
+        if (name == e.name) sum += e.duration;
+    return sum;
+}
+
+bool TimeTrace::write(const std::string& path) const {
+    std::lock_guard lock(m);
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    file << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < events.size(); i++) {
+        const auto& e = events[i];
+        file << "{\"name\":\"" << e.name << "\",\"cat\":\"poloc\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.thread
+             << ",\"ts\":" << e.start << ",\"dur\":" << e.duration;
+        if (!e.detail.empty()) file << ",\"args\":{\"detail\":\"" << escape(e.detail) << "\"}";
+        file << (i + 1 < events.size() ? "},\n" : "}\n");
+    }
+    file << "],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(file.flush());
+}
@@ -0,0 +1,69 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_TIME_TRACE_H
+#define POLO_COMPILER_PRE_TIME_TRACE_H
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// -ftime-report / -ftime-trace：记录一次编译里各阶段和每个函数的耗时。
+// 在要计时的代码块开头放一个 TimeScope；没有开启时它只读一次 time_trace 指针。
+class TimeTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* name;
+        std::string detail;     // 模块路径、函数名等，可以为空
+        int64_t start, duration;    // 微秒，start 相对 TimeTrace 创建的时间
+        uint32_t thread;
+    };
+
+    void add(const char* name, std::string detail, Clock::time_point start, Clock::time_point end);
+    // 按阶段汇总的表格和最慢的函数
+    void print(std::ostream& out, const std::string& title) const;
+    // Chrome trace-event JSON（每个事件是一个 "ph": "X"），可以在 chrome://tracing 或 Perfetto 里打开
+    bool write(const std::string& path) const;
+    // 名字为 name 的事件的总耗时（微秒）
+    [[nodiscard]] int64_t total(std::string_view name) const;
+
+private:
+    Clock::time_point origin{Clock::now()};
+    mutable std::mutex m;
+    std::vector<Event> events;
+    std::unordered_map<std::thread::id, uint32_t> threads;
+};
+
+// 当前线程在为哪次编译计时，nullptr 表示没有开启；ThreadPool 的任务沿用提交者的设置
+inline thread_local TimeTrace* time_trace = nullptr;
+
+class TimeScope {
+public:
+    explicit TimeScope(const char* name) : trace(time_trace), name(name) {
+        if (trace) start = TimeTrace::Clock::now();
+    }
+    TimeScope(const char* name, const std::string& detail) : TimeScope(name) {
+        if (trace) this->detail = detail;
+    }
+    ~TimeScope() {
+        if (trace) trace->add(name, std::move(detail), start, TimeTrace::Clock::now());
+    }
+    TimeScope(const TimeScope&) = delete;
+    TimeScope& operator=(const TimeScope&) = delete;
+
+private:
+    TimeTrace* trace;
+    const char* name;
+    std::string detail;
+    TimeTrace::Clock::time_point start;
+};
+
+#endif //POLO_COMPILER_PRE_TIME_TRACE_H
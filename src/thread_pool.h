@@ -0,0 +1,100 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_THREAD_POOL_H
+#define POLO_COMPILER_PRE_THREAD_POOL_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "stats/time_trace.h"
+
+// 固定大小的线程池；只有一个线程时任务直接在调用者线程上顺序执行
+class ThreadPool {
+public:
+    // threads == 0 表示使用全部硬件线程
+    explicit ThreadPool(size_t threads = 0) {
+        if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        count = threads;
+        if (count == 1) return;
+        for (size_t i = 0; i < count; i++)
+            workers.emplace_back([this] { work(); });
+    }
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(m);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& w : workers) w.join();
+    }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    [[nodiscard]] size_t size() const { return count; }
+
+    void submit(std::function<void()> task) {
+        if (count == 1) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard lock(m);
+            // 任务里报告的错误和计时属于提交它的那次编译
+            tasks.push_back([task = std::move(task), diag = diagnostics, trace = time_trace] {
+                diagnostics = diag;
+                time_trace = trace;
+                task();
+            });
+            pending++;
+        }
+        ready.notify_one();
+    }
+
+    // 等待所有已提交的任务完成
+    void wait() {
+        std::unique_lock lock(m);
+        idle.wait(lock, [this] { return pending == 0; });
+    }
+
+    // 对 0..n-1 调用 fn 并等待完成，任务之间的顺序不确定
+    void parallel_for(const size_t n, const std::function<void(size_t)>& fn) {
+        for (size_t i = 0; i < n; i++) submit([&fn, i] { fn(i); });
+        wait();
+    }
+
+private:
+    size_t count{1};
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex m;
+    std::condition_variable ready, idle;
+    size_t pending{0};
+    bool stopping{false};
+
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m);
+                ready.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+            {
+                std::lock_guard lock(m);
+                pending--;
+            }
+            idle.notify_all();
+        }
+    }
+};
+
+#endif //POLO_COMPILER_PRE_THREAD_POOL_H
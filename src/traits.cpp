@@ -0,0 +1,127 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "traits.h"
+#include "common.h"
+#include "generics.h"
+
+namespace {
+
+bool is_coercion(const ASTNodePtr& node) {
+    return node && node->type == NodeType::UNARY && std::static_pointer_cast<UnaryOpNode>(node)->op == UnaryOpType::Dyn;
+}
+
+// p as dyn Trait 的源类型，类型检查记在 p 的 ret_type 上
+std::string source_type(const UnaryOpNode& coercion) {
+    const auto& t = std::static_pointer_cast<ExprNode>(coercion.expr)->ret_type;
+    return t ? t->name : "";
+}
+
+}
+
+std::string vtable_symbol(const std::string& type, const std::string& trait) {
+    return "vtable$" + type + "$" + trait;
+}
+
+std::string vtable_symbol(const UnaryOpNode& coercion) {
+    return vtable_symbol(source_type(coercion), coercion.ret_type->name);
+}
+
+void Devirtualizer::run() {
+    for (const auto& s : program->stmts) {
+        if (s->type == NodeType::TRAIT_DECL) {
+            const auto trait = std::static_pointer_cast<TraitDeclNode>(s);
+            traits[trait->name] = trait;
+        } else if (s->type == NodeType::IMPL_DECL) {
+            const auto impl = std::static_pointer_cast<ImplDeclNode>(s);
+            if (!impl->trait_name.empty()) impls[impl->target_type + ":" + impl->trait_name] = impl;
+        }
+    }
+    // 没有 trait 的程序不用再遍历
+    if (traits.empty()) return;
+
+    for (const auto& s : program->stmts) {
+        each_node(s, [&](const ASTNodePtr& node) {
+            if (!is_coercion(node)) return;
+            const auto& op = *std::static_pointer_cast<UnaryOpNode>(node);
+            types[op.ret_type->name].insert(source_type(op));
+        });
+    }
+    for (const auto& s : program->stmts)
+        if (const auto fn = function_of(s)) function(fn);
+    emit_vtables();
+}
+
+void Devirtualizer::function(const std::shared_ptr<FunctionNode>& fn) {
+    // 局部 dyn 变量每次赋值的来源类型，空串表示不知道；被取地址的变量可能被别处改写
+    std::unordered_map<std::string, std::set<std::string>> locals;
+    const auto escaped = addressed_vars(fn);
+    auto def = [&](const std::string& name, const ASTNodePtr& value) {
+        locals[name].insert(is_coercion(value) ? source_type(*std::static_pointer_cast<UnaryOpNode>(value)) : "");
+    };
+    each_node(fn, [&](const ASTNodePtr& node) {
+        if (node->type == NodeType::VARIABLE_DECL) {
+            const auto decl = std::static_pointer_cast<VariableDeclNode>(node);
+            if (decl->type && decl->type->is_fat() && decl->type->is_dyn) def(decl->name, decl->initializer);
+        } else if (node->type == NodeType::ASSIGNMENT) {
+            const auto assign = std::static_pointer_cast<AssignmentNode>(node);
+            if (locals.contains(assign->name)) def(assign->name, assign->value);
+        }
+    });
+
+    each_node(fn, [&](const ASTNodePtr& node) {
+        if (node->type != NodeType::FUNCTION_CALL) return;
+        const auto call = std::static_pointer_cast<FunctionCallNode>(node);
+        if (call->vslot < 0 || call->arguments.empty()) return;
+        const auto dot = call->name.rfind('.');
+        const std::string trait = call->name.substr(0, dot), method = call->name.substr(dot + 1);
+
+        auto& receiver = call->arguments[0];
+        std::string type;
+        if (is_coercion(receiver)) {
+            // (p as dyn Trait).m()：直接传 p
+            const auto op = std::static_pointer_cast<UnaryOpNode>(receiver);
+            type = source_type(*op);
+            receiver = op->expr;
+        } else if (receiver->type == NodeType::IDENTIFIER) {
+            const auto& name = std::static_pointer_cast<IdentifierNode>(receiver)->name;
+            if (const auto it = locals.find(name); it != locals.end() && it->second.size() == 1 && !escaped.contains(name))
+                type = *it->second.begin();
+        }
+        if (type.empty()) {
+            if (const auto it = types.find(trait); it != types.end() && it->second.size() == 1)
+                type = *it->second.begin();
+        }
+        if (type.empty()) {
+            dynamic.insert(trait);
+            return;
+        }
+        // 接收者仍是 dyn 值时，代码生成只传数据指针
+        call->name = type + "." + method;
+        call->vslot = -1;
+    });
+}
+
+void Devirtualizer::emit_vtables() {
+    for (const auto& trait : dynamic) {
+        const auto t = traits.find(trait);
+        if (t == traits.end()) continue;
+        for (const auto& type : types[trait]) {
+            const auto it = impls.find(type + ":" + trait);
+            if (it == impls.end()) {
+                THROW_ERROR("`" + type + "` does not implement trait `" + trait + "`", t->second->line, t->second->col);
+                continue;
+            }
+            // 虚表按 trait 声明的顺序排列，和调用处的槽位一致
+            const auto& impl = it->second;
+            std::vector<ASTNodePtr> methods;
+            for (const auto& m : t->second->methods)
+                methods.push_back(std::make_shared<IdentifierNode>(impl->line, impl->col, type + "." + m->name));
+            for (const auto& m : impl->methods)
+                if (m->type != NodeType::IDENTIFIER) methods.push_back(m);
+            impl->methods = std::move(methods);
+            impl->vtable = true;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_TRAITS_H
+#define POLO_COMPILER_PRE_TRAITS_H
+#include "ast.h"
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// trait 和 trait 对象
+//   trait Shape { fn area(self: *Self) -> i32; }
+//   impl Point : Shape { fn area(self: *Self) -> i32 { ... } }    方法改名为 Point.area
+//   p.area()                            p: *Point，类型检查直接解析成 Point.area(p)
+//   let s: dyn Shape = p as dyn Shape;  s.area() 通过虚表调用
+// dyn Trait 和 str 一样占两个字：数据指针 + 虚表。虚表放在 .text 里，按 trait 的方法顺序
+// 每项是一条跳到方法的 jmp，占 8 字节；调用时 call 虚表地址 + 8 * 槽位，不需要数据段的重定位。
+//
+// 模块合并、单态化之后整个程序都在手里，Devirtualizer 找出所有转换成 dyn Trait 的地方，
+// 把能确定接收者实际类型的调用改成直接调用：
+//   接收者就是 p as dyn Trait；接收者是只由同一种类型转换来的局部变量（没有被取地址）；
+//   整个程序里只有一种类型转换成了这个 trait。
+// 仍有动态调用的 trait 才为转换过的类型生成虚表（ImplDeclNode::vtable）。
+
+// 类型 type 实现 trait 的虚表
+std::string vtable_symbol(const std::string& type, const std::string& trait);
+// p as dyn Trait 用到的虚表
+std::string vtable_symbol(const UnaryOpNode& coercion);
+
+class Devirtualizer {
+public:
+    explicit Devirtualizer(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    // 出错时设置 has_err
+    void run();
+
+private:
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_map<std::string, std::shared_ptr<TraitDeclNode>> traits;
+    std::unordered_map<std::string, std::shared_ptr<ImplDeclNode>> impls;     // "Type:Trait"
+    std::unordered_map<std::string, std::set<std::string>> types;             // trait -> 转换成 dyn Trait 的类型
+    std::unordered_set<std::string> dynamic;                                  // 还有动态调用的 trait
+
+    void function(const std::shared_ptr<FunctionNode>& fn);
+    void emit_vtables();
+};
+
+#endif //POLO_COMPILER_PRE_TRAITS_H
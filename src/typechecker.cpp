@@ -1,8 +1,18 @@
 #include "typechecker.h"
 #include "common.h"
+#include "generics.h"
+#include <algorithm>
 #include <stdexcept>
 #include <utility>
 
+namespace {
+    // 接收者或被转换的值的类型：&p 得到的 ExtType 取它的基础类型
+    std::shared_ptr<Type> unwrap(const std::shared_ptr<Type>& type) {
+        if (const auto ext = std::dynamic_pointer_cast<ExtType>(type); ext && !ext->is_ptr) return ext->basic;
+        return type;
+    }
+}
+
 TypeChecker::TypeChecker() {
     auto i32Type = std::make_shared<Type>(TypeKind::I32);
     auto voidType = std::make_shared<Type>(TypeKind::VOID);
@@ -20,16 +30,16 @@ void TypeChecker::popScope() {
     }
 }
 
-void TypeChecker::addVariable(const std::string& name, std::shared_ptr<Type> type, size_t line, size_t col) {
+void TypeChecker::addVariable(const std::string& name, std::shared_ptr<Type> type, size_t line, size_t col, const bool is_const) {
     if (variables.contains(name)) {
         THROW_ERROR("Variable already defined: " + name, line, col);
     }
-    variables[name] = {std::move(type)};
+    variables[name] = {std::move(type), is_const};
 }
 
 std::shared_ptr<VariableInfo> TypeChecker::findVariable(const std::string& name) {
     if (const auto it = variables.find(name); it != variables.end()) {
-        auto info = std::make_shared<VariableInfo>(it->second.type->clone());
+        auto info = std::make_shared<VariableInfo>(it->second.type->clone(), it->second.is_const);
         return info;
     }
     return nullptr;
@@ -40,7 +50,7 @@ void TypeChecker::addFunction(const std::string& name, const std::vector<std::sh
     if (const auto it = functions.find(name); it != functions.end() && it->second.has_body) {
         THROW_ERROR("Function already defined: " + name, line, col);
     }
-    functions[name] = {paramTypes, std::move(returnType), has_body};
+    functions[name] = {paramTypes, std::move(returnType), has_body, {}};
 }
 
 FunctionInfo* TypeChecker::findFunction(const std::string& name) {
@@ -61,11 +71,19 @@ void TypeChecker::checkProgram(const std::shared_ptr<ProgramNode>& program) {
         }
 
         addFunction(func->name, paramTypes, func->returnType, func->has_body, func->line, func->col);
+        functions[func->name].typeParams = func->type_params;
     };
     for (const ASTNodePtr& stmt : program->stmts) {
         if (stmt->type == NodeType::FUNCTION) {
             handle_function(stmt);
         }
+        else if (stmt->type == NodeType::VARIABLE_DECL) {
+            // 全局变量加入最外层作用域，函数体都能看到
+            const auto decl = std::static_pointer_cast<VariableDeclNode>(stmt);
+            if (!decl->is_static)
+                THROW_ERROR("Global variable `" + decl->name + "` must be declared static", decl->line, decl->col);
+            checkVariableDecl(decl);
+        }
         else if (stmt->type == NodeType::MACRO_DECL) {
             bool check = true;
             const auto& tmp = std::static_pointer_cast<MacroDeclNode>(stmt);
@@ -78,8 +96,17 @@ void TypeChecker::checkProgram(const std::shared_ptr<ProgramNode>& program) {
             if (check)
                 handle_function(tmp->declaration);
         }
+        else if (stmt->type == NodeType::TRAIT_DECL) {
+            const auto trait = std::static_pointer_cast<TraitDeclNode>(stmt);
+            checkTrait(trait);
+            declareTrait(trait);
+        }
 
     }
+    // 所有方法都登记之后才能检查 impl 是否完整
+    for (const ASTNodePtr& stmt : program->stmts) {
+        if (stmt->type == NodeType::IMPL_DECL) checkImpl(std::static_pointer_cast<ImplDeclNode>(stmt));
+    }
 
     for (const ASTNodePtr& stmt : program->stmts) {
         if (stmt->type == NodeType::FUNCTION) {
@@ -94,6 +121,116 @@ void TypeChecker::checkProgram(const std::shared_ptr<ProgramNode>& program) {
     }
 }
 
+void TypeChecker::declareFunction(const std::shared_ptr<FunctionNode>& func) {
+    std::vector<std::shared_ptr<Type>> paramTypes;
+    for (const auto& param : func->parameters)
+        paramTypes.push_back(param.type);
+    functions[func->name] = {paramTypes, func->returnType, func->has_body, func->type_params};
+}
+
+void TypeChecker::declareGlobal(const std::shared_ptr<VariableDeclNode>& decl) {
+    variables[decl->name] = {decl->type, decl->is_const};
+}
+
+void TypeChecker::declareTrait(const std::shared_ptr<TraitDeclNode>& trait) {
+    traits[trait->name] = trait;
+    auto self = std::make_shared<Type>(TypeKind::I32);
+    self->name = trait->name;
+    self->is_dyn = true;
+    for (const auto& method : trait->methods) {
+        std::vector<std::shared_ptr<Type>> paramTypes{self};
+        for (size_t i = 1; i < method->parameters.size(); ++i)
+            paramTypes.push_back(method->parameters[i].type);
+        functions[trait->name + "." + method->name] = {paramTypes, method->returnType, true, {}};
+    }
+}
+
+void TypeChecker::declareImpl(const std::shared_ptr<ImplDeclNode>& impl) {
+    if (!impl->trait_name.empty()) impls.insert(impl->target_type + ":" + impl->trait_name);
+}
+
+void TypeChecker::checkTrait(const std::shared_ptr<TraitDeclNode>& trait) {
+    std::set<std::string> names;
+    for (const auto& method : trait->methods) {
+        if (!names.insert(method->name).second)
+            THROW_ERROR("Method `" + method->name + "` is declared twice in trait `" + trait->name + "`",
+                        method->line, method->col);
+        const auto& params = method->parameters;
+        if (params.empty() || params[0].type->name != "Self" || !params[0].type->is_ptr || params[0].type->is_arr)
+            THROW_ERROR("Trait method `" + trait->name + "." + method->name + "` must take `self: *Self` first",
+                        method->line, method->col);
+    }
+}
+
+void TypeChecker::checkImpl(const std::shared_ptr<ImplDeclNode>& impl) {
+    if (impl->trait_name.empty()) return;
+    const auto it = traits.find(impl->trait_name);
+    if (it == traits.end()) {
+        THROW_ERROR("Unknown trait `" + impl->trait_name + "`", impl->line, impl->col);
+        return;
+    }
+    const auto& trait = it->second;
+    std::set<std::string> methods;
+    for (const auto& m : impl->methods)
+        if (m->type == NodeType::IDENTIFIER) methods.insert(std::static_pointer_cast<IdentifierNode>(m)->name);
+
+    // 把 Self 换成实现的类型后，方法签名必须和 trait 里的一致
+    auto self = std::make_shared<Type>(TypeKind::I32);
+    self->name = impl->target_type;
+    const TypeBindings bindings{{"Self", self}};
+    for (const auto& method : trait->methods) {
+        const std::string name = impl->target_type + "." + method->name;
+        const auto info = methods.erase(name) ? findFunction(name) : nullptr;
+        if (!info) {
+            THROW_ERROR("`" + impl->target_type + "` does not implement method `" + method->name +
+                        "` of trait `" + trait->name + "`", impl->line, impl->col);
+            continue;
+        }
+        bool same = info->typeParams.empty() && info->paramTypes.size() == method->parameters.size()
+                    && substitute(method->returnType, bindings)->equals(info->returnType);
+        for (size_t i = 0; same && i < info->paramTypes.size(); ++i)
+            same = substitute(method->parameters[i].type, bindings)->equals(info->paramTypes[i]);
+        if (!same)
+            THROW_ERROR("Method `" + name + "` does not match its declaration in trait `" + trait->name + "`",
+                        impl->line, impl->col);
+    }
+    for (const auto& name : methods)
+        THROW_ERROR("`" + name.substr(impl->target_type.size() + 1) + "` is not a method of trait `" + trait->name + "`",
+                    impl->line, impl->col);
+    declareImpl(impl);
+}
+
+bool TypeChecker::resolveMethod(const std::shared_ptr<FunctionCallNode>& call, const std::shared_ptr<Type>& receiver) {
+    if (!receiver) return false;
+    const auto type = unwrap(receiver);
+    const std::string method = call->name;
+    if (type->is_dyn && !type->is_ptr && !type->is_arr) {
+        // dyn Trait：通过虚表调用，Devirtualizer 能确定实际类型时再改成直接调用
+        const auto it = traits.find(type->name);
+        if (it == traits.end()) {
+            THROW_ERROR("Unknown trait `" + type->name + "`", call->line, call->col);
+            return false;
+        }
+        const auto& methods = it->second->methods;
+        const auto m = std::ranges::find_if(methods, [&](const auto& f) { return f->name == method; });
+        if (m == methods.end()) {
+            THROW_ERROR("Trait `" + type->name + "` has no method `" + method + "`", call->line, call->col);
+            return false;
+        }
+        call->name = type->name + "." + method;
+        call->vslot = static_cast<int>(m - methods.begin());
+    } else {
+        // 具体类型：静态解析成 "类型.m" 的普通调用
+        call->name = type->name + "." + method;
+        if (!findFunction(call->name)) {
+            THROW_ERROR("No method `" + method + "` on type `" + type->name + "`", call->line, call->col);
+            return false;
+        }
+    }
+    call->is_method = false;
+    return true;
+}
+
 void TypeChecker::checkFunction(const std::shared_ptr<FunctionNode>& func) {
     /*std::vector<std::shared_ptr<Type>> paramTypes;
     for (const auto& param : func->parameters) {
@@ -129,6 +266,10 @@ std::shared_ptr<Type> TypeChecker::checkStatement(const ASTNodePtr& stmt) {
                 THROW_ERROR("Undefined variable: " + assign->name, stmt->line, stmt->col);
                 return nullptr;
             }
+            if (varInfo->is_const) {
+                THROW_ERROR("Cannot assign to const variable: " + assign->name, stmt->line, stmt->col);
+                return nullptr;
+            }
             auto valueType = checkExpression(assign->value);
             if (!varInfo->type->equals(valueType)) {
                 THROW_ERROR("Type mismatch in assignment", stmt->line, stmt->col);
@@ -160,13 +301,13 @@ std::shared_ptr<Type> TypeChecker::checkStatement(const ASTNodePtr& stmt) {
         case NodeType::FOR_STMT: {
             auto forStmt = std::static_pointer_cast<ForStmtNode>(stmt);
             if (forStmt->init) {
-                checkExpression(forStmt->init);
+                checkStatement(forStmt->init);
             }
             if (forStmt->condition) {
                 checkExpression(forStmt->condition);
             }
             if (forStmt->increment) {
-                checkExpression(forStmt->increment);
+                checkStatement(forStmt->increment);
             }
             for (const auto& s : forStmt->body) {
                 checkStatement(s);
@@ -184,13 +325,16 @@ std::shared_ptr<Type> TypeChecker::checkStatement(const ASTNodePtr& stmt) {
 }
 
 void TypeChecker::checkVariableDecl(const std::shared_ptr<VariableDeclNode>& decl) {
+    if (decl->is_static && !scopes.empty()) {
+        THROW_ERROR("static variable `" + decl->name + "` must be declared at top level", decl->line, decl->col);
+    }
     auto initType = checkExpression(decl->initializer);
     if (!decl->type->equals(initType)) {
         THROW_ERROR("Type mismatch in variable declaration"
                     ": var `" + decl->name + "` type is (" + decl->type->to_string() + ") but expr type (" + initType->to_string() + ")"
             , decl->line, decl->col);
     }
-    addVariable(decl->name, decl->type, decl->line, decl->col);
+    addVariable(decl->name, decl->type, decl->line, decl->col, decl->is_const);
 }
 
 std::shared_ptr<Type> TypeChecker::checkBinaryOp(const std::shared_ptr<BinaryOpNode>& op) {
@@ -234,6 +378,18 @@ std::shared_ptr<Type> TypeChecker::checkBinaryOp(const std::shared_ptr<BinaryOpN
                 return nullptr;
             }
             return std::make_shared<Type>(TypeKind::BOOL);
+        case BinaryOpType::BIT_AND: {
+            auto integer = [](const std::shared_ptr<Type>& t) {
+                return t && !t->is_ptr && !t->is_arr &&
+                       (t->kind == TypeKind::I8 || t->kind == TypeKind::I16 || t->kind == TypeKind::I32 ||
+                        t->kind == TypeKind::I64 || t->kind == TypeKind::U8 || t->kind == TypeKind::U16 ||
+                        t->kind == TypeKind::U32 || t->kind == TypeKind::U64);
+            };
+            if (!integer(leftType) || !integer(rightType)) {
+                THROW_ERROR("Bitwise operations require integer types", op->line, op->col);
+            }
+            return leftType;
+        }
         case BinaryOpType::AS:
 
         default:
@@ -242,6 +398,12 @@ std::shared_ptr<Type> TypeChecker::checkBinaryOp(const std::shared_ptr<BinaryOpN
 }
 
 std::shared_ptr<Type> TypeChecker::checkFunctionCall(const std::shared_ptr<FunctionCallNode>& call) {
+    std::vector<std::shared_ptr<Type>> argTypes;
+    // recv.m(args)：先按接收者的类型确定调用的函数
+    if (call->is_method) {
+        argTypes.push_back(checkExpression(call->arguments[0]));
+        if (!resolveMethod(call, argTypes[0])) return nullptr;
+    }
     const auto funcInfo = findFunction(call->name);
     if (!funcInfo) {
         THROW_ERROR("Undefined function: " + call->name, call->line, call->col);
@@ -254,14 +416,56 @@ std::shared_ptr<Type> TypeChecker::checkFunctionCall(const std::shared_ptr<Funct
             , call->line, call->col);
     }
 
-    for (size_t i = 0; i < call->arguments.size(); ++i)
-        if (const auto argType = checkExpression(call->arguments[i]); !argType->equals(funcInfo->paramTypes[i]))
+    for (size_t i = argTypes.size(); i < call->arguments.size(); ++i) argTypes.push_back(checkExpression(call->arguments[i]));
+
+    // 泛型函数：按实参类型推导类型参数，再用代入后的签名检查
+    TypeBindings bindings;
+    if (!funcInfo->typeParams.empty()) {
+        std::string error;
+        for (size_t i = 0; i < argTypes.size() && i < funcInfo->paramTypes.size(); ++i) {
+            if (!deduce(funcInfo->paramTypes[i], argTypes[i], funcInfo->typeParams, bindings, error)) {
+                THROW_ERROR("Cannot infer type arguments of function " + call->name + ": " + error, call->line, call->col);
+                return funcInfo->returnType;
+            }
+        }
+        call->type_args.clear();
+        for (const auto& p : funcInfo->typeParams) {
+            const auto it = bindings.find(p);
+            if (it == bindings.end()) {
+                THROW_ERROR("Cannot infer type parameter `" + p + "` of function " + call->name, call->line, call->col);
+                return funcInfo->returnType;
+            }
+            call->type_args.push_back(it->second);
+        }
+    }
+
+    for (size_t i = 0; i < argTypes.size() && i < funcInfo->paramTypes.size(); ++i) {
+        const auto paramType = substitute(funcInfo->paramTypes[i], bindings);
+        if (argTypes[i] && !argTypes[i]->equals(paramType))
             THROW_ERROR(
                 "Type mismatch in argument " + std::to_string(i) + " of function " + call->name +
-                " (expected " + funcInfo->paramTypes[i]->to_string() + ", got " + argType->to_string() + ")"
+                " (expected " + paramType->to_string() + ", got " + argTypes[i]->to_string() + ")"
                 , call->line, call->col);
+    }
 
-    return funcInfo->returnType;
+    return substitute(funcInfo->returnType, bindings);
+}
+
+void TypeChecker::resolveCalls(const ASTNodePtr& expr) {
+    if (!expr) return;
+    if (expr->type == NodeType::FUNCTION_CALL) {
+        const auto call = std::static_pointer_cast<FunctionCallNode>(expr);
+        const auto info = call->is_method ? nullptr : findFunction(call->name);
+        // checkFunctionCall 会检查实参，不再往下走
+        if (call->is_method || (info && !info->typeParams.empty())) {
+            checkFunctionCall(call);
+            return;
+        }
+    } else if (expr->type == NodeType::MACRO_CALL) {
+        checkMacroCall(std::static_pointer_cast<MacroCallNode>(expr));
+        return;
+    }
+    each_slot(expr, [&](ASTNodePtr& n) { resolveCalls(n); });
 }
 
 std::shared_ptr<Type> TypeChecker::checkPrimary(const ASTNodePtr& expr) {
@@ -274,7 +478,13 @@ std::shared_ptr<Type> TypeChecker::checkPrimary(const ASTNodePtr& expr) {
         case NodeType::STRING:return e->ret_type;
         default:break;
     }
-    if (e->ret_type) return e->ret_type;
+    // p as dyn Trait 的 ret_type 是解析时定的，仍要检查 p
+    if (e->type == NodeType::UNARY && std::static_pointer_cast<UnaryOpNode>(expr)->op == UnaryOpType::Dyn)
+        return checkUnary(std::static_pointer_cast<UnaryOpNode>(expr));
+    if (e->ret_type) {
+        resolveCalls(expr);
+        return e->ret_type;
+    }
     switch (e->type) {
     case NodeType::IDENTIFIER:
         return checkIdentifier(std::static_pointer_cast<IdentifierNode>(expr));
@@ -283,8 +493,7 @@ std::shared_ptr<Type> TypeChecker::checkPrimary(const ASTNodePtr& expr) {
     case NodeType::BINARY_OP:
         return checkBinaryOp(std::static_pointer_cast<BinaryOpNode>(expr));
     case NodeType::MACRO_CALL:
-        // 宏调用由编译器特殊处理，返回 i32
-        return std::make_shared<Type>(TypeKind::I32);
+        return checkMacroCall(std::static_pointer_cast<MacroCallNode>(expr));
     case NodeType::UNARY:
         return checkUnary(std::static_pointer_cast<UnaryOpNode>(expr));
     default:
@@ -294,6 +503,24 @@ std::shared_ptr<Type> TypeChecker::checkPrimary(const ASTNodePtr& expr) {
 
 }
 
+std::shared_ptr<Type> TypeChecker::checkMacroCall(const std::shared_ptr<MacroCallNode>& macro) {
+    // 宏调用由编译器特殊处理：size_of!、align_of!、load!、bounds!、stack_alloc! 和 rodata! 得到 i64，store! 没有值，其余返回 i32
+    if (macro->name == "load" || macro->name == "store") {
+        if (macro->arguments.size() != (macro->name == "load" ? 1u : 2u))
+            THROW_ERROR(macro->name + "!() expects " + (macro->name == "load" ? "(address)" : "(address, value)"),
+                        macro->line, macro->col);
+    }
+    if (macro->name == "bounds" && macro->arguments.size() != 2)
+        THROW_ERROR("bounds!() expects (index, length)", macro->line, macro->col);
+    // size_of!/align_of! 的类型参数不在 arguments 里，其余参数都是普通表达式
+    for (const auto& a : macro->arguments) checkExpression(a);
+    if (macro->name == "size_of" || macro->name == "align_of" || macro->name == "load" || macro->name == "bounds" ||
+        macro->name == "stack_alloc" || macro->name == "rodata")
+        return std::make_shared<Type>(TypeKind::I64);
+    if (macro->name == "store") return std::make_shared<Type>(TypeKind::VOID);
+    return std::make_shared<Type>(TypeKind::I32);
+}
+
 std::shared_ptr<Type> TypeChecker::checkUnary(const std::shared_ptr<UnaryOpNode>& op) {
     switch (op->op) {
         case UnaryOpType::Addr: {
@@ -306,6 +533,25 @@ std::shared_ptr<Type> TypeChecker::checkUnary(const std::shared_ptr<UnaryOpNode>
             result->is_ptr = true;
             return result;
         }
+        case UnaryOpType::Dyn: {
+            // 只有指向实现了该 trait 的类型的指针能转换成 dyn Trait
+            const auto& trait = op->ret_type->name;
+            const auto source = unwrap(checkExpression(op->expr));
+            if (!source) return op->ret_type;
+            if (!source->is_ptr || source->is_arr || source->is_dyn) {
+                THROW_ERROR("Only pointers can be converted to `dyn " + trait + "`", op->line, op->col);
+                return op->ret_type;
+            }
+            if (!traits.contains(trait))
+                THROW_ERROR("Unknown trait `" + trait + "`", op->line, op->col);
+            else if (!impls.contains(source->name + ":" + trait))
+                THROW_ERROR("`" + source->name + "` does not implement trait `" + trait + "`", op->line, op->col);
+            // 记下源类型，Devirtualizer 和代码生成据此找到虚表
+            auto type = std::make_shared<Type>(TypeKind::I32, true);
+            type->name = source->name;
+            std::static_pointer_cast<ExprNode>(op->expr)->ret_type = type;
+            return op->ret_type;
+        }
         case UnaryOpType::Minus:
         default:
             return checkExpression(op->expr);
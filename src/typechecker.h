@@ -4,17 +4,20 @@
 #include "ast.h"
 #include <memory>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
 
 struct VariableInfo {
     std::shared_ptr<Type> type;
+    bool is_const{false};
 };
 
 struct FunctionInfo {
     std::vector<std::shared_ptr<Type>> paramTypes;
     std::shared_ptr<Type> returnType;
     bool has_body;
+    std::vector<std::string> typeParams;    // 泛型函数的类型参数
 };
 
 class TypeChecker {
@@ -22,29 +25,43 @@ public:
     TypeChecker();
     
     void checkProgram(const std::shared_ptr<ProgramNode> &program);
+    // 登记其他模块导出的函数和全局变量，名字已经由 ModuleLoader 改写过
+    void declareFunction(const std::shared_ptr<FunctionNode>& func);
+    void declareGlobal(const std::shared_ptr<VariableDeclNode>& decl);
+    // 登记 trait 和 impl Type : Trait；trait 的方法登记为 "Trait.m"，接收者是 dyn Trait
+    void declareTrait(const std::shared_ptr<TraitDeclNode>& trait);
+    void declareImpl(const std::shared_ptr<ImplDeclNode>& impl);
     
 private:
     std::map<std::string, VariableInfo> variables;
     std::map<std::string, FunctionInfo> functions;
+    std::map<std::string, std::shared_ptr<TraitDeclNode>> traits;
+    std::set<std::string> impls;    // "Type:Trait"
     std::vector<std::map<std::string, VariableInfo>> scopes;
     
     void pushScope();
     void popScope();
-    void addVariable(const std::string& name, std::shared_ptr<Type> type, size_t line, size_t col);
+    void addVariable(const std::string& name, std::shared_ptr<Type> type, size_t line, size_t col, bool is_const = false);
     std::shared_ptr<VariableInfo> findVariable(const std::string& name);
     void addFunction(const std::string &name, const std::vector<std::shared_ptr<Type>> &paramTypes, std::shared_ptr<Type> returnType, bool
                      has_body, size_t line, size_t col);
     FunctionInfo* findFunction(const std::string& name);
     
     void checkFunction(const std::shared_ptr<FunctionNode> &func);
+    void checkTrait(const std::shared_ptr<TraitDeclNode> &trait);
+    void checkImpl(const std::shared_ptr<ImplDeclNode> &impl);
+    bool resolveMethod(const std::shared_ptr<FunctionCallNode> &call, const std::shared_ptr<Type> &receiver);
     std::shared_ptr<Type> checkExpression(const ASTNodePtr& expr);
     std::shared_ptr<Type> checkStatement(const ASTNodePtr &stmt);
     void checkVariableDecl(const std::shared_ptr<VariableDeclNode>& decl);
     std::shared_ptr<Type> checkBinaryOp(const std::shared_ptr<BinaryOpNode>& op);
     std::shared_ptr<Type> checkFunctionCall(const std::shared_ptr<FunctionCallNode> &call);
     std::shared_ptr<Type> checkPrimary(const ASTNodePtr &expr);
+    // `expr as T` 不检查 expr 的类型，但其中的泛型调用要推导类型实参、方法调用要解析、宏参数要检查
+    void resolveCalls(const ASTNodePtr &expr);
 
     std::shared_ptr<Type> checkUnary(const std::shared_ptr<UnaryOpNode> &op);
+    std::shared_ptr<Type> checkMacroCall(const std::shared_ptr<MacroCallNode> &macro);
 
     std::shared_ptr<Type> checkIdentifier(const std::shared_ptr<IdentifierNode> &id);
 };
@@ -0,0 +1,178 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "unroll.h"
+#include "generics.h"
+#include <functional>
+
+namespace {
+
+// 紧挨在 result 末尾、名字是 name 的变量声明
+std::shared_ptr<VariableDeclNode> last_decl(const std::vector<ASTNodePtr>& result, const size_t skip, const std::string& name) {
+    if (result.size() <= skip) return nullptr;
+    const auto& s = result[result.size() - 1 - skip];
+    if (s->type != NodeType::VARIABLE_DECL) return nullptr;
+    const auto decl = std::static_pointer_cast<VariableDeclNode>(s);
+    return decl->name == name && decl->initializer ? decl : nullptr;
+}
+
+int64_t number(const ASTNodePtr& node) {
+    return std::static_pointer_cast<NumberNode>(node)->value;
+}
+
+// 循环体里 name 换成字面量 value
+void replace(ASTNodePtr& node, const std::string& name, const int64_t value, const std::shared_ptr<Type>& type) {
+    if (!node) return;
+    if (node->type == NodeType::IDENTIFIER) {
+        const auto id = std::static_pointer_cast<IdentifierNode>(node);
+        if (id->name != name) return;
+        const auto n = std::make_shared<NumberNode>(id->line, id->col, value);
+        n->set_ret_type(id->ret_type ? id->ret_type : type);
+        node = n;
+        return;
+    }
+    each_slot(node, [&](ASTNodePtr& n) { replace(n, name, value, type); });
+    if (node->type == NodeType::IF_STMT) {
+        const auto n = std::static_pointer_cast<IfStmtNode>(node);
+        for (auto& s : n->thenBody) replace(s, name, value, type);
+        for (auto& s : n->elseBody) replace(s, name, value, type);
+    } else if (node->type == NodeType::FOR_STMT) {
+        for (auto& s : std::static_pointer_cast<ForStmtNode>(node)->body) replace(s, name, value, type);
+    }
+}
+
+}
+
+void LoopUnroller::run() {
+    for (const auto& s : program->stmts) {
+        const auto fn = function_of(s);
+        if (!fn || !fn->has_body || !fn->type_params.empty()) continue;
+        addressed = addressed_vars(fn);
+        body(fn->body);
+    }
+}
+
+void LoopUnroller::body(std::vector<ASTNodePtr>& stmts) {
+    std::vector<ASTNodePtr> result;
+    for (const auto& s : stmts) {
+        if (s->type == NodeType::IF_STMT) {
+            const auto n = std::static_pointer_cast<IfStmtNode>(s);
+            body(n->thenBody);
+            body(n->elseBody);
+        } else if (s->type == NodeType::FOR_STMT) {
+            const auto loop = std::static_pointer_cast<ForStmtNode>(s);
+            body(loop->body);
+            if (unroll(loop, result)) continue;
+        }
+        result.push_back(s);
+    }
+    stmts = std::move(result);
+}
+
+bool LoopUnroller::unroll(const std::shared_ptr<ForStmtNode>& loop, std::vector<ASTNodePtr>& result) {
+    // 范围 for 的形状：for v < hi / end，增量 v = v + step
+    if (loop->init || !loop->increment || loop->increment->type != NodeType::ASSIGNMENT ||
+        !loop->condition || loop->condition->type != NodeType::BINARY_OP) return false;
+    const auto cond = std::static_pointer_cast<BinaryOpNode>(loop->condition);
+    if (cond->op != BinaryOpType::LT || cond->left->type != NodeType::IDENTIFIER) return false;
+    const auto& v = std::static_pointer_cast<IdentifierNode>(cond->left)->name;
+    const auto inc = std::static_pointer_cast<AssignmentNode>(loop->increment);
+    const auto step = inc->value->type == NodeType::BINARY_OP ? std::static_pointer_cast<BinaryOpNode>(inc->value) : nullptr;
+    if (inc->name != v || !step || step->op != BinaryOpType::ADD || step->right->type != NodeType::NUMBER) return false;
+
+    // 上界：字面量，或者紧挨在循环前的 let end = ...
+    ASTNodePtr hi = cond->right;
+    size_t prelude = 0;
+    if (hi->type == NodeType::IDENTIFIER) {
+        const auto end = last_decl(result, 0, std::static_pointer_cast<IdentifierNode>(hi)->name);
+        if (!end) return false;
+        hi = end->initializer;
+        prelude++;
+    } else if (hi->type != NodeType::NUMBER) {
+        return false;
+    }
+    const auto start = last_decl(result, prelude, v);
+    if (!start) return false;
+    prelude++;
+
+    // 每一轮代入的变量和值
+    std::string name;
+    std::shared_ptr<Type> type;
+    std::vector<int64_t> values;
+    size_t first = 0;       // 循环体从这条语句开始复制
+    if (start->initializer->type == NodeType::NUMBER && hi->type == NodeType::NUMBER && number(step->right) == 1) {
+        // for v <: lo..hi
+        const auto lo = number(start->initializer), count = number(hi) - lo;
+        if (count > static_cast<int64_t>(MAX_TRIPS)) return false;
+        for (int64_t k = 0; k < count; k++) values.push_back(lo + k);
+        name = v;
+        type = start->type;
+    } else if (start->initializer->type == NodeType::MACRO_CALL &&
+               std::static_pointer_cast<MacroCallNode>(start->initializer)->name == "rodata") {
+        // for x <: [c0, c1, ...]：p = rodata!(...), end = p + 8n，循环体开头 let x = load!(p)
+        const auto& table = std::static_pointer_cast<MacroCallNode>(start->initializer)->arguments;
+        if (table.size() > MAX_TRIPS || number(step->right) != 8 || hi->type != NodeType::BINARY_OP) return false;
+        const auto size = std::static_pointer_cast<BinaryOpNode>(hi);
+        if (size->op != BinaryOpType::ADD || size->left->type != NodeType::IDENTIFIER ||
+            std::static_pointer_cast<IdentifierNode>(size->left)->name != v || size->right->type != NodeType::NUMBER ||
+            number(size->right) != static_cast<int64_t>(table.size()) * 8) return false;
+        if (loop->body.empty() || loop->body[0]->type != NodeType::VARIABLE_DECL) return false;
+        const auto element = std::static_pointer_cast<VariableDeclNode>(loop->body[0]);
+        const auto& load = element->initializer;
+        if (!load || load->type != NodeType::MACRO_CALL || std::static_pointer_cast<MacroCallNode>(load)->name != "load" ||
+            std::static_pointer_cast<MacroCallNode>(load)->arguments.size() != 1 ||
+            std::static_pointer_cast<MacroCallNode>(load)->arguments[0]->type != NodeType::IDENTIFIER ||
+            std::static_pointer_cast<IdentifierNode>(std::static_pointer_cast<MacroCallNode>(load)->arguments[0])->name != v)
+            return false;
+        for (const auto& c : table) values.push_back(number(c));
+        name = element->name;
+        type = element->type;
+        first = 1;
+    } else {
+        return false;
+    }
+
+    // 循环体：没有 break / continue，代入的变量不被赋值、取地址，节点能复制
+    if (addressed.contains(name) || addressed.contains(v)) return false;
+    bool ok = true;
+    size_t count = 0;
+    for (size_t k = first; k < loop->body.size(); k++) {
+        each_node(loop->body[k], [&](const ASTNodePtr& node) {
+            count++;
+            switch (node->type) {
+            case NodeType::ASSIGNMENT:
+                ok &= std::static_pointer_cast<AssignmentNode>(node)->name != name &&
+                      std::static_pointer_cast<AssignmentNode>(node)->name != v;
+                break;
+            case NodeType::VARIABLE_DECL:
+                ok &= std::static_pointer_cast<VariableDeclNode>(node)->name != name;
+                break;
+            case NodeType::IDENTIFIER:
+                // 数组的循环体只通过 x 用到元素，不直接用指针
+                ok &= first == 0 || std::static_pointer_cast<IdentifierNode>(node)->name != v;
+                break;
+            case NodeType::BREAK_STMT:
+            case NodeType::CONTINUE_STMT:
+            case NodeType::NAME_SPACE_VISIT:
+            case NodeType::FUNCTION:
+            case NodeType::STRUCT_DECL:
+                ok = false;
+                break;
+            default:
+                break;
+            }
+        });
+    }
+    if (!ok || count * values.size() > MAX_NODES) return false;
+
+    result.resize(result.size() - prelude);
+    for (const auto value : values) {
+        for (size_t k = first; k < loop->body.size(); k++) {
+            auto s = copy_node(loop->body[k]);
+            replace(s, name, value, type);
+            result.push_back(s);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_UNROLL_H
+#define POLO_COMPILER_PRE_UNROLL_H
+#include "ast.h"
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// 循环完全展开。解析范围 for 得到的计数循环（见 Parser::parseRangeFor）次数是编译期常量且不多时，
+// 把循环体按轮复制，循环变量换成这一轮的字面量，循环前的准备语句一并去掉：
+//   for i <: 0..3 { s = s + i; }          ->  s = s + 0; s = s + 1; s = s + 2;
+//   for x <: [1, 4, 7] { s = s + x; }     ->  s = s + 1; s = s + 4; s = s + 7;
+// 循环里有 break / continue，或者给循环变量赋值、取地址时不展开。
+// 在编译期求值之后运行，上界是 const 的范围也能展开；先展开内层循环。
+
+class LoopUnroller {
+public:
+    static constexpr size_t MAX_TRIPS = 8;
+    static constexpr size_t MAX_NODES = 256;    // 展开后的节点总数
+
+    explicit LoopUnroller(std::shared_ptr<ProgramNode> program) : program(std::move(program)) {}
+    void run();
+
+private:
+    std::shared_ptr<ProgramNode> program;
+    std::unordered_set<std::string> addressed;      // 当前函数里被取了地址的变量
+
+    void body(std::vector<ASTNodePtr>& stmts);
+    // result 的最后是循环前的准备语句；能展开时去掉它们，换成展开的语句
+    bool unroll(const std::shared_ptr<ForStmtNode>& loop, std::vector<ASTNodePtr>& result);
+};
+
+#endif //POLO_COMPILER_PRE_UNROLL_H
@@ -0,0 +1,183 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_ASM_H
+#define POLO_COMPILER_PRE_ASM_H
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// 机器指令层：WatGen 生成它，再由 AsmPrinter 打印成 .s 或由 X64Encoder 直接编码
+
+enum class Reg : uint8_t {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+    RIP,
+    NONE = 0xff,
+};
+
+Reg reg_from_name(const std::string& name);
+const char* reg_name(Reg r, uint8_t size = 8);
+
+enum class Cond : uint8_t {
+    B = 0x2, AE = 0x3, BE = 0x6, A = 0x7,      // 无符号
+    E = 0x4, NE = 0x5, L = 0xC, GE = 0xD, LE = 0xE, G = 0xF,
+};
+
+enum class Op : uint8_t {
+    MOV, LEA, PUSH, POP, XCHG,
+    ADD, SUB, AND, OR, CMP, TEST, IMUL,
+    NEG, IDIV, CQO, INC, MOVSXD, BT,
+    SETCC, JMP, JCC, CALL, RET, LEAVE, SYSCALL, UD2,
+
+    // 伪指令
+    LABEL, ALIGN, COMMENT,
+    TABLE_ENTRY,        // 跳转表项 .long a - b，a 是代码里的标签，b 是 .rodata 里的表头标签
+    RODATA, TEXT,       // 之后的伪指令放进 .rodata / 回到 .text，.rodata 里只有 LABEL、ALIGN、TABLE_ENTRY
+    CFI_STARTPROC, CFI_ENDPROC,
+    CFI_DEF_CFA, CFI_DEF_CFA_OFFSET, CFI_DEF_CFA_REGISTER, CFI_ADJUST_CFA_OFFSET,
+    CFI_OFFSET, CFI_REMEMBER_STATE, CFI_RESTORE_STATE,
+};
+
+struct Operand {
+    enum class Kind : uint8_t { None, Reg, Imm, Mem, Label, Symbol };
+    Kind kind{Kind::None};
+    uint8_t size{8};        // 寄存器宽度（字节）
+    Reg reg{Reg::NONE};     // Reg 或 Mem 的基址
+    Reg index{Reg::NONE};   // Mem 的变址寄存器，地址 = reg + index * scale + imm
+    uint8_t scale{1};
+    int64_t imm{0};         // Imm 的值或 Mem 的偏移
+    int label{-1};          // Label: 函数内标签；Mem+RIP: 字符串常量编号
+    std::string sym;        // Symbol: 调用目标；Mem+RIP: 数据符号
+
+    static Operand r(const Reg reg, const uint8_t size = 8) {
+        Operand o;
+        o.kind = Kind::Reg;
+        o.reg = reg;
+        o.size = size;
+        return o;
+    }
+    static Operand i(const int64_t v) {
+        Operand o;
+        o.kind = Kind::Imm;
+        o.imm = v;
+        return o;
+    }
+    static Operand mem(const Reg base, const int64_t disp) {
+        Operand o;
+        o.kind = Kind::Mem;
+        o.reg = base;
+        o.imm = disp;
+        return o;
+    }
+    static Operand sib(const Reg base, const Reg index, const uint8_t scale) {
+        Operand o;
+        o.kind = Kind::Mem;
+        o.reg = base;
+        o.index = index;
+        o.scale = scale;
+        return o;
+    }
+    static Operand str(const int id) {     // [rip + .L_str_<id>]
+        Operand o;
+        o.kind = Kind::Mem;
+        o.reg = Reg::RIP;
+        o.label = id;
+        return o;
+    }
+    static Operand data(std::string name, const int64_t disp = 0) {    // [rip + name+disp]
+        Operand o;
+        o.kind = Kind::Mem;
+        o.reg = Reg::RIP;
+        o.sym = std::move(name);
+        o.imm = disp;
+        return o;
+    }
+    static Operand lbl(const int id) {
+        Operand o;
+        o.kind = Kind::Label;
+        o.label = id;
+        return o;
+    }
+    static Operand symbol(std::string name) {
+        Operand o;
+        o.kind = Kind::Symbol;
+        o.sym = std::move(name);
+        return o;
+    }
+};
+
+struct Inst {
+    Op op;
+    Cond cc{Cond::E};
+    Operand a, b;
+    std::string text;       // COMMENT 的内容
+};
+
+struct MachineFunction {
+    std::string name;
+    std::vector<Inst> insts;
+    std::vector<std::string> labels;    // 标签 id -> 前缀
+    int label_base{0};                  // 模块内的标签编号 = label_base + id
+    size_t frame_fixup{SIZE_MAX};       // `sub rsp, N` 的位置，函数体生成完后回填 N
+
+    [[nodiscard]] std::string label_name(const int id) const {
+        return ".L_" + labels[id] + "_" + std::to_string(label_base + id);
+    }
+};
+
+// 顶层条目按源码顺序保存，保证 .s 输出顺序不变
+struct AsmEntry {
+    enum class Kind : uint8_t { Extern, Function } kind;
+    std::string name;       // Extern
+    size_t index{0};        // Function: functions 下标
+};
+
+// 可写数据段中的对象
+struct DataObject {
+    std::string name;
+    std::vector<uint8_t> bytes;
+    size_t align{8};
+};
+
+struct AsmModule {
+    std::vector<std::string> globals;
+    std::vector<AsmEntry> entries;
+    std::vector<MachineFunction> functions;
+    std::vector<std::string> strings;   // .L_str_<id> 的内容
+    std::unordered_set<int> tables;     // strings 中 rodata! 的常量表，按 8 字节对齐
+    std::vector<DataObject> data;       // .data
+    std::vector<std::string> fini_array;    // 程序退出时调用的函数
+    bool gnu_stack_note{true};
+};
+
+// 按输出顺序接收模块内容：WatGen 每合并完一个函数就交给它，随后释放该函数
+// begin 时 globals 已确定；strings / data / fini_array 要到 end 时才完整
+class ModuleSink {
+public:
+    virtual ~ModuleSink() = default;
+    virtual void begin(const AsmModule& /*module*/) {}
+    virtual void external(const std::string& /*name*/) {}
+    virtual void function(const MachineFunction& fn) = 0;
+    virtual void end(const AsmModule& /*module*/) {}
+};
+
+class AsmPrinter : public ModuleSink {
+public:
+    explicit AsmPrinter(std::ostream& os) : os(os) {}
+    void print(const AsmModule& module);
+    void begin(const AsmModule& module) override;
+    void external(const std::string& name) override;
+    void function(const MachineFunction& fn) override { print_function(fn); }
+    void end(const AsmModule& module) override;
+    void print_function(const MachineFunction& fn);
+    void print_inst(const MachineFunction& fn, const Inst& inst);
+private:
+    std::ostream& os;
+    void print_operand(const MachineFunction& fn, const Operand& o);
+};
+
+#endif //POLO_COMPILER_PRE_ASM_H
@@ -0,0 +1,278 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "asm.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+namespace {
+
+const char* reg64[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+                       "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15", "rip"};
+const char* reg8[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+                      "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b", "rip"};
+
+const char* cond_suffix(const Cond cc) {
+    switch (cc) {
+    case Cond::B: return "b";
+    case Cond::AE: return "ae";
+    case Cond::BE: return "be";
+    case Cond::A: return "a";
+    case Cond::E: return "z";
+    case Cond::NE: return "nz";
+    case Cond::L: return "l";
+    case Cond::GE: return "ge";
+    case Cond::LE: return "le";
+    case Cond::G: return "g";
+    }
+    return "";
+}
+
+const char* mnemonic(const Op op) {
+    switch (op) {
+    case Op::MOV: return "mov";
+    case Op::LEA: return "lea";
+    case Op::PUSH: return "push";
+    case Op::POP: return "pop";
+    case Op::XCHG: return "xchg";
+    case Op::ADD: return "add";
+    case Op::SUB: return "sub";
+    case Op::AND: return "and";
+    case Op::OR: return "or";
+    case Op::CMP: return "cmp";
+    case Op::TEST: return "test";
+    case Op::IMUL: return "imul";
+    case Op::NEG: return "neg";
+    case Op::IDIV: return "idiv";
+    case Op::CQO: return "cqo";
+    case Op::INC: return "inc";
+    case Op::MOVSXD: return "movsxd";
+    case Op::BT: return "bt";
+    case Op::JMP: return "jmp";
+    case Op::CALL: return "call";
+    case Op::RET: return "ret";
+    case Op::LEAVE: return "leave";
+    case Op::SYSCALL: return "syscall";
+    case Op::UD2: return "ud2";
+    default: return "";
+    }
+}
+
+// 转义字符串用于 .string 指令
+std::string escape(const std::string& str) {
+    std::string escaped;
+    for (const unsigned char c : str) {
+        if (c == '"') escaped += "\\\"";
+        else if (c == '\\') escaped += "\\\\";
+        else if (c == '\n') escaped += "\\n";
+        else if (c == '\r') escaped += "\\r";
+        else if (c == '\t') escaped += "\\t";
+        else if (c >= 32 && c < 127) escaped += static_cast<char>(c);
+        else {
+            // 八进制转义
+            char buf[8] = {};
+            snprintf(buf, sizeof(buf), "\\%03o", c);
+            escaped += buf;
+        }
+    }
+    return escaped;
+}
+
+}
+
+Reg reg_from_name(const std::string& name) {
+    for (size_t i = 0; i < std::size(reg64); i++)
+        if (name == reg64[i]) return static_cast<Reg>(i);
+    return Reg::NONE;
+}
+
+const char* reg_name(const Reg r, const uint8_t size) {
+    if (r == Reg::NONE) return "";
+    return size == 1 ? reg8[static_cast<size_t>(r)] : reg64[static_cast<size_t>(r)];
+}
+
+void AsmPrinter::print(const AsmModule& module) {
+    begin(module);
+    for (const auto& e : module.entries) {
+        if (e.kind == AsmEntry::Kind::Extern) external(e.name);
+        else print_function(module.functions[e.index]);
+    }
+    end(module);
+}
+
+void AsmPrinter::begin(const AsmModule& module) {
+    os << ".intel_syntax noprefix\n";
+    for (const auto& g : module.globals)
+        os << ".globl " << g << '\n';
+    os << '\n';
+}
+
+void AsmPrinter::external(const std::string& name) {
+    os << ".extern " << name << '\n';
+}
+
+void AsmPrinter::end(const AsmModule& module) {
+    // 输出数据段（字符串常量）
+    if (!module.strings.empty()) {
+        os << '\n';
+        os << ".section .rodata\n";
+        for (size_t i = 0; i < module.strings.size(); i++) {
+            if (module.tables.contains(static_cast<int>(i))) os << "    .balign 8\n";
+            os << ".L_str_" << i << ":\n";
+            os << "    .string \"" << escape(module.strings[i]) << "\"\n";
+            os << '\n';
+        }
+    }
+    if (!module.data.empty()) {
+        os << '\n';
+        os << ".data\n";
+        for (const auto& d : module.data) {
+            os << "    .align " << d.align << '\n';
+            os << d.name << ":\n";
+            size_t end = d.bytes.size();
+            while (end > 0 && d.bytes[end - 1] == 0) end--;
+            for (size_t i = 0; i < end; i += 16) {
+                os << "    .byte ";
+                for (size_t j = i; j < std::min(end, i + 16); j++)
+                    os << (j == i ? "" : ", ") << static_cast<unsigned>(d.bytes[j]);
+                os << '\n';
+            }
+            if (end < d.bytes.size())
+                os << "    .zero " << d.bytes.size() - end << '\n';
+        }
+    }
+    if (!module.fini_array.empty()) {
+        os << '\n';
+        os << ".section .fini_array,\"aw\"\n";
+        os << "    .align 8\n";
+        for (const auto& f : module.fini_array)
+            os << "    .quad " << f << '\n';
+    }
+    if (module.gnu_stack_note)
+        os << ".section .note.GNU-stack,\"\",@progbits\n";
+}
+
+void AsmPrinter::print_function(const MachineFunction& fn) {
+    for (const auto& inst : fn.insts)
+        print_inst(fn, inst);
+    os << '\n';
+}
+
+void AsmPrinter::print_operand(const MachineFunction& fn, const Operand& o) {
+    switch (o.kind) {
+    case Operand::Kind::Reg:
+        os << reg_name(o.reg, o.size);
+        break;
+    case Operand::Kind::Imm:
+        os << o.imm;
+        break;
+    case Operand::Kind::Mem:
+        if (o.reg == Reg::RIP && !o.sym.empty()) {
+            os << "[rip + " << o.sym;
+            if (o.imm) os << (o.imm < 0 ? "" : "+") << o.imm;
+            os << "]";
+        } else if (o.reg == Reg::RIP) {
+            os << "[rip + .L_str_" << o.label << "]";
+        } else if (o.index != Reg::NONE) {
+            os << "[" << reg_name(o.reg) << " + " << reg_name(o.index) << "*" << static_cast<int>(o.scale);
+            if (o.imm) os << (o.imm < 0 ? " - " : " + ") << (o.imm < 0 ? -o.imm : o.imm);
+            os << "]";
+        } else if (o.imm == 0) {
+            os << "[" << reg_name(o.reg) << "]";
+        } else {
+            os << "[" << reg_name(o.reg) << (o.imm < 0 ? " - " : " + ")
+               << (o.imm < 0 ? -o.imm : o.imm) << "]";
+        }
+        break;
+    case Operand::Kind::Label:
+        os << fn.label_name(o.label);
+        break;
+    case Operand::Kind::Symbol:
+        os << o.sym;
+        break;
+    case Operand::Kind::None:
+        break;
+    }
+}
+
+void AsmPrinter::print_inst(const MachineFunction& fn, const Inst& inst) {
+    switch (inst.op) {
+    case Op::LABEL:
+        if (inst.a.kind == Operand::Kind::Symbol) os << inst.a.sym << ":\n";
+        else os << fn.label_name(inst.a.label) << ":\n";
+        return;
+    case Op::ALIGN:
+        os << "    .align " << inst.a.imm << '\n';
+        return;
+    case Op::TABLE_ENTRY:
+        os << "    .long " << fn.label_name(inst.a.label) << " - " << fn.label_name(inst.b.label) << '\n';
+        return;
+    case Op::RODATA:
+        os << "    .section .rodata\n";
+        return;
+    case Op::TEXT:
+        os << "    .text\n";
+        return;
+    case Op::COMMENT: {
+        std::string text;
+        for (const char c : inst.text) text += c == '\n' ? ' ' : c;
+        os << "    # " << text << '\n';
+        return;
+    }
+    case Op::CFI_STARTPROC:
+        os << "    .cfi_startproc\n";
+        return;
+    case Op::CFI_ENDPROC:
+        os << "    .cfi_endproc\n";
+        return;
+    case Op::CFI_DEF_CFA:
+        os << "    .cfi_def_cfa " << reg_name(inst.a.reg) << ", " << inst.b.imm << '\n';
+        return;
+    case Op::CFI_DEF_CFA_OFFSET:
+        os << "    .cfi_def_cfa_offset " << inst.a.imm << '\n';
+        return;
+    case Op::CFI_DEF_CFA_REGISTER:
+        os << "    .cfi_def_cfa_register " << reg_name(inst.a.reg) << '\n';
+        return;
+    case Op::CFI_ADJUST_CFA_OFFSET:
+        os << "    .cfi_adjust_cfa_offset " << inst.a.imm << '\n';
+        return;
+    case Op::CFI_OFFSET:
+        os << "    .cfi_offset " << reg_name(inst.a.reg) << ", " << inst.b.imm << '\n';
+        return;
+    case Op::CFI_REMEMBER_STATE:
+        os << "    .cfi_remember_state\n";
+        return;
+    case Op::CFI_RESTORE_STATE:
+        os << "    .cfi_restore_state\n";
+        return;
+    case Op::SETCC:
+        os << "    set" << cond_suffix(inst.cc);
+        break;
+    case Op::JCC:
+        os << "    j" << cond_suffix(inst.cc);
+        break;
+    default:
+        os << "    " << mnemonic(inst.op);
+        break;
+    }
+    if (inst.a.kind != Operand::Kind::None) {
+        os << " ";
+        // 没有寄存器操作数时需要标明内存操作数宽度
+        if (inst.a.kind == Operand::Kind::Mem && inst.b.kind != Operand::Kind::Reg)
+            os << "qword ptr ";
+        print_operand(fn, inst.a);
+    }
+    if (inst.b.kind != Operand::Kind::None) {
+        os << ", ";
+        if (inst.op == Op::LEA && inst.b.kind == Operand::Kind::Symbol) os << "[rip + " << inst.b.sym << "]";
+        else if (inst.op == Op::LEA && inst.b.kind == Operand::Kind::Label) os << "[rip + " << fn.label_name(inst.b.label) << "]";
+        else {
+            if (inst.op == Op::MOVSXD) os << "dword ptr ";
+            print_operand(fn, inst.b);
+        }
+    }
+    os << '\n';
+}
@@ -0,0 +1,505 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "encoder.h"
+#include "../common.h"
+
+namespace {
+
+uint8_t low3(const Reg r) { return static_cast<uint8_t>(r) & 7; }
+bool ext(const Reg r) { return r != Reg::RIP && r != Reg::NONE && static_cast<uint8_t>(r) >= 8; }
+bool fits8(const int64_t v) { return v >= INT8_MIN && v <= INT8_MAX; }
+bool fits32(const int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+void put32(std::vector<uint8_t>& out, const int64_t v) {
+    const auto u = static_cast<uint32_t>(v);
+    for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(u >> (i * 8)));
+}
+
+void put64(std::vector<uint8_t>& out, const int64_t v) {
+    const auto u = static_cast<uint64_t>(v);
+    for (int i = 0; i < 8; i++) out.push_back(static_cast<uint8_t>(u >> (i * 8)));
+}
+
+void uleb(std::vector<uint8_t>& out, uint64_t v) {
+    do {
+        uint8_t b = v & 0x7f;
+        v >>= 7;
+        if (v) b |= 0x80;
+        out.push_back(b);
+    } while (v);
+}
+
+// REX 前缀：W=64 位操作数，R 扩展 ModRM.reg，X 扩展 SIB.index，B 扩展 ModRM.rm / 基址
+void rex(std::vector<uint8_t>& out, const bool w, const Reg reg, const Reg rm, const bool force = false,
+         const Reg index = Reg::NONE) {
+    uint8_t b = 0x40;
+    if (w) b |= 0x08;
+    if (ext(reg)) b |= 0x04;
+    if (ext(index)) b |= 0x02;
+    if (ext(rm)) b |= 0x01;
+    if (b != 0x40 || force) out.push_back(b);
+}
+
+void modrm_reg(std::vector<uint8_t>& out, const uint8_t reg_field, const Reg rm) {
+    out.push_back(static_cast<uint8_t>(0xC0 | (reg_field & 7) << 3 | low3(rm)));
+}
+
+// 内存操作数；trailing 为 disp32 之后还跟着的立即数字节数（影响 RIP 相对寻址的 addend）
+void modrm_mem(std::vector<uint8_t>& out, const uint8_t reg_field, const Operand& m,
+               std::vector<Reloc>& relocs, const size_t trailing) {
+    const uint8_t r = (reg_field & 7) << 3;
+    if (m.reg == Reg::RIP) {
+        out.push_back(r | 0x05);
+        const auto addend = -4 - static_cast<int64_t>(trailing);
+        if (!m.sym.empty())
+            relocs.push_back({Reloc::Kind::Data, out.size(), m.sym, -1, m.imm + addend});
+        else
+            relocs.push_back({Reloc::Kind::String, out.size(), "", m.label, addend});
+        put32(out, 0);
+        return;
+    }
+    const uint8_t base = low3(m.reg);
+    uint8_t mod;
+    if (m.imm == 0 && base != 5) mod = 0x00;
+    else if (fits8(m.imm)) mod = 0x40;
+    else mod = 0x80;
+    if (m.index != Reg::NONE) {
+        const uint8_t ss = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+        out.push_back(mod | r | 0x04);
+        out.push_back(static_cast<uint8_t>(ss << 6 | low3(m.index) << 3 | base));
+    } else {
+        out.push_back(mod | r | base);
+        if (base == 4) out.push_back(0x24);     // rsp / r12 需要 SIB
+    }
+    if (mod == 0x40) out.push_back(static_cast<uint8_t>(m.imm));
+    else if (mod == 0x80) put32(out, m.imm);
+}
+
+void modrm(std::vector<uint8_t>& out, const uint8_t reg_field, const Operand& rm,
+           std::vector<Reloc>& relocs, const size_t trailing = 0) {
+    if (rm.kind == Operand::Kind::Reg) modrm_reg(out, reg_field, rm.reg);
+    else modrm_mem(out, reg_field, rm, relocs, trailing);
+}
+
+// ALU 指令的 /n 编号与 r/m,r 形式的操作码
+struct AluInfo { uint8_t ext; uint8_t op_rm_r; };
+AluInfo alu_info(const Op op) {
+    switch (op) {
+    case Op::ADD: return {0, 0x01};
+    case Op::OR: return {1, 0x09};
+    case Op::AND: return {4, 0x21};
+    case Op::SUB: return {5, 0x29};
+    case Op::CMP: return {7, 0x39};
+    default: return {0, 0};
+    }
+}
+
+bool is_label_jump(const Inst& inst) {
+    return (inst.op == Op::JMP || inst.op == Op::JCC) && inst.a.kind == Operand::Kind::Label;
+}
+
+// 引用函数内标签的定长项：lea r, [rip + 标签] 和跳转表项，在布局之后编码
+bool is_label_ref(const Inst& inst) {
+    return inst.op == Op::TABLE_ENTRY || (inst.op == Op::LEA && inst.b.kind == Operand::Kind::Label);
+}
+
+}
+
+uint8_t dwarf_reg(const Reg r) {
+    switch (r) {
+    case Reg::RAX: return 0;
+    case Reg::RDX: return 1;
+    case Reg::RCX: return 2;
+    case Reg::RBX: return 3;
+    case Reg::RSI: return 4;
+    case Reg::RDI: return 5;
+    case Reg::RBP: return 6;
+    case Reg::RSP: return 7;
+    default: return static_cast<uint8_t>(r);    // r8 ~ r15 编号一致
+    }
+}
+
+void X64Encoder::encode_inst(const Inst& inst, std::vector<uint8_t>& out, std::vector<Reloc>& relocs) {
+    const auto& a = inst.a;
+    const auto& b = inst.b;
+    const bool a_reg = a.kind == Operand::Kind::Reg, b_reg = b.kind == Operand::Kind::Reg;
+    const bool a_mem = a.kind == Operand::Kind::Mem, b_mem = b.kind == Operand::Kind::Mem;
+    const bool b_imm = b.kind == Operand::Kind::Imm;
+    const Reg no = Reg::NONE;
+
+    switch (inst.op) {
+    case Op::MOV:
+        if (a_reg && b_reg) {
+            rex(out, true, b.reg, a.reg);
+            out.push_back(0x89);
+            modrm_reg(out, low3(b.reg), a.reg);
+        } else if (a_reg && b_imm) {
+            if (b.imm >= 0 && b.imm <= UINT32_MAX) {
+                // mov r32, imm32 会零扩展到 64 位
+                rex(out, false, no, a.reg);
+                out.push_back(0xB8 + low3(a.reg));
+                put32(out, b.imm);
+            } else if (fits32(b.imm)) {
+                rex(out, true, no, a.reg);
+                out.push_back(0xC7);
+                modrm_reg(out, 0, a.reg);
+                put32(out, b.imm);
+            } else {
+                rex(out, true, no, a.reg);
+                out.push_back(0xB8 + low3(a.reg));
+                put64(out, b.imm);
+            }
+        } else if (a_reg && b_mem) {
+            rex(out, true, a.reg, b.reg);
+            out.push_back(0x8B);
+            modrm_mem(out, low3(a.reg), b, relocs, 0);
+        } else if (a_mem && b_reg) {
+            rex(out, true, b.reg, a.reg);
+            out.push_back(0x89);
+            modrm_mem(out, low3(b.reg), a, relocs, 0);
+        } else if (a_mem && b_imm) {
+            rex(out, true, no, a.reg);
+            out.push_back(0xC7);
+            modrm_mem(out, 0, a, relocs, 4);
+            put32(out, b.imm);
+        }
+        break;
+    case Op::LEA:
+        if (b.kind == Operand::Kind::Symbol) {
+            // 代码段里的符号（虚表）：按调用的方式重定位
+            rex(out, true, a.reg, no);
+            out.push_back(0x8D);
+            out.push_back(static_cast<uint8_t>(low3(a.reg) << 3 | 0x05));
+            relocs.push_back({Reloc::Kind::Call, out.size(), b.sym, -1, -4});
+            put32(out, 0);
+            break;
+        }
+        rex(out, true, a.reg, b.reg);
+        out.push_back(0x8D);
+        modrm_mem(out, low3(a.reg), b, relocs, 0);
+        break;
+    case Op::PUSH:
+        rex(out, false, no, a.reg);
+        out.push_back(0x50 + low3(a.reg));
+        break;
+    case Op::POP:
+        rex(out, false, no, a.reg);
+        out.push_back(0x58 + low3(a.reg));
+        break;
+    case Op::XCHG:
+        rex(out, true, b.reg, a.reg);
+        out.push_back(0x87);
+        modrm_reg(out, low3(b.reg), a.reg);
+        break;
+    case Op::ADD:
+    case Op::SUB:
+    case Op::AND:
+    case Op::OR:
+    case Op::CMP: {
+        const auto info = alu_info(inst.op);
+        if (b_imm) {
+            rex(out, true, no, a.reg);
+            out.push_back(fits8(b.imm) ? 0x83 : 0x81);
+            modrm(out, info.ext, a, relocs, fits8(b.imm) ? 1 : 4);
+            if (fits8(b.imm)) out.push_back(static_cast<uint8_t>(b.imm));
+            else put32(out, b.imm);
+        } else if (b_mem) {
+            rex(out, true, a.reg, b.reg);
+            out.push_back(info.op_rm_r + 2);
+            modrm_mem(out, low3(a.reg), b, relocs, 0);
+        } else {
+            rex(out, true, b.reg, a.reg);
+            out.push_back(info.op_rm_r);
+            modrm(out, low3(b.reg), a, relocs);
+        }
+        break;
+    }
+    case Op::TEST:
+        if (a.size == 1) {
+            // spl/bpl/sil/dil 需要空 REX 前缀
+            rex(out, false, b.reg, a.reg, low3(a.reg) >= 4 || low3(b.reg) >= 4);
+            out.push_back(0x84);
+        } else {
+            rex(out, true, b.reg, a.reg);
+            out.push_back(0x85);
+        }
+        modrm_reg(out, low3(b.reg), a.reg);
+        break;
+    case Op::IMUL:
+        rex(out, true, a.reg, b.reg);
+        out.push_back(0x0F);
+        out.push_back(0xAF);
+        modrm(out, low3(a.reg), b, relocs);
+        break;
+    case Op::NEG:
+    case Op::IDIV:
+        rex(out, true, no, a.reg);
+        out.push_back(0xF7);
+        modrm(out, inst.op == Op::NEG ? 3 : 7, a, relocs);
+        break;
+    case Op::INC:
+        rex(out, true, no, a.reg);
+        out.push_back(0xFF);
+        modrm(out, 0, a, relocs);
+        break;
+    case Op::CQO:
+        out.push_back(0x48);
+        out.push_back(0x99);
+        break;
+    case Op::MOVSXD:
+        // movsxd r64, dword [m]
+        rex(out, true, a.reg, b.reg, false, b.index);
+        out.push_back(0x63);
+        modrm_mem(out, low3(a.reg), b, relocs, 0);
+        break;
+    case Op::BT:
+        // bt r/m64, r64：第 b 位复制到 CF
+        rex(out, true, b.reg, a.reg);
+        out.push_back(0x0F);
+        out.push_back(0xA3);
+        modrm_reg(out, low3(b.reg), a.reg);
+        break;
+    case Op::SETCC:
+        rex(out, false, no, a.reg, low3(a.reg) >= 4);
+        out.push_back(0x0F);
+        out.push_back(0x90 + static_cast<uint8_t>(inst.cc));
+        modrm_reg(out, 0, a.reg);
+        break;
+    case Op::JMP:
+        if (a.kind == Operand::Kind::Reg) {
+            rex(out, false, no, a.reg);
+            out.push_back(0xFF);
+            modrm_reg(out, 4, a.reg);
+            break;
+        }
+        // 跳到符号（虚表项），跳到标签的在布局时编码
+        out.push_back(0xE9);
+        relocs.push_back({Reloc::Kind::Call, out.size(), a.sym, -1, -4});
+        put32(out, 0);
+        break;
+    case Op::CALL:
+        if (a.kind == Operand::Kind::Reg) {
+            rex(out, false, no, a.reg);
+            out.push_back(0xFF);
+            modrm_reg(out, 2, a.reg);
+            break;
+        }
+        out.push_back(0xE8);
+        relocs.push_back({Reloc::Kind::Call, out.size(), a.sym, -1, -4});
+        put32(out, 0);
+        break;
+    case Op::RET:
+        out.push_back(0xC3);
+        break;
+    case Op::LEAVE:
+        out.push_back(0xC9);
+        break;
+    case Op::SYSCALL:
+        out.push_back(0x0F);
+        out.push_back(0x05);
+        break;
+    case Op::UD2:
+        out.push_back(0x0F);
+        out.push_back(0x0B);
+        break;
+    default:
+        break;
+    }
+}
+
+void X64Encoder::encode_cfi(const Inst& inst, const size_t offset, EncodedFunction& result) {
+    auto& out = result.cfi;
+    if (inst.op == Op::CFI_STARTPROC) {
+        result.has_cfi = true;
+        cfa = {};
+        cfa_stack.clear();
+        cfi_loc = offset;
+        return;
+    }
+    if (inst.op == Op::CFI_ENDPROC) return;
+
+    if (const size_t delta = offset - cfi_loc) {
+        if (delta < 0x40) {
+            out.push_back(static_cast<uint8_t>(0x40 | delta));     // DW_CFA_advance_loc
+        } else if (delta <= UINT8_MAX) {
+            out.push_back(0x02);
+            out.push_back(static_cast<uint8_t>(delta));
+        } else if (delta <= UINT16_MAX) {
+            out.push_back(0x03);
+            out.push_back(static_cast<uint8_t>(delta));
+            out.push_back(static_cast<uint8_t>(delta >> 8));
+        } else {
+            out.push_back(0x04);
+            put32(out, static_cast<int64_t>(delta));
+        }
+        cfi_loc = offset;
+    }
+
+    switch (inst.op) {
+    case Op::CFI_DEF_CFA:
+        cfa = {dwarf_reg(inst.a.reg), inst.b.imm};
+        out.push_back(0x0c);
+        uleb(out, cfa.reg);
+        uleb(out, cfa.offset);
+        break;
+    case Op::CFI_DEF_CFA_OFFSET:
+        cfa.offset = inst.a.imm;
+        out.push_back(0x0e);
+        uleb(out, cfa.offset);
+        break;
+    case Op::CFI_ADJUST_CFA_OFFSET:
+        cfa.offset += inst.a.imm;
+        out.push_back(0x0e);
+        uleb(out, cfa.offset);
+        break;
+    case Op::CFI_DEF_CFA_REGISTER:
+        cfa.reg = dwarf_reg(inst.a.reg);
+        out.push_back(0x0d);
+        uleb(out, cfa.reg);
+        break;
+    case Op::CFI_OFFSET:
+        // data_alignment_factor = -8
+        out.push_back(static_cast<uint8_t>(0x80 | dwarf_reg(inst.a.reg)));
+        uleb(out, static_cast<uint64_t>(-inst.b.imm / 8));
+        break;
+    case Op::CFI_REMEMBER_STATE:
+        cfa_stack.push_back(cfa);
+        out.push_back(0x0a);
+        break;
+    case Op::CFI_RESTORE_STATE:
+        if (!cfa_stack.empty()) {
+            cfa = cfa_stack.back();
+            cfa_stack.pop_back();
+        }
+        out.push_back(0x0b);
+        break;
+    default:
+        break;
+    }
+}
+
+EncodedFunction X64Encoder::encode(const MachineFunction& fn) {
+    EncodedFunction result;
+    result.name = fn.name;
+
+    // 固定长度的指令先编码一次，跳转的长度在布局时确定
+    std::vector<Item> items(fn.insts.size());
+    std::vector<std::vector<uint8_t>> bytes(fn.insts.size());
+    std::vector<std::vector<Reloc>> relocs(fn.insts.size());
+    std::vector<size_t> label_item(fn.labels.size(), SIZE_MAX);
+    bool rodata = false;
+    for (size_t i = 0; i < fn.insts.size(); i++) {
+        const auto& inst = fn.insts[i];
+        if (inst.op == Op::RODATA || inst.op == Op::TEXT) rodata = inst.op == Op::RODATA;
+        items[i].rodata = rodata;
+        if (inst.op == Op::LABEL && inst.a.kind == Operand::Kind::Label)
+            label_item[inst.a.label] = i;
+        else if (inst.op == Op::ALIGN) {
+            auto& align = rodata ? result.rodata_align : result.align;
+            align = std::max(align, static_cast<size_t>(inst.a.imm));
+        } else if (!is_label_jump(inst) && !is_label_ref(inst))
+            encode_inst(inst, bytes[i], relocs[i]);
+    }
+
+    // 跳转松弛：先假设全部是短跳转，放不下的改成长跳转，直到布局不再变化
+    bool changed = true;
+    while (changed) {
+        size_t offsets[2] = {0, 0};     // .text、.rodata
+        for (size_t i = 0; i < fn.insts.size(); i++) {
+            const auto& inst = fn.insts[i];
+            size_t& offset = offsets[items[i].rodata];
+            items[i].offset = offset;
+            if (inst.op == Op::ALIGN) {
+                const auto align = static_cast<size_t>(inst.a.imm);
+                items[i].size = (align - offset % align) % align;
+            } else if (is_label_jump(inst)) {
+                if (!items[i].long_jump) items[i].size = 2;
+                else items[i].size = inst.op == Op::JMP ? 5 : 6;
+            } else if (is_label_ref(inst)) {
+                items[i].size = inst.op == Op::LEA ? 7 : 4;
+            } else {
+                items[i].size = bytes[i].size();
+            }
+            offset += items[i].size;
+        }
+        changed = false;
+        for (size_t i = 0; i < fn.insts.size(); i++) {
+            if (!is_label_jump(fn.insts[i]) || items[i].long_jump) continue;
+            const size_t target = label_item[fn.insts[i].a.label];
+            if (target == SIZE_MAX) continue;
+            const int64_t disp = static_cast<int64_t>(items[target].offset)
+                               - static_cast<int64_t>(items[i].offset + items[i].size);
+            if (!fits8(disp)) {
+                items[i].long_jump = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < fn.insts.size(); i++) {
+        const auto& inst = fn.insts[i];
+        auto& out = items[i].rodata ? result.rodata : result.code;
+        if (inst.op == Op::ALIGN) {
+            out.insert(out.end(), items[i].size, items[i].rodata ? 0 : 0x90);
+        } else if (is_label_jump(inst)) {
+            const size_t target = label_item[inst.a.label];
+            if (target == SIZE_MAX) {
+                THROW_ERROR("Undefined label " + fn.label_name(inst.a.label) + " in " + fn.name, 0, 0);
+                continue;
+            }
+            const int64_t disp = static_cast<int64_t>(items[target].offset)
+                               - static_cast<int64_t>(items[i].offset + items[i].size);
+            if (!items[i].long_jump) {
+                out.push_back(inst.op == Op::JMP ? 0xEB : 0x70 + static_cast<uint8_t>(inst.cc));
+                out.push_back(static_cast<uint8_t>(disp));
+            } else {
+                if (inst.op == Op::JMP) {
+                    out.push_back(0xE9);
+                } else {
+                    out.push_back(0x0F);
+                    out.push_back(0x80 + static_cast<uint8_t>(inst.cc));
+                }
+                put32(out, disp);
+            }
+        } else if (is_label_ref(inst)) {
+            const Operand& target_op = inst.op == Op::LEA ? inst.b : inst.a;
+            const size_t target = label_item[target_op.label];
+            const size_t base = inst.op == Op::LEA ? SIZE_MAX : label_item[inst.b.label];
+            if (target == SIZE_MAX || (inst.op == Op::TABLE_ENTRY && base == SIZE_MAX)) {
+                THROW_ERROR("Undefined label in " + fn.name, 0, 0);
+                continue;
+            }
+            if (inst.op == Op::TABLE_ENTRY && (!items[i].rodata || !items[base].rodata || items[target].rodata)) {
+                THROW_ERROR("Jump table outside of .rodata in " + fn.name, 0, 0);
+                continue;
+            }
+            if (inst.op == Op::LEA) {
+                rex(out, true, inst.a.reg, Reg::NONE);
+                out.push_back(0x8D);
+                out.push_back(static_cast<uint8_t>(low3(inst.a.reg) << 3 | 0x05));
+                if (items[target].rodata)
+                    result.relocs.push_back({Reloc::Kind::Rodata, out.size(), "", -1,
+                                             static_cast<int64_t>(items[target].offset) - 4});
+                put32(out, items[target].rodata ? 0
+                           : static_cast<int64_t>(items[target].offset) - static_cast<int64_t>(items[i].offset + 7));
+            } else {
+                // 值 = 目标 - 表头；表和目标不在同一节，按本项的 PC 相对重定位，addend 补上本项到表头的距离
+                result.rodata_relocs.push_back({Reloc::Kind::Text, out.size(), "", -1,
+                                                static_cast<int64_t>(items[target].offset + items[i].offset
+                                                                     - items[base].offset)});
+                put32(out, 0);
+            }
+        } else if (inst.op >= Op::CFI_STARTPROC) {
+            encode_cfi(inst, items[i].offset, result);
+        } else {
+            for (auto r : relocs[i]) {
+                r.offset += items[i].offset;
+                result.relocs.push_back(std::move(r));
+            }
+            out.insert(out.end(), bytes[i].begin(), bytes[i].end());
+        }
+    }
+    return result;
+}
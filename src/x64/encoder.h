@@ -0,0 +1,68 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_ENCODER_H
+#define POLO_COMPILER_PRE_ENCODER_H
+#include "asm.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 函数内需要链接时回填的位置
+struct Reloc {
+    enum class Kind : uint8_t {
+        Call,       // call rel32 -> 符号
+        String,     // [rip + disp32] -> .L_str_<id>
+        Data,       // [rip + disp32] -> .data 中的符号
+        Rodata,     // [rip + disp32] -> 函数自己的 .rodata（跳转表），addend 含表的偏移
+        Text,       // .rodata 里的跳转表项 -> .text，addend 含目标的偏移
+    };
+    Kind kind;
+    size_t offset;          // 相对函数起始的字节偏移，Text 相对函数 .rodata 的起始
+    std::string sym;        // Call / Data
+    int str{-1};            // String
+    int64_t addend{-4};
+};
+
+struct EncodedFunction {
+    std::string name;
+    size_t align{1};
+    std::vector<uint8_t> code;
+    std::vector<Reloc> relocs;
+    std::vector<uint8_t> rodata;        // 跳转表
+    size_t rodata_align{1};
+    std::vector<Reloc> rodata_relocs;
+    bool has_cfi{false};
+    std::vector<uint8_t> cfi;   // FDE 的 DW_CFA 指令序列
+};
+
+// DWARF 寄存器编号
+uint8_t dwarf_reg(Reg r);
+
+class X64Encoder {
+public:
+    EncodedFunction encode(const MachineFunction& fn);
+
+private:
+    struct Item {
+        size_t offset{0};
+        size_t size{0};
+        bool long_jump{false};
+        bool rodata{false};     // 在函数的 .rodata 里，offset 相对 .rodata 起始
+    };
+
+    void encode_inst(const Inst& inst, std::vector<uint8_t>& out, std::vector<Reloc>& relocs);
+    void encode_cfi(const Inst& inst, size_t offset, EncodedFunction& result);
+
+    // CFA 状态，用于把 .cfi_adjust_cfa_offset 翻译成 DW_CFA_def_cfa_offset
+    struct CfaState {
+        uint8_t reg{7};
+        int64_t offset{8};
+    };
+    CfaState cfa;
+    std::vector<CfaState> cfa_stack;
+    size_t cfi_loc{0};
+};
+
+#endif //POLO_COMPILER_PRE_ENCODER_H
@@ -0,0 +1,149 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#include "frame.h"
+#include <algorithm>
+#include "../common.h"
+
+namespace {
+
+// 返回表达式求值时需要的临时槽数量
+size_t expr_temps(const ASTNodePtr& node) {
+    if (!node) return 0;
+    switch (node->type) {
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        // 左值压栈后再计算右值
+        return std::max(expr_temps(n->left), 1 + expr_temps(n->right));
+    }
+    case NodeType::UNARY:
+        return expr_temps(std::static_pointer_cast<UnaryOpNode>(node)->expr);
+    case NodeType::FUNCTION_CALL: {
+        // 前面的参数压栈后再计算后面的参数，str 参数按两个槽保守估计
+        size_t depth = 0, pushed = 0;
+        for (const auto& a : std::static_pointer_cast<FunctionCallNode>(node)->arguments) {
+            depth = std::max(depth, pushed + expr_temps(a));
+            pushed += 2;
+        }
+        return depth;
+    }
+    case NodeType::MACRO_CALL: {
+        const auto n = std::static_pointer_cast<MacroCallNode>(node);
+        // store! 先把地址压栈再计算值，bounds! 先把下标压栈；syscall! 的参数与函数调用一样先压栈
+        size_t depth = 0, pushed = 0;
+        for (const auto& a : n->arguments) {
+            depth = std::max(depth, pushed + expr_temps(a));
+            if (n->name == "store" || n->name == "syscall" || n->name == "bounds") pushed++;
+        }
+        return depth;
+    }
+    default:
+        return 0;
+    }
+}
+
+void scan(const ASTNodePtr& node, FrameInfo& info);
+
+void scan_body(const std::vector<ASTNodePtr>& body, FrameInfo& info) {
+    for (const auto& stmt : body) scan(stmt, info);
+}
+
+void scan_expr(const ASTNodePtr& node, FrameInfo& info) {
+    if (!node) return;
+    info.temp_depth = std::max(info.temp_depth, expr_temps(node));
+    scan(node, info);
+}
+
+void scan(const ASTNodePtr& node, FrameInfo& info) {
+    if (!node) return;
+    switch (node->type) {
+    case NodeType::VARIABLE_DECL: {
+        // const 已被折叠，不分配栈槽
+        const auto n = std::static_pointer_cast<VariableDeclNode>(node);
+        if (!n->is_const) info.slot_size += n->type && n->type->is_fat() ? 16 : 8;
+        scan_expr(n->initializer, info);
+        break;
+    }
+    case NodeType::ASSIGNMENT:
+        scan_expr(std::static_pointer_cast<AssignmentNode>(node)->value, info);
+        break;
+    case NodeType::RETURN_STMT:
+        scan_expr(std::static_pointer_cast<ReturnStmtNode>(node)->expression, info);
+        break;
+    case NodeType::IF_STMT: {
+        const auto n = std::static_pointer_cast<IfStmtNode>(node);
+        scan_expr(n->condition, info);
+        scan_body(n->thenBody, info);
+        scan_body(n->elseBody, info);
+        break;
+    }
+    case NodeType::FOR_STMT: {
+        const auto n = std::static_pointer_cast<ForStmtNode>(node);
+        scan_expr(n->init, info);
+        scan_expr(n->condition, info);
+        scan_expr(n->increment, info);
+        scan_body(n->body, info);
+        break;
+    }
+    case NodeType::BINARY_OP: {
+        const auto n = std::static_pointer_cast<BinaryOpNode>(node);
+        scan(n->left, info);
+        scan(n->right, info);
+        break;
+    }
+    case NodeType::UNARY:
+        scan(std::static_pointer_cast<UnaryOpNode>(node)->expr, info);
+        break;
+    case NodeType::FUNCTION_CALL: {
+        info.is_leaf = false;
+        for (const auto& a : std::static_pointer_cast<FunctionCallNode>(node)->arguments)
+            scan_expr(a, info);
+        break;
+    }
+    case NodeType::MACRO_CALL: {
+        // syscall 不使用用户栈，不影响叶子属性；作为语句出现时自己的临时槽也要算上
+        const auto n = std::static_pointer_cast<MacroCallNode>(node);
+        info.temp_depth = std::max(info.temp_depth, expr_temps(node));
+        // 逃逸分析放到栈上的对象，大小已经按 8 字节对齐
+        if (n->name == "stack_alloc" && n->arguments.size() == 1 && n->arguments[0]->type == NodeType::NUMBER)
+            info.slot_size += static_cast<size_t>(std::static_pointer_cast<NumberNode>(n->arguments[0])->value);
+        for (const auto& a : n->arguments)
+            scan_expr(a, info);
+        break;
+    }
+    case NodeType::NAME_SPACE_VISIT:
+    case NodeType::MEMBER_ACCESS:
+    case NodeType::MEMBER_ASSIGN:
+        // 尚未支持的节点保守处理
+        info.is_leaf = false;
+        break;
+    default:
+        break;
+    }
+}
+
+}
+
+FrameInfo lower_frame(const std::shared_ptr<FunctionNode>& fn, const bool c_abi) {
+    FrameInfo info;
+    // 寄存器和栈上传来的参数都复制到自己的栈槽里
+    for (const auto& p : fn->parameters) {
+        const bool fat = p.type && (c_abi ? p.type->is_fat_str() : p.type->is_fat());
+        info.slot_size += fat ? 16 : 8;
+        if (fat && c_abi) info.is_leaf = false;
+    }
+    scan_body(fn->body, info);
+
+    if (!info.is_leaf) {
+        info.kind = FrameKind::Full;
+    } else if (info.slot_size == 0) {
+        // 临时值直接 push/pop，用 .cfi_adjust_cfa_offset 跟踪
+        info.kind = FrameKind::None;
+    } else if (P_TARGET == "Linux" && info.slot_size + info.temp_depth * 8 <= RED_ZONE_SIZE) {
+        info.kind = FrameKind::RedZone;
+    } else {
+        info.kind = FrameKind::Full;
+    }
+    return info;
+}
@@ -0,0 +1,31 @@
+//
+// Created by geguj on 2026/10/18.
+//
+
+#ifndef POLO_COMPILER_PRE_FRAME_H
+#define POLO_COMPILER_PRE_FRAME_H
+#include "../ast.h"
+
+// SysV 在 rsp 下方保留的 128 字节红区，信号处理不会覆盖
+constexpr size_t RED_ZONE_SIZE = 128;
+
+enum class FrameKind {
+    None,       // 叶子函数且没有栈槽：不建立栈帧
+    RedZone,    // 叶子函数：栈槽放在红区内，用 rsp 寻址
+    Full,       // push rbp; mov rbp, rsp; sub rsp, N
+};
+
+struct FrameInfo {
+    FrameKind kind{FrameKind::Full};
+    bool is_leaf{true};
+    size_t slot_size{0};    // 参数 + 局部变量占用的字节数
+    size_t temp_depth{0};   // 表达式临时值（gen_binary 压栈）的最大嵌套深度
+};
+
+// 在生成函数体之前分析函数，决定栈帧形态。
+// str 参数占 16 字节的栈槽；Polo 约定下用两个参数寄存器传递（指针、长度），
+// c_abi（extern 函数）只传指针，长度在入口处调用 strlen 求出。
+// 寄存器放不下时参数在调用者的栈上，入口处同样复制进栈槽
+FrameInfo lower_frame(const std::shared_ptr<FunctionNode>& fn, bool c_abi);
+
+#endif //POLO_COMPILER_PRE_FRAME_H
@@ -5,6 +5,7 @@
 #ifndef POLO_COMPILER_PRE_REGISTER_H
 #define POLO_COMPILER_PRE_REGISTER_H
 #include <bitset>
+#include <cstdint>
 #include <ranges>
 #include <unordered_map>
 inline const char* func_call_regs[] =
@@ -12,13 +13,18 @@ inline const char* func_call_regs[] =
 
 #if defined(_WIN32) || defined(_WIN64)
 	{"rcx", "rdx", "r8", "r9"};
+// 栈上传递的参数前面为被调用者保留的影子空间
+inline constexpr int64_t stack_args_offset = 32;
 inline const char* free_regs[] = {"rbx", "rsi", "rdi", "r10", "r11", "r12", "r13", "r14", "r15"};
 
 #else
 	{"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+inline constexpr int64_t stack_args_offset = 0;
 inline const char* free_regs[] = {"rbx", "r10", "r11", "r12", "r13", "r14", "r15"};
 #endif
 inline auto result_reg = "rax";
+// Linux 系统调用的参数寄存器，第四个是 r10 而不是 rcx（syscall 会覆盖 rcx）
+inline const char* syscall_regs[] = {"rdi", "rsi", "rdx", "r10", "r8", "r9"};
 
 #elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM64_ARCH_8)
 		{}
@@ -7,18 +7,21 @@
 #include <sstream>
 #include <iostream>
 #include "register.h"
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <thread>
 #include "../common.h"
+#include "../generics.h"
+#include "../thread_pool.h"
+#include "../traits.h"
+#include "../stats/time_trace.h"
 
-void WatGen::gen(const ASTNodePtr &node) {
+void FunctionGen::gen(const ASTNodePtr &node) {
     switch (node->type) {
     using enum NodeType;
-    case PROGRAM: {
-        gen_program(node);
-        break;
-    }
     case FUNCTION: {
-        gen_function(node);
+        THROW_ERROR("Nested functions are not supported", node->line, node->col);
         break;
     }
     case VARIABLE_DECL: {
@@ -99,331 +102,912 @@ void WatGen::gen(const ASTNodePtr &node) {
 default: ;
     }
 }
+// 每个线程一个窗口里分到的函数数
+constexpr size_t FUNCTIONS_PER_THREAD = 16;
+
+// 不需要计算、可以直接装进寄存器的表达式
+static bool is_simple(const ASTNodePtr& node) {
+    switch (node->type) {
+    case NodeType::NUMBER:
+    case NodeType::BOOLEAN:
+    case NodeType::STRING:
+    case NodeType::IDENTIFIER:
+        return true;
+    default:
+        return false;
+    }
+}
+
 template<class T> T align_of_16(T num) {
     T tmp = num % 16;
     if (tmp == 0)return num;
     return num + (16 - tmp);
 }
+void WatGen::gen(const ASTNodePtr &node) {
+    if (node->type == NodeType::PROGRAM) gen_program(node);
+}
+
 void WatGen::gen_program(const ASTNodePtr &node) {
     const auto n = std::static_pointer_cast<ProgramNode>(node);
     
-    output << ".intel_syntax noprefix" << std::endl;
-    output << ".globl main" << std::endl;
-    output << std::endl;
-    
-    stack_offset = 0;
-    var_offsets.clear();
-    var_str_lens.clear();
+    module.globals.emplace_back("main");
+    module.gnu_stack_note = P_TARGET != "Windows";
     
+    for (const auto& c: n->stmts)
+        if (c->type == NodeType::VARIABLE_DECL)
+            gen_static(std::static_pointer_cast<VariableDeclNode>(c));
+    std::vector<std::shared_ptr<FunctionNode>> functions;
     for (const auto& c: n->stmts) {
-        gen(c);
+        collect(c, functions);
     }
-    
-    // 输出数据段（字符串常量）
-    if (!data_output.str().empty()) {
-        output << std::endl;
-        output << ".section .rodata" << std::endl;
-        output << data_output.str();
+
+    if (profile) order_by_profile(functions);
+    if (sink) sink->begin(module);
+    std::unordered_map<std::string, CacheKey> counts;
+    const CacheContext ctx = cache ? cache_context(counts) : CacheContext{};
+
+    // 各函数互不依赖，按窗口放到线程池里生成，再按输出顺序合并；
+    // 一个窗口交出去之后才生成下一个，内存占用与函数总数无关
+    const size_t threads = jobs ? jobs : std::max(1u, std::thread::hardware_concurrency());
+    ThreadPool pool(std::max<size_t>(1, std::min(threads, functions.size())));
+    const size_t window = pool.size() * FUNCTIONS_PER_THREAD;
+    std::vector<std::unique_ptr<FunctionGen>> gens;
+    size_t first = 0;       // gens[0] 对应的函数
+    for (const auto& e : module.entries) {
+        if (e.kind == AsmEntry::Kind::Extern) {
+            if (sink) sink->external(e.name);
+            continue;
+        }
+        if (e.index >= first + gens.size()) {
+            first = e.index;
+            gens.clear();
+            for (size_t i = first; i < std::min(first + window, functions.size()); i++)
+                gens.push_back(std::make_unique<FunctionGen>(*this));
+            pool.parallel_for(gens.size(), [&](const size_t i) {
+                gen_cached(*gens[i], functions[first + i], ctx);
+            });
+        }
+        emit_function(*gens[e.index - first]);
+        gens[e.index - first].reset();
+    }
+
+    for (const auto& impl : vtable_impls) {
+        std::vector<std::string> methods;
+        for (const auto& m : impl->methods)
+            if (m->type == NodeType::IDENTIFIER) methods.push_back(std::static_pointer_cast<IdentifierNode>(m)->name);
+        FunctionGen vtable(*this);
+        vtable.gen_vtable(vtable_symbol(impl->target_type, impl->trait_name), methods);
+        module.entries.push_back({AsmEntry::Kind::Function, "", module.functions.size()});
+        emit_function(vtable);
+    }
+    if (profile_generate) {
+        auto data = build_profile_data(prof_names);
+        const auto data_size = static_cast<int64_t>(data.bytes.size());
+        module.data.push_back(std::move(data));
+        module.fini_array.emplace_back(PROFILE_DUMP_SYMBOL);
+        FunctionGen dump(*this);
+        dump.gen_profile_dump(data_size, profile_path);
+        module.entries.push_back({AsmEntry::Kind::Function, "", module.functions.size()});
+        emit_function(dump);
+    }
+    if (sink) sink->end(module);
+}
+
+void WatGen::gen_cached(FunctionGen& gen, const std::shared_ptr<FunctionNode>& fn, const CacheContext& ctx) {
+    TimeScope scope("Function codegen", fn->name);
+    if (!cache) {
+        gen.gen_function(fn);
+        return;
+    }
+    const auto key = function_key(fn, ctx);
+    if (key) {
+        if (auto cached = cache->find(*key)) {
+            gen.restore(std::move(*cached));
+            return;
+        }
+    }
+    gen.gen_function(fn);
+    if (key) cache->store(*key, gen.snapshot());
+}
+
+CacheContext WatGen::cache_context(std::unordered_map<std::string, CacheKey>& counts) const {
+    // 每个函数的计数器以 "函数名" 或 "函数名:" 开头；逐项相加，与遍历顺序无关
+    if (profile) {
+        for (const auto& [name, count] : profile->entries()) {
+            KeyHasher h;
+            h.add(name);
+            h.add(count);
+            auto& k = counts[name.substr(0, name.find(':'))];
+            k.a += h.key().a;
+            k.b += h.key().b;
+        }
     }
-    if (P_TARGET != "Windows")
-        output << ".section .note.GNU-stack,\"\",@progbits" << std::endl;
+    KeyHasher global;
+    global.add(CODEGEN_VERSION);
+    global.add(P_TARGET);
+    global.add(profile_generate);
+    global.add(profile != nullptr);
+
+    CacheContext ctx;
+    ctx.global = global.key();
+    ctx.signatures = &signatures;
+    ctx.profile = &counts;
+    ctx.statics = &static_vars;
+    ctx.c_functions = &c_functions;
+    ctx.vtables = &vtables;
+    return ctx;
+}
+
+std::shared_ptr<FunctionNode> WatGen::signature(const std::string& name) const {
+    const auto it = signatures.find(name);
+    return it != signatures.end() ? it->second : nullptr;
+}
+
+void WatGen::collect(const ASTNodePtr& node, std::vector<std::shared_ptr<FunctionNode>>& functions) {
+    switch (node->type) {
+    case NodeType::FUNCTION: {
+        const auto fn = std::static_pointer_cast<FunctionNode>(node);
+        if (extern_flag) {
+            module.entries.push_back({AsmEntry::Kind::Extern, fn->name});
+            c_functions.insert(fn->name);
+        }
+        // 有函数体的定义优先于前面的声明
+        if (auto& sig = signatures[fn->name]; !sig || fn->has_body) sig = fn;
+        if (!fn->has_body) return;
+        module.entries.push_back({AsmEntry::Kind::Function, "", functions.size()});
+        functions.push_back(fn);
+        break;
+    }
+    case NodeType::MACRO_DECL: {
+        bool gen_ = true;
+        const auto macro = std::static_pointer_cast<MacroDeclNode>(node);
+        for (const auto& [name, v] : macro->equations) {
+            if (name == "target") {
+                if (std::static_pointer_cast<StringNode>(v)->value != P_TARGET) gen_ = false;
+            }
+            if (name == "extern") extern_flag = true;
+        }
+        if (gen_) collect(macro->declaration, functions);
+        extern_flag = false;
+        break;
+    }
+    case NodeType::TRAIT_DECL: {
+        // 通过虚表调用 "Trait.m" 时按 trait 里的签名传参、取返回值
+        const auto trait = std::static_pointer_cast<TraitDeclNode>(node);
+        for (const auto& m : trait->methods) signatures.try_emplace(trait->name + "." + m->name, m);
+        break;
+    }
+    case NodeType::IMPL_DECL: {
+        const auto impl = std::static_pointer_cast<ImplDeclNode>(node);
+        if (!impl->vtable) break;
+        vtable_impls.push_back(impl);
+        vtables.insert(vtable_symbol(impl->target_type, impl->trait_name));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void WatGen::merge(FunctionGen& gen) {
+    auto& fn = gen.fn;
+    // 把函数内的局部编号换成模块内的编号，顺序与串行生成时相同
+    fn.label_base = label_counter;
+    label_counter += static_cast<int>(fn.labels.size());
+    std::vector<int> ids;
+    for (const int id : gen.strings) ids.push_back(module_string(id));
+    const auto prof_base = static_cast<int64_t>(prof_names.size());
+    prof_names.insert(prof_names.end(), gen.prof_names.begin(), gen.prof_names.end());
+    for (auto& inst : fn.insts) {
+        for (auto* o : {&inst.a, &inst.b}) {
+            if (o->kind != Operand::Kind::Mem || o->reg != Reg::RIP) continue;
+            if (o->sym.empty()) o->label = ids[o->label];
+            else if (inst.op == Op::INC && o->sym == PROFILE_DATA_SYMBOL) o->imm += prof_base * 8;
+        }
+    }
+    module.functions.push_back(std::move(fn));
+}
+
+void WatGen::emit_function(FunctionGen& gen) {
+    merge(gen);
+    if (!sink) return;
+    // 汇编在这里边生成边写出，目标文件在这里编码
+    TimeScope scope("Emit function");
+    sink->function(module.functions.back());
+    module.functions.pop_back();
+}
+
+int WatGen::module_string(const int pool_id) {
+    const auto [it, inserted] = string_ids.try_emplace(pool_id, static_cast<int>(module.strings.size()));
+    if (inserted) {
+        module.strings.push_back(strings.get(pool_id));
+        if (strings.is_table(pool_id)) module.tables.insert(it->second);
+    }
+    return it->second;
+}
+
+uint64_t WatGen::prof_get(const std::string& name) const {
+    return profile ? profile->count(name) : 0;
+}
+
+int StringPool::intern(const std::string& str, const bool table) {
+    std::lock_guard lock(m);
+    const auto [it, inserted] = ids.try_emplace(str, static_cast<int>(strings.size()));
+    if (inserted) strings.push_back(str);
+    if (table) tables.insert(it->second);
+    return it->second;
 }
 
-void WatGen::gen_function(const ASTNodePtr &node) {
+std::string StringPool::get(const int id) const {
+    std::lock_guard lock(m);
+    return strings[id];
+}
+
+bool StringPool::is_table(const int id) const {
+    std::lock_guard lock(m);
+    return tables.contains(id);
+}
+
+void FunctionGen::gen_function(const ASTNodePtr &node) {
     const auto fn = std::static_pointer_cast<FunctionNode>(node);
     
     has_return = false;
     stack_offset = 0;
     var_offsets.clear();
+    str_vars.clear();
+    reg_vars.clear();
+    loops.clear();
+    addressed = addressed_vars(fn);
+    if_index = 0;
+    for_index = 0;
 #if defined(_WIN32) || defined(_WIN64)
     var_size = 32;
 #else
     var_size = 0;
 #endif
 
-    if (extern_flag) {
-        output << ".extern " << fn->name << std::endl;
-    }
     if (!fn->has_body) return;
-    output << fn->name;
-    // for (const auto& p : fn->parameters) {
-    //     output << "#" << Type::to_string(p.type->kind);
-    // }
-    output << ":\n";\
-
-    bool should_save_frame = true;
-    output << "    .align 16" << std::endl;
-    // 保存栈帧
-    output << "    push rbp" << std::endl;
-    output << "    mov rbp, rsp" << std::endl;
-    output << "    sub rsp, ";
-    auto backup_output = output.str();
-    output.str("");
-    // 为参数分配栈空间并存储
     const auto regs = func_call_regs;
-    constexpr size_t reg_count = RegAlloc::used.size();
-    
-    for (size_t i = 0; i < fn->parameters.size() && i < reg_count; i++) {
-        stack_offset += 8;
-        var_offsets[fn->parameters[i].name] = stack_offset;
-        output << "    mov [rbp - " << stack_offset << "], " << regs[i] << std::endl;
+    constexpr size_t reg_count = std::size(func_call_regs);
+    // extern 函数由 C 代码调用，str 参数只有指针
+    const bool c_abi = module.c_functions.contains(fn->name);
+
+    frame = lower_frame(fn, c_abi);
+    temp_top = 0;
+#if defined(_WIN32) || defined(_WIN64)
+    // 叶子函数不调用其他函数，不需要影子空间
+    if (frame.is_leaf) var_size = 0;
+#endif
+
+    cur = &this->fn;
+    cur->name = fn->name;
+
+    emit(Op::ALIGN, Operand::i(16));
+    emit(Op::LABEL, Operand::symbol(fn->name));
+    emit(Op::CFI_STARTPROC);
+    if (frame.kind == FrameKind::Full) {
+        // 保存栈帧，栈大小在函数体生成完后回填
+        emit(Op::PUSH, Operand::r(Reg::RBP));
+        emit(Op::CFI_DEF_CFA_OFFSET, Operand::i(16));
+        emit(Op::CFI_OFFSET, Operand::r(Reg::RBP), Operand::i(-16));
+        emit(Op::MOV, Operand::r(Reg::RBP), Operand::r(Reg::RSP));
+        emit(Op::CFI_DEF_CFA_REGISTER, Operand::r(Reg::RBP));
+        cur->frame_fixup = cur->insts.size();
+        emit(Op::SUB, Operand::r(Reg::RSP), Operand::i(0));
+    }
+    // 为参数分配栈空间并存储，str 参数的指针和长度占两个寄存器。
+    // 按 SysV，剩下的寄存器放不下的参数整个由调用者放在栈上（返回地址之后），后面的参数仍然可以用寄存器；
+    // 栈上的参数也复制到自己的栈槽里
+    int64_t stack_arg = stack_args_offset + (frame.kind == FrameKind::Full ? 16 : 8);
+    const auto stack_base = frame.kind == FrameKind::Full ? Reg::RBP : Reg::RSP;
+    for (size_t i = 0, r = 0; i < fn->parameters.size(); i++) {
+        const auto& p = fn->parameters[i];
+        const bool fat = p.type && (c_abi ? p.type->is_fat_str() : p.type->is_fat());
+        const size_t words = fat && !c_abi ? 2 : 1;
+        stack_offset += fat ? 16 : 8;
+        var_offsets[p.name] = stack_offset;
+        if (fat) str_vars.insert(p.name);
+        if (r + words > reg_count) {
+            for (size_t w = 0; w < words; w++) {
+                emit(Op::MOV, Operand::r(Reg::RAX), Operand::mem(stack_base, stack_arg));
+                emit(Op::MOV, w ? len_operand(p.name) : local(stack_offset), Operand::r(Reg::RAX));
+                stack_arg += 8;
+            }
+            continue;
+        }
+        emit(Op::MOV, local(stack_offset), Operand::r(reg_from_name(regs[r++])));
+        if (fat && !c_abi) emit(Op::MOV, len_operand(p.name), Operand::r(reg_from_name(regs[r++])));
+    }
+    // C 调用方只传了指针，参数都存好之后再逐个求长度
+    if (c_abi) {
+        for (const auto& p : fn->parameters) {
+            if (!str_vars.contains(p.name)) continue;
+            emit(Op::MOV, Operand::r(reg_from_name(regs[0])), var_operand(p.name));
+            call("strlen");
+            emit(Op::MOV, len_operand(p.name), Operand::r(Reg::RAX));
+        }
     }
     size_t param_size = stack_offset;
+    prof_count(fn->name);
     
     // 生成函数体
     for (const auto& stmt : fn->body) {
         gen(stmt);
+        // if / for 里的 return 不一定会执行
+        if (stmt->type == NodeType::IF_STMT || stmt->type == NodeType::FOR_STMT) has_return = false;
     }
     
     // 如果没有显式返回，添加默认返回
     if (!has_return) {
-        output << "    leave" << std::endl;
-        output << "    ret" << std::endl;
+        gen_epilogue();
+    }
+    emit(Op::CFI_ENDPROC);
+    if (cur->frame_fixup != SIZE_MAX)
+        cur->insts[cur->frame_fixup].b.imm = static_cast<int64_t>(align_of_16(var_size + param_size));
+    cur = nullptr;
+}
+
+CachedFunction FunctionGen::snapshot() const {
+    CachedFunction cached{fn, {}, {}, prof_names};
+    for (const int id : strings) {
+        cached.strings.push_back(module.strings.get(id));
+        cached.tables.push_back(module.strings.is_table(id));
+    }
+    return cached;
+}
+
+void FunctionGen::restore(CachedFunction cached) {
+    fn = std::move(cached.fn);
+    for (size_t i = 0; i < cached.strings.size(); i++)
+        strings.push_back(module.strings.intern(cached.strings[i], i < cached.tables.size() && cached.tables[i]));
+    prof_names = std::move(cached.prof_names);
+}
+
+void FunctionGen::prof_count(const std::string& name) {
+    if (!module.profile_generate || !cur) return;
+    prof_names.push_back(name);
+    emit(Op::INC, Operand::data(PROFILE_DATA_SYMBOL, profile_counter_offset(prof_names.size() - 1)));
+}
+
+uint64_t FunctionGen::prof_get(const std::string& name) const {
+    return module.prof_get(name);
+}
+
+void FunctionGen::gen_profile_dump(const int64_t data_size, const std::string& path_str) {
+    const int path = gen_string_data(path_str);
+    cur = &fn;
+    cur->name = PROFILE_DUMP_SYMBOL;
+    frame = {};
+    frame.kind = FrameKind::None;
+    const int fail = new_label("prof_fail");
+
+    emit(Op::ALIGN, Operand::i(16));
+    emit(Op::LABEL, Operand::symbol(PROFILE_DUMP_SYMBOL));
+    emit(Op::CFI_STARTPROC);
+    // fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(2));
+    emit(Op::LEA, Operand::r(Reg::RDI), Operand::str(path));
+    emit(Op::MOV, Operand::r(Reg::RSI), Operand::i(0x241));
+    emit(Op::MOV, Operand::r(Reg::RDX), Operand::i(0644));
+    emit(Op::SYSCALL);
+    emit(Op::CMP, Operand::r(Reg::RAX), Operand::i(0));
+    emit_cc(Op::JCC, Cond::L, Operand::lbl(fail));
+    // write(fd, __polo_prof_data, size); close(fd)
+    emit(Op::MOV, Operand::r(Reg::RDI), Operand::r(Reg::RAX));
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(1));
+    emit(Op::LEA, Operand::r(Reg::RSI), Operand::data(PROFILE_DATA_SYMBOL));
+    emit(Op::MOV, Operand::r(Reg::RDX), Operand::i(data_size));
+    emit(Op::SYSCALL);
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(3));
+    emit(Op::SYSCALL);
+    emit(Op::LABEL, Operand::lbl(fail));
+    emit(Op::RET);
+    emit(Op::CFI_ENDPROC);
+    cur = nullptr;
+}
+
+void FunctionGen::gen_vtable(const std::string& name, const std::vector<std::string>& methods) {
+    cur = &fn;
+    cur->name = name;
+    frame = {};
+    frame.kind = FrameKind::None;
+    // 调用处 call 虚表 + 8 * 槽位，每项都要对齐到 8 字节
+    emit(Op::ALIGN, Operand::i(8));
+    emit(Op::LABEL, Operand::symbol(name));
+    for (const auto& m : methods) {
+        emit(Op::JMP, Operand::symbol(m));
+        emit(Op::ALIGN, Operand::i(8));
+    }
+    cur = nullptr;
+}
+
+void WatGen::order_by_profile(std::vector<std::shared_ptr<FunctionNode>>& functions) {
+    // 热函数排在前面，没执行过的排到最后；计数相同的保持源码顺序
+    // 生成之前就排好，函数按输出顺序编号，流式输出时也不用回头
+    std::vector<AsmEntry> entries;
+    std::vector<std::shared_ptr<FunctionNode>> order;
+    for (const auto& e : module.entries) {
+        if (e.kind == AsmEntry::Kind::Function) order.push_back(functions[e.index]);
+        else entries.push_back(e);
+    }
+    std::stable_sort(order.begin(), order.end(), [this](const auto& a, const auto& b) {
+        return prof_get(a->name) > prof_get(b->name);
+    });
+    for (size_t i = 0; i < order.size(); i++)
+        entries.push_back({AsmEntry::Kind::Function, "", i});
+    module.entries = std::move(entries);
+    functions = std::move(order);
+}
+
+void FunctionGen::gen_epilogue() {
+    if (frame.kind != FrameKind::Full) {
+        emit(Op::RET);
+        return;
+    }
+    // 返回之后可能还有代码，需要恢复 CFA 规则
+    emit(Op::CFI_REMEMBER_STATE);
+    emit(Op::LEAVE);
+    emit(Op::CFI_DEF_CFA, Operand::r(Reg::RSP), Operand::i(8));
+    emit(Op::RET);
+    emit(Op::CFI_RESTORE_STATE);
+}
+
+void FunctionGen::emit(const Op op, Operand a, Operand b) {
+    if (!cur) return;
+    cur->insts.push_back({op, Cond::E, std::move(a), std::move(b), {}});
+}
+
+void FunctionGen::emit_cc(const Op op, const Cond cc, Operand a) {
+    if (!cur) return;
+    cur->insts.push_back({op, cc, std::move(a), {}, {}});
+}
+
+void FunctionGen::comment(std::string text) {
+    if (!cur) return;
+    cur->insts.push_back({Op::COMMENT, Cond::E, {}, {}, std::move(text)});
+}
+
+Operand FunctionGen::local(const size_t offset) const {
+    const auto disp = -static_cast<int64_t>(offset);
+    if (frame.kind == FrameKind::Full)
+        return Operand::mem(Reg::RBP, disp);
+    return Operand::mem(Reg::RSP, disp);
+}
+
+void FunctionGen::push_temp(const Reg reg) {
+    // temp_top 在各种栈帧下都记录深度，call 用它保持 rsp 16 字节对齐
+    temp_top++;
+    switch (frame.kind) {
+    case FrameKind::RedZone:
+        // 红区内不能 push，否则会覆盖局部变量
+        emit(Op::MOV, local(frame.slot_size + temp_top * 8), Operand::r(reg));
+        break;
+    case FrameKind::None:
+        emit(Op::PUSH, Operand::r(reg));
+        emit(Op::CFI_ADJUST_CFA_OFFSET, Operand::i(8));
+        break;
+    case FrameKind::Full:
+        emit(Op::PUSH, Operand::r(reg));
+        break;
+    }
+}
+
+void FunctionGen::pop_temp(const Reg reg) {
+    switch (frame.kind) {
+    case FrameKind::RedZone:
+        emit(Op::MOV, Operand::r(reg), local(frame.slot_size + temp_top * 8));
+        break;
+    case FrameKind::None:
+        emit(Op::POP, Operand::r(reg));
+        emit(Op::CFI_ADJUST_CFA_OFFSET, Operand::i(-8));
+        break;
+    case FrameKind::Full:
+        emit(Op::POP, Operand::r(reg));
+        break;
+    }
+    temp_top--;
+}
+
+void FunctionGen::call(const std::string& name) {
+    call(Operand::symbol(name));
+}
+
+void FunctionGen::call(const Operand& target) {
+    // 栈上压了奇数个临时值时 rsp 没有 16 字节对齐，C 函数可能依赖对齐
+    const bool pad = temp_top % 2 != 0;
+    if (pad) emit(Op::SUB, Operand::r(Reg::RSP), Operand::i(8));
+    emit(Op::CALL, target);
+    if (pad) emit(Op::ADD, Operand::r(Reg::RSP), Operand::i(8));
+}
+
+void WatGen::gen_static(const std::shared_ptr<VariableDeclNode>& var) {
+    // static const 已在编译期折叠进所有使用处，不占存储
+    if (var->is_const) return;
+    // 初值已由编译期求值算成字面量
+    int64_t value = 0;
+    if (var->initializer->type == NodeType::NUMBER)
+        value = std::static_pointer_cast<NumberNode>(var->initializer)->value;
+    else if (var->initializer->type == NodeType::BOOLEAN)
+        value = std::static_pointer_cast<BooleanNode>(var->initializer)->value;
+    else {
+        THROW_ERROR("static let `" + var->name + "`: only integer and bool globals are supported", var->line, var->col);
+        return;
     }
-    backup_output += std::to_string(align_of_16(var_size + param_size)) + "\n";
-    std::ostringstream new_ss;
-    new_ss << backup_output;
-    new_ss << output.str();
-    output = std::move(new_ss);
-    output << std::endl;
+    DataObject d;
+    d.name = var->name;
+    for (int i = 0; i < 8; i++) d.bytes.push_back(static_cast<uint8_t>(static_cast<uint64_t>(value) >> (i * 8)));
+    module.data.push_back(std::move(d));
+    static_vars.insert(var->name);
 }
 
-void WatGen::gen_var(const ASTNodePtr &node) {
+void FunctionGen::gen_var(const ASTNodePtr &node) {
     const auto var = std::static_pointer_cast<VariableDeclNode>(node);
+    // static 在 gen_program 中处理；const 的使用处都已替换成字面量
+    if (var->is_static || var->is_const) return;
     
     // 为变量分配栈空间 (8 字节对齐)
     // 如果是字符串类型，需要 16 字节（fat pointer）
-    const bool is_string = var->type->kind == TypeKind::STR;
-    size_t lvar_size = 8;
+    const bool is_string = var->type->is_fat();
+    size_t lvar_size = is_string ? 16 : 8;
     stack_offset += lvar_size;
     var_size += lvar_size;
-    var_offsets[var->name] = stack_offset;
+    // 初始化表达式里的 stack_alloc! 还会继续分配栈空间
+    const size_t offset = stack_offset;
+    var_offsets[var->name] = offset;
+    if (is_string) str_vars.insert(var->name);
+    else str_vars.erase(var->name);
     
-    output << "    # declare var: " << var->name << std::endl;
+    comment("declare var: " + var->name);
     
     // 如果有初始化值，计算并存储
     if (var->initializer) {
-        gen(var->initializer);
-        if (is_string) {
-            var_str_lens[var->name] = str_len;
-        }
-        output << "    mov [rbp - " << stack_offset << "], rax" << std::endl;
+        gen_value(var->initializer, is_string);
+        emit(Op::MOV, local(offset), Operand::r(Reg::RAX));
+        if (is_string) emit(Op::MOV, len_operand(var->name), Operand::r(Reg::RDX));
     }
 }
 
-void WatGen::gen_unary(const ASTNodePtr& node) {
+void FunctionGen::gen_unary(const ASTNodePtr& node) {
     const auto n = std::static_pointer_cast<UnaryOpNode>(node);
     switch (n->op) {
         using enum UnaryOpType;
     case Addr: {
-        var_operation = "lea";
+        var_operation = Op::LEA;
         gen(n->expr);
-        var_operation = "mov";
+        var_operation = Op::MOV;
+        break;
     }
     case Minus: {
         if (n->expr->type == NodeType::NUMBER) {
             const auto tmp = std::static_pointer_cast<NumberNode>(n->expr);
-            output << "    mov rax, -" << tmp->value << std::endl;
+            emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(-tmp->value));
         }
         else {
             gen(n->expr);
-            output << "    neg rax" << std::endl;
+            emit(Op::NEG, Operand::r(Reg::RAX));
         }
+        break;
+    }
+    case Dyn: {
+        // 数据指针在 rax，虚表在 rdx；trait 没有动态调用时不生成虚表
+        gen_value(n->expr, false);
+        if (!want_len) break;
+        if (const auto vt = vtable_symbol(*n); module.vtables.contains(vt))
+            emit(Op::LEA, Operand::r(Reg::RDX), Operand::symbol(vt));
+        else
+            emit(Op::MOV, Operand::r(Reg::RDX), Operand::i(0));
+        break;
     }
     }
 }
 
-void WatGen::gen_assignment(const ASTNodePtr &node) {
+void FunctionGen::gen_assignment(const ASTNodePtr &node) {
     const auto assign = std::static_pointer_cast<AssignmentNode>(node);
 
+    // 寄存器里的变量加减常量：add / sub reg, imm
+    if (!reg_vars.empty() && assign->value->type == NodeType::BINARY_OP) {
+        const auto target = var_operand(assign->name);
+        const auto op = std::static_pointer_cast<BinaryOpNode>(assign->value);
+        if (target.kind == Operand::Kind::Reg && (op->op == BinaryOpType::ADD || op->op == BinaryOpType::SUB) &&
+            op->left->type == NodeType::IDENTIFIER && std::static_pointer_cast<IdentifierNode>(op->left)->name == assign->name &&
+            op->right->type == NodeType::NUMBER) {
+            const auto value = std::static_pointer_cast<NumberNode>(op->right)->value;
+            if (value >= INT32_MIN && value <= INT32_MAX) {
+                emit(op->op == BinaryOpType::ADD ? Op::ADD : Op::SUB, target, Operand::i(value));
+                return;
+            }
+        }
+    }
+
     // 计算右侧表达式
-    gen(assign->value);
+    const bool is_string = str_vars.contains(assign->name);
+    gen_value(assign->value, is_string);
     
     // 存储到变量
-    output << "    mov [rbp - " << get_var_offset(assign->name) << "], rax" << std::endl;
+    emit(Op::MOV, var_operand(assign->name), Operand::r(Reg::RAX));
+    if (is_string) emit(Op::MOV, len_operand(assign->name), Operand::r(Reg::RDX));
 }
 
-void WatGen::gen_binary(const ASTNodePtr &node) {
+void FunctionGen::gen_binary(const ASTNodePtr &node) {
     const auto binop = std::static_pointer_cast<BinaryOpNode>(node);
+    // 左操作数放在调用者保存的 rcx 中，JIT 直接从 poloc 调用生成的代码，不能破坏 rbx
+    const auto rax = Operand::r(Reg::RAX), rcx = Operand::r(Reg::RCX);
+    const auto al = Operand::r(Reg::RAX, 1);
+    // setcc 只写 al，rax 的高位还是右操作数的值，要清掉才能当作布尔值使用
+    auto compare = [&](const Cond cc) {
+        emit(Op::CMP, rcx, rax);
+        emit_cc(Op::SETCC, cc, al);
+        emit(Op::AND, rax, Operand::i(1));
+    };
     
     // 先计算左操作数
     gen(binop->left);
-    output << "    push rax" << std::endl;
+    push_temp(Reg::RAX);
     
     // 再计算右操作数
     gen(binop->right);
-    output << "    pop rbx" << std::endl;
+    pop_temp(Reg::RCX);
     
     // 根据操作符生成指令
     switch (binop->op) {
     case BinaryOpType::ADD:
-        output << "    add rax, rbx" << std::endl;
+        emit(Op::ADD, rax, rcx);
         break;
     case BinaryOpType::SUB:
-        output << "    sub rbx, rax" << std::endl;
-        output << "    mov rax, rbx" << std::endl;
+        emit(Op::SUB, rcx, rax);
+        emit(Op::MOV, rax, rcx);
         break;
     case BinaryOpType::MUL:
-        output << "    imul rax, rbx" << std::endl;
+        emit(Op::IMUL, rax, rcx);
         break;
     case BinaryOpType::DIV:
-        output << "    mov rax, rbx" << std::endl;
-        output << "    xor rdx, rdx" << std::endl;
-        output << "    pop rcx" << std::endl;
-        output << "    idiv rcx" << std::endl;
+        // 除数在 rax，不能再从栈上取
+        emit(Op::XCHG, rax, rcx);
+        emit(Op::CQO);
+        emit(Op::IDIV, rcx);
         return; // 已经在 rax 中
     case BinaryOpType::MOD:
-        output << "    mov rax, rbx" << std::endl;
-        output << "    xor rdx, rdx" << std::endl;
-        output << "    pop rcx" << std::endl;
-        output << "    idiv rcx" << std::endl;
-        output << "    mov rax, rdx" << std::endl;
+        emit(Op::XCHG, rax, rcx);
+        emit(Op::CQO);
+        emit(Op::IDIV, rcx);
+        emit(Op::MOV, rax, Operand::r(Reg::RDX));
         return; // 余数在 rdx
     case BinaryOpType::EQ:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setz al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::E);
         break;
     case BinaryOpType::NE:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setnz al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::NE);
         break;
     case BinaryOpType::LT:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setl al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::L);
         break;
     case BinaryOpType::GT:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setg al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::G);
         break;
     case BinaryOpType::LE:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setle al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::LE);
         break;
     case BinaryOpType::GE:
-        output << "    cmp rbx, rax" << std::endl;
-        output << "    setge al" << std::endl;
-        //output << "    movzx rax, al" << std::endl;
+        compare(Cond::GE);
         break;
     case BinaryOpType::AND:
-        output << "    and rbx, rax" << std::endl;
-        output << "    mov rax, rbx" << std::endl;
+    case BinaryOpType::BIT_AND:
+        emit(Op::AND, rcx, rax);
+        emit(Op::MOV, rax, rcx);
         break;
     case BinaryOpType::OR:
-        output << "    or rbx, rax" << std::endl;
-        output << "    mov rax, rbx" << std::endl;
+        emit(Op::OR, rcx, rax);
+        emit(Op::MOV, rax, rcx);
         break;
     default:
         break;
     }
 }
 
-void WatGen::gen_number(const ASTNodePtr &node) {
+void FunctionGen::gen_number(const ASTNodePtr &node) {
     const auto num = std::static_pointer_cast<NumberNode>(node);
-    output << "    mov rax, " << num->value << std::endl;
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(num->value));
 }
 
-void WatGen::gen_float(const ASTNodePtr &node) {
+void FunctionGen::gen_float(const ASTNodePtr &node) {
     const auto flt = std::static_pointer_cast<FloatNode>(node);
     // 浮点数需要特殊处理，这里简化为整数加载
-    output << "    # float: " << flt->value << std::endl;
-    output << "    mov rax, " << static_cast<int64_t>(flt->value) << std::endl;
+    comment("float: " + std::to_string(flt->value));
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(static_cast<int64_t>(flt->value)));
 }
 
-void WatGen::gen_boolean(const ASTNodePtr &node) {
+void FunctionGen::gen_boolean(const ASTNodePtr &node) {
     const auto boolean = std::static_pointer_cast<BooleanNode>(node);
-    output << "    mov rax, " << (boolean->value ? 1 : 0) << std::endl;
+    emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(boolean->value ? 1 : 0));
 }
 
-void WatGen::gen_string(const ASTNodePtr &node) {
+void FunctionGen::gen_string(const ASTNodePtr &node) {
     const auto str = std::static_pointer_cast<StringNode>(node);
     
     // 生成字符串数据（在数据段）
     int label = gen_string_data(str->value);
 
-    // rax = ptr
-    output << "    # string: " << str->value << std::endl;
-    output << "    lea rax, [rip + .L_str_" << label << "]" << std::endl;
-    str_len = str->value.length();
+    // rax = ptr, rdx = len
+    comment("string: " + str->value);
+    emit(Op::LEA, Operand::r(Reg::RAX), Operand::str(label));
+    if (want_len) emit(Op::MOV, Operand::r(Reg::RDX), Operand::i(static_cast<int64_t>(str->value.length())));
+}
+
+int FunctionGen::gen_string_data(const std::string& str, const bool table) {
+    // 相同字符串共用池中的一项，函数内按首次出现的顺序编号
+    const int id = module.strings.intern(str, table);
+    const auto [it, inserted] = string_ids.try_emplace(id, static_cast<int>(strings.size()));
+    if (inserted) strings.push_back(id);
+    return it->second;
 }
 
-int WatGen::gen_string_data(const std::string& str) {
-    int label = string_counter++;
+void FunctionGen::gen_identifier(const ASTNodePtr &node) {
+    const auto id = std::static_pointer_cast<IdentifierNode>(node);
     
-    // 检查是否已存在相同字符串
-    auto it = string_labels.find(str);
-    if (it != string_labels.end()) {
-        return it->second;
+    // 字符串（fat pointer）同时读出长度；取地址时只要栈槽的地址
+    emit(var_operation, Operand::r(Reg::RAX), var_operand(id->name));
+    if (want_len && var_operation == Op::MOV && str_vars.contains(id->name))
+        emit(Op::MOV, Operand::r(Reg::RDX), len_operand(id->name));
+}
+
+bool FunctionGen::is_str(const ASTNodePtr& node) const {
+    switch (node->type) {
+    case NodeType::STRING:
+        return true;
+    case NodeType::IDENTIFIER:
+        return str_vars.contains(std::static_pointer_cast<IdentifierNode>(node)->name);
+    case NodeType::FUNCTION_CALL: {
+        const auto fn = module.signature(std::static_pointer_cast<FunctionCallNode>(node)->name);
+        return fn && fn->returnType && fn->returnType->is_fat();
     }
-    
-    string_labels[str] = label;
-    
-    // 转义字符串用于 .string 指令
-    std::string escaped;
-    for (size_t i = 0; i < str.length(); i++) {
-        unsigned char c = str[i];
-        if (c == '"') escaped += "\\\"";
-        else if (c == '\\') escaped += "\\\\";
-        else if (c == '\n') escaped += "\\n";
-        else if (c == '\r') escaped += "\\r";
-        else if (c == '\t') escaped += "\\t";
-        else if (c >= 32 && c < 127) escaped += c;
-        else {
-            // 八进制转义
-            char buf[8] = {};
-            snprintf(buf, sizeof(buf), "\\%03o", c);
-            escaped += buf;
-        }
+    case NodeType::UNARY:
+        return std::static_pointer_cast<UnaryOpNode>(node)->op == UnaryOpType::Dyn;
+    default:
+        return false;
     }
-    
-    data_output << ".L_str_" << label << ":" << std::endl;
-    data_output << "    .string \"" << escaped << "\"" << std::endl;
-    data_output << std::endl;
-    
-    return label;
 }
 
-void WatGen::gen_identifier(const ASTNodePtr &node) {
-    const auto id = std::static_pointer_cast<IdentifierNode>(node);
-    size_t offset = get_var_offset(id->name);
-    
-    // 检查是否是字符串类型（fat pointer）
-    // 简单判断：如果 offset 是 16 的倍数，可能是字符串
-    // 这里简化处理，直接读取 ptr 部分
-    output << "    " << var_operation << " rax, [rbp - " << offset << "]" << std::endl;
+void FunctionGen::gen_value(const ASTNodePtr& node, const bool with_len) {
+    const bool saved = want_len;
+    want_len = with_len;
+    gen(node);
+    want_len = saved;
+}
+
+void FunctionGen::load_simple(const ASTNodePtr& node, const Reg ptr, const Reg len) {
+    // 常量和变量直接装进目标寄存器，不经过 rax，也不会破坏其他寄存器
+    switch (node->type) {
+    case NodeType::NUMBER:
+        emit(Op::MOV, Operand::r(ptr), Operand::i(std::static_pointer_cast<NumberNode>(node)->value));
+        break;
+    case NodeType::BOOLEAN:
+        emit(Op::MOV, Operand::r(ptr), Operand::i(std::static_pointer_cast<BooleanNode>(node)->value ? 1 : 0));
+        break;
+    case NodeType::STRING: {
+        const auto str = std::static_pointer_cast<StringNode>(node);
+        comment("string: " + str->value);
+        emit(Op::LEA, Operand::r(ptr), Operand::str(gen_string_data(str->value)));
+        if (len != Reg::NONE) emit(Op::MOV, Operand::r(len), Operand::i(static_cast<int64_t>(str->value.length())));
+        break;
+    }
+    case NodeType::IDENTIFIER: {
+        const auto& name = std::static_pointer_cast<IdentifierNode>(node)->name;
+        emit(Op::MOV, Operand::r(ptr), var_operand(name));
+        if (len != Reg::NONE) emit(Op::MOV, Operand::r(len), len_operand(name));
+        break;
+    }
+    default:
+        THROW_ERROR("load_simple: not a constant or variable", node->line, node->col);
+        break;
+    }
 }
 
-void WatGen::gen_function_call(const ASTNodePtr &node) {
+void FunctionGen::gen_function_call(const ASTNodePtr &node) {
     const auto call = std::static_pointer_cast<FunctionCallNode>(node);
 
     // x86-64 调用约定：使用寄存器传递参数 (rdi, rsi, rdx, rcx, r8, r9)
+    // Polo 函数的 str 参数占两个寄存器（指针、长度）；extern 函数按 C 约定只传指针
     const char** regs = func_call_regs;
-    size_t reg_count = RegAlloc::used.size();
-    
-    // 从左到右计算参数并放入寄存器
-    std::map<size_t, size_t> no_call_expr;
-    for (size_t i = 0; i < call->arguments.size() && i < reg_count; i++) {
-        if (call->arguments[i]->type != NodeType::FUNCTION_CALL) 
-            no_call_expr[i] = i;
-        else {
-            gen(call->arguments[i]);
-            output << "    mov " << regs[i] << ", rax" << std::endl;
+    constexpr size_t reg_count = std::size(func_call_regs);
+    const bool c_abi = module.c_functions.contains(call->name);
+    const auto sig = module.signature(call->name);
+    std::vector<Arg> args;
+    size_t r = 0;
+    int64_t stack = 0;
+    // 通过虚表调用：接收者的数据指针作为 self，虚表放在 r11
+    if (call->vslot >= 0 && !call->arguments.empty())
+        args.push_back({&call->arguments[r++], reg_from_name(regs[0]), Reg::R11});
+    for (size_t i = r; i < call->arguments.size(); i++) {
+        // 形参不是两个字时（dyn 值传给 *Self）只传指针
+        const bool fat = !c_abi && is_str(call->arguments[i])
+                         && (!sig || i >= sig->parameters.size() || sig->parameters[i].type->is_fat());
+        // 剩下的寄存器放不下时整个参数放到栈上，和 gen_function 取参数的方式一致
+        if (r + (fat ? 2 : 1) > reg_count) {
+            args.push_back({&call->arguments[i], Reg::NONE, Reg::NONE, stack, fat});
+            stack += fat ? 16 : 8;
+            continue;
         }
+        const Reg ptr = reg_from_name(regs[r++]);
+        args.push_back({&call->arguments[i], ptr, fat ? reg_from_name(regs[r++]) : Reg::NONE, -1, fat});
     }
-    
-    // 调用函数
-    for (const auto&[fst, snd] : no_call_expr) {
-        gen(call->arguments[fst]);
-        output << "    mov " << regs[snd] << ", rax" << std::endl;
+    // 栈上的参数区在 call 时位于 rsp 处；加上填充让 rsp 保持 16 字节对齐，call 就不用再填充
+    size_t area = 0;
+    if (stack) {
+        const auto words = static_cast<size_t>((stack + stack_args_offset) / 8);
+        area = words + (temp_top + words) % 2;
+        emit(Op::SUB, Operand::r(Reg::RSP), Operand::i(static_cast<int64_t>(area * 8)));
+        temp_top += area;
+    }
+    gen_args(args);
+    if (call->vslot > 0) emit(Op::ADD, Operand::r(Reg::R11), Operand::i(8 * call->vslot));
+    if (call->vslot >= 0) this->call(Operand::r(Reg::R11));
+    else this->call(call->name);
+    if (area) {
+        emit(Op::ADD, Operand::r(Reg::RSP), Operand::i(static_cast<int64_t>(area * 8)));
+        temp_top -= area;
+    }
+
+    // C 函数返回的字符串没有长度，需要时在这里求一次
+    if (const auto fn = module.signature(call->name);
+        c_abi && want_len && fn && fn->returnType && fn->returnType->is_fat_str()) {
+        push_temp(Reg::RAX);
+        emit(Op::MOV, Operand::r(reg_from_name(regs[0])), Operand::r(Reg::RAX));
+        this->call("strlen");
+        emit(Op::MOV, Operand::r(Reg::RDX), Operand::r(Reg::RAX));
+        pop_temp(Reg::RAX);
+    }
+}
+
+void FunctionGen::gen_args(const std::vector<Arg>& args) {
+    // 栈上的参数区在进来时的 rsp 处，之后压的临时值会让它相对 rsp 上移
+    const size_t base = temp_top;
+    const auto slot = [&](const Arg& a, const int64_t word) {
+        return Operand::mem(Reg::RSP, static_cast<int64_t>(temp_top - base) * 8 + stack_args_offset + a.stack + word * 8);
+    };
+    // 需要计算的参数从左到右求值：栈上的算完直接写进参数区；放进寄存器的除最后一个外先压栈，
+    // 全部算完再放进寄存器，计算后面的参数不会破坏已经放好的寄存器
+    const Arg* last = nullptr;
+    for (const auto& a : args)
+        if (!is_simple(*a.node)) last = &a;
+    std::vector<const Arg*> pushed;
+    for (const auto& a : args) {
+        if (is_simple(*a.node)) continue;
+        gen_value(*a.node, a.stack >= 0 ? a.fat : a.len != Reg::NONE);
+        if (a.stack >= 0) {
+            emit(Op::MOV, slot(a, 0), Operand::r(Reg::RAX));
+            if (a.fat) emit(Op::MOV, slot(a, 1), Operand::r(Reg::RDX));
+        } else if (&a == last) {
+            if (a.len != Reg::NONE) emit(Op::MOV, Operand::r(a.len), Operand::r(Reg::RDX));
+            if (a.ptr != Reg::RAX) emit(Op::MOV, Operand::r(a.ptr), Operand::r(Reg::RAX));
+        } else {
+            push_temp(Reg::RAX);
+            if (a.len != Reg::NONE) push_temp(Reg::RDX);
+            pushed.push_back(&a);
+        }
+    }
+    for (auto it = pushed.rbegin(); it != pushed.rend(); ++it) {
+        if ((*it)->len != Reg::NONE) pop_temp((*it)->len);
+        pop_temp((*it)->ptr);
+    }
+    // 栈上的常量和变量经过 rax 写进参数区，rax 不是参数寄存器
+    for (const auto& a : args) {
+        if (!is_simple(*a.node)) continue;
+        if (a.stack < 0) {
+            load_simple(*a.node, a.ptr, a.len);
+            continue;
+        }
+        load_simple(*a.node, Reg::RAX, Reg::NONE);
+        emit(Op::MOV, slot(a, 0), Operand::r(Reg::RAX));
+        if (!a.fat) continue;
+        if ((*a.node)->type == NodeType::STRING)
+            emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(static_cast<int64_t>(std::static_pointer_cast<StringNode>(*a.node)->value.length())));
+        else
+            emit(Op::MOV, Operand::r(Reg::RAX), len_operand(std::static_pointer_cast<IdentifierNode>(*a.node)->name));
+        emit(Op::MOV, slot(a, 1), Operand::r(Reg::RAX));
     }
-    output << "    call " << call->name << std::endl;
 }
 
-void WatGen::gen_return_stmt(const ASTNodePtr &node) {
+void FunctionGen::gen_return_stmt(const ASTNodePtr &node) {
     const auto ret = std::static_pointer_cast<ReturnStmtNode>(node);
     
     if (ret->expression) {
@@ -431,15 +1015,10 @@ void WatGen::gen_return_stmt(const ASTNodePtr &node) {
     }
     
     has_return = true;
-    output << "    leave" << std::endl;
-    output << "    ret" << std::endl;
-}
-
-std::string WatGen::get_output() const {
-    return output.str();
+    gen_epilogue();
 }
 
-size_t WatGen::get_var_offset(const std::string& name) {
+size_t FunctionGen::get_var_offset(const std::string& name) {
     auto it = var_offsets.find(name);
     if (it != var_offsets.end()) {
         return it->second;
@@ -449,89 +1028,434 @@ size_t WatGen::get_var_offset(const std::string& name) {
     return -1;
 }
 
-int WatGen::new_label() {
-    return label_counter++;
+Operand FunctionGen::var_operand(const std::string& name) {
+    for (auto it = reg_vars.rbegin(); it != reg_vars.rend(); ++it)
+        if (it->name == name) return Operand::r(it->reg);
+    if (!var_offsets.contains(name) && module.static_vars.contains(name))
+        return Operand::data(name);
+    return local(get_var_offset(name));
+}
+
+Operand FunctionGen::len_operand(const std::string& name) {
+    return local(get_var_offset(name) - 8);
+}
+
+// 条件是 v < e 等比较的循环，循环里不调用函数（调用会破坏调用者保存的寄存器）时，
+// 把 v 和循环里不变的 e 放进 r8 ~ r11；v 在循环里被赋值时，循环结束后写回栈槽。
+// 返回放进寄存器的变量个数
+size_t FunctionGen::promote_loop(const std::shared_ptr<ForStmtNode>& loop) {
+    if (!loop->condition || loop->condition->type != NodeType::BINARY_OP) return 0;
+    const auto cmp = std::static_pointer_cast<BinaryOpNode>(loop->condition);
+    switch (cmp->op) {
+    case BinaryOpType::EQ: case BinaryOpType::NE: case BinaryOpType::LT:
+    case BinaryOpType::GT: case BinaryOpType::LE: case BinaryOpType::GE:
+        break;
+    default:
+        return 0;
+    }
+
+    std::unordered_set<std::string> assigned, declared;
+    bool ok = true;
+    const auto scan = [&](const ASTNodePtr& node) {
+        each_node(node, [&](const ASTNodePtr& n) {
+            switch (n->type) {
+            case NodeType::ASSIGNMENT:
+                assigned.insert(std::static_pointer_cast<AssignmentNode>(n)->name);
+                break;
+            case NodeType::VARIABLE_DECL:
+                declared.insert(std::static_pointer_cast<VariableDeclNode>(n)->name);
+                break;
+            case NodeType::MACRO_CALL:
+                ok &= std::static_pointer_cast<MacroCallNode>(n)->name != "syscall";
+                break;
+            case NodeType::FUNCTION_CALL:
+            case NodeType::MEMBER_ACCESS:
+            case NodeType::MEMBER_ASSIGN:
+            case NodeType::NAME_SPACE_VISIT:
+                ok = false;
+                break;
+            default:
+                break;
+            }
+        });
+    };
+    scan(loop->condition);
+    scan(loop->increment);
+    for (const auto& s : loop->body) scan(s);
+    if (!ok) return 0;
+
+    const auto candidate = [&](const ASTNodePtr& n) -> std::string {
+        if (n->type != NodeType::IDENTIFIER) return {};
+        const auto& name = std::static_pointer_cast<IdentifierNode>(n)->name;
+        if (!var_offsets.contains(name) || str_vars.contains(name) || addressed.contains(name) || declared.contains(name))
+            return {};
+        for (const auto& r : reg_vars)
+            if (r.name == name) return {};
+        return name;
+    };
+    size_t count = 0;
+    const auto take = [&](const std::string& name, const bool written) {
+        for (const Reg reg : {Reg::R8, Reg::R9, Reg::R10, Reg::R11}) {
+            if (std::ranges::any_of(reg_vars, [&](const RegVar& r) { return r.reg == reg; })) continue;
+            emit(Op::MOV, Operand::r(reg), local(get_var_offset(name)));
+            reg_vars.push_back({name, reg, written});
+            count++;
+            return;
+        }
+    };
+    if (const auto v = candidate(cmp->left); !v.empty()) take(v, assigned.contains(v));
+    if (const auto e = candidate(cmp->right); !e.empty() && !assigned.contains(e)) take(e, false);
+    return count;
+}
+
+void FunctionGen::release_loop(const size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const auto r = reg_vars.back();
+        reg_vars.pop_back();
+        if (r.written) emit(Op::MOV, local(get_var_offset(r.name)), Operand::r(r.reg));
+    }
+}
+
+// 比较的左边是寄存器里的变量、右边是常量或变量时直接 cmp，不经过 rax 和 setcc；
+// cc 是条件成立的跳转条件
+bool FunctionGen::gen_loop_test(const ASTNodePtr& cond, Cond& cc) {
+    if (!cond || cond->type != NodeType::BINARY_OP) return false;
+    const auto cmp = std::static_pointer_cast<BinaryOpNode>(cond);
+    if (cmp->left->type != NodeType::IDENTIFIER) return false;
+    const auto a = var_operand(std::static_pointer_cast<IdentifierNode>(cmp->left)->name);
+    if (a.kind != Operand::Kind::Reg) return false;
+    Operand b;
+    if (cmp->right->type == NodeType::NUMBER) {
+        const auto value = std::static_pointer_cast<NumberNode>(cmp->right)->value;
+        if (value < INT32_MIN || value > INT32_MAX) return false;
+        b = Operand::i(value);
+    } else if (cmp->right->type == NodeType::IDENTIFIER) {
+        const auto& name = std::static_pointer_cast<IdentifierNode>(cmp->right)->name;
+        if (str_vars.contains(name)) return false;
+        b = var_operand(name);
+    } else {
+        return false;
+    }
+    switch (cmp->op) {
+    case BinaryOpType::EQ: cc = Cond::E; break;
+    case BinaryOpType::NE: cc = Cond::NE; break;
+    case BinaryOpType::LT: cc = Cond::L; break;
+    case BinaryOpType::GT: cc = Cond::G; break;
+    case BinaryOpType::LE: cc = Cond::LE; break;
+    case BinaryOpType::GE: cc = Cond::GE; break;
+    default: return false;
+    }
+    emit(Op::CMP, a, b);
+    return true;
+}
+
+int FunctionGen::new_label(const char* prefix) {
+    // 编号在合并时加上 label_base
+    cur->labels.emplace_back(prefix);
+    return static_cast<int>(cur->labels.size() - 1);
+}
+
+// cond 是 v == 常量，或者这样的比较用 or 连起来时，取出 v 和各个常量
+static bool switch_values(const ASTNodePtr& cond, std::string& var, std::vector<int64_t>& values) {
+    if (!cond || cond->type != NodeType::BINARY_OP) return false;
+    const auto op = std::static_pointer_cast<BinaryOpNode>(cond);
+    if (op->op == BinaryOpType::OR)
+        return switch_values(op->left, var, values) && switch_values(op->right, var, values);
+    if (op->op != BinaryOpType::EQ) return false;
+    auto id = op->left, value = op->right;
+    if (id->type != NodeType::IDENTIFIER) std::swap(id, value);
+    if (id->type != NodeType::IDENTIFIER) return false;
+    int64_t v;
+    if (value->type == NodeType::NUMBER) {
+        v = std::static_pointer_cast<NumberNode>(value)->value;
+    } else if (value->type == NodeType::UNARY && std::static_pointer_cast<UnaryOpNode>(value)->op == UnaryOpType::Minus &&
+               std::static_pointer_cast<UnaryOpNode>(value)->expr->type == NodeType::NUMBER) {
+        v = -std::static_pointer_cast<NumberNode>(std::static_pointer_cast<UnaryOpNode>(value)->expr)->value;
+    } else {
+        return false;
+    }
+    if (v < INT32_MIN || v > INT32_MAX) return false;
+    const auto& name = std::static_pointer_cast<IdentifierNode>(id)->name;
+    if (var.empty()) var = name;
+    else if (var != name) return false;
+    values.push_back(v);
+    return true;
+}
+
+bool FunctionGen::gen_switch(const std::shared_ptr<IfStmtNode>& node) {
+    // 沿着 else if 收集分支；第一个不是这种条件的 if 连同后面的部分当作默认分支
+    std::string var;
+    std::vector<std::pair<std::shared_ptr<IfStmtNode>, std::vector<int64_t>>> arms;
+    const std::vector<ASTNodePtr>* otherwise = nullptr;
+    for (auto n = node;;) {
+        std::string name = var;
+        std::vector<int64_t> values;
+        if (!switch_values(n->condition, name, values)) {
+            if (arms.empty()) return false;
+            otherwise = &arms.back().first->elseBody;
+            break;
+        }
+        var = name;
+        arms.emplace_back(n, std::move(values));
+        if (n->elseBody.size() != 1 || n->elseBody[0]->type != NodeType::IF_STMT) {
+            otherwise = &n->elseBody;
+            break;
+        }
+        n = std::static_pointer_cast<IfStmtNode>(n->elseBody[0]);
+    }
+    if (str_vars.contains(var)) return false;
+    // 重复的值按 if 的顺序只有第一个分支能走到；不到三个值时比较链就够了
+    std::unordered_set<int64_t> seen;
+    for (const auto& arm : arms)
+        seen.insert(arm.second.begin(), arm.second.end());
+    if (seen.size() < 3) return false;
+
+    seen.clear();
+    std::vector<SwitchCase> cases;
+    std::vector<int> labels;
+    for (const auto& arm : arms) {
+        labels.push_back(new_label("case"));
+        for (const auto v : arm.second)
+            if (seen.insert(v).second) cases.push_back({v, labels.back()});
+    }
+    std::sort(cases.begin(), cases.end(), [](const SwitchCase& a, const SwitchCase& b) { return a.value < b.value; });
+    const int defaultLabel = new_label("case_default");
+    const int endLabel = new_label("end");
+
+    emit(Op::MOV, Operand::r(Reg::RAX), var_operand(var));
+    gen_switch_range(cases, 0, cases.size(), defaultLabel);
+    for (size_t i = 0; i < arms.size(); i++) {
+        emit(Op::LABEL, Operand::lbl(labels[i]));
+        for (const auto& stmt : arms[i].first->thenBody)
+            gen(stmt);
+        emit(Op::JMP, Operand::lbl(endLabel));
+    }
+    emit(Op::LABEL, Operand::lbl(defaultLabel));
+    for (const auto& stmt : *otherwise)
+        gen(stmt);
+    emit(Op::LABEL, Operand::lbl(endLabel));
+    return true;
+}
+
+// 值在 rax 里，cases[begin, end) 按值排好序。每种分派都以跳转结束，可以随意改 rax、rcx
+void FunctionGen::gen_switch_range(const std::vector<SwitchCase>& cases, const size_t begin, const size_t end,
+                                   const int otherwise) {
+    const auto rax = Operand::r(Reg::RAX), rcx = Operand::r(Reg::RCX);
+    const size_t count = end - begin;
+    const int64_t lo = cases[begin].value, hi = cases[end - 1].value;
+    const int64_t span = hi - lo + 1;
+    std::vector<int> targets;
+    for (size_t i = begin; i < end; i++)
+        if (std::find(targets.begin(), targets.end(), cases[i].label) == targets.end()) targets.push_back(cases[i].label);
+
+    // 位测试：值落在 64 以内的区间、只通往一两个分支时，每个分支一条 bt，比逐个比较的跳转少
+    const size_t n = targets.size();
+    const bool bit_test = span <= 64 && ((n == 1 && count >= 3) || (n == 2 && count >= 5) || (n == 3 && count >= 6));
+    // 跳转表：区间里至少 40% 的值有分支
+    const bool table = count >= 4 && span <= MAX_JUMP_TABLE && span * 2 <= static_cast<int64_t>(count) * 5;
+    if (bit_test || table) {
+        // 减去下界后按无符号比较，一次排除两侧越界的值
+        if (lo) emit(Op::SUB, rax, Operand::i(lo));
+        emit(Op::CMP, rax, Operand::i(hi - lo));
+        emit_cc(Op::JCC, Cond::A, Operand::lbl(otherwise));
+    }
+    if (bit_test) {
+        for (const int target : targets) {
+            uint64_t mask = 0;
+            for (size_t i = begin; i < end; i++)
+                if (cases[i].label == target) mask |= uint64_t{1} << (cases[i].value - lo);
+            emit(Op::MOV, rcx, Operand::i(static_cast<int64_t>(mask)));
+            emit(Op::BT, rcx, rax);
+            emit_cc(Op::JCC, Cond::B, Operand::lbl(target));
+        }
+        emit(Op::JMP, Operand::lbl(otherwise));
+        return;
+    }
+    if (table) {
+        // 表放在 .rodata，不占指令缓存；每项是分支相对表头的 32 位偏移，位置无关
+        const int base = new_label("case_table");
+        emit(Op::LEA, rcx, Operand::lbl(base));
+        emit(Op::MOVSXD, rax, Operand::sib(Reg::RCX, Reg::RAX, 4));
+        emit(Op::ADD, rax, rcx);
+        emit(Op::JMP, rax);
+        emit(Op::RODATA);
+        emit(Op::ALIGN, Operand::i(4));
+        emit(Op::LABEL, Operand::lbl(base));
+        size_t i = begin;
+        for (int64_t v = lo; v <= hi; v++) {
+            const int target = cases[i].value == v ? cases[i++].label : otherwise;
+            emit(Op::TABLE_ENTRY, Operand::lbl(target), Operand::lbl(base));
+        }
+        emit(Op::TEXT);
+        return;
+    }
+    if (count <= 3) {
+        for (size_t i = begin; i < end; i++) {
+            emit(Op::CMP, rax, Operand::i(cases[i].value));
+            emit_cc(Op::JCC, Cond::E, Operand::lbl(cases[i].label));
+        }
+        emit(Op::JMP, Operand::lbl(otherwise));
+        return;
+    }
+    // 稀疏的值：和中间的值比较一次，相等直接跳到分支，两半各自再选分派方式
+    const size_t mid = begin + count / 2;
+    const int below = new_label("case_lt");
+    emit(Op::CMP, rax, Operand::i(cases[mid].value));
+    emit_cc(Op::JCC, Cond::E, Operand::lbl(cases[mid].label));
+    emit_cc(Op::JCC, Cond::L, Operand::lbl(below));
+    gen_switch_range(cases, mid + 1, end, otherwise);
+    emit(Op::LABEL, Operand::lbl(below));
+    gen_switch_range(cases, begin, mid, otherwise);
 }
 
-void WatGen::gen_if_stmt(const ASTNodePtr &node) {
+void FunctionGen::gen_if_stmt(const ASTNodePtr &node) {
     const auto ifStmt = std::static_pointer_cast<IfStmtNode>(node);
+    if (gen_switch(ifStmt)) return;
+    const std::string key = cur->name + ":if" + std::to_string(if_index++);
     
-    int elseLabel = new_label();
-    int endLabel = new_label();
+    int elseLabel = new_label("else");
+    int endLabel = new_label("end");
     
     // 生成条件代码
     gen(ifStmt->condition);
+    emit(Op::TEST, Operand::r(Reg::RAX, 1), Operand::r(Reg::RAX, 1));
+
+    if (prof_get(key + ":else") > prof_get(key + ":then")) {
+        // profile 显示 else 更热：条件为真才跳走，让 else 分支顺序执行
+        emit_cc(Op::JCC, Cond::NE, Operand::lbl(elseLabel));
+        prof_count(key + ":else");
+        for (const auto& stmt : ifStmt->elseBody)
+            gen(stmt);
+        emit(Op::JMP, Operand::lbl(endLabel));
+
+        emit(Op::LABEL, Operand::lbl(elseLabel));
+        prof_count(key + ":then");
+        for (const auto& stmt : ifStmt->thenBody)
+            gen(stmt);
+        emit(Op::LABEL, Operand::lbl(endLabel));
+        return;
+    }
     
     // 如果条件为假，跳转到 else
-    output << "    test al, al" << std::endl;
-    output << "    jz .L_else_" << elseLabel << std::endl;
+    emit_cc(Op::JCC, Cond::E, Operand::lbl(elseLabel));
     
     // then 分支
+    prof_count(key + ":then");
     for (const auto& stmt : ifStmt->thenBody)
         gen(stmt);
 
-    output << "    jmp .L_end_" << endLabel << std::endl;
+    emit(Op::JMP, Operand::lbl(endLabel));
     
     // else 分支
-    output << ".L_else_" << elseLabel << ":" << std::endl;
+    emit(Op::LABEL, Operand::lbl(elseLabel));
+    prof_count(key + ":else");
     for (const auto& stmt : ifStmt->elseBody)
         gen(stmt);
 
     
-    output << ".L_end_" << endLabel << ":" << std::endl;
+    emit(Op::LABEL, Operand::lbl(endLabel));
 }
 
-void WatGen::gen_for_stmt(const ASTNodePtr &node) {
+void FunctionGen::gen_for_stmt(const ASTNodePtr &node) {
     const auto forStmt = std::static_pointer_cast<ForStmtNode>(node);
+    const std::string key = cur->name + ":for" + std::to_string(for_index++);
     
-    int startLabel = new_label();
-    int endLabel = new_label();
-    int continueLabel = new_label();
+    int startLabel = new_label("for_start");
+    int endLabel = new_label("for_end");
+    int continueLabel = new_label("for_continue");
     
     // 初始化
     if (forStmt->init) {
         gen(forStmt->init);
     }
+    const size_t promoted = promote_loop(forStmt);
+    prof_count(key + ":entry");
+
+    // profile 显示平均每次进入至少迭代两次：把条件放到循环底部，每次迭代少一次跳转，
+    // 并把循环头对齐到 16 字节
+    const uint64_t entries = prof_get(key + ":entry");
+    if (forStmt->condition && entries && prof_get(key + ":body") >= 2 * entries) {
+        int bodyLabel = new_label("for_body");
+        emit(Op::JMP, Operand::lbl(startLabel));
+        emit(Op::ALIGN, Operand::i(16));
+        emit(Op::LABEL, Operand::lbl(bodyLabel));
+        prof_count(key + ":body");
+        loops.push_back({endLabel, continueLabel});
+        for (const auto& stmt : forStmt->body) {
+            gen(stmt);
+        }
+        loops.pop_back();
+        emit(Op::LABEL, Operand::lbl(continueLabel));
+        if (forStmt->increment) {
+            gen(forStmt->increment);
+        }
+        emit(Op::LABEL, Operand::lbl(startLabel));
+        if (Cond cc{}; gen_loop_test(forStmt->condition, cc)) {
+            emit_cc(Op::JCC, cc, Operand::lbl(bodyLabel));
+        } else {
+            gen(forStmt->condition);
+            emit(Op::TEST, Operand::r(Reg::RAX), Operand::r(Reg::RAX));
+            emit_cc(Op::JCC, Cond::NE, Operand::lbl(bodyLabel));
+        }
+        emit(Op::LABEL, Operand::lbl(endLabel));
+        release_loop(promoted);
+        return;
+    }
     
     // 循环开始
-    output << ".L_for_start_" << startLabel << ":" << std::endl;
+    emit(Op::LABEL, Operand::lbl(startLabel));
     
     // 条件检查
-    if (forStmt->condition) {
+    if (Cond cc{}; gen_loop_test(forStmt->condition, cc)) {
+        // 条件码取反：x86 的条件码最低位相反的两个互为否定
+        emit_cc(Op::JCC, static_cast<Cond>(static_cast<uint8_t>(cc) ^ 1), Operand::lbl(endLabel));
+    } else if (forStmt->condition) {
         gen(forStmt->condition);
-        output << "    test rax, rax" << std::endl;
-        output << "    jz .L_for_end_" << endLabel << std::endl;
+        emit(Op::TEST, Operand::r(Reg::RAX), Operand::r(Reg::RAX));
+        emit_cc(Op::JCC, Cond::E, Operand::lbl(endLabel));
     }
     
     // 循环体
+    prof_count(key + ":body");
+    loops.push_back({endLabel, continueLabel});
     for (const auto& stmt : forStmt->body) {
         gen(stmt);
     }
+    loops.pop_back();
     
     // continue 标签（增量）
-    output << ".L_for_continue_" << continueLabel << ":" << std::endl;
+    emit(Op::LABEL, Operand::lbl(continueLabel));
     if (forStmt->increment) {
         gen(forStmt->increment);
     }
     
     // 跳回开始
-    output << "    jmp .L_for_start_" << startLabel << std::endl;
+    emit(Op::JMP, Operand::lbl(startLabel));
     
     // 循环结束
-    output << ".L_for_end_" << endLabel << ":" << std::endl;
+    emit(Op::LABEL, Operand::lbl(endLabel));
+    release_loop(promoted);
 }
 
-void WatGen::gen_break_stmt(const ASTNodePtr &node) {
-    (void)node; // 简化处理，需要知道外层循环的结束标签
-    output << "    ; break - needs outer loop context" << std::endl;
+// 提升到寄存器的循环变量在 end 标签之后的 release_loop 里写回，跳到 end 就会经过写回；
+// 内层循环 break 时外层的变量仍在寄存器里，不用写回
+void FunctionGen::gen_break_stmt(const ASTNodePtr &node) {
+    if (loops.empty()) {
+        THROW_ERROR("break outside of a loop", node->line, node->col);
+        return;
+    }
+    emit(Op::JMP, Operand::lbl(loops.back().end));
 }
 
-void WatGen::gen_continue_stmt(const ASTNodePtr &node) {
-    (void)node; // 简化处理，需要知道外层循环的 continue 标签
-    output << "    ; continue - needs outer loop context" << std::endl;
+void FunctionGen::gen_continue_stmt(const ASTNodePtr &node) {
+    if (loops.empty()) {
+        THROW_ERROR("continue outside of a loop", node->line, node->col);
+        return;
+    }
+    emit(Op::JMP, Operand::lbl(loops.back().next));
 }
 
-void WatGen::gen_macro_call(const ASTNodePtr &node) {
+void FunctionGen::gen_macro_call(const ASTNodePtr &node) {
     const auto macro = std::static_pointer_cast<MacroCallNode>(node);
 
     if (macro->name == "syscall") {
@@ -542,51 +1466,109 @@ void WatGen::gen_macro_call(const ASTNodePtr &node) {
         }
 
         
-        // 计算其他参数并放入寄存器 (rdi, rsi, rdx, r10, r8, r9)
-        const char** regs = func_call_regs;
-        for (size_t i = 1; i < macro->arguments.size() && i <= 6; i++) {
-            gen(macro->arguments[i]);
-            output << "    mov " << regs[i - 1] << ", rax" << std::endl;
-        }
-        gen(macro->arguments[0]);
+        // 计算其他参数并放入寄存器 (rdi, rsi, rdx, r10, r8, r9)，系统调用号放进 rax；
+        // 字符串只传指针
+        std::vector<Arg> args{{&macro->arguments[0], Reg::RAX, Reg::NONE}};
+        for (size_t i = 1; i < macro->arguments.size() && i <= std::size(syscall_regs); i++)
+            args.push_back({&macro->arguments[i], reg_from_name(syscall_regs[i - 1]), Reg::NONE});
+        gen_args(args);
         
-        // 执行 syscall
-        output << "    " + macro->name << std::endl;
+        // 执行 syscall，结果在 rax
+        emit(Op::SYSCALL);
         
-        // vmcall 不会返回，标记函数已有返回
-        has_return = true;
-    } else if (macro->name == "strlen") {
-        if (macro->arguments.size() == 1) {
-            switch (macro->arguments[0]->type) {
-            case NodeType::STRING: {
-                output << "    mov rax, " << std::static_pointer_cast<StringNode>(macro->arguments[0])->value.length() << std::endl;
-                break;
-            }
-            case NodeType::IDENTIFIER: {
-                output << "    mov rax, " << var_str_lens[std::static_pointer_cast<IdentifierNode>(macro->arguments[0])->name] << std::endl;
-                break;
-            }
-            default: THROW_ERROR("strlen!() should a strLiteral or strVar", macro->line, macro->col); break;
+        // exit / exit_group 不会返回，标记函数已有返回
+        if (macro->arguments[0]->type == NodeType::NUMBER) {
+            const auto nr = std::static_pointer_cast<NumberNode>(macro->arguments[0])->value;
+            if (nr == 60 || nr == 231) has_return = true;
+        }
+    } else if (macro->name == "load") {
+        // load!(addr)：读出 addr 处的 8 字节
+        if (macro->arguments.size() != 1) {
+            THROW_ERROR("load!() expects (address)", macro->line, macro->col);
+            return;
+        }
+        gen(macro->arguments[0]);
+        emit(Op::MOV, Operand::r(Reg::RAX), Operand::mem(Reg::RAX, 0));
+    } else if (macro->name == "store") {
+        // store!(addr, value)：把 value 写进 addr 处的 8 字节
+        if (macro->arguments.size() != 2) {
+            THROW_ERROR("store!() expects (address, value)", macro->line, macro->col);
+            return;
+        }
+        gen(macro->arguments[0]);
+        push_temp(Reg::RAX);
+        gen(macro->arguments[1]);
+        pop_temp(Reg::RCX);
+        emit(Op::MOV, Operand::mem(Reg::RCX, 0), Operand::r(Reg::RAX));
+    } else if (macro->name == "bounds") {
+        // bounds!(i, n)：i 在 [0, n) 内时得到 i，否则执行 ud2 终止程序；无符号比较一次检查两端
+        if (macro->arguments.size() != 2) {
+            THROW_ERROR("bounds!() expects (index, length)", macro->line, macro->col);
+            return;
+        }
+        gen(macro->arguments[0]);
+        push_temp(Reg::RAX);
+        gen(macro->arguments[1]);
+        pop_temp(Reg::RCX);
+        const int ok = new_label("bounds_ok");
+        emit(Op::CMP, Operand::r(Reg::RCX), Operand::r(Reg::RAX));
+        emit_cc(Op::JCC, Cond::B, Operand::lbl(ok));
+        emit(Op::UD2);
+        emit(Op::LABEL, Operand::lbl(ok));
+        emit(Op::MOV, Operand::r(Reg::RAX), Operand::r(Reg::RCX));
+    } else if (macro->name == "stack_alloc") {
+        // stack_alloc!(n)：逃逸分析把 malloc(n) 改成在栈帧里预留 n 字节，见 escape.h
+        if (macro->arguments.size() != 1 || macro->arguments[0]->type != NodeType::NUMBER) {
+            THROW_ERROR("stack_alloc!() expects a constant size", macro->line, macro->col);
+            return;
+        }
+        const auto size = static_cast<size_t>(std::static_pointer_cast<NumberNode>(macro->arguments[0])->value);
+        stack_offset += size;
+        var_size += size;
+        emit(Op::LEA, Operand::r(Reg::RAX), local(stack_offset));
+    } else if (macro->name == "rodata") {
+        // rodata!(c0, c1, ...)：范围 for 遍历的常量数组，每项 8 字节放进 .rodata，得到表的地址
+        std::string bytes;
+        for (const auto& a : macro->arguments) {
+            if (a->type != NodeType::NUMBER) {
+                THROW_ERROR("rodata!() expects integer constants", a->line, a->col);
+                return;
             }
-        } else THROW_ERROR("strlen!() should a strLiteral or strVar", macro->line, macro->col);
+            const auto v = static_cast<uint64_t>(std::static_pointer_cast<NumberNode>(a)->value);
+            for (int b = 0; b < 8; b++) bytes.push_back(static_cast<char>(v >> (b * 8) & 0xff));
+        }
+        comment("table: " + std::to_string(macro->arguments.size()) + " entries");
+        emit(Op::LEA, Operand::r(Reg::RAX), Operand::str(gen_string_data(bytes, true)));
+    } else if (macro->name == "strlen") {
+        // 字面量直接得到长度，其他 str 取 fat pointer 的长度字段，不扫描字符串
+        if (macro->arguments.size() != 1 || !is_str(macro->arguments[0])) {
+            THROW_ERROR("strlen!() expects a str", macro->line, macro->col);
+        } else if (macro->arguments[0]->type == NodeType::STRING) {
+            emit(Op::MOV, Operand::r(Reg::RAX), Operand::i(static_cast<int64_t>(
+                std::static_pointer_cast<StringNode>(macro->arguments[0])->value.length())));
+        } else if (macro->arguments[0]->type == NodeType::IDENTIFIER) {
+            emit(Op::MOV, Operand::r(Reg::RAX),
+                 len_operand(std::static_pointer_cast<IdentifierNode>(macro->arguments[0])->name));
+        } else {
+            gen_value(macro->arguments[0], true);
+            emit(Op::MOV, Operand::r(Reg::RAX), Operand::r(Reg::RDX));
+        }
     }
 }
 
-void WatGen::gen_macro_decl(const ASTNodePtr& node) {
+void FunctionGen::gen_macro_decl(const ASTNodePtr& node) {
     bool gen_ = true;
     const auto macro = std::static_pointer_cast<MacroDeclNode>(node);
     for (const auto& [name, v] : macro->equations) {
         if (name == "target") {
             if (std::static_pointer_cast<StringNode>(v)->value != P_TARGET) gen_ = false;
         }
-        if (name == "extern") extern_flag = true;
     }
     if (gen_) gen(macro->declaration);
-    extern_flag = false;
 }
 
 
-void WatGen::gen_struct_decl(const ASTNodePtr& node) {
+void FunctionGen::gen_struct_decl(const ASTNodePtr& node) {
     const auto decl = std::static_pointer_cast<StructDeclNode>(node);
     //x64 asm
 
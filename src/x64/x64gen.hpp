@@ -5,23 +5,39 @@
 #ifndef POLO_COMPILER_PRE_WATGEN_HPP
 #define POLO_COMPILER_PRE_WATGEN_HPP
 #include "../ast.h"
+#include "asm.h"
+#include "frame.h"
+#include "../pgo/profile.h"
+#include "../cache/codegen_cache.h"
+#include <deque>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 
-class WatGen {
+class WatGen;
+
+// 单个函数的代码生成上下文。标签、字符串常量和 profile 计数器都用函数内的局部编号，
+// 由 WatGen 按源码顺序合并时统一重排，因此可以并行生成且结果与串行完全一致
+class FunctionGen {
 public:
-    bool extern_flag{false};
-    std::vector<std::string> using_namespace;
-    explicit WatGen()  {
-        using_namespace.emplace_back("");
-    }
-    ~WatGen() = default;
+    explicit FunctionGen(WatGen& module) : module(module) {}
 
     void gen(const ASTNodePtr& node);
-    std::string get_output() const;
-    
+    void gen_profile_dump(int64_t data_size, const std::string& path);
+    // 虚表：每项一条跳到方法的 jmp，占 8 字节
+    void gen_vtable(const std::string& name, const std::vector<std::string>& methods);
+    // 增量编译缓存：保存 / 恢复生成结果，字符串存内容而不是池编号
+    [[nodiscard]] CachedFunction snapshot() const;
+    void restore(CachedFunction cached);
+
+    MachineFunction fn;
+    std::vector<int> strings;               // 局部字符串编号 -> 字符串池编号
+    std::vector<std::string> prof_names;    // 局部计数器编号 -> 名字
+
 #define decl_gen_tool(name) void gen_##name(const ASTNodePtr& node);
     decl_gen_tool(function);
     decl_gen_tool(var);
@@ -31,7 +47,6 @@ public:
 
     void gen_struct_decl(const ASTNodePtr &node);;
     decl_gen_tool(float);
-    decl_gen_tool(program);
     decl_gen_tool(string);
     decl_gen_tool(assignment);
     decl_gen_tool(boolean);
@@ -47,22 +62,144 @@ public:
 #undef decl_gen_tool
 
 private:
-    size_t str_len;
-    std::string var_operation{"mov"};
-    std::ostringstream output;
-    std::ostringstream data_output;
+    WatGen& module;
+    Op var_operation{Op::MOV};
+    // str 的值是 fat pointer：指针在 rax，长度在 rdx。只用到指针时（传给 C 函数、syscall）
+    // 为 false，不加载长度
+    bool want_len{true};
+    MachineFunction* cur{nullptr};     // 正在生成的函数
+    // str 变量占 16 字节：指针在 var_offsets 处，长度紧跟其后（偏移小 8）
     std::unordered_map<std::string, size_t> var_offsets;
-    std::unordered_map<std::string, size_t> var_str_lens;
-    std::unordered_map<std::string, int> string_labels;
+    std::unordered_set<std::string> str_vars;
+    std::unordered_map<int, int> string_ids;    // 字符串池编号 -> 局部编号
+    std::unordered_set<std::string> addressed;  // 函数里被取了地址的变量
+    // 循环期间放在寄存器里的变量，内层循环的在后面；written 的在循环结束后写回栈槽
+    struct RegVar {
+        std::string name;
+        Reg reg;
+        bool written;
+    };
+    std::vector<RegVar> reg_vars;
+    // 外层到内层的循环：break 跳到 end，continue 跳到 next（增量前）
+    struct LoopLabels {
+        int end, next;
+    };
+    std::vector<LoopLabels> loops;
     size_t stack_offset = 0;
     bool has_return = false;
-    int label_counter = 0;
-    int string_counter = 0;
     
+    FrameInfo frame;
+    size_t temp_top = 0;    // 当前红区临时槽深度
+
     size_t get_var_offset(const std::string& name);
-    int new_label();
-    int gen_string_data(const std::string& str);
+    Operand var_operand(const std::string& name);
+    size_t promote_loop(const std::shared_ptr<ForStmtNode>& loop);
+    void release_loop(size_t count);
+    bool gen_loop_test(const ASTNodePtr& cond, Cond& cc);
+    // if v == a [or v == b ...] { } else if v == c { } ... 的链（match 展开的就是这种形式）
+    // 按取值分派：位测试、跳转表或二分比较，返回 false 时按普通 if 生成
+    struct SwitchCase {
+        int64_t value;
+        int label;      // 分支的标签
+    };
+    static constexpr int64_t MAX_JUMP_TABLE = 1024;     // 跳转表最多的项数
+    bool gen_switch(const std::shared_ptr<IfStmtNode>& node);
+    void gen_switch_range(const std::vector<SwitchCase>& cases, size_t begin, size_t end, int otherwise);
+    Operand len_operand(const std::string& name);
+    [[nodiscard]] bool is_str(const ASTNodePtr& node) const;
+    void gen_value(const ASTNodePtr& node, bool with_len);
+    void load_simple(const ASTNodePtr& node, Reg ptr, Reg len);
+    // 一个参数的表达式和要放进的寄存器，不传长度时 len 为 NONE；
+    // stack >= 0 时参数在栈上的参数区里，fat 表示同时传长度
+    struct Arg {
+        const ASTNodePtr* node;
+        Reg ptr, len;
+        int64_t stack{-1};
+        bool fat{false};
+    };
+    void gen_args(const std::vector<Arg>& args);
+    void call(const std::string& name);
+    void call(const Operand& target);
+    void emit(Op op, Operand a = {}, Operand b = {});
+    void emit_cc(Op op, Cond cc, Operand a);
+    void comment(std::string text);
+    Operand local(size_t offset) const;
+    void push_temp(Reg reg);
+    void pop_temp(Reg reg);
+    void gen_epilogue();
+    int new_label(const char* prefix);
+    int gen_string_data(const std::string& str, bool table = false);
     size_t var_size{0};
+
+    size_t if_index{0}, for_index{0};       // 函数内 if / for 的序号，用于给计数器命名
+    void prof_count(const std::string& name);
+    [[nodiscard]] uint64_t prof_get(const std::string& name) const;
+};
+
+// 各函数共享的字符串常量池，可以多线程同时访问
+class StringPool {
+public:
+    // table 为 true 时是 rodata! 的常量表，输出时按 8 字节对齐
+    int intern(const std::string& str, bool table = false);
+    std::string get(int id) const;
+    bool is_table(int id) const;
+private:
+    mutable std::mutex m;
+    std::unordered_map<std::string, int> ids;
+    std::deque<std::string> strings;
+    std::unordered_set<int> tables;
+};
+
+class WatGen {
+public:
+    bool extern_flag{false};
+    std::vector<std::string> using_namespace;
+    // -fprofile-generate：插桩计数，程序退出时写到 profile_path
+    bool profile_generate{false};
+    std::string profile_path;
+    // -fprofile-use：按计数决定分支布局、循环形态和函数顺序
+    const ProfileData* profile{nullptr};
+    // 并行生成函数的线程数，0 表示使用全部硬件线程
+    size_t jobs{0};
+    // 设置后按输出顺序把每个函数交给 sink 并立即释放，module 中不再保留函数体；
+    // 同一时刻只有一个窗口的函数在内存里
+    ModuleSink* sink{nullptr};
+    // 设置后内容没变的函数直接复用上次的生成结果
+    CodegenCache* cache{nullptr};
+    explicit WatGen()  {
+        using_namespace.emplace_back("");
+    }
+    ~WatGen() = default;
+
+    void gen(const ASTNodePtr& node);
+    [[nodiscard]] const AsmModule& get_module() const { return module; }
+
+private:
+    friend class FunctionGen;
+    AsmModule module;
+    StringPool strings;
+    std::unordered_set<std::string> static_vars;    // .data 中的 static let
+    // 参与生成的函数的声明；extern 函数按 C 约定调用，str 只传指针
+    std::unordered_map<std::string, std::shared_ptr<FunctionNode>> signatures;
+    std::unordered_set<std::string> c_functions;
+    // 需要虚表的 impl（见 traits.h），虚表在所有函数之后生成
+    std::vector<std::shared_ptr<ImplDeclNode>> vtable_impls;
+    std::unordered_set<std::string> vtables;
+    std::unordered_map<int, int> string_ids;        // 字符串池编号 -> .L_str_<id>
+    std::vector<std::string> prof_names;            // 计数器 k 的名字
+    int label_counter = 0;
+
+    void gen_program(const ASTNodePtr& node);
+    void gen_cached(FunctionGen& gen, const std::shared_ptr<FunctionNode>& fn, const CacheContext& ctx);
+    [[nodiscard]] CacheContext cache_context(std::unordered_map<std::string, CacheKey>& counts) const;
+    [[nodiscard]] std::shared_ptr<FunctionNode> signature(const std::string& name) const;
+    void collect(const ASTNodePtr& node, std::vector<std::shared_ptr<FunctionNode>>& functions);
+    void gen_static(const std::shared_ptr<VariableDeclNode>& var);
+    void merge(FunctionGen& gen);
+    void emit_function(FunctionGen& gen);
+    int module_string(int pool_id);
+    [[nodiscard]] uint64_t prof_get(const std::string& name) const;
+    void order_by_profile(std::vector<std::shared_ptr<FunctionNode>>& functions);
 };
 
 
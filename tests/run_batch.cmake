@@ -0,0 +1,51 @@
+# 一次命令行编译多个文件（compile_batch）：每个文件的结果必须和单独编译的相同，
+# 其中一个文件出错时命令失败、报出该文件的错误，其余文件照常生成
+#   cmake -DPOLOC=<poloc> -DSTD=<polo-std> -DPROGRAMS=<tests/programs> -DWORK=<目录> -P run_batch.cmake
+
+function(check result what)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${what} failed (${result})")
+    endif()
+endfunction()
+
+# 输出写在源文件旁边，所以在副本里做；modules 和 interfaces 导入同一批模块，vec 导入标准库
+set(names modules interfaces vec match)
+file(REMOVE_RECURSE ${WORK})
+file(COPY ${PROGRAMS}/ DESTINATION ${WORK})
+file(WRITE ${WORK}/broken.polo "fn main() -> i32 {\n    let x: i64 = \"no\";\n    return 0 as i32;\n}\n")
+
+set(inputs "")
+foreach(name ${names})
+    execute_process(COMMAND ${POLOC} -I ${STD} -o ${name}.single.o ${name}.polo
+                    WORKING_DIRECTORY ${WORK} RESULT_VARIABLE result)
+    check("${result}" "poloc ${name}.polo")
+    list(APPEND inputs ${name}.polo)
+endforeach()
+
+function(compare_outputs what)
+    foreach(name ${names})
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/${name}.o ${WORK}/${name}.single.o
+                        RESULT_VARIABLE result)
+        check("${result}" "comparing ${name}.o from ${what} with a separate compile")
+        file(REMOVE ${WORK}/${name}.o)
+    endforeach()
+endfunction()
+
+execute_process(COMMAND ${POLOC} -I ${STD} -j 4 ${inputs} WORKING_DIRECTORY ${WORK} RESULT_VARIABLE result)
+check("${result}" "poloc -j 4 ${inputs}")
+compare_outputs("the batch")
+
+# 出错的文件放在第二个，和其余的文件一起在线程池里编译；第一个文件先单独编译
+list(INSERT inputs 1 broken.polo)
+execute_process(COMMAND ${POLOC} -I ${STD} -j 4 ${inputs} WORKING_DIRECTORY ${WORK}
+                RESULT_VARIABLE result ERROR_VARIABLE errors)
+if(result EQUAL 0)
+    message(FATAL_ERROR "poloc -j 4 ${inputs} succeeded although broken.polo does not compile")
+endif()
+if(NOT errors MATCHES "broken\\.polo:2:")
+    message(FATAL_ERROR "the batch did not report the error in broken.polo: ${errors}")
+endif()
+if(EXISTS ${WORK}/broken.o)
+    message(FATAL_ERROR "the batch wrote broken.o")
+endif()
+compare_outputs("the batch with a failing input")
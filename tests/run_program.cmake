@@ -0,0 +1,207 @@
+# 编译并运行一个回归程序，main 返回 0 表示全部检查通过
+#   cmake -DPOLOC=<poloc> -DCC=<cc> -DSTD=<polo-std> -DPROGRAM=<x.polo> -DMODE=<mode> -DWORK=<前缀> -P run_program.cmake
+# MODE：
+#   run          poloc --run（JIT）
+#   obj          生成目标文件，用 cc 链接后运行
+#   asm          生成汇编，用 cc 汇编链接后运行
+#   pgo          插桩运行一次得到 profile，再用 -fprofile-use 编译运行
+#   incremental  用同一个 -fincremental 缓存编译两次，第二次的结果必须和不用缓存时相同，再运行
+#   parallel     分别用 -j1 和 -j8 生成汇编，两份必须相同，再运行
+#   stream       汇编分别写到文件和标准输出（-o -），两份必须相同，再运行
+#   interfaces   在程序目录的副本里生成导入模块的 .pmi，从 .pmi 编译的结果必须和从源码编译的相同，再运行
+#   server       后台启动 poloc --server，经 POLO_SERVER 编译两次（第二次用上服务器内存里的模块接口），
+#                两次的结果都必须和直接编译的相同，再运行
+#   time-report  加 -ftime-report 编译，报告里要有各阶段和最慢的函数，输出必须和不加时相同，再运行
+#   time-trace   加 -ftime-trace 编译，写出的必须是含各阶段事件的 JSON，输出必须和不加时相同，再运行
+#   mem-report   加 -fmem-report 编译，报告里要有各阶段的内存和按类别的统计，输出必须和不加时相同，再运行
+# -DEXPECT=trap 时程序必须被信号终止（例如 bounds! 越界执行的 ud2），而不是返回
+
+function(check result what)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${what} failed (${result})")
+    endif()
+endfunction()
+
+# 被信号终止时 result 是描述信号的字符串而不是退出码
+function(check_run result what)
+    if(NOT EXPECT STREQUAL "trap")
+        check("${result}" "${what}")
+    elseif(result MATCHES "^[0-9]+$")
+        message(FATAL_ERROR "${what} was expected to trap but exited with ${result}")
+    endif()
+endfunction()
+
+function(compile)
+    execute_process(COMMAND ${POLOC} -I ${STD} ${ARGN} ${PROGRAM} RESULT_VARIABLE result)
+    check("${result}" "poloc ${ARGN}")
+endfunction()
+
+# 加上报告选项编译，报告（标准错误）放进 var，输出必须和不加选项时相同
+function(compile_with_report var)
+    execute_process(COMMAND ${POLOC} -I ${STD} ${ARGN} -o ${WORK}.o ${PROGRAM}
+                    RESULT_VARIABLE result ERROR_VARIABLE report)
+    check("${result}" "poloc ${ARGN}")
+    compile(-o ${WORK}.fresh.o)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.o ${WORK}.fresh.o RESULT_VARIABLE result)
+    check("${result}" "comparing output with and without ${ARGN}")
+    set(${var} "${report}" PARENT_SCOPE)
+endfunction()
+
+function(expect_lines text what)
+    foreach(line ${ARGN})
+        if(NOT text MATCHES "${line}")
+            message(FATAL_ERROR "${what} has no line matching '${line}':\n${text}")
+        endif()
+    endforeach()
+endfunction()
+
+function(link_and_run input)
+    execute_process(COMMAND ${CC} ${input} -o ${WORK} RESULT_VARIABLE result)
+    check("${result}" "linking ${input}")
+    execute_process(COMMAND ${WORK} RESULT_VARIABLE result)
+    check_run("${result}" "${PROGRAM}")
+endfunction()
+
+get_filename_component(dir ${WORK} DIRECTORY)
+file(MAKE_DIRECTORY ${dir})
+
+if(MODE STREQUAL "run")
+    execute_process(COMMAND ${POLOC} -I ${STD} --run ${PROGRAM} RESULT_VARIABLE result)
+    check_run("${result}" "poloc --run")
+elseif(MODE STREQUAL "obj")
+    compile(-o ${WORK}.o)
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "asm")
+    compile(-S -o ${WORK}.s)
+    link_and_run(${WORK}.s)
+elseif(MODE STREQUAL "pgo")
+    file(REMOVE ${WORK}.poloprof)
+    compile(-fprofile-generate=${WORK}.poloprof -o ${WORK}.o)
+    link_and_run(${WORK}.o)
+    if(NOT EXISTS ${WORK}.poloprof)
+        message(FATAL_ERROR "the instrumented program did not write ${WORK}.poloprof")
+    endif()
+    compile(-fprofile-use=${WORK}.poloprof -o ${WORK}.o)
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "incremental")
+    file(REMOVE ${WORK}.polocache)
+    compile(-fincremental=${WORK}.polocache -o ${WORK}.o)
+    compile(-fincremental=${WORK}.polocache -o ${WORK}.o)
+    compile(-o ${WORK}.fresh.o)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.o ${WORK}.fresh.o RESULT_VARIABLE result)
+    check("${result}" "comparing cached and fresh output")
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "parallel")
+    compile(-j1 -S -o ${WORK}.1.s)
+    compile(-j8 -S -o ${WORK}.s)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.1.s ${WORK}.s RESULT_VARIABLE result)
+    check("${result}" "comparing -j1 and -j8 output")
+    link_and_run(${WORK}.s)
+elseif(MODE STREQUAL "stream")
+    compile(-S -o ${WORK}.s)
+    execute_process(COMMAND ${POLOC} -I ${STD} -S -o - ${PROGRAM} OUTPUT_FILE ${WORK}.stdout.s RESULT_VARIABLE result)
+    check("${result}" "poloc -S -o -")
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.s ${WORK}.stdout.s RESULT_VARIABLE result)
+    check("${result}" "comparing file and stdout output")
+    link_and_run(${WORK}.s)
+elseif(MODE STREQUAL "interfaces")
+    # .pmi 写在模块源文件旁边，所以在副本里做
+    get_filename_component(source_dir ${PROGRAM} DIRECTORY)
+    get_filename_component(program_name ${PROGRAM} NAME)
+    file(REMOVE_RECURSE ${WORK}.src)
+    file(COPY ${source_dir}/ DESTINATION ${WORK}.src)
+    set(PROGRAM ${WORK}.src/${program_name})
+    compile(-o ${WORK}.fresh.o)
+    compile(-femit-interfaces -fsyntax-only)
+    file(GLOB_RECURSE interfaces ${WORK}.src/*.pmi)
+    if(NOT interfaces)
+        message(FATAL_ERROR "-femit-interfaces wrote no .pmi files")
+    endif()
+    compile(-o ${WORK}.o)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.o ${WORK}.fresh.o RESULT_VARIABLE result)
+    check("${result}" "comparing output built from .pmi and from source")
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "server")
+    set(socket ${WORK}.sock)
+    file(REMOVE ${socket})
+    # 服务器的输出重定向到文件，sh 退出后 execute_process 才不会等它
+    execute_process(COMMAND sh -c "\"$0\" --server \"$1\" -j 2 >\"$1.log\" 2>&1 & echo $!" ${POLOC} ${socket}
+                    OUTPUT_VARIABLE pid OUTPUT_STRIP_TRAILING_WHITESPACE)
+    # 套接字在 bind 之后、改成 0600 并 listen 之前就出现了，等到权限改好
+    set(mode "")
+    foreach(i RANGE 100)
+        if(EXISTS ${socket})
+            execute_process(COMMAND stat -c %a ${socket} OUTPUT_VARIABLE mode OUTPUT_STRIP_TRAILING_WHITESPACE)
+            if(mode STREQUAL "600")
+                break()
+            endif()
+        endif()
+        execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.05)
+    endforeach()
+    # 第二个服务器连得上已有的就报错退出，说明客户端不会因为连不上而退回到自己编译
+    execute_process(COMMAND ${POLOC} --server ${socket} TIMEOUT 5 RESULT_VARIABLE probe ERROR_VARIABLE probe_error)
+    set(client ${CMAKE_COMMAND} -E env POLO_SERVER=${socket} ${POLOC} -I ${STD})
+    execute_process(COMMAND ${client} -o ${WORK}.o ${PROGRAM} RESULT_VARIABLE first)
+    execute_process(COMMAND ${client} -o ${WORK}.2.o ${PROGRAM} RESULT_VARIABLE second)
+    execute_process(COMMAND kill ${pid})
+    file(READ ${socket}.log server_log)
+    if(NOT mode STREQUAL "600")
+        message(FATAL_ERROR "the server socket has mode '${mode}', expected 600")
+    endif()
+    if(NOT probe_error MATCHES "already listening")
+        message(FATAL_ERROR "the server was not accepting connections: ${probe_error}")
+    endif()
+    if(NOT server_log STREQUAL "")
+        message(FATAL_ERROR "the server printed: ${server_log}")
+    endif()
+    check("${first}" "poloc through the server")
+    check("${second}" "poloc through the server with cached interfaces")
+    compile(-o ${WORK}.fresh.o)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.o ${WORK}.fresh.o RESULT_VARIABLE result)
+    check("${result}" "comparing server and direct output")
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}.2.o ${WORK}.fresh.o RESULT_VARIABLE result)
+    check("${result}" "comparing the second server output and direct output")
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "time-report")
+    compile_with_report(report -ftime-report)
+    expect_lines("${report}" "-ftime-report" "Time report: " "[0-9.]+ +100\\.0 +1  Total"
+                 "  Load modules" "  Type check" "  Codegen" "slowest functions")
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "time-trace")
+    file(REMOVE ${WORK}.trace.json)
+    compile_with_report(report -ftime-trace=${WORK}.trace.json)
+    file(READ ${WORK}.trace.json trace)
+    # string(JSON) 需要 CMake 3.19，更早的版本只检查开头
+    if(CMAKE_VERSION VERSION_LESS 3.19)
+        expect_lines("${trace}" "-ftime-trace output" "^{\"traceEvents\":\\[")
+    else()
+        string(JSON count ERROR_VARIABLE error LENGTH "${trace}" traceEvents)
+        if(error)
+            message(FATAL_ERROR "-ftime-trace wrote invalid JSON: ${error}")
+        endif()
+        set(names "")
+        math(EXPR last "${count} - 1")
+        foreach(i RANGE ${last})
+            string(JSON name GET "${trace}" traceEvents ${i} name)
+            string(JSON phase GET "${trace}" traceEvents ${i} ph)
+            if(NOT phase STREQUAL "X")
+                message(FATAL_ERROR "-ftime-trace event ${name} is not a complete event (ph ${phase})")
+            endif()
+            list(APPEND names "${name}")
+        endforeach()
+        foreach(pass "Lex+Parse" "Type check" "Inline" "Codegen" "Write output")
+            list(FIND names "${pass}" found)
+            if(found EQUAL -1)
+                message(FATAL_ERROR "-ftime-trace has no ${pass} event")
+            endif()
+        endforeach()
+    endif()
+    link_and_run(${WORK}.o)
+elseif(MODE STREQUAL "mem-report")
+    compile_with_report(report -fmem-report)
+    expect_lines("${report}" "-fmem-report" "Memory report: " "  Load modules +[0-9.]+ KiB" "  Codegen +[0-9.]+ KiB"
+                 "peak resident: [0-9.]+ KiB" "  AST Function +[1-9]" "  total counted +[0-9.]+ KiB")
+    link_and_run(${WORK}.o)
+else()
+    message(FATAL_ERROR "unknown mode ${MODE}")
+endif()